@@ -60,12 +60,12 @@ static int _machine_base_address_index(uint16_t machine_number, int mode)
 {
 	int machine_config_base_address;
 
-    if(machine_number < 0 || machine_number > 63) {
+    if(machine_number >= NUM_MACHINES) {
 	printf("Failed: machine number is out of range\n");
 	return -1;
     }
 
-    machine_config_base_address = machine_number << 5;
+    machine_config_base_address = machine_number * MACHINE_SLOT_SIZE;
     //if (mode == DIRECTED)
 //	machine_config_base_address += 0x1000;
 
@@ -83,7 +83,7 @@ int enable_machine(ocxl_afu_h afu, MachineConfig *machine, MachineConfigParam pa
 	machine_number = param.machine_number;
 	int machine_config_base_address = _machine_base_address_index(machine_number, mode);
 
-	machine_config_base_address += context * 0x1000; //debug1
+	machine_config_base_address += context * TESTAFU_CONTEXT_MMIO; //debug1
 	printf("machine config base address = 0x%x\n", machine_config_base_address);
 	for (i = 3; i >= 0; --i){
 		uint64_t data = machine->config[i];
@@ -109,7 +109,7 @@ int clear_machine_config(ocxl_afu_h afu, MachineConfig *machine, MachineConfigPa
     context = param.context;
     machine_number = param.machine_number;
     machine_config_base_address = _machine_base_address_index(machine_number, mode);
-    machine_config_base_address += context * 0x1000;
+    machine_config_base_address += context * TESTAFU_CONTEXT_MMIO;
 
     if(ocxl_mmio_write64(afu, machine_config_base_address, OCXL_MMIO_LITTLE_ENDIAN, 0x0)) {
 	printf("Failed to clear machine config\n");
@@ -390,3 +390,83 @@ void get_machine_memory_base_address(MachineConfig *machine, uint64_t* addr) {
 void get_machine_memory_size(MachineConfig *machine, uint64_t* size) {
 	*size = machine->config[3];
 }
+
+/////////////////////////////////
+// Traffic generator functions //
+/////////////////////////////////
+
+// Function to write traffic config to AFU MMIO space without starting it
+int config_traffic(ocxl_mmio_h mmio, TrafficConfigParam param)
+{
+	uint64_t config[6];
+	int i, traffic_base_address;
+
+	traffic_base_address = param.context * TESTAFU_CONTEXT_MMIO + TRAFFIC_OFFSET;
+	config[1] = param.op | (param.pattern << 8) | ((uint64_t)param.depth << 16);
+	config[2] = param.count;
+	config[3] = param.base;
+	config[4] = param.range;
+	config[5] = param.stride;
+	for (i = 1; i < 6; i++) {
+		if (ocxl_mmio_write64(mmio, traffic_base_address + i * 8,
+		    OCXL_MMIO_LITTLE_ENDIAN, config[i])) {
+			printf("Failed to write traffic config[%d]\n", i);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// Function to write traffic config to AFU MMIO space and start the run
+int start_traffic(ocxl_mmio_h mmio, TrafficConfigParam param)
+{
+	if (config_traffic(mmio, param) < 0)
+		return -1;
+	return start_traffic_from_file(mmio, param.context, 0);
+}
+
+// Function to start a run with the config the AFU loaded from AFU_TRAFFIC_CFG
+int start_traffic_from_file(ocxl_mmio_h mmio, uint16_t context, uint64_t base)
+{
+	int traffic_base_address = context * TESTAFU_CONTEXT_MMIO + TRAFFIC_OFFSET;
+
+	if (base && ocxl_mmio_write64(mmio, traffic_base_address + 3 * 8,
+	    OCXL_MMIO_LITTLE_ENDIAN, base)) {
+		printf("Failed to write traffic base\n");
+		return -1;
+	}
+	if (ocxl_mmio_write64(mmio, traffic_base_address, OCXL_MMIO_LITTLE_ENDIAN,
+	    TRAFFIC_START)) {
+		printf("Failed to start traffic\n");
+		return -1;
+	}
+	return 0;
+}
+
+// Wait for the traffic generator to finish and read its counters
+int wait_traffic(ocxl_mmio_h mmio, uint16_t context, TrafficStats *stats)
+{
+	uint64_t status, *counter;
+	int i, traffic_base_address;
+
+	traffic_base_address = context * TESTAFU_CONTEXT_MMIO + TRAFFIC_OFFSET;
+	do {
+		if (ocxl_mmio_read64(mmio, traffic_base_address, OCXL_MMIO_LITTLE_ENDIAN,
+		    &status)) {
+			printf("Failed to read traffic status\n");
+			return -1;
+		}
+		if (!(status & TRAFFIC_DONE))
+			usleep(10000);
+	} while (!(status & TRAFFIC_DONE));
+
+	counter = (uint64_t *)stats;
+	for (i = 0; i < 7; i++) {
+		if (ocxl_mmio_read64(mmio, traffic_base_address + (8 + i) * 8,
+		    OCXL_MMIO_LITTLE_ENDIAN, &counter[i])) {
+			printf("Failed to read traffic counter %d\n", i);
+			return -1;
+		}
+	}
+	return 0;
+}
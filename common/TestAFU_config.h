@@ -23,6 +23,7 @@
 #pragma once
 #include <inttypes.h>
 #include "../libocxl/libocxl.h"
+#include "TestAFU_mmio.h"
 
 #define DEDICATED 1
 #define DIRECTED 0
@@ -187,3 +188,41 @@ void get_machine_memory_base_address(MachineConfig *machine, uint64_t* addr);
 // Size of the memory space the AFU machine operate in
 void get_machine_memory_size(MachineConfig *machine, uint64_t* size);
 
+
+// Traffic generator parameters, an intrp base is the interrupt handle
+typedef struct TrafficParam
+{
+    uint16_t	context;
+    uint8_t	op;
+    uint8_t	pattern;
+    uint16_t	depth;			// outstanding commands
+    uint64_t	count;			// commands to send
+    uint64_t	base;
+    uint64_t	range;			// addresses stay in [base, base + range)
+    uint64_t	stride;
+} TrafficConfigParam;
+
+// Traffic generator counters, latencies are in AFU cycles
+typedef struct TrafficCounters
+{
+    uint64_t	completed;
+    uint64_t	bytes;
+    uint64_t	failed;
+    uint64_t	cycles;
+    uint64_t	latency_min;
+    uint64_t	latency_max;
+    uint64_t	latency_total;
+} TrafficStats;
+
+// Function to write traffic config to AFU MMIO space without starting it
+int config_traffic(ocxl_mmio_h mmio, TrafficConfigParam param);
+
+// Function to write traffic config to AFU MMIO space and start the run
+int start_traffic(ocxl_mmio_h mmio, TrafficConfigParam param);
+
+// Function to start a run with the config the AFU loaded from AFU_TRAFFIC_CFG,
+// base overrides the config file unless it is 0
+int start_traffic_from_file(ocxl_mmio_h mmio, uint16_t context, uint64_t base);
+
+// Wait for the traffic generator to finish and read its counters
+int wait_traffic(ocxl_mmio_h mmio, uint16_t context, TrafficStats *stats);
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2015,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Description: TestAFU_mmio.h
+ *
+ *  Global MMIO registers of the Test AFU, shared by the AFU in test/afu and
+ *  the host side helpers in TestAFU_config.c so the two can't drift apart.
+ */
+
+#ifndef _TESTAFU_MMIO_H_
+#define _TESTAFU_MMIO_H_
+
+// Every context has a page of the global MMIO space, the AFU backs only the
+// first TESTAFU_CONTEXTS of them
+#define TESTAFU_CONTEXTS	4
+#define TESTAFU_CONTEXT_MMIO	0x1000
+
+// Machine config registers, four double words per machine from the start of
+// a context's page.  The slots end at TRAFFIC_OFFSET, which caps the number
+// of machines of a context.
+#define MACHINE_SLOT_SIZE	0x20
+#define NUM_MACHINES		64
+
+// Traffic generator registers, at TRAFFIC_OFFSET in each context's 0x1000
+// byte page of the global MMIO space, one double word each
+#define TRAFFIC_OFFSET		0x800
+#define TRAFFIC_CONFIG_WORDS	6
+#define TRAFFIC_STATS_WORD	8
+#define TRAFFIC_STATS_WORDS	7
+
+// double word 0, control and status
+#define TRAFFIC_START		0x8000000000000000ull
+#define TRAFFIC_BUSY		0x4000000000000000ull
+#define TRAFFIC_DONE		0x2000000000000000ull
+// double word 1, op in bits 0-7, pattern in bits 8-15, depth in bits 16-31
+#define TRAFFIC_READ		0
+#define TRAFFIC_WRITE		1
+#define TRAFFIC_AMO		2
+#define TRAFFIC_INTRP		3
+#define TRAFFIC_SEQUENTIAL	0
+#define TRAFFIC_STRIDED		1
+#define TRAFFIC_RANDOM		2
+// double words 2-5 are count, base, range and stride; double words 8-14
+// are completed, bytes, failed, cycles, min, max and total latency
+
+#endif				/* _TESTAFU_MMIO_H_ */
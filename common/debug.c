@@ -14,10 +14,29 @@
  * limitations under the License.
  */
 
+/*
+ * Description: debug.c
+ *
+ *  Binary debug.log records.  The debug_* calls sit on the socket and command
+ *  paths of every thread, so they only copy the record into a ring buffer of
+ *  the calling thread.  A writer thread started with the first record moves
+ *  the records to their FILE.  Each record takes a number from one global
+ *  counter and the writer emits them strictly in that order, so debug.log
+ *  reads exactly as if every thread had written it directly.  The writer
+ *  also inserts a DBG_HEADER_TIME record whenever the wall time of the
+ *  records has moved on by a microsecond.  debug_flush() waits until
+ *  everything logged so far is written.
+ */
+
 #include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
+#include <time.h>
 
 #include "debug.h"
 #include "tlx_interface_t.h"
@@ -41,135 +60,321 @@ static DBG_HEADER adjust_header(DBG_HEADER header)
 	return header;
 }
 
-static void _debug_send_id(FILE * fp, DBG_HEADER header, uint8_t id)
+#define DEBUG_RECORD_MAX 16		// largest record, see _debug_send_*
+#define DEBUG_RING_SLOTS 2048		// records per thread, a power of 2
+#define DEBUG_TIME_NS 1000		// resolution of DBG_HEADER_TIME
+
+struct debug_slot {
+	uint64_t seq;
+	uint64_t ns;
+	FILE *fp;
+	uint8_t size;
+	uint8_t data[DEBUG_RECORD_MAX];
+};
+
+// Filled by one thread only and drained by the writer only, head and tail
+// count records and each is written by one side only
+struct debug_ring {
+	struct debug_slot slot[DEBUG_RING_SLOTS];
+	uint64_t head;
+	uint64_t tail;
+	int dead;			// thread is gone, free once drained
+	struct debug_ring *_next;
+};
+
+static pthread_once_t _debug_once = PTHREAD_ONCE_INIT;
+static pthread_key_t _debug_key;
+static __thread struct debug_ring *_debug_ring;
+static struct debug_ring *_debug_rings;	// new rings are pushed at the head
+static uint64_t _debug_seq;		// records numbered so far
+static uint64_t _debug_written;		// records written so far
+static FILE *_debug_time_fp;		// writer only, last DBG_HEADER_TIME
+static uint64_t _debug_time_base;
+static uint64_t _debug_time_last;
+
+static void _debug_ring_exit(void *ptr)
 {
-	char *buffer;
-	size_t size;
-	int offset;
+	struct debug_ring *ring = (struct debug_ring *)ptr;
 
-	offset = 0;
-	header = adjust_header(header);
-	size = sizeof(DBG_HEADER) + sizeof(id);
-	if ((buffer = (char *)malloc(size)) != NULL) {
-		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
-		offset += sizeof(DBG_HEADER);
-		buffer[offset] = id;
-		fwrite(buffer, size, 1, fp);
-		free(buffer);
+	__atomic_store_n(&(ring->dead), 1, __ATOMIC_RELEASE);
+}
+
+// Put a DBG_HEADER_TIME record in front of a record logged at least
+// DEBUG_TIME_NS after the last time record in the same file
+static void _debug_time(struct debug_slot *slot)
+{
+	char buffer[sizeof(DBG_HEADER) + sizeof(uint64_t)];
+	DBG_HEADER header;
+	uint64_t ns;
+
+	if (_debug_time_base == 0)
+		_debug_time_base = slot->ns;
+	if ((slot->fp == _debug_time_fp) &&
+	    (slot->ns < _debug_time_last + DEBUG_TIME_NS))
+		return;
+	_debug_time_fp = slot->fp;
+	_debug_time_last = slot->ns;
+	ns = 0;
+	if (slot->ns > _debug_time_base)
+		ns = slot->ns - _debug_time_base;
+	header = adjust_header(DBG_HEADER_TIME);
+	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
+	ns = htonll(ns);
+	memcpy(buffer + sizeof(DBG_HEADER), (char *)&ns, sizeof(ns));
+	fwrite(buffer, sizeof(buffer), 1, slot->fp);
+}
+
+// Write the records of all rings in sequence order, returns how many
+static uint64_t _debug_drain(void)
+{
+	struct debug_ring *ring;
+	struct debug_slot *slot;
+	uint64_t next, head, count;
+	int progress;
+
+	count = 0;
+	next = __atomic_load_n(&_debug_written, __ATOMIC_RELAXED);
+	do {
+		// a record not found in any ring is still being copied,
+		// stop there and look again on the next pass
+		progress = 0;
+		ring = __atomic_load_n(&_debug_rings, __ATOMIC_ACQUIRE);
+		for (; ring != NULL; ring = ring->_next) {
+			head = __atomic_load_n(&(ring->head), __ATOMIC_ACQUIRE);
+			while (ring->tail != head) {
+				slot = &(ring->slot[ring->tail %
+						    DEBUG_RING_SLOTS]);
+				if (slot->seq != next)
+					break;
+				_debug_time(slot);
+				fwrite(slot->data, slot->size, 1, slot->fp);
+				__atomic_store_n(&(ring->tail), ring->tail + 1,
+						 __ATOMIC_RELEASE);
+				next++;
+				count++;
+				progress = 1;
+			}
+		}
+	} while (progress);
+	__atomic_store_n(&_debug_written, next, __ATOMIC_RELEASE);
+	return count;
+}
+
+// Free the drained rings of threads that have exited.  Only the writer
+// unlinks rings and new ones are only pushed in front of the first, so
+// everything behind it can be unlinked without a lock.
+static void _debug_reap(void)
+{
+	struct debug_ring **prev;
+	struct debug_ring *ring, *first;
+
+	first = __atomic_load_n(&_debug_rings, __ATOMIC_ACQUIRE);
+	if (first == NULL)
+		return;
+	prev = &(first->_next);
+	while ((ring = *prev) != NULL) {
+		if (__atomic_load_n(&(ring->dead), __ATOMIC_ACQUIRE) &&
+		    (ring->tail == __atomic_load_n(&(ring->head),
+						   __ATOMIC_ACQUIRE))) {
+			*prev = ring->_next;
+			free(ring);
+			continue;
+		}
+		prev = &(ring->_next);
+	}
+}
+
+static void *_debug_writer(void *ptr)
+{
+	while (1) {
+		if (_debug_drain() == 0) {
+			_debug_reap();
+			ns_delay(1000000);
+		}
+	}
+	return NULL;
+}
+
+static void _debug_atexit(void)
+{
+	debug_flush();
+}
+
+static void _debug_start(void)
+{
+	pthread_t thread;
+	pthread_attr_t attr;
+	sigset_t all, old;
+
+	pthread_key_create(&_debug_key, _debug_ring_exit);
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	// the writer must not run signal handlers, ocse's SIGINT handler waits
+	// for threads that wait for the writer
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	if (pthread_create(&thread, &attr, _debug_writer, NULL))
+		perror("pthread_create");
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	pthread_attr_destroy(&attr);
+	atexit(_debug_atexit);
+}
+
+static struct debug_ring *_debug_ring_new(void)
+{
+	struct debug_ring *ring;
+
+	pthread_once(&_debug_once, _debug_start);
+	if ((ring = (struct debug_ring *)calloc(1, sizeof(*ring))) == NULL) {
+		perror("malloc");
+		return NULL;
 	}
+	pthread_setspecific(_debug_key, ring);
+	ring->_next = __atomic_load_n(&_debug_rings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&_debug_rings, &(ring->_next), ring,
+					    0, __ATOMIC_RELEASE,
+					    __ATOMIC_RELAXED)) ;
+	return ring;
 }
 
-static void _debug_send_id_8(FILE * fp, DBG_HEADER header, uint8_t id,
-			     uint8_t value)
+static uint64_t _debug_now(void)
 {
-	char *buffer;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Queue one record for the writer thread
+static void _debug_put(FILE * fp, char *buffer, size_t size)
+{
+	struct debug_ring *ring;
+	struct debug_slot *slot;
+
+	if (fp == NULL)
+		return;
+	if ((ring = _debug_ring) == NULL) {
+		if ((ring = _debug_ring_new()) == NULL)
+			return;
+		_debug_ring = ring;
+	}
+	// only when the writer falls a whole ring behind
+	while ((ring->head - __atomic_load_n(&(ring->tail), __ATOMIC_ACQUIRE))
+	       == DEBUG_RING_SLOTS)
+		sched_yield();
+	slot = &(ring->slot[ring->head % DEBUG_RING_SLOTS]);
+	slot->seq = __atomic_fetch_add(&_debug_seq, 1, __ATOMIC_RELAXED);
+	slot->ns = _debug_now();
+	slot->fp = fp;
+	slot->size = size;
+	memcpy(slot->data, buffer, size);
+	__atomic_store_n(&(ring->head), ring->head + 1, __ATOMIC_RELEASE);
+}
+
+void debug_flush(void)
+{
+	uint64_t seq;
+
+	seq = __atomic_load_n(&_debug_seq, __ATOMIC_ACQUIRE);
+	while (__atomic_load_n(&_debug_written, __ATOMIC_ACQUIRE) < seq)
+		ns_delay(100000);
+	fflush(NULL);
+}
+
+static void _debug_send_id(FILE * fp, DBG_HEADER header, uint8_t id)
+{
+	char buffer[DEBUG_RECORD_MAX];
 	size_t size;
 	int offset;
 
 	offset = 0;
 	header = adjust_header(header);
-	size = sizeof(DBG_HEADER) + sizeof(id) + sizeof(value);
-	if ((buffer = (char *)malloc(size)) != NULL) {
-		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
-		offset += sizeof(header);
-		buffer[offset] = id;
-		offset += sizeof(id);
-		buffer[offset] = value;
-		fwrite(buffer, size, 1, fp);
-		free(buffer);
-	}
+	size = sizeof(DBG_HEADER) + sizeof(id);
+	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
+	offset += sizeof(DBG_HEADER);
+	buffer[offset] = id;
+	_debug_put(fp, buffer, size);
 }
 
-static void _debug_send_id_8_8_8(FILE * fp, DBG_HEADER header, uint8_t id,
-			     uint8_t value, uint8_t value1, uint8_t value2)
+static void _debug_send_id_16_8_8(FILE * fp, DBG_HEADER header, uint8_t id,
+			     uint16_t value, uint8_t value1, uint8_t value2)
 {
-	char *buffer;
+	char buffer[DEBUG_RECORD_MAX];
 	size_t size;
 	int offset;
 
 	offset = 0;
 	header = adjust_header(header);
 	size = sizeof(DBG_HEADER) + sizeof(id) + sizeof(value) + sizeof(value1) + sizeof(value2);
-	if ((buffer = (char *)malloc(size)) != NULL) {
-		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
-		offset += sizeof(header);
-		buffer[offset] = id;
-		offset += sizeof(id);
-		buffer[offset] = value;
-		offset += sizeof(value);
-		buffer[offset] = value1;
-		offset += sizeof(value1);
-		buffer[offset] = value2;
-		fwrite(buffer, size, 1, fp);
-		free(buffer);
-	}
+	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
+	offset += sizeof(header);
+	buffer[offset] = id;
+	offset += sizeof(id);
+	value = htons(value);
+	memcpy(buffer + offset, (char *)&value, sizeof(value));
+	offset += sizeof(value);
+	buffer[offset] = value1;
+	offset += sizeof(value1);
+	buffer[offset] = value2;
+	_debug_put(fp, buffer, size);
 }
 
 static void _debug_send_id_16(FILE * fp, DBG_HEADER header, uint8_t id,
 			      uint16_t value)
 {
-	char *buffer;
+	char buffer[DEBUG_RECORD_MAX];
 	size_t size;
 	int offset;
 
 	offset = 0;
 	header = adjust_header(header);
 	size = sizeof(DBG_HEADER) + sizeof(id) + sizeof(value);
-	if ((buffer = (char *)malloc(size)) != NULL) {
-		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
-		offset += sizeof(header);
-		buffer[offset] = id;
-		offset += sizeof(id);
-		value = htons(value);
-		memcpy(buffer + offset, (char *)&value, sizeof(value));
-		fwrite(buffer, size, 1, fp);
-		free(buffer);
-	}
+	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
+	offset += sizeof(header);
+	buffer[offset] = id;
+	offset += sizeof(id);
+	value = htons(value);
+	memcpy(buffer + offset, (char *)&value, sizeof(value));
+	_debug_put(fp, buffer, size);
 }
 
 /* static void _debug_send_id_32(FILE * fp, DBG_HEADER header, uint8_t id, */
 /* 			      uint32_t value) */
 /* { */
-/* 	char *buffer; */
+/* 	char buffer[DEBUG_RECORD_MAX]; */
 /* 	size_t size; */
 /* 	int offset; */
 
 /* 	offset = 0; */
 /* 	header = adjust_header(header); */
 /* 	size = sizeof(DBG_HEADER) + sizeof(id) + sizeof(value); */
-/* 	if ((buffer = (char *)malloc(size)) != NULL) { */
-/* 		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER)); */
-/* 		offset += sizeof(header); */
-/* 		buffer[offset] = id; */
-/* 		offset += sizeof(id); */
-/* 		value = htonl(value); */
-/* 		memcpy(buffer + offset, (char *)&value, sizeof(value)); */
-/* 		fwrite(buffer, size, 1, fp); */
-/* 		free(buffer); */
-/* 	} */
+/* 	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER)); */
+/* 	offset += sizeof(header); */
+/* 	buffer[offset] = id; */
+/* 	offset += sizeof(id); */
+/* 	value = htonl(value); */
+/* 	memcpy(buffer + offset, (char *)&value, sizeof(value)); */
+/* 	_debug_put(fp, buffer, size); */
 /* } */
 
 static void _debug_send_32_32(FILE * fp, DBG_HEADER header, uint32_t value0,
 			      uint32_t value1)
 {
-	char *buffer;
+	char buffer[DEBUG_RECORD_MAX];
 	size_t size;
 	int offset;
 
 	offset = 0;
 	header = adjust_header(header);
 	size = sizeof(DBG_HEADER) + sizeof(value0) + sizeof(value1);
-	if ((buffer = (char *)malloc(size)) != NULL) {
-		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
-		offset += sizeof(header);
-		value0 = htonl(value0);
-		memcpy(buffer + offset, (char *)&value0, sizeof(value0));
-		offset += sizeof(value0);
-		value1 = htonl(value1);
-		memcpy(buffer + offset, (char *)&value1, sizeof(value1));
-		fwrite(buffer, size, 1, fp);
-		free(buffer);
-	}
+	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
+	offset += sizeof(header);
+	value0 = htonl(value0);
+	memcpy(buffer + offset, (char *)&value0, sizeof(value0));
+	offset += sizeof(value0);
+	value1 = htonl(value1);
+	memcpy(buffer + offset, (char *)&value1, sizeof(value1));
+	_debug_put(fp, buffer, size);
 }
 
 
@@ -177,7 +382,7 @@ static void _debug_send_32_32(FILE * fp, DBG_HEADER header, uint32_t value0,
 static void _debug_send_id_8_16(FILE * fp, DBG_HEADER header, uint8_t id,
 				uint8_t value0, uint16_t value1)
 {
-	char *buffer;
+	char buffer[DEBUG_RECORD_MAX];
 	size_t size;
 	int offset;
 
@@ -185,24 +390,44 @@ static void _debug_send_id_8_16(FILE * fp, DBG_HEADER header, uint8_t id,
 	header = adjust_header(header);
 	size =
 	    sizeof(DBG_HEADER) + sizeof(id) + sizeof(value0) + sizeof(value1);
-	if ((buffer = (char *)malloc(size)) != NULL) {
-		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
-		offset += sizeof(header);
-		buffer[offset] = id;
-		offset += sizeof(id);
-		buffer[offset] = value0;
-		offset += sizeof(value0);
-		value1 = htons(value1);
-		memcpy(buffer + offset, (char *)&value1, sizeof(value1));
-		fwrite(buffer, size, 1, fp);
-		free(buffer);
-	}
+	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
+	offset += sizeof(header);
+	buffer[offset] = id;
+	offset += sizeof(id);
+	buffer[offset] = value0;
+	offset += sizeof(value0);
+	value1 = htons(value1);
+	memcpy(buffer + offset, (char *)&value1, sizeof(value1));
+	_debug_put(fp, buffer, size);
+}
+
+static void _debug_send_id_16_16(FILE * fp, DBG_HEADER header, uint8_t id,
+				 uint16_t value0, uint16_t value1)
+{
+	char buffer[DEBUG_RECORD_MAX];
+	size_t size;
+	int offset;
+
+	offset = 0;
+	header = adjust_header(header);
+	size =
+	    sizeof(DBG_HEADER) + sizeof(id) + sizeof(value0) + sizeof(value1);
+	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
+	offset += sizeof(header);
+	buffer[offset] = id;
+	offset += sizeof(id);
+	value0 = htons(value0);
+	memcpy(buffer + offset, (char *)&value0, sizeof(value0));
+	offset += sizeof(value0);
+	value1 = htons(value1);
+	memcpy(buffer + offset, (char *)&value1, sizeof(value1));
+	_debug_put(fp, buffer, size);
 }
 
 /* static void _debug_send_id_32_64(FILE * fp, DBG_HEADER header, uint8_t id, */
 /* 				uint32_t value0, uint64_t value1) */
 /* { */
-/* 	char *buffer; */
+/* 	char buffer[DEBUG_RECORD_MAX]; */
 /* 	size_t size; */
 /* 	int offset; */
 
@@ -210,27 +435,24 @@ static void _debug_send_id_8_16(FILE * fp, DBG_HEADER header, uint8_t id,
 /* 	header = adjust_header(header); */
 /* 	size = */
 /* 	    sizeof(DBG_HEADER) + sizeof(id) + sizeof(value0) + sizeof(value1); */
-/* 	if ((buffer = (char *)malloc(size)) != NULL) { */
-/* 		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER)); */
-/* 		offset += sizeof(header); */
-/* 		buffer[offset] = id; */
-/* 		offset += sizeof(id); */
-/* 		value0 = htonl(value0); */
-/* 		memcpy(buffer + offset, (char *)&value0, sizeof(value0)); */
-/* 		offset += sizeof(value0); */
-/* 		value1 = htonll(value1); */
-/* 		memcpy(buffer + offset, (char *)&value1, sizeof(value1)); */
-/* 		fwrite(buffer, size, 1, fp); */
-/* 		free(buffer); */
-/* 	} */
+/* 	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER)); */
+/* 	offset += sizeof(header); */
+/* 	buffer[offset] = id; */
+/* 	offset += sizeof(id); */
+/* 	value0 = htonl(value0); */
+/* 	memcpy(buffer + offset, (char *)&value0, sizeof(value0)); */
+/* 	offset += sizeof(value0); */
+/* 	value1 = htonll(value1); */
+/* 	memcpy(buffer + offset, (char *)&value1, sizeof(value1)); */
+/* 	_debug_put(fp, buffer, size); */
 /* } */
 
 
-static void _debug_send_id_8_16_16(FILE * fp, DBG_HEADER header, uint8_t id,
-				   uint8_t value0, uint16_t value1,
-				   uint16_t value2)
+static void _debug_send_id_16_16_16(FILE * fp, DBG_HEADER header, uint8_t id,
+				    uint16_t value0, uint16_t value1,
+				    uint16_t value2)
 {
-	char *buffer;
+	char buffer[DEBUG_RECORD_MAX];
 	size_t size;
 	int offset;
 
@@ -239,28 +461,26 @@ static void _debug_send_id_8_16_16(FILE * fp, DBG_HEADER header, uint8_t id,
 	size =
 	    sizeof(DBG_HEADER) + sizeof(id) + sizeof(value0) + sizeof(value1) +
 	    sizeof(value2);
-	if ((buffer = (char *)malloc(size)) != NULL) {
-		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
-		offset += sizeof(header);
-		buffer[offset] = id;
-		offset += sizeof(id);
-		buffer[offset] = value0;
-		offset += sizeof(value0);
-		value1 = htons(value1);
-		memcpy(buffer + offset, (char *)&value1, sizeof(value1));
-		offset += sizeof(value1);
-		value2 = htons(value2);
-		memcpy(buffer + offset, (char *)&value2, sizeof(value2));
-		fwrite(buffer, size, 1, fp);
-		free(buffer);
-	}
+	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
+	offset += sizeof(header);
+	buffer[offset] = id;
+	offset += sizeof(id);
+	value0 = htons(value0);
+	memcpy(buffer + offset, (char *)&value0, sizeof(value0));
+	offset += sizeof(value0);
+	value1 = htons(value1);
+	memcpy(buffer + offset, (char *)&value1, sizeof(value1));
+	offset += sizeof(value1);
+	value2 = htons(value2);
+	memcpy(buffer + offset, (char *)&value2, sizeof(value2));
+	_debug_put(fp, buffer, size);
 }
 
 static void _debug_send_id_8_8_16_32(FILE * fp, DBG_HEADER header, uint8_t id,
 				     uint8_t value0, uint8_t value1,
 				     uint16_t value2, uint32_t value3)
 {
-	char *buffer;
+	char buffer[DEBUG_RECORD_MAX];
 	size_t size;
 	int offset;
 
@@ -269,23 +489,20 @@ static void _debug_send_id_8_8_16_32(FILE * fp, DBG_HEADER header, uint8_t id,
 	size =
 	    sizeof(DBG_HEADER) + sizeof(id) + sizeof(value0) + sizeof(value1) +
 	    sizeof(value2) + sizeof(value3);
-	if ((buffer = (char *)malloc(size)) != NULL) {
-		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
-		offset += sizeof(header);
-		buffer[offset] = id;
-		offset += sizeof(id);
-		buffer[offset] = value0;
-		offset += sizeof(value0);
-		buffer[offset] = value1;
-		offset += sizeof(value1);
-		value2 = htons(value2);
-		memcpy(buffer + offset, (char *)&value2, sizeof(value2));
-		offset += sizeof(value2);
-		value3 = htonl(value3);
-		memcpy(buffer + offset, (char *)&value3, sizeof(value3));
-		fwrite(buffer, size, 1, fp);
-		free(buffer);
-	}
+	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
+	offset += sizeof(header);
+	buffer[offset] = id;
+	offset += sizeof(id);
+	buffer[offset] = value0;
+	offset += sizeof(value0);
+	buffer[offset] = value1;
+	offset += sizeof(value1);
+	value2 = htons(value2);
+	memcpy(buffer + offset, (char *)&value2, sizeof(value2));
+	offset += sizeof(value2);
+	value3 = htonl(value3);
+	memcpy(buffer + offset, (char *)&value3, sizeof(value3));
+	_debug_put(fp, buffer, size);
 }
 
 size_t debug_get_64(FILE * fp, uint64_t * value)
@@ -344,7 +561,7 @@ DBG_HEADER debug_get_header(FILE * fp)
 
 void debug_send_version(FILE * fp, uint8_t major, uint8_t minor)
 {
-	char *buffer;
+	char buffer[DEBUG_RECORD_MAX];
 	size_t size;
 	int offset;
 	DBG_HEADER header;
@@ -352,15 +569,12 @@ void debug_send_version(FILE * fp, uint8_t major, uint8_t minor)
 	offset = 0;
 	header = adjust_header(DBG_HEADER_VERSION);
 	size = sizeof(DBG_HEADER) + sizeof(major) + sizeof(minor);
-	if ((buffer = (char *)malloc(size)) != NULL) {
-		memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
-		offset += sizeof(header);
-		buffer[offset] = major;
-		offset += sizeof(major);
-		buffer[offset] = minor;
-		fwrite(buffer, size, 1, fp);
-		free(buffer);
-	}
+	memcpy(buffer, (char *)&header, sizeof(DBG_HEADER));
+	offset += sizeof(header);
+	buffer[offset] = major;
+	offset += sizeof(major);
+	buffer[offset] = minor;
+	_debug_put(fp, buffer, size);
 }
 
 void debug_afu_connect(FILE * fp, uint8_t id)
@@ -442,43 +656,43 @@ void debug_mmio_return(FILE * fp, uint8_t id, uint16_t context)
 	_debug_send_id_16(fp, DBG_HEADER_MMIO_RETURN, id, context);
 }
 
-void debug_cmd_add(FILE * fp, uint8_t id, uint8_t afutag, uint16_t context,
+void debug_cmd_add(FILE * fp, uint8_t id, uint16_t afutag, uint16_t context,
 		   uint16_t command)
 {
-	_debug_send_id_8_16_16(fp, DBG_HEADER_CMD_ADD, id, afutag, context,
+	_debug_send_id_16_16_16(fp, DBG_HEADER_CMD_ADD, id, afutag, context,
 			       command);
 }
 
-void debug_cmd_update(FILE * fp, uint8_t id, uint8_t afutag, uint16_t context,
+void debug_cmd_update(FILE * fp, uint8_t id, uint16_t afutag, uint16_t context,
 		      uint16_t resp)
 {
-	_debug_send_id_8_16_16(fp, DBG_HEADER_CMD_UPDATE, id, afutag, context,
+	_debug_send_id_16_16_16(fp, DBG_HEADER_CMD_UPDATE, id, afutag, context,
 			       resp);
 }
 
-void debug_cmd_client(FILE * fp, uint8_t id, uint8_t afutag, uint16_t context)
+void debug_cmd_client(FILE * fp, uint8_t id, uint16_t afutag, uint16_t context)
 {
-	_debug_send_id_8_16(fp, DBG_HEADER_CMD_CLIENT_REQ, id, afutag, context);
+	_debug_send_id_16_16(fp, DBG_HEADER_CMD_CLIENT_REQ, id, afutag, context);
 }
 
-void debug_cmd_return(FILE * fp, uint8_t id, uint8_t afutag, uint16_t context)
+void debug_cmd_return(FILE * fp, uint8_t id, uint16_t afutag, uint16_t context)
 {
-	_debug_send_id_8_16(fp, DBG_HEADER_CMD_CLIENT_ACK, id, afutag, context);
+	_debug_send_id_16_16(fp, DBG_HEADER_CMD_CLIENT_ACK, id, afutag, context);
 }
 
-void debug_cmd_buffer_write(FILE * fp, uint8_t id, uint8_t afutag)
+void debug_cmd_buffer_write(FILE * fp, uint8_t id, uint16_t afutag)
 {
-	_debug_send_id_8(fp, DBG_HEADER_CMD_BUFFER_WRITE, id, afutag);
+	_debug_send_id_16(fp, DBG_HEADER_CMD_BUFFER_WRITE, id, afutag);
 }
 
-void debug_cmd_buffer_read(FILE * fp, uint8_t id, uint8_t afutag)
+void debug_cmd_buffer_read(FILE * fp, uint8_t id, uint16_t afutag)
 {
-	_debug_send_id_8(fp, DBG_HEADER_CMD_BUFFER_READ, id, afutag);
+	_debug_send_id_16(fp, DBG_HEADER_CMD_BUFFER_READ, id, afutag);
 }
 
-void debug_cmd_response(FILE * fp, uint8_t id, uint8_t afutag, uint8_t resp, uint8_t opcode)
+void debug_cmd_response(FILE * fp, uint8_t id, uint16_t afutag, uint8_t resp, uint8_t opcode)
 {
-	_debug_send_id_8_8_8(fp, DBG_HEADER_CMD_RESPONSE, id, afutag, resp, opcode);
+	_debug_send_id_16_8_8(fp, DBG_HEADER_CMD_RESPONSE, id, afutag, resp, opcode);
 }
 
 void debug_socket_put(FILE * fp, uint8_t id, uint16_t context, uint8_t type)
@@ -45,6 +45,9 @@ typedef uint8_t DBG_HEADER;
 #define DBG_HEADER_CMD_BUFFER_WRITE 	0x14
 #define DBG_HEADER_CMD_BUFFER_READ 	0x15
 #define DBG_HEADER_CMD_RESPONSE    	0x16
+// Written by debug.c itself: 64 bit ns since the first record, the time of
+// the records that follow to within a microsecond
+#define DBG_HEADER_TIME			0x17
 //#define DBG_HEADER_PE_ADD		0x18
 //#define DBG_HEADER_PE_SEND		0x19
 
@@ -78,18 +81,21 @@ size_t debug_get_16(FILE * fp, uint16_t * value);
 size_t debug_get_8(FILE * fp, uint8_t * value);
 DBG_HEADER debug_get_header(FILE * fp);
 
+// Wait until every record logged so far is written and flushed
+void debug_flush(void);
+
 void debug_send_version(FILE * fp, uint8_t major, uint8_t minor);
 void debug_afu_connect(FILE * fp, uint8_t id);
 void debug_afu_drop(FILE * fp, uint8_t id);
-void debug_cmd_add(FILE * fp, uint8_t id, uint8_t tag, uint16_t context,
+void debug_cmd_add(FILE * fp, uint8_t id, uint16_t tag, uint16_t context,
 		   uint16_t command);
-void debug_cmd_update(FILE * fp, uint8_t id, uint8_t tag, uint16_t context,
+void debug_cmd_update(FILE * fp, uint8_t id, uint16_t tag, uint16_t context,
 		      uint16_t resp);
-void debug_cmd_client(FILE * fp, uint8_t id, uint8_t tag, uint16_t context);
-void debug_cmd_return(FILE * fp, uint8_t id, uint8_t tag, uint16_t context);
-void debug_cmd_buffer_write(FILE * fp, uint8_t id, uint8_t tag);
-void debug_cmd_buffer_read(FILE * fp, uint8_t id, uint8_t tag);
-void debug_cmd_response(FILE * fp, uint8_t id, uint8_t tag, uint8_t resp, uint8_t opcode);
+void debug_cmd_client(FILE * fp, uint8_t id, uint16_t tag, uint16_t context);
+void debug_cmd_return(FILE * fp, uint8_t id, uint16_t tag, uint16_t context);
+void debug_cmd_buffer_write(FILE * fp, uint8_t id, uint16_t tag);
+void debug_cmd_buffer_read(FILE * fp, uint8_t id, uint16_t tag);
+void debug_cmd_response(FILE * fp, uint8_t id, uint16_t tag, uint8_t resp, uint8_t opcode);
 void debug_context_add(FILE * fp, uint8_t id, uint16_t context);
 void debug_context_remove(FILE * fp, uint8_t id, uint16_t context);
 void debug_job_add(FILE * fp, uint8_t id, uint32_t code);
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2014,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Description: ocse_plugin.h
+ *
+ *  Transaction level AFU plug-in interface.  A shim_host.dat line of the form
+ *
+ *      tlx0,plugin:/path/to/libmyafu.so
+ *
+ *  makes ocse dlopen() the shared object instead of connecting to an AFU
+ *  simulator.  ocse looks up OCSE_PLUGIN_INIT in it, calls it once to get the
+ *  plug-in's ops and then calls ops->open() for the tlx entry.
+ *
+ *  Everything the host sends to the AFU (config reads and writes, MMIO and LPC
+ *  commands, responses to AFU commands) is delivered as a call to one of the
+ *  ops, always from the tlx thread of that entry with the ocse lock held.  The
+ *  plug-in answers and issues its own commands by calling the functions in the
+ *  ocse_plugin_host it was opened with, either from inside an op or from
+ *  ops->poll(), which ocse calls every time it services the entry.  Calls into
+ *  ocse_plugin_host may also come from a thread of the plug-in.
+ *
+ *  There is no clock and no socket.  Each call carries a whole transaction:
+ *  data of any length is passed in one buffer and ocse splits it into 64 byte
+ *  beats itself.  Credits are handled by ocse, a plug-in never sees them and
+ *  may queue as many commands and responses as it likes.  Opcodes, response
+ *  codes and the dl/pl encodings are the ones in tlx_interface_t.h.
+ *
+ *  A plug-in is built as a normal shared object, e.g.
+ *
+ *      gcc -shared -fPIC -I<ocse>/common -o libmyafu.so myafu.c
+ *
+ *  ocse_plugin_example.c is a complete minimal one, "make plugin" in
+ *  test/tests runs it.
+ */
+
+#ifndef _OCSE_PLUGIN_H_
+#define _OCSE_PLUGIN_H_
+
+#include <stdint.h>
+
+#define OCSE_PLUGIN_VERSION 1
+#define OCSE_PLUGIN_INIT "ocse_plugin_init"
+
+// Config read or write from the host, answer with host->cfg_resp().  ocse
+// pipelines config accesses: they must take effect in the order they arrive,
+// but may be answered in any order as the response echoes the capptag
+struct ocse_plugin_cfg_cmd {
+	uint8_t opcode;		// TLX_CMD_CONFIG_READ or TLX_CMD_CONFIG_WRITE
+	uint16_t capptag;	// unique among the accesses in flight
+	uint8_t pl;
+	uint8_t t;
+	uint64_t pa;
+	uint8_t data[4];	// write data
+};
+
+// MMIO or LPC command from the host, answer with host->afu_resp()
+struct ocse_plugin_host_cmd {
+	uint8_t opcode;		// TLX_CMD_*
+	uint16_t capptag;
+	uint8_t dl;
+	uint8_t pl;
+	uint64_t be;
+	uint8_t end;
+	uint8_t os;
+	uint8_t flag;
+	uint64_t pa;
+	uint8_t *data;		// write data, NULL for reads
+	uint16_t data_size;
+};
+
+// Response from the host to a command from host->afu_cmd()
+struct ocse_plugin_host_resp {
+	uint8_t opcode;		// TLX_RSP_*
+	uint16_t afutag;
+	uint8_t code;
+	uint8_t pg_size;
+	uint8_t dl;
+	uint8_t dp;
+	uint32_t addr_tag;
+	uint32_t host_tag;
+	uint8_t cache_state;
+	uint8_t *data;		// read data, NULL if none
+	uint16_t data_size;
+};
+
+// Command from the AFU to the host, the fields of afu_tlx_send_cmd()
+struct ocse_plugin_afu_cmd {
+	uint8_t opcode;		// AFU_CMD_*
+	uint16_t actag;
+	uint8_t stream_id;
+	uint8_t ea_or_obj[9];
+	uint16_t afutag;
+	uint8_t dl;
+	uint8_t pl;
+	uint8_t os;
+	uint64_t be;
+	uint8_t flag;
+	uint8_t endian;
+	uint16_t bdf;
+	uint32_t pasid;
+	uint8_t pg_size;
+	uint8_t *data;		// write or amo data, NULL if none
+	uint16_t data_size;	// multiple of 64 for dl writes, 64 for pl commands
+};
+
+// Response from the AFU to a host command
+struct ocse_plugin_afu_resp {
+	uint8_t opcode;		// AFU_RSP_*
+	uint16_t capptag;
+	uint8_t dl;
+	uint8_t dp;
+	uint8_t code;
+	uint8_t *data;		// read data, NULL if none
+	uint16_t data_size;
+};
+
+// Response from the AFU to a config command
+struct ocse_plugin_cfg_resp {
+	uint8_t opcode;		// AFU_RSP_MEM_RD_RESP, AFU_RSP_MEM_WR_RESP or a _FAIL
+	uint16_t capptag;
+	uint8_t code;
+	uint8_t data[4];	// read data
+};
+
+// Provided by ocse, pass ocl back as the first argument.  The structures and
+// their data are copied before the call returns.  All return 0 on success.
+struct ocse_plugin_host {
+	void *ocl;
+	int (*afu_cmd)(void *ocl, const struct ocse_plugin_afu_cmd *cmd);
+	int (*afu_resp)(void *ocl, const struct ocse_plugin_afu_resp *resp);
+	int (*cfg_resp)(void *ocl, const struct ocse_plugin_cfg_resp *resp);
+};
+
+// Provided by the plug-in, everything but poll is required
+struct ocse_plugin_ops {
+	uint32_t version;	// OCSE_PLUGIN_VERSION
+	// returns the plug-in's handle for tlx entry name, NULL on failure;
+	// host stays valid until close
+	void *(*open)(const struct ocse_plugin_host *host, const char *name);
+	void (*close)(void *afu);
+	void (*cfg_cmd)(void *afu, const struct ocse_plugin_cfg_cmd *cmd);
+	void (*cmd)(void *afu, const struct ocse_plugin_host_cmd *cmd);
+	void (*resp)(void *afu, const struct ocse_plugin_host_resp *resp);
+	void (*poll)(void *afu);
+};
+
+// The function named OCSE_PLUGIN_INIT has this type
+typedef const struct ocse_plugin_ops *(*ocse_plugin_init_t)(void);
+
+#endif				/* _OCSE_PLUGIN_H_ */
@@ -0,0 +1,266 @@
+/*
+ * Copyright 2014,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Description: ocse_plugin_example.c
+ *
+ *  The smallest useful AFU plug-in, see ocse_plugin.h.  Function 0 has one
+ *  AFU with 64KB of global MMIO and 64KB of lpc memory, both plain storage:
+ *  what is written is read back.  The AFU never issues commands of its own.
+ *
+ *  The configuration space holds just what ocse's discovery walks: the
+ *  header with BAR0, a PASID capability and the function, AFU information
+ *  and AFU control DVSECs.  Configuration accesses are 4 byte words.
+ *
+ *      gcc -shared -fPIC -I<ocse>/common -o libocse_plugin_example.so \
+ *          ocse_plugin_example.c
+ *
+ *  and "tlx0,plugin:/path/to/libocse_plugin_example.so" in shim_host.dat.
+ *  test/tests/plugin_smoke runs it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ocse_plugin.h"
+#include "tlx_interface_t.h"
+
+#define EXAMPLE_CFG_SIZE 0x1000		// function 0 configuration space
+#define EXAMPLE_MMIO_SIZE 0x10000	// global MMIO, also the BAR0 window
+#define EXAMPLE_LPC_SIZE 0x10000
+#define EXAMPLE_LPC_SIZE_LOG2 16
+
+#define EXAMPLE_PASID 0x100		// extended capabilities
+#define EXAMPLE_FUNCTION 0x200
+#define EXAMPLE_AFU_INFO 0x300
+#define EXAMPLE_AFU_CTL 0x400
+
+#define EXAMPLE_DESC_VALID 0x80000000
+
+struct example {
+	const struct ocse_plugin_host *host;
+	uint32_t cfg[EXAMPLE_CFG_SIZE / 4];
+	uint32_t desc[0x50 / 4];	// AFU descriptor
+	uint8_t mmio[EXAMPLE_MMIO_SIZE];
+	uint8_t lpc[EXAMPLE_LPC_SIZE];
+};
+
+// Extended capability header: next offset, version 1 and id
+static uint32_t _ec(uint32_t next, uint32_t id)
+{
+	return (next << 20) | (1 << 16) | id;
+}
+
+static void _cfg_init(struct example *afu)
+{
+	uint32_t *cfg = afu->cfg;
+	char name[24] = "IBM,PLUGIN_EXAMPLE";
+
+	cfg[0x00 / 4] = 0x06321014;	// device and vendor id
+	cfg[0x10 / 4] = 0x00000004;	// BAR0, 64 bit memory
+	cfg[EXAMPLE_PASID / 4] = _ec(EXAMPLE_FUNCTION, 0x001b);
+	cfg[(EXAMPLE_PASID + 0x04) / 4] = 4 << 8;	// max pasid width
+	cfg[EXAMPLE_FUNCTION / 4] = _ec(EXAMPLE_AFU_INFO, 0x0023);
+	cfg[(EXAMPLE_FUNCTION + 0x08) / 4] = 0x8000f001; // afu present, index 0
+	cfg[EXAMPLE_AFU_INFO / 4] = _ec(EXAMPLE_AFU_CTL, 0x0023);
+	cfg[(EXAMPLE_AFU_INFO + 0x08) / 4] = 0x0000f003;
+	cfg[EXAMPLE_AFU_CTL / 4] = _ec(0, 0x0023);
+	cfg[(EXAMPLE_AFU_CTL + 0x08) / 4] = 0x0000f004;	// afu index 0
+	cfg[(EXAMPLE_AFU_CTL + 0x10) / 4] = 4;	// pasid length supported
+	cfg[(EXAMPLE_AFU_CTL + 0x18) / 4] = 1;	// actag length supported
+
+	// name, version, global MMIO at BAR0 offset 0, no per pasid MMIO and
+	// the lpc memory size
+	memcpy(afu->desc + 0x04 / 4, name, sizeof(name));
+	afu->desc[0x1c / 4] = 0x01000000;
+	afu->desc[0x28 / 4] = EXAMPLE_MMIO_SIZE;
+	afu->desc[0x3c / 4] = EXAMPLE_LPC_SIZE_LOG2;
+}
+
+static uint32_t _cfg_read(struct example *afu, uint32_t offset)
+{
+	uint32_t index;
+
+	// the descriptor word selected through the AFU information DVSEC
+	if (offset == EXAMPLE_AFU_INFO + 0x10) {
+		index = afu->cfg[(EXAMPLE_AFU_INFO + 0x0c) / 4] & 0x7ffffffc;
+		if (index < sizeof(afu->desc))
+			return afu->desc[index / 4];
+		return 0;
+	}
+	return afu->cfg[offset / 4];
+}
+
+static void _cfg_write(struct example *afu, uint32_t offset, uint32_t data)
+{
+	switch (offset) {
+	case 0x10:		// BAR0 low, the window is EXAMPLE_MMIO_SIZE
+		data = (data & ~(EXAMPLE_MMIO_SIZE - 1)) | 0x4;
+		break;
+	case EXAMPLE_AFU_INFO + 0x08:	// only the afu index is writable
+		data = (data & 0x003f0000) | (afu->cfg[offset / 4] & ~0x003f0000);
+		break;
+	case EXAMPLE_AFU_INFO + 0x0c:	// the data is there right away
+		data |= EXAMPLE_DESC_VALID;
+		break;
+	default:
+		break;
+	}
+	afu->cfg[offset / 4] = data;
+}
+
+// Storage behind a host physical address, NULL if there is none
+static uint8_t *_mem(struct example *afu, uint64_t pa, uint32_t size)
+{
+	uint64_t bar;
+
+	bar = ((uint64_t)afu->cfg[0x14 / 4] << 32) |
+	    (afu->cfg[0x10 / 4] & 0xfffffff0);
+	if ((pa >= bar) && (pa - bar + size <= EXAMPLE_MMIO_SIZE))
+		return afu->mmio + (pa - bar);
+	if (pa + size <= EXAMPLE_LPC_SIZE)
+		return afu->lpc + pa;
+	return NULL;
+}
+
+static void *example_open(const struct ocse_plugin_host *host,
+			  const char *name)
+{
+	struct example *afu;
+
+	if ((afu = (struct example *)calloc(1, sizeof(struct example))) == NULL)
+		return NULL;
+	afu->host = host;
+	_cfg_init(afu);
+	return afu;
+}
+
+static void example_close(void *ptr)
+{
+	free(ptr);
+}
+
+static void example_cfg_cmd(void *ptr, const struct ocse_plugin_cfg_cmd *cmd)
+{
+	struct example *afu = (struct example *)ptr;
+	struct ocse_plugin_cfg_resp resp;
+	uint32_t offset, data;
+
+	memset(&resp, 0, sizeof(resp));
+	resp.capptag = cmd->capptag;
+	offset = cmd->pa & 0xffffc;
+	if (cmd->opcode == TLX_CMD_CONFIG_WRITE) {
+		resp.opcode = AFU_RSP_MEM_WR_RESP;
+		memcpy(&data, cmd->data, 4);
+		if ((cmd->pa & 0xf0000) == 0)
+			_cfg_write(afu, offset, data);
+	} else {
+		resp.opcode = AFU_RSP_MEM_RD_RESP;
+		// there is only function 0
+		if ((cmd->pa & 0xf0000) == 0)
+			data = _cfg_read(afu, offset);
+		else
+			data = 0xffffffff;
+		memcpy(resp.data, &data, 4);
+	}
+	afu->host->cfg_resp(afu->host->ocl, &resp);
+}
+
+static void example_cmd(void *ptr, const struct ocse_plugin_host_cmd *cmd)
+{
+	struct example *afu = (struct example *)ptr;
+	struct ocse_plugin_afu_resp resp;
+	uint8_t data[256];
+	uint8_t *mem;
+	uint32_t size, offset;
+	int i;
+
+	memset(&resp, 0, sizeof(resp));
+	resp.capptag = cmd->capptag;
+	// partial lengths sit at their offset in a 64 byte beat
+	if ((cmd->opcode == TLX_CMD_PR_RD_MEM) ||
+	    (cmd->opcode == TLX_CMD_PR_WR_MEM)) {
+		size = 1 << cmd->pl;
+		offset = cmd->pa & 0x3f;
+	} else {
+		size = 64 << (cmd->dl - 1);
+		offset = 0;
+	}
+	mem = (size <= 256) ? _mem(afu, cmd->pa, size) : NULL;
+
+	switch (cmd->opcode) {
+	case TLX_CMD_RD_MEM:
+	case TLX_CMD_PR_RD_MEM:
+		if (mem == NULL) {
+			resp.opcode = AFU_RSP_MEM_RD_FAIL;
+			resp.code = 0xe;
+			break;
+		}
+		memset(data, 0, sizeof(data));
+		memcpy(data + offset, mem, size);
+		resp.opcode = AFU_RSP_MEM_RD_RESP;
+		resp.dl = (cmd->opcode == TLX_CMD_PR_RD_MEM) ? 1 : cmd->dl;
+		resp.data = data;
+		resp.data_size = (size < 64) ? 64 : size;
+		break;
+	case TLX_CMD_WRITE_MEM:
+	case TLX_CMD_WRITE_MEM_BE:
+	case TLX_CMD_PR_WR_MEM:
+		if ((mem == NULL) || (cmd->data == NULL) ||
+		    (cmd->data_size < offset + size)) {
+			resp.opcode = AFU_RSP_MEM_WR_FAIL;
+			resp.code = 0xe;
+			break;
+		}
+		if (cmd->opcode == TLX_CMD_WRITE_MEM_BE) {
+			for (i = 0; i < 64; i++)
+				if (cmd->be & (1ull << i))
+					mem[i] = cmd->data[i];
+		} else {
+			memcpy(mem, cmd->data + offset, size);
+		}
+		resp.opcode = AFU_RSP_MEM_WR_RESP;
+		break;
+	default:
+		fprintf(stderr, "plugin example: unsupported command 0x%02x\n",
+			cmd->opcode);
+		resp.opcode = AFU_RSP_MEM_WR_FAIL;
+		resp.code = 0xe;
+		break;
+	}
+	afu->host->afu_resp(afu->host->ocl, &resp);
+}
+
+// The AFU sends no commands, so no responses come back
+static void example_resp(void *ptr, const struct ocse_plugin_host_resp *resp)
+{
+}
+
+static const struct ocse_plugin_ops example_ops = {
+	.version = OCSE_PLUGIN_VERSION,
+	.open = example_open,
+	.close = example_close,
+	.cfg_cmd = example_cfg_cmd,
+	.cmd = example_cmd,
+	.resp = example_resp,
+	.poll = NULL,
+};
+
+const struct ocse_plugin_ops *ocse_plugin_init(void)
+{
+	return &example_ops;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2014,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _PROBE_H_
+#define _PROBE_H_
+
+// Static user space tracepoints for perf, bpftrace or systemtap, e.g.
+//
+//     bpftrace -e 'usdt:ocse/ocse:ocse:cmd_resp { @[arg3] = count(); }'
+//
+// With <sys/sdt.h> (systemtap-sdt-dev) each probe is a single nop and a note
+// in the binary.  Without it, or built with -DOCSE_NO_PROBES, the probes
+// compile to nothing.  Arguments must be integers or pointers.
+//
+// ocse provider:
+//     cmd_add(port, context, afutag, opcode)      AFU command taken
+//     cmd_resp(port, context, afutag, resp)       response sent to the AFU
+//     mmio_send(port, context, addr, rnw)         access sent to the AFU
+//     mmio_ack(port, context, addr, rnw)          access answered by the AFU
+//     client_in(port, context, message)           message from a client
+//     client_out(port, context, message, size)    message to a client
+//     clock(port, cycle)                          AFU clocked
+//
+// libocxl provider:
+//     message(context, message)                   message from ocse handled
+//     request_submit(context, message, addr)      request sent to ocse
+//     request_complete(context, message)          ocse answered a request
+//     interrupt(context, irq)                     interrupt delivered
+//     wake_host_thread(context)                   wake_host_thread delivered
+
+#if !defined(OCSE_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define OCSE_PROBES
+#endif
+#endif
+
+#ifdef OCSE_PROBES
+#define OCSE_PROBE(provider, name) \
+	DTRACE_PROBE(provider, name)
+#define OCSE_PROBE1(provider, name, a1) \
+	DTRACE_PROBE1(provider, name, a1)
+#define OCSE_PROBE2(provider, name, a1, a2) \
+	DTRACE_PROBE2(provider, name, a1, a2)
+#define OCSE_PROBE3(provider, name, a1, a2, a3) \
+	DTRACE_PROBE3(provider, name, a1, a2, a3)
+#define OCSE_PROBE4(provider, name, a1, a2, a3, a4) \
+	DTRACE_PROBE4(provider, name, a1, a2, a3, a4)
+#else
+#define OCSE_PROBE(provider, name) do { } while (0)
+#define OCSE_PROBE1(provider, name, a1) do { } while (0)
+#define OCSE_PROBE2(provider, name, a1, a2) do { } while (0)
+#define OCSE_PROBE3(provider, name, a1, a2, a3) do { } while (0)
+#define OCSE_PROBE4(provider, name, a1, a2, a3, a4) do { } while (0)
+#endif
+
+#endif				/* _PROBE_H_ */
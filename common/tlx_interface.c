@@ -1505,7 +1505,7 @@ int tlx_get_afu_events(struct AFU_EVENT *event)
 		event->afu_tlx_resp_valid = 1;
 		// event->tlx_afu_resp_credit = 1;  // allow ocse to process the response and return the credit
 		// event->tlx_afu_credit_valid = 1;
-		printf("in tlx_get_afu_events and NOT setting tlx_afu_credit & resp credits to 1 bc we got resp \n");
+		debug_msg("tlx_get_afu_events: resp, its credit is returned once ocse has processed it");
 		event->afu_tlx_resp_opcode = event->rbuf[rbc++];
 		event->afu_tlx_resp_dl = event->rbuf[rbc++];
 		event->afu_tlx_resp_capptag = event->rbuf[rbc++];
@@ -1522,7 +1522,7 @@ int tlx_get_afu_events(struct AFU_EVENT *event)
 		event->afu_tlx_rdata_valid = 1;
 		//event->tlx_afu_resp_data_credit = 1;
 		//event->tlx_afu_credit_valid = 1;
-		printf("in tlx_get_afu_events and NOT setting tlx_afu_credit & resp_data credits to 1 bc we got resp data\n");
+		debug_msg("tlx_get_afu_events: resp data, its credit is returned once ocse has processed it");
 		event->afu_tlx_rdata_bdi= event->rbuf[rbc++];
 		//printf("event->rbuf[%x] is 0x%2x \n", rbc-1, event->rbuf[rbc-1]);
 		for (i = 0; i < 64; i++) {
@@ -1891,6 +1891,253 @@ int tlx_get_tlx_events(struct AFU_EVENT *event)
 }
 
 
+/* Direct handoff for an AFU model in the ocse process.  Every group is moved
+ * with the same masking and credit side effects as its socket encoding.  This
+ * half is tlx_signal_afu_model/tlx_get_tlx_events, except for the AFU credit
+ * returns a missing group clears, see tlx_handoff_events. */
+
+static void tlx_handoff_afu_model(struct AFU_EVENT *host, struct AFU_EVENT *afu)
+{
+	if (host->tlx_cfg_valid) {
+		afu->tlx_cfg_valid = 1;
+		afu->tlx_cfg_opcode = host->tlx_cfg_opcode;
+		afu->tlx_cfg_capptag = host->tlx_cfg_capptag;
+		afu->tlx_cfg_pa = host->tlx_cfg_pa;
+		afu->tlx_cfg_t = host->tlx_cfg_t & 0x01;
+		afu->tlx_cfg_pl = host->tlx_cfg_pl & 0x07;
+		afu->tlx_cfg_data_bdi = host->tlx_cfg_data_bdi & 0x01;
+		memcpy(afu->tlx_cfg_data_bus, host->tlx_cfg_data_bus, 4);
+		host->tlx_cfg_valid = 0;
+	} else {
+		afu->tlx_cfg_valid = 0;
+	}
+
+	if (host->tlx_afu_cmd_valid) {
+		afu->tlx_afu_cmd_valid = 1;
+		afu->tlx_afu_cmd_opcode = host->tlx_afu_cmd_opcode;
+		afu->tlx_afu_cmd_capptag = host->tlx_afu_cmd_capptag;
+		afu->tlx_afu_cmd_dl = host->tlx_afu_cmd_dl & 0x03;
+		afu->tlx_afu_cmd_pl = host->tlx_afu_cmd_pl & 0x07;
+		afu->tlx_afu_cmd_be = host->tlx_afu_cmd_be;
+		afu->tlx_afu_cmd_end = host->tlx_afu_cmd_end & 0x01;
+		afu->tlx_afu_cmd_pa = host->tlx_afu_cmd_pa;
+#ifdef TLX4
+		afu->tlx_afu_cmd_flag = host->tlx_afu_cmd_flag & 0x0f;
+		afu->tlx_afu_cmd_os = host->tlx_afu_cmd_os & 0x01;
+#endif
+		host->tlx_afu_cmd_valid = 0;
+	} else {
+		afu->tlx_afu_cmd_valid = 0;
+	}
+
+	if (host->tlx_afu_cmd_data_valid) {
+		afu->tlx_afu_cmd_data_valid = 1;
+		afu->tlx_afu_cmd_data_bdi = host->tlx_afu_cmd_data_bdi & 0x01;
+		memcpy(afu->tlx_afu_cmd_data_bus, host->tlx_afu_cmd_data_bus,
+		       host->tlx_afu_cmd_data_byte_cnt);
+		host->tlx_afu_cmd_data_valid = 0;
+	} else {
+		afu->tlx_afu_cmd_data_valid = 0;
+	}
+
+	if (host->tlx_afu_resp_valid) {
+		afu->tlx_afu_resp_valid = 1;
+		afu->tlx_afu_resp_opcode = host->tlx_afu_resp_opcode;
+		afu->tlx_afu_resp_afutag = host->tlx_afu_resp_afutag;
+		afu->tlx_afu_resp_code = host->tlx_afu_resp_code;
+		afu->tlx_afu_resp_pg_size = host->tlx_afu_resp_pg_size;
+		afu->tlx_afu_resp_dl = host->tlx_afu_resp_dl;
+		afu->tlx_afu_resp_dp = host->tlx_afu_resp_dp;
+		host->tlx_afu_resp_valid = 0;
+	} else {
+		afu->tlx_afu_resp_valid = 0;
+	}
+
+	if (host->tlx_afu_resp_data_valid) {
+		afu->tlx_afu_resp_data_valid = 1;
+		afu->tlx_afu_resp_data_bdi = host->tlx_afu_resp_data_bdi & 0x01;
+		memcpy(afu->tlx_afu_resp_data, host->tlx_afu_resp_data,
+		       host->tlx_afu_resp_data_byte_cnt);
+		host->tlx_afu_resp_data_valid = 0;
+	} else {
+		afu->tlx_afu_resp_data_valid = 0;
+	}
+
+	if (host->tlx_afu_credit_valid) {
+		afu->tlx_afu_credit_valid = 1;
+		afu->tlx_afu_cmd_initial_credit = host->tlx_afu_cmd_initial_credit;
+		afu->tlx_afu_cmd_data_initial_credit = host->tlx_afu_cmd_data_initial_credit;
+		afu->tlx_afu_resp_initial_credit = host->tlx_afu_resp_initial_credit;
+		afu->tlx_afu_resp_data_initial_credit = host->tlx_afu_resp_data_initial_credit;
+		afu->tlx_afu_resp_credit = host->tlx_afu_resp_credit;
+		afu->tlx_afu_cmd_credit = host->tlx_afu_cmd_credit;
+		afu->tlx_afu_resp_data_credit = host->tlx_afu_resp_data_credit;
+		afu->tlx_afu_cmd_data_credit = host->tlx_afu_cmd_data_credit;
+		afu->tlx_cfg_resp_ack = host->tlx_cfg_resp_ack;
+		if (afu->tlx_afu_cmd_credit == 1)
+			afu->tlx_afu_cmd_credits_available += 1;
+		if (afu->tlx_afu_resp_credit == 1)
+			afu->tlx_afu_resp_credits_available += 1;
+		if (afu->tlx_afu_cmd_data_credit == 1)
+			afu->tlx_afu_cmd_data_credits_available += 1;
+		if (afu->tlx_afu_resp_data_credit == 1)
+			afu->tlx_afu_resp_data_credits_available += 1;
+		host->tlx_afu_credit_valid = 0;
+		host->tlx_afu_cmd_credit = 0;
+		host->tlx_cfg_resp_ack = 0;
+		host->tlx_afu_cmd_data_credit = 0;
+		host->tlx_afu_resp_credit = 0;
+		host->tlx_afu_resp_data_credit = 0;
+	} else {
+		afu->tlx_afu_credit_valid = 0;
+		afu->tlx_afu_cmd_credit = 0;
+		afu->tlx_afu_resp_credit = 0;
+		afu->tlx_afu_cmd_data_credit = 0;
+		afu->tlx_afu_resp_data_credit = 0;
+	}
+}
+
+/* The other half, tlx_signal_tlx_model/tlx_get_afu_events */
+
+static void tlx_handoff_tlx_model(struct AFU_EVENT *afu, struct AFU_EVENT *host)
+{
+	// an AFU with nothing to say leaves the ocse side as it was
+	if (!afu->afu_tlx_cmd_valid && !afu->afu_tlx_cdata_valid &&
+	    !afu->afu_tlx_resp_valid && !afu->afu_tlx_rdata_valid &&
+	    !afu->cfg_tlx_resp_valid && !afu->afu_tlx_credit_req_valid)
+		return;
+
+	if (afu->afu_tlx_cmd_valid) {
+		host->afu_tlx_cmd_valid = 1;
+		host->tlx_afu_cmd_credit = 1;
+		host->tlx_afu_credit_valid = 1;
+		host->afu_tlx_cmd_opcode = afu->afu_tlx_cmd_opcode;
+		host->afu_tlx_cmd_actag = afu->afu_tlx_cmd_actag;
+		host->afu_tlx_cmd_stream_id = afu->afu_tlx_cmd_stream_id & 0x0f;
+		memcpy(host->afu_tlx_cmd_ea_or_obj, afu->afu_tlx_cmd_ea_or_obj, 9);
+		host->afu_tlx_cmd_afutag = afu->afu_tlx_cmd_afutag;
+		host->afu_tlx_cmd_dl = afu->afu_tlx_cmd_dl & 0x03;
+		host->afu_tlx_cmd_pl = afu->afu_tlx_cmd_pl & 0x07;
+#ifdef TLX4
+		host->afu_tlx_cmd_os = afu->afu_tlx_cmd_os & 0x01;
+#endif
+		host->afu_tlx_cmd_be = afu->afu_tlx_cmd_be;
+		host->afu_tlx_cmd_flag = afu->afu_tlx_cmd_flag & 0x0f;
+		host->afu_tlx_cmd_endian = afu->afu_tlx_cmd_endian & 0x01;
+		host->afu_tlx_cmd_bdf = afu->afu_tlx_cmd_bdf;
+		host->afu_tlx_cmd_pasid = afu->afu_tlx_cmd_pasid;
+		host->afu_tlx_cmd_pg_size = afu->afu_tlx_cmd_pg_size;
+		afu->afu_tlx_cmd_valid = 0;
+	} else {
+		host->afu_tlx_cmd_valid = 0;
+		host->tlx_afu_cmd_credit = 0;
+	}
+
+	if (afu->afu_tlx_cdata_valid) {
+		host->afu_tlx_cdata_valid = 1;
+		host->tlx_afu_cmd_data_credit = 1;
+		host->tlx_afu_credit_valid = 1;
+		host->afu_tlx_cdata_bdi = afu->afu_tlx_cdata_bdi & 0x01;
+		memcpy(host->afu_tlx_cdata_bus, afu->afu_tlx_cdata_bus, 64);
+		afu->afu_tlx_cdata_valid = 0;
+	} else {
+		host->afu_tlx_cdata_valid = 0;
+		host->tlx_afu_cmd_data_credit = 0;
+	}
+
+	if (afu->afu_tlx_resp_valid) {
+		host->afu_tlx_resp_valid = 1;
+		host->afu_tlx_resp_opcode = afu->afu_tlx_resp_opcode;
+		host->afu_tlx_resp_dl = afu->afu_tlx_resp_dl & 0x03;
+		host->afu_tlx_resp_capptag = afu->afu_tlx_resp_capptag;
+		host->afu_tlx_resp_dp = afu->afu_tlx_resp_dp & 0x03;
+		host->afu_tlx_resp_code = afu->afu_tlx_resp_code & 0x0f;
+		afu->afu_tlx_resp_valid = 0;
+	} else {
+		host->afu_tlx_resp_valid = 0;
+		host->tlx_afu_resp_credit = 0;
+	}
+
+	if (afu->afu_tlx_rdata_valid) {
+		host->afu_tlx_rdata_valid = 1;
+		host->afu_tlx_rdata_bdi = afu->afu_tlx_rdata_bdi & 0x01;
+		memcpy(host->afu_tlx_rdata_bus, afu->afu_tlx_rdata_bus, 64);
+		afu->afu_tlx_rdata_valid = 0;
+	} else {
+		host->afu_tlx_rdata_valid = 0;
+		host->tlx_afu_resp_data_credit = 0;
+	}
+
+	if (afu->cfg_tlx_resp_valid) {
+		host->cfg_tlx_resp_valid = 1;
+		host->cfg_tlx_resp_opcode = afu->cfg_tlx_resp_opcode;
+		host->cfg_tlx_resp_capptag = afu->cfg_tlx_resp_capptag;
+		host->cfg_tlx_resp_code = afu->cfg_tlx_resp_code & 0x0f;
+		host->cfg_tlx_rdata_bdi = afu->cfg_tlx_rdata_bdi & 0x01;
+		memcpy(host->cfg_tlx_rdata_bus, afu->cfg_tlx_rdata_bus, 4);
+		afu->cfg_tlx_resp_valid = 0;
+	} else {
+		host->cfg_tlx_resp_valid = 0;
+	}
+
+	if (afu->afu_tlx_credit_req_valid) {
+		host->afu_tlx_credit_req_valid = 1;
+		host->afu_tlx_resp_initial_credit = afu->afu_tlx_resp_initial_credit;
+		host->afu_tlx_cmd_initial_credit = afu->afu_tlx_cmd_initial_credit;
+		host->cfg_tlx_initial_credit = afu->cfg_tlx_initial_credit;
+		host->afu_tlx_resp_rd_req = afu->afu_tlx_resp_rd_req;
+		host->afu_tlx_resp_rd_cnt = afu->afu_tlx_resp_rd_cnt;
+		host->afu_tlx_cmd_rd_req = afu->afu_tlx_cmd_rd_req;
+		host->afu_tlx_cmd_rd_cnt = afu->afu_tlx_cmd_rd_cnt;
+		if (afu->afu_tlx_cmd_credit == 1)
+			host->afu_tlx_cmd_credits_available += 1;
+		if (afu->cfg_tlx_credit_return == 1)
+			host->cfg_tlx_credits_available += 1;
+		if (afu->afu_tlx_resp_credit == 1)
+			host->afu_tlx_resp_credits_available += 1;
+		host->afu_tlx_cmd_credit = 0;
+		host->cfg_tlx_credit_return = 0;
+		host->afu_tlx_resp_credit = 0;
+		afu->afu_tlx_credit_req_valid = 0;
+		afu->afu_tlx_cmd_credit = 0;
+		afu->cfg_tlx_credit_return = 0;
+		afu->afu_tlx_resp_credit = 0;
+	} else {
+		host->afu_tlx_credit_req_valid = 0;
+	}
+}
+
+void tlx_handoff_events(struct AFU_EVENT *host, struct AFU_EVENT *afu)
+{
+	uint8_t clock_only, cfg, cmd, resp;
+
+	// On a socket ocse sends its message before it reads the AFU's answer,
+	// and the AFU sends that answer before it reads ocse's message.  The
+	// credit returns are the only fields both halves touch, so do ocse's
+	// message first and hold back what it clears on the AFU side until the
+	// answer has taken the AFU's credit returns.
+	clock_only = !host->tlx_cfg_valid && !host->tlx_afu_cmd_valid &&
+	    !host->tlx_afu_cmd_data_valid && !host->tlx_afu_resp_valid &&
+	    !host->tlx_afu_resp_data_valid && !host->tlx_afu_credit_valid;
+	cfg = host->tlx_cfg_valid;
+	cmd = host->tlx_afu_cmd_valid;
+	resp = host->tlx_afu_resp_valid;
+
+	// a clock with nothing else leaves the AFU side as it was
+	if (!clock_only)
+		tlx_handoff_afu_model(host, afu);
+	tlx_handoff_tlx_model(afu, host);
+	if (clock_only)
+		return;
+	if (!cfg)
+		afu->cfg_tlx_credit_return = 0;
+	if (!cmd)
+		afu->afu_tlx_cmd_credit = 0;
+	if (!resp)
+		afu->afu_tlx_resp_credit = 0;
+}
+
+
 /* Call this from AFU to set the initial afu tlx_credit values */
 
 int afu_tlx_send_initial_credits(struct AFU_EVENT *event,
@@ -238,6 +238,15 @@ int tlx_get_afu_events(struct AFU_EVENT *event);
 
 int tlx_get_tlx_events(struct AFU_EVENT *event);
 
+/* For an AFU model linked into the ocse process.  host is ocse's AFU_EVENT and
+ * afu is the model's, each side keeps using its own exactly as with a socket.
+ * Call this once per clock instead of tlx_signal_afu_model and
+ * tlx_get_afu_events on the ocse side and tlx_get_tlx_events on the AFU side;
+ * it copies the fields directly with the same effect as the messages would
+ * have. */
+
+void tlx_handoff_events(struct AFU_EVENT *host, struct AFU_EVENT *afu);
+
 
 /* Call this from AFU to set the initial afu tlx_credit values */
 
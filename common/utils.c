@@ -26,6 +26,7 @@
 #include <unistd.h>
 
 #include "debug.h"
+#include "probe.h"
 #include "utils.h"
 
 #ifndef __APPLE__
@@ -147,8 +148,84 @@ void lock_delay(pthread_mutex_t * lock)
 	pthread_mutex_lock(lock);
 }
 
-// Is there incoming data on socket?
-int bytes_ready(int fd, int timeout, int *abort)
+// Per socket read ahead buffer.  get_bytes_silent fills it with everything
+// the socket has ready in one recv, then parses fields out of it, so a message
+// made of several fields costs one recv instead of a poll, a peek and a recv
+// per field.
+struct socket_buffer {
+	int head;
+	int tail;
+	int size;
+	uint8_t *data;
+};
+
+#define SOCKET_BUFFER_SIZE 4096
+
+static struct socket_buffer **socket_buffers = NULL;
+static int socket_buffers_max = 0;
+static pthread_mutex_t socket_buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Find the read ahead buffer for fd, allocating it on first use
+static struct socket_buffer *_socket_buffer(int fd)
+{
+	struct socket_buffer **buffers;
+	struct socket_buffer *sb;
+	int max;
+
+	if (fd < 0)
+		return NULL;
+
+	pthread_mutex_lock(&socket_buffers_lock);
+	if (fd >= socket_buffers_max) {
+		max = socket_buffers_max ? socket_buffers_max : 64;
+		while (fd >= max)
+			max *= 2;
+		buffers = (struct socket_buffer **)realloc(socket_buffers,
+				max * sizeof(struct socket_buffer *));
+		if (buffers == NULL) {
+			pthread_mutex_unlock(&socket_buffers_lock);
+			return NULL;
+		}
+		memset(&(buffers[socket_buffers_max]), 0,
+		       (max - socket_buffers_max) * sizeof(struct socket_buffer *));
+		socket_buffers = buffers;
+		socket_buffers_max = max;
+	}
+	sb = socket_buffers[fd];
+	if (sb == NULL) {
+		sb = (struct socket_buffer *)calloc(1, sizeof(struct socket_buffer));
+		if (sb != NULL)
+			sb->data = (uint8_t *)malloc(SOCKET_BUFFER_SIZE);
+		if ((sb != NULL) && (sb->data == NULL)) {
+			free(sb);
+			sb = NULL;
+		}
+		if (sb != NULL) {
+			sb->size = SOCKET_BUFFER_SIZE;
+			socket_buffers[fd] = sb;
+		}
+	}
+	pthread_mutex_unlock(&socket_buffers_lock);
+	return sb;
+}
+
+// Number of bytes already read from fd but not yet consumed
+int bytes_buffered(int fd)
+{
+	struct socket_buffer *sb;
+	int bytes = 0;
+
+	pthread_mutex_lock(&socket_buffers_lock);
+	if ((fd >= 0) && (fd < socket_buffers_max) && (socket_buffers[fd] != NULL)) {
+		sb = socket_buffers[fd];
+		bytes = sb->tail - sb->head;
+	}
+	pthread_mutex_unlock(&socket_buffers_lock);
+	return bytes;
+}
+
+// Is there incoming data on socket itself?
+static int _socket_ready(int fd, int timeout, int *abort)
 {
 	struct pollfd pfd;
 	int rc;
@@ -170,50 +247,81 @@ int bytes_ready(int fd, int timeout, int *abort)
 	return -1;
 }
 
+// Is there incoming data on socket?
+int bytes_ready(int fd, int timeout, int *abort)
+{
+	if (bytes_buffered(fd) > 0) {
+		if ((abort != NULL) && (*abort != 0))
+			return -1;
+		return 1;
+	}
+	return _socket_ready(fd, timeout, abort);
+}
+
 // Get bytes from socket
 int get_bytes_silent(int fd, int size, uint8_t * data, int timeout, int *abort)
 {
-	int count, bytes, rc;
+	struct socket_buffer *sb;
+	uint8_t *grow;
+	int count, rc;
 
-	bytes = 0;
-	while (bytes < size) {
-		// Check for socket activity
+	sb = _socket_buffer(fd);
+	if (sb == NULL) {
+		warn_msg("get_bytes_silent:No socket buffer");
+		return -1;
+	}
 
-		rc = bytes_ready(fd, timeout, abort);
+	// Nothing is consumed until all size bytes have arrived
+	while (sb->tail - sb->head < size) {
+		if (sb->head > 0) {
+			memmove(sb->data, &(sb->data[sb->head]), sb->tail - sb->head);
+			sb->tail -= sb->head;
+			sb->head = 0;
+		}
+		if (size > sb->size) {
+			grow = (uint8_t *)realloc(sb->data, size);
+			if (grow == NULL) {
+				warn_msg("get_bytes_silent:No socket buffer");
+				return -1;
+			}
+			sb->data = grow;
+			sb->size = size;
+		}
+
+		// Check for socket activity
+		rc = _socket_ready(fd, timeout, abort);
 		if (rc == 0) {
 			warn_msg("Socket timeout");
-			break;
+			return -1;
 		}
 		if (rc < 0) {
 			warn_msg("bytes_ready:Socket disconnect");
-			break;
+			return -1;
 		}
 
-		bytes = recv(fd, data, size - bytes, MSG_PEEK | MSG_DONTWAIT);
-		if (((bytes < 0) && (errno != EINTR)) || !bytes) {
+		count = recv(fd, &(sb->data[sb->tail]), sb->size - sb->tail, MSG_DONTWAIT);
+		if ((count < 0) && ((errno == EINTR) || (errno == EAGAIN)))
+			continue;
+		if (count <= 0) {
 			warn_msg("get_bytes_silent:Socket disconnect on recv");
 			return -1;
 		}
+		sb->tail += count;
 	}
 
-	if (bytes < size)
-		return -1;
+	if (data == NULL)
+		return 0;
 
-	bytes = 0;
-	while (data && (bytes < size)) {
-		count = recv(fd, &(data[bytes]), size, 0);
-		if (count <= 0) {
-			if (errno != EINTR)
-				break;
-			else
-				continue;
-		}
-		bytes += count;
+	memcpy(data, &(sb->data[sb->head]), size);
+	sb->head += size;
+	if (sb->head == sb->tail) {
+		sb->head = 0;
+		sb->tail = 0;
 	}
 
 #if DEBUG
 	DPRINTF("DEBUG:SOCKET IN:0x");
-	for (count = 0; count < bytes; count++)
+	for (count = 0; count < size; count++)
 		DPRINTF("%02x", data[count]);
 	DPRINTF("\n");
 #endif				/* DEBUG */
@@ -228,8 +336,10 @@ int get_bytes(int fd, int size, uint8_t * data, int timeout, int *abort,
 	int rc;
 
 	rc = get_bytes_silent(fd, size, data, timeout, abort);
-	if (rc == 0)
+	if (rc == 0) {
 		debug_socket_get(dbg_fp, dbg_id, context, data[0]);
+		OCSE_PROBE3(ocse, client_in, dbg_id, context, data[0]);
+	}
 	return rc;
 }
 
@@ -267,8 +377,10 @@ int put_bytes(int fd, int size, uint8_t * data, FILE * dbg_fp, uint8_t dbg_id,
 	int bytes;
 
 	bytes = put_bytes_silent(fd, size, data);
-	if (bytes == size)
+	if (bytes == size) {
 		debug_socket_put(dbg_fp, dbg_id, context, data[0]);
+		OCSE_PROBE4(ocse, client_out, dbg_id, context, data[0], size);
+	}
 
 	return bytes;
 }
@@ -315,6 +427,15 @@ int close_socket(int *sockfd)
 	char buffer[4096];
 	int yes = 1;
 
+	// Discard anything left in the read ahead buffer
+	pthread_mutex_lock(&socket_buffers_lock);
+	if ((*sockfd >= 0) && (*sockfd < socket_buffers_max) &&
+	    (socket_buffers[*sockfd] != NULL)) {
+		socket_buffers[*sockfd]->head = 0;
+		socket_buffers[*sockfd]->tail = 0;
+	}
+	pthread_mutex_unlock(&socket_buffers_lock);
+
 	// Shutdown socket traffic
 	if (shutdown(*sockfd, SHUT_RDWR))
 		return -1;
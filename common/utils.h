@@ -79,6 +79,7 @@
 #define OCSE_FIND                       0x30
 #define OCSE_FIND_NTH                   0x31
 #define OCSE_FIND_ACK                   0x32
+#define OCSE_STATS                      0x33
 
 #define OCSE_FAILED                     0xff
 
@@ -134,6 +135,9 @@ void lock_delay(pthread_mutex_t * lock);
 // Is there incoming data on socket?
 int bytes_ready(int fd, int timeout, int *abort);
 
+// Number of bytes already read from socket but not yet consumed
+int bytes_buffered(int fd);
+
 // Allocate memory for data and get size bytes from fd, no debug
 int get_bytes_silent(int fd, int size, uint8_t * data, int timeout, int *abort);
 
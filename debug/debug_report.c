@@ -0,0 +1,690 @@
+/*
+ * Copyright 2015,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Description: debug_report.c
+ *
+ *  Offline analyzer for the binary debug.log ocse writes (common/debug.h).
+ *  It streams through the log once, with memory that does not grow with the
+ *  log, and rebuilds per AFU (tlx port) and per client context:
+ *
+ *  - AFU commands: CMD_ADD to CMD_RESPONSE, split at the client request and
+ *    answer (CMD_CLIENT_REQ, CMD_CLIENT_ACK), matched by afutag
+ *  - MMIOs: MMIO_SEND to the next MMIO_ACK of the AFU, ocse has them in order
+ *  - client socket messages by type (SOCKET_PUT, SOCKET_GET)
+ *
+ *  and reports a timeline of completions and outstanding depth per interval,
+ *  throughput, latency percentiles and stalls, i.e. stretches in which an AFU
+ *  had work outstanding but nothing of it progressed.  Times come from the
+ *  DBG_HEADER_TIME records; a log without them is measured in records.
+ *
+ *  Usage: debug_report [-i interval_us] [-s stall_us] [-q] [debug.log]
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../common/debug.h"
+#include "../common/utils.h"
+
+#define MAX_AFUS 256
+#define MAX_TAGS 65536		// afutags are logged as 16 bits
+#define MMIO_QUEUE 64
+#define STALLS_KEPT 5
+
+// log-linear histogram: HIST_SUB buckets for every power of 2, good for
+// percentiles within 1/HIST_SUB whatever the range
+#define HIST_SUB_BITS 3
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (64 * HIST_SUB)
+
+struct hist {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t bucket[HIST_BUCKETS];
+};
+
+struct cmd_track {
+	int active;
+	uint16_t context;
+	uint16_t command;
+	uint64_t add;
+	uint64_t req;
+	int requested;
+};
+
+struct mmio_track {
+	uint64_t send;
+};
+
+struct stall {
+	uint64_t start;
+	uint64_t length;
+};
+
+struct context_stats {
+	uint64_t added;
+	uint64_t completed;
+	uint64_t failed;
+	uint64_t mmios;
+	uint64_t puts[256];
+	uint64_t gets[256];
+	struct hist total;
+	struct hist host;
+};
+
+struct afu_stats {
+	int seen;
+	uint64_t added;
+	uint64_t completed;
+	uint64_t failed;
+	uint64_t updates;
+	uint64_t superseded;	// afutag added again before its response
+	uint64_t buffer_reads;
+	uint64_t buffer_writes;
+	uint64_t mmio_added;
+	uint64_t mmio_sent;
+	uint64_t mmio_acked;
+	uint64_t mmio_returned;
+	uint64_t first;
+	uint64_t last;
+	struct cmd_track tag[MAX_TAGS];
+	int outstanding;
+	int max_outstanding;
+	struct mmio_track mmio[MMIO_QUEUE];
+	int mmio_head;
+	int mmio_count;
+	// stalls
+	uint64_t progress;
+	uint64_t stalls;
+	uint64_t stalled;
+	struct stall longest[STALLS_KEPT];
+	// timeline interval
+	uint64_t int_completed;
+	uint64_t int_added;
+	uint64_t int_mmios;
+	int int_max_outstanding;
+	// histograms
+	struct hist total;
+	struct hist host;
+	struct hist mmio_latency;
+	struct hist *opcode[256];
+	struct context_stats **context;
+	int contexts;
+};
+
+static struct afu_stats *afu[MAX_AFUS];
+static uint64_t now;		// ns, or records without DBG_HEADER_TIME
+static int have_time;
+static uint64_t records;
+static uint64_t interval = 1000000;
+static uint64_t stall_limit = 1000000;
+static int quiet;
+static uint64_t interval_end;
+
+static const char *unit(void)
+{
+	return have_time ? "us" : "records";
+}
+
+// Times are kept in ns and shown in us
+static double show(uint64_t value)
+{
+	return have_time ? value / 1000.0 : (double)value;
+}
+
+static void hist_add(struct hist *hist, uint64_t value)
+{
+	int exp, i;
+
+	if (value < HIST_SUB) {
+		i = value;
+	} else {
+		exp = 63 - __builtin_clzll(value);
+		i = ((exp - HIST_SUB_BITS + 1) << HIST_SUB_BITS) +
+		    ((value >> (exp - HIST_SUB_BITS)) & (HIST_SUB - 1));
+	}
+	hist->bucket[i]++;
+	if ((hist->count == 0) || (value < hist->min))
+		hist->min = value;
+	if (value > hist->max)
+		hist->max = value;
+	hist->count++;
+	hist->sum += value;
+}
+
+// Upper bound of bucket i
+static uint64_t hist_bound(int i)
+{
+	int exp;
+
+	if (i < HIST_SUB)
+		return i;
+	exp = (i >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+	return ((uint64_t) (HIST_SUB + (i & (HIST_SUB - 1)) + 1) <<
+		(exp - HIST_SUB_BITS)) - 1;
+}
+
+static uint64_t hist_percentile(struct hist *hist, double p)
+{
+	uint64_t want, seen;
+	int i;
+
+	want = (uint64_t) (hist->count * p / 100.0);
+	if (want >= hist->count)
+		want = hist->count - 1;
+	seen = 0;
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += hist->bucket[i];
+		if (seen > want)
+			break;
+	}
+	if (hist_bound(i) > hist->max)
+		return hist->max;
+	return hist_bound(i);
+}
+
+static void hist_print(const char *label, struct hist *hist)
+{
+	if (hist->count == 0)
+		return;
+	printf("    %-22s n=%-8" PRIu64 " min=%.1f avg=%.1f p50=%.1f p90=%.1f"
+	       " p99=%.1f max=%.1f %s\n", label, hist->count, show(hist->min),
+	       show(hist->sum / hist->count), show(hist_percentile(hist, 50)),
+	       show(hist_percentile(hist, 90)), show(hist_percentile(hist, 99)),
+	       show(hist->max), unit());
+}
+
+static struct afu_stats *get_afu(uint8_t id)
+{
+	if (afu[id] == NULL) {
+		afu[id] = (struct afu_stats *)calloc(1, sizeof(struct afu_stats));
+		if (afu[id] == NULL) {
+			perror("malloc");
+			exit(1);
+		}
+		afu[id]->first = now;
+	}
+	afu[id]->seen = 1;
+	afu[id]->last = now;
+	return afu[id];
+}
+
+static struct context_stats *get_context(struct afu_stats *a, uint16_t context)
+{
+	struct context_stats **grown;
+
+	if (context >= a->contexts) {
+		grown = (struct context_stats **)realloc(a->context,
+							 (context + 1) *
+							 sizeof(*grown));
+		if (grown == NULL) {
+			perror("malloc");
+			exit(1);
+		}
+		memset(grown + a->contexts, 0,
+		       (context + 1 - a->contexts) * sizeof(*grown));
+		a->context = grown;
+		a->contexts = context + 1;
+	}
+	if (a->context[context] == NULL) {
+		a->context[context] = (struct context_stats *)
+		    calloc(1, sizeof(struct context_stats));
+		if (a->context[context] == NULL) {
+			perror("malloc");
+			exit(1);
+		}
+	}
+	return a->context[context];
+}
+
+// Something outstanding on AFU a moved, account for the wait since the last
+// time anything did
+static void progress(struct afu_stats *a)
+{
+	uint64_t gap;
+	int i, j;
+
+	if ((a->outstanding + a->mmio_count) == 0) {
+		a->progress = now;
+		return;
+	}
+	gap = now - a->progress;
+	a->progress = now;
+	if (gap < stall_limit)
+		return;
+	a->stalls++;
+	a->stalled += gap;
+	for (i = 0; i < STALLS_KEPT; i++) {
+		if (gap > a->longest[i].length)
+			break;
+	}
+	if (i == STALLS_KEPT)
+		return;
+	for (j = STALLS_KEPT - 1; j > i; j--)
+		a->longest[j] = a->longest[j - 1];
+	a->longest[i].start = now - gap;
+	a->longest[i].length = gap;
+}
+
+static void outstanding(struct afu_stats *a, int delta)
+{
+	a->outstanding += delta;
+	if (a->outstanding > a->max_outstanding)
+		a->max_outstanding = a->outstanding;
+	if (a->outstanding > a->int_max_outstanding)
+		a->int_max_outstanding = a->outstanding;
+}
+
+// Timeline row per AFU for every interval in which it did anything
+static void timeline(uint64_t end)
+{
+	struct afu_stats *a;
+	int id;
+
+	for (id = 0; id < MAX_AFUS; id++) {
+		if (((a = afu[id]) == NULL) ||
+		    ((a->int_completed == 0) && (a->int_added == 0) &&
+		     (a->int_mmios == 0) && (a->outstanding == 0)))
+			continue;
+		if (!quiet)
+			printf("%12.1f tlx%x added=%-6" PRIu64 " done=%-6" PRIu64
+			       " mmio=%-5" PRIu64 " depth=%d max=%d\n",
+			       show(end), id, a->int_added, a->int_completed,
+			       a->int_mmios, a->outstanding,
+			       a->int_max_outstanding);
+		a->int_added = 0;
+		a->int_completed = 0;
+		a->int_mmios = 0;
+		a->int_max_outstanding = a->outstanding;
+	}
+}
+
+static void advance(uint64_t t)
+{
+	if (interval_end == 0)
+		interval_end = t + interval;
+	while (t >= interval_end) {
+		timeline(interval_end);
+		interval_end += interval;
+		// skip stretches without any record in one step
+		if (t >= interval_end + interval)
+			interval_end += ((t - interval_end) / interval) *
+			    interval;
+	}
+	now = t;
+}
+
+static void cmd_add(uint8_t id, uint16_t afutag, uint16_t context,
+		    uint16_t command)
+{
+	struct afu_stats *a = get_afu(id);
+	struct cmd_track *t = &(a->tag[afutag]);
+
+	progress(a);
+	if (t->active) {
+		a->superseded++;
+		outstanding(a, -1);
+	}
+	t->active = 1;
+	t->context = context;
+	t->command = command;
+	t->add = now;
+	t->requested = 0;
+	a->added++;
+	a->int_added++;
+	get_context(a, context)->added++;
+	outstanding(a, 1);
+}
+
+static void cmd_client(uint8_t id, uint16_t afutag, int ack)
+{
+	struct afu_stats *a = get_afu(id);
+	struct cmd_track *t = &(a->tag[afutag]);
+
+	if (!t->active)
+		return;
+	progress(a);
+	if (!ack) {
+		t->req = now;
+		t->requested = 1;
+	} else if (t->requested) {
+		hist_add(&(a->host), now - t->req);
+		hist_add(&(get_context(a, t->context)->host), now - t->req);
+		t->requested = 0;
+	}
+}
+
+static void cmd_response(uint8_t id, uint16_t afutag, uint8_t code)
+{
+	struct afu_stats *a = get_afu(id);
+	struct cmd_track *t = &(a->tag[afutag]);
+	struct context_stats *c;
+	uint64_t latency;
+
+	if (!t->active)
+		return;
+	progress(a);
+	c = get_context(a, t->context);
+	latency = now - t->add;
+	hist_add(&(a->total), latency);
+	hist_add(&(c->total), latency);
+	if (a->opcode[t->command & 0xff] == NULL)
+		a->opcode[t->command & 0xff] =
+		    (struct hist *)calloc(1, sizeof(struct hist));
+	if (a->opcode[t->command & 0xff] != NULL)
+		hist_add(a->opcode[t->command & 0xff], latency);
+	if (code) {
+		a->failed++;
+		c->failed++;
+	}
+	a->completed++;
+	a->int_completed++;
+	c->completed++;
+	t->active = 0;
+	outstanding(a, -1);
+}
+
+static void mmio_send(uint8_t id)
+{
+	struct afu_stats *a = get_afu(id);
+
+	progress(a);
+	a->mmio_sent++;
+	if (a->mmio_count == MMIO_QUEUE)
+		return;
+	a->mmio[(a->mmio_head + a->mmio_count) % MMIO_QUEUE].send = now;
+	a->mmio_count++;
+}
+
+// Reads are acked twice, once for the response and once for the data, only
+// the first ack after a send is timed
+static void mmio_ack(uint8_t id)
+{
+	struct afu_stats *a = get_afu(id);
+
+	a->mmio_acked++;
+	if (a->mmio_count == 0)
+		return;
+	progress(a);
+	a->int_mmios++;
+	hist_add(&(a->mmio_latency), now - a->mmio[a->mmio_head].send);
+	a->mmio_head = (a->mmio_head + 1) % MMIO_QUEUE;
+	a->mmio_count--;
+}
+
+static int parse(FILE * fp)
+{
+	DBG_HEADER header;
+	uint8_t id, b0, b1;
+	uint16_t tag, context, value;
+	uint32_t w0, w1;
+	uint64_t ns;
+	struct afu_stats *a;
+
+	while (1) {
+		header = debug_get_header(fp);
+		if ((header == (DBG_HEADER) - 1) && feof(fp))
+			return 0;
+		records++;
+		if (!have_time)
+			advance(records);
+		switch (header) {
+		case DBG_HEADER_TIME:
+			if (debug_get_64(fp, &ns) != 1)
+				return -1;
+			if (!have_time) {
+				// times from here on, forget the record counts
+				have_time = 1;
+				interval_end = 0;
+			}
+			advance(ns);
+			break;
+		case DBG_HEADER_VERSION:
+			if ((debug_get_8(fp, &b0) != 1) ||
+			    (debug_get_8(fp, &b1) != 1))
+				return -1;
+			if (!quiet)
+				printf("OCSE version %d.%03d\n", b0, b1);
+			break;
+		case DBG_HEADER_PARM:
+			if ((debug_get_32(fp, &w0) != 1) ||
+			    (debug_get_32(fp, &w1) != 1))
+				return -1;
+			break;
+		case DBG_HEADER_SOCKET_PUT:
+		case DBG_HEADER_SOCKET_GET:
+			if ((debug_get_8(fp, &id) != 1) ||
+			    (debug_get_8(fp, &b0) != 1) ||
+			    (debug_get_16(fp, &context) != 1))
+				return -1;
+			a = get_afu(id);
+			if (header == DBG_HEADER_SOCKET_PUT)
+				get_context(a, context)->puts[b0]++;
+			else
+				get_context(a, context)->gets[b0]++;
+			break;
+		case DBG_HEADER_AFU_CONNECT:
+		case DBG_HEADER_AFU_DROP:
+		case DBG_HEADER_MMIO_ACK:
+			if (debug_get_8(fp, &id) != 1)
+				return -1;
+			if (header == DBG_HEADER_MMIO_ACK)
+				mmio_ack(id);
+			else
+				get_afu(id);
+			break;
+		case DBG_HEADER_CONTEXT_ADD:
+		case DBG_HEADER_CONTEXT_REMOVE:
+		case DBG_HEADER_MMIO_MAP:
+		case DBG_HEADER_MMIO_RETURN:
+			if ((debug_get_8(fp, &id) != 1) ||
+			    (debug_get_16(fp, &context) != 1))
+				return -1;
+			a = get_afu(id);
+			get_context(a, context);
+			if (header == DBG_HEADER_MMIO_RETURN)
+				a->mmio_returned++;
+			break;
+		case DBG_HEADER_MMIO_ADD:
+		case DBG_HEADER_MMIO_SEND:
+			if ((debug_get_8(fp, &id) != 1) ||
+			    (debug_get_8(fp, &b0) != 1) ||
+			    (debug_get_8(fp, &b1) != 1) ||
+			    (debug_get_16(fp, &context) != 1) ||
+			    (debug_get_32(fp, &w0) != 1))
+				return -1;
+			// MMIO_SEND logs the config flag as context
+			if (header == DBG_HEADER_MMIO_ADD) {
+				a = get_afu(id);
+				a->mmio_added++;
+				get_context(a, context)->mmios++;
+			} else {
+				mmio_send(id);
+			}
+			break;
+		case DBG_HEADER_CMD_ADD:
+		case DBG_HEADER_CMD_UPDATE:
+			if ((debug_get_8(fp, &id) != 1) ||
+			    (debug_get_16(fp, &tag) != 1) ||
+			    (debug_get_16(fp, &context) != 1) ||
+			    (debug_get_16(fp, &value) != 1))
+				return -1;
+			if (header == DBG_HEADER_CMD_ADD)
+				cmd_add(id, tag, context, value);
+			else
+				get_afu(id)->updates++;
+			break;
+		case DBG_HEADER_CMD_CLIENT_REQ:
+		case DBG_HEADER_CMD_CLIENT_ACK:
+			if ((debug_get_8(fp, &id) != 1) ||
+			    (debug_get_16(fp, &tag) != 1) ||
+			    (debug_get_16(fp, &context) != 1))
+				return -1;
+			cmd_client(id, tag,
+				   header == DBG_HEADER_CMD_CLIENT_ACK);
+			break;
+		case DBG_HEADER_CMD_BUFFER_WRITE:
+		case DBG_HEADER_CMD_BUFFER_READ:
+			if ((debug_get_8(fp, &id) != 1) ||
+			    (debug_get_16(fp, &tag) != 1))
+				return -1;
+			if (header == DBG_HEADER_CMD_BUFFER_WRITE)
+				get_afu(id)->buffer_writes++;
+			else
+				get_afu(id)->buffer_reads++;
+			break;
+		case DBG_HEADER_CMD_RESPONSE:
+			// cmd.c logs the response opcode, then the code
+			if ((debug_get_8(fp, &id) != 1) ||
+			    (debug_get_16(fp, &tag) != 1) ||
+			    (debug_get_8(fp, &b0) != 1) ||
+			    (debug_get_8(fp, &b1) != 1))
+				return -1;
+			cmd_response(id, tag, b1);
+			break;
+		default:
+			fprintf(stderr, "Unknown record 0x%02x at record %"
+				PRIu64 "\n", header, records);
+			return -1;
+		}
+	}
+}
+
+static void report_afu(int id, struct afu_stats *a)
+{
+	struct context_stats *c;
+	struct stall *s;
+	char label[32];
+	double span;
+	int i, j;
+
+	if (id == 0xff)
+		printf("\nocse\n");	// client messages before a port is known
+	else
+		printf("\ntlx%x\n", id);
+	span = show(a->last - a->first);
+	printf("  commands: added=%" PRIu64 " completed=%" PRIu64 " failed=%"
+	       PRIu64 " updated=%" PRIu64 " superseded=%" PRIu64
+	       " outstanding=%d max depth=%d\n", a->added, a->completed,
+	       a->failed, a->updates, a->superseded, a->outstanding,
+	       a->max_outstanding);
+	printf("  mmio: added=%" PRIu64 " sent=%" PRIu64 " acked=%" PRIu64
+	       " returned=%" PRIu64 "\n", a->mmio_added, a->mmio_sent,
+	       a->mmio_acked, a->mmio_returned);
+	if (have_time && (span > 0))
+		printf("  throughput over %.1f us: %.0f commands/s %.0f mmio/s\n",
+		       span, a->completed * 1000000.0 / span,
+		       a->mmio_acked * 1000000.0 / span);
+	hist_print("command total", &(a->total));
+	hist_print("command client trip", &(a->host));
+	hist_print("mmio afu trip", &(a->mmio_latency));
+	for (i = 0; i < 256; i++) {
+		if (a->opcode[i] == NULL)
+			continue;
+		snprintf(label, sizeof(label), "opcode 0x%02x total", i);
+		hist_print(label, a->opcode[i]);
+	}
+	printf("  stalls over %.1f %s: %" PRIu64 " for %.1f %s\n",
+	       show(stall_limit), unit(), a->stalls, show(a->stalled), unit());
+	for (i = 0; i < STALLS_KEPT; i++) {
+		s = &(a->longest[i]);
+		if (s->length == 0)
+			break;
+		printf("    at %.1f for %.1f %s\n", show(s->start),
+		       show(s->length), unit());
+	}
+	for (i = 0; i < a->contexts; i++) {
+		if ((c = a->context[i]) == NULL)
+			continue;
+		printf("  context %d: added=%" PRIu64 " completed=%" PRIu64
+		       " failed=%" PRIu64 " mmio=%" PRIu64 "\n", i, c->added,
+		       c->completed, c->failed, c->mmios);
+		if (have_time && (span > 0) && c->completed)
+			printf("    throughput %.0f commands/s\n",
+			       c->completed * 1000000.0 / span);
+		hist_print("command total", &(c->total));
+		hist_print("command client trip", &(c->host));
+		for (j = 0; j < 256; j++) {
+			if (c->puts[j] || c->gets[j])
+				printf("    socket type 0x%02x: out=%" PRIu64
+				       " in=%" PRIu64 "\n", j, c->puts[j],
+				       c->gets[j]);
+		}
+	}
+}
+
+static void usage(char *name)
+{
+	fprintf(stderr, "Usage: %s [-i interval_us] [-s stall_us] [-q] "
+		"[debug.log]\n", name);
+	fprintf(stderr, "  -i  timeline interval, default 1000\n");
+	fprintf(stderr, "  -s  report waits this long as stalls, default 1000\n");
+	fprintf(stderr, "  -q  no timeline, summary only\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	char *path;
+	FILE *fp;
+	int opt, id, rc;
+
+	while ((opt = getopt(argc, argv, "i:s:q")) != -1) {
+		switch (opt) {
+		case 'i':
+			interval = strtoull(optarg, NULL, 0) * 1000;
+			break;
+		case 's':
+			stall_limit = strtoull(optarg, NULL, 0) * 1000;
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (interval == 0)
+		usage(argv[0]);
+	path = "debug.log";
+	if (optind < argc)
+		path = argv[optind];
+	if ((fp = fopen(path, "r")) == NULL) {
+		perror(path);
+		return 1;
+	}
+	setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+	rc = parse(fp);
+	if (rc < 0)
+		fprintf(stderr, "%s: truncated or corrupt after %" PRIu64
+			" records\n", path, records);
+	timeline(now);
+	fclose(fp);
+
+	printf("\n%" PRIu64 " records, %.1f %s\n", records, show(now), unit());
+	for (id = 0; id < MAX_AFUS; id++) {
+		if (afu[id] && afu[id]->seen)
+			report_afu(id, afu[id]);
+	}
+	return rc < 0;
+}
@@ -0,0 +1,239 @@
+/*
+ * Copyright 2015,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Description: ocse_stats.c
+ *
+ *  Print the live counters of a running ocse (ocse/stats.c) without
+ *  disturbing it.  Connects like an application, to the server in
+ *  $OCSE_SERVER_DAT or ocse_server.dat, and sends OCSE_STATS.  With -i the
+ *  counters are fetched every interval seconds, each shown with its change
+ *  per second since the last fetch, -n limits how many times.
+ *
+ *  Usage: ocse_stats [-i interval] [-n count]
+ */
+
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/utils.h"
+
+#define MAX_COUNTERS 4096
+
+struct counter {
+	char name[64];
+	uint64_t value;
+};
+
+static struct counter counter[MAX_COUNTERS];
+static int counters;
+
+static int ocse_connect(void)
+{
+	char *path, *host, *port;
+	char line[MAX_LINE_CHARS];
+	struct sockaddr_in addr;
+	struct hostent *he;
+	uint8_t buffer[6];
+	FILE *fp;
+	int fd;
+
+	path = getenv("OCSE_SERVER_DAT");
+	if (!path)
+		path = "ocse_server.dat";
+	if ((fp = fopen(path, "r")) == NULL) {
+		perror(path);
+		return -1;
+	}
+	do {
+		if (fgets(line, sizeof(line), fp) == NULL) {
+			fprintf(stderr, "%s: no server\n", path);
+			fclose(fp);
+			return -1;
+		}
+	} while (line[0] == '#');
+	fclose(fp);
+	host = line;
+	if ((port = strchr(line, ':')) == NULL) {
+		fprintf(stderr, "%s: expected host:port\n", path);
+		return -1;
+	}
+	*port++ = '\0';
+
+	if ((he = gethostbyname(host)) == NULL) {
+		herror(host);
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	memcpy(&addr.sin_addr, he->h_addr_list[0], he->h_length);
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(atoi(port));
+	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+		perror("socket");
+		return -1;
+	}
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("connect");
+		close(fd);
+		return -1;
+	}
+
+	memcpy(buffer, "OCSE", 4);
+	buffer[4] = OCSE_VERSION_MAJOR;
+	buffer[5] = OCSE_VERSION_MINOR;
+	if ((put_bytes_silent(fd, 6, buffer) != 6) ||
+	    (get_bytes_silent(fd, 3, buffer, 10000, 0) < 0) ||
+	    (buffer[0] != OCSE_CONNECT)) {
+		fprintf(stderr, "ocse refused the connection\n");
+		close_socket(&fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Fetch the counters, returns the text or NULL
+static char *fetch(int fd)
+{
+	uint8_t buffer[5];
+	uint32_t length;
+	char *text;
+
+	buffer[0] = OCSE_STATS;
+	if ((put_bytes_silent(fd, 1, buffer) != 1) ||
+	    (get_bytes_silent(fd, 5, buffer, 10000, 0) < 0) ||
+	    (buffer[0] != OCSE_STATS)) {
+		fprintf(stderr, "no answer from ocse\n");
+		return NULL;
+	}
+	memcpy(&length, &(buffer[1]), sizeof(length));
+	length = ntohl(length);
+	if ((text = (char *)malloc(length + 1)) == NULL) {
+		perror("malloc");
+		return NULL;
+	}
+	if (get_bytes_silent(fd, length, (uint8_t *) text, 10000, 0) < 0) {
+		fprintf(stderr, "short answer from ocse\n");
+		free(text);
+		return NULL;
+	}
+	text[length] = '\0';
+	return text;
+}
+
+// Print every "<port> <counter> <value>" line, with its rate if seconds
+static void show(char *text, double seconds)
+{
+	char *line, *next, *value;
+	struct counter *c;
+	uint64_t now;
+	int i;
+
+	for (line = text; *line; line = next) {
+		if ((next = strchr(line, '\n')) != NULL)
+			*next++ = '\0';
+		else
+			next = line + strlen(line);
+		if ((value = strrchr(line, ' ')) == NULL)
+			continue;
+		*value++ = '\0';
+		now = strtoull(value, NULL, 0);
+		c = NULL;
+		for (i = 0; i < counters; i++) {
+			if (!strcmp(counter[i].name, line)) {
+				c = &(counter[i]);
+				break;
+			}
+		}
+		if ((c == NULL) && (counters < MAX_COUNTERS)) {
+			c = &(counter[counters++]);
+			snprintf(c->name, sizeof(c->name), "%s", line);
+			c->value = now;
+		}
+		if ((seconds > 0) && c && (now >= c->value))
+			printf("%-36s %14" PRIu64 " %12.1f/s\n", line, now,
+			       (now - c->value) / seconds);
+		else
+			printf("%-36s %14" PRIu64 "\n", line, now);
+		if (c)
+			c->value = now;
+	}
+}
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(char *name)
+{
+	fprintf(stderr, "Usage: %s [-i interval] [-n count]\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	double interval, start, last, t;
+	char *text;
+	int opt, fd, count, i;
+
+	interval = 0;
+	count = 0;
+	while ((opt = getopt(argc, argv, "i:n:")) != -1) {
+		switch (opt) {
+		case 'i':
+			interval = atof(optarg);
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (interval <= 0)
+		count = 1;
+
+	if ((fd = ocse_connect()) < 0)
+		return 1;
+	start = last = now_seconds();
+	for (i = 0; (count == 0) || (i < count); i++) {
+		if (i)
+			usleep(interval * 1000000);
+		if ((text = fetch(fd)) == NULL) {
+			close_socket(&fd);
+			return 1;
+		}
+		t = now_seconds();
+		if (interval > 0)
+			printf("--- %.1f s\n", t - start);
+		show(text, i ? t - last : 0);
+		fflush(stdout);
+		last = t;
+		free(text);
+	}
+	close_socket(&fd);
+	return 0;
+}
@@ -0,0 +1,373 @@
+/*
+ * Copyright 2015,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Description: tlx_bench.c
+ *
+ *  Time the TLX frame codec (common/tlx_interface.c) on its own.  A TLX side
+ *  and an AFU side AFU_EVENT are joined by a socketpair and clocked in one
+ *  thread, each cycle:
+ *
+ *      tlx_signal_afu_model(tlx)   encode and send the TLX frame
+ *      tlx_get_tlx_events(afu)     receive and decode it, then encode and
+ *                                  send the AFU frame (tlx_signal_tlx_model)
+ *      tlx_get_afu_events(tlx)     receive and decode the AFU frame
+ *
+ *  with the traffic of a mix valid on both sides:
+ *
+ *      clock   nothing but the clock
+ *      cmd     TLX command with data, AFU command with data
+ *      resp    TLX response with data, AFU response with data
+ *      credit  credits both ways
+ *
+ *  Every decoded frame is checked against what was sent.  For each mix the
+ *  bytes per frame, the ns spent in each call, ns per frame and frames per
+ *  second (a cycle is two frames) are printed.
+ *
+ *  Usage: tlx_bench [-n cycles] [-m mix] [-d data_bytes]
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/tlx_interface.h"
+
+#define WARMUP 1000
+
+enum mix {
+	MIX_CLOCK,
+	MIX_CMD,
+	MIX_RESP,
+	MIX_CREDIT,
+	MIXES
+};
+
+static char *mix_name[MIXES] = { "clock", "cmd", "resp", "credit" };
+
+// Data bytes the TLX side sends with a command or response, the AFU side
+// always sends 64
+static int data_bytes = 64;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Make the traffic of mix valid on both sides for cycle
+static void load(enum mix mix, uint32_t cycle, struct AFU_EVENT *tlx,
+		 struct AFU_EVENT *afu)
+{
+	int i;
+
+	switch (mix) {
+	case MIX_CLOCK:
+		tlx->tlx_afu_credit_valid = 0;
+		break;
+	case MIX_CMD:
+		tlx->tlx_afu_cmd_valid = 1;
+		tlx->tlx_afu_cmd_opcode = TLX_CMD_PR_WR_MEM;
+		tlx->tlx_afu_cmd_capptag = cycle & 0xffff;
+		tlx->tlx_afu_cmd_dl = 1;
+		tlx->tlx_afu_cmd_pl = 3;
+		tlx->tlx_afu_cmd_be = ~0ull;
+		tlx->tlx_afu_cmd_pa = 0x1000 + ((uint64_t) cycle << 6);
+		tlx->tlx_afu_cmd_data_valid = 1;
+		tlx->tlx_afu_cmd_data_byte_cnt = data_bytes;
+		for (i = 0; i < data_bytes; i++)
+			tlx->tlx_afu_cmd_data_bus[i] = cycle + i;
+		afu->afu_tlx_cmd_valid = 1;
+		afu->afu_tlx_cmd_opcode = AFU_CMD_DMA_W;
+		afu->afu_tlx_cmd_actag = 1;
+		afu->afu_tlx_cmd_afutag = cycle & 0xffff;
+		afu->afu_tlx_cmd_dl = 1;
+		for (i = 0; i < 9; i++)
+			afu->afu_tlx_cmd_ea_or_obj[i] = cycle >> (i & 3);
+		afu->afu_tlx_cmd_pasid = cycle & 0xfffff;
+		afu->afu_tlx_cdata_valid = 1;
+		for (i = 0; i < 64; i++)
+			afu->afu_tlx_cdata_bus[i] = cycle - i;
+		break;
+	case MIX_RESP:
+		tlx->tlx_afu_resp_valid = 1;
+		tlx->tlx_afu_resp_opcode = TLX_RSP_READ_RESP;
+		tlx->tlx_afu_resp_afutag = cycle & 0xffff;
+		tlx->tlx_afu_resp_dl = 1;
+		tlx->tlx_afu_resp_data_valid = 1;
+		tlx->tlx_afu_resp_data_byte_cnt = data_bytes;
+		for (i = 0; i < data_bytes; i++)
+			tlx->tlx_afu_resp_data[i] = cycle + i;
+		afu->afu_tlx_resp_valid = 1;
+		afu->afu_tlx_resp_opcode = AFU_RSP_MEM_RD_RESP;
+		afu->afu_tlx_resp_capptag = cycle & 0xffff;
+		afu->afu_tlx_resp_dl = 1;
+		afu->afu_tlx_rdata_valid = 1;
+		for (i = 0; i < 64; i++)
+			afu->afu_tlx_rdata_bus[i] = cycle - i;
+		break;
+	case MIX_CREDIT:
+		tlx->tlx_afu_credit_valid = 1;
+		tlx->tlx_afu_resp_credit = 1;
+		tlx->tlx_afu_cmd_credit = 1;
+		tlx->tlx_afu_resp_data_credit = 1;
+		tlx->tlx_afu_cmd_data_credit = 1;
+		afu->afu_tlx_credit_req_valid = 1;
+		afu->afu_tlx_resp_credit = 1;
+		afu->afu_tlx_cmd_credit = 1;
+		afu->afu_tlx_resp_rd_cnt = cycle & 0x7;
+		afu->afu_tlx_cmd_rd_cnt = cycle & 0x7;
+		break;
+	default:
+		break;
+	}
+}
+
+// Check the frames of cycle arrived, returns what is wrong or NULL
+static char *check(enum mix mix, uint32_t cycle, struct AFU_EVENT *tlx,
+		   struct AFU_EVENT *afu)
+{
+	int i;
+
+	switch (mix) {
+	case MIX_CMD:
+		if (!afu->tlx_afu_cmd_valid ||
+		    (afu->tlx_afu_cmd_capptag != (cycle & 0xffff)) ||
+		    (afu->tlx_afu_cmd_pa != 0x1000 + ((uint64_t) cycle << 6)))
+			return "tlx_afu_cmd";
+		if (!afu->tlx_afu_cmd_data_valid)
+			return "tlx_afu_cmd_data";
+		for (i = 0; i < data_bytes; i++)
+			if (afu->tlx_afu_cmd_data_bus[i] != (uint8_t) (cycle + i))
+				return "tlx_afu_cmd_data";
+		if (!tlx->afu_tlx_cmd_valid ||
+		    (tlx->afu_tlx_cmd_afutag != (cycle & 0xffff)) ||
+		    (tlx->afu_tlx_cmd_pasid != (cycle & 0xfffff)))
+			return "afu_tlx_cmd";
+		if (!tlx->afu_tlx_cdata_valid)
+			return "afu_tlx_cdata";
+		for (i = 0; i < 64; i++)
+			if (tlx->afu_tlx_cdata_bus[i] != (uint8_t) (cycle - i))
+				return "afu_tlx_cdata";
+		break;
+	case MIX_RESP:
+		if (!afu->tlx_afu_resp_valid ||
+		    (afu->tlx_afu_resp_afutag != (cycle & 0xffff)))
+			return "tlx_afu_resp";
+		if (!afu->tlx_afu_resp_data_valid)
+			return "tlx_afu_resp_data";
+		for (i = 0; i < data_bytes; i++)
+			if (afu->tlx_afu_resp_data[i] != (uint8_t) (cycle + i))
+				return "tlx_afu_resp_data";
+		if (!tlx->afu_tlx_resp_valid ||
+		    (tlx->afu_tlx_resp_capptag != (cycle & 0xffff)))
+			return "afu_tlx_resp";
+		if (!tlx->afu_tlx_rdata_valid)
+			return "afu_tlx_rdata";
+		for (i = 0; i < 64; i++)
+			if (tlx->afu_tlx_rdata_bus[i] != (uint8_t) (cycle - i))
+				return "afu_tlx_rdata";
+		break;
+	case MIX_CREDIT:
+		if (!afu->tlx_afu_credit_valid || (afu->tlx_afu_cmd_credit != 1))
+			return "tlx_afu_credit";
+		if (!tlx->afu_tlx_credit_req_valid ||
+		    (tlx->afu_tlx_cmd_rd_cnt != (cycle & 0x7)))
+			return "afu_tlx_credit";
+		break;
+	default:
+		break;
+	}
+	return NULL;
+}
+
+// Bytes of the frame in tbuf, as the receiving side counts them
+static int frame_bytes(unsigned char *tbuf, int from_tlx)
+{
+	int bytes;
+
+	if (tbuf[0] == (from_tlx ? 0x40 : 0x10))
+		return 1;
+	bytes = 5;
+	if (from_tlx) {
+		if (tbuf[0] & 0x20)
+			bytes += 18;
+		if (tbuf[0] & 0x10)
+			bytes += 22;
+		if (tbuf[0] & 0x08)
+			bytes += 1 + ((tbuf[1] << 8) | tbuf[2]);
+		if (tbuf[0] & 0x04)
+			bytes += 7;
+		if (tbuf[0] & 0x02)
+			bytes += 1 + ((tbuf[3] << 8) | tbuf[4]);
+		if (tbuf[0] & 0x01)
+			bytes += 9;
+	} else {
+		if (tbuf[0] & 0x02)
+			bytes += 34;
+		if (tbuf[0] & 0x04)
+			bytes += 1 + ((tbuf[1] << 8) | tbuf[2]);
+		if (tbuf[0] & 0x08)
+			bytes += 6;
+		if (tbuf[0] & 0x20)
+			bytes += 1 + ((tbuf[3] << 8) | tbuf[4]);
+		if (tbuf[0] & 0x40)
+			bytes += 9;
+		if (tbuf[0] & 0x01)
+			bytes += 10;
+	}
+	return bytes;
+}
+
+// Clock cycles of mix, print its line, returns 0 or -1
+static int bench(enum mix mix, uint32_t cycles)
+{
+	struct AFU_EVENT *tlx, *afu;
+	uint64_t ns[3], t0, t1, t2, t3, total;
+	uint32_t cycle;
+	int fd[2], tlx_bytes, afu_bytes;
+	char *wrong;
+
+	tlx = (struct AFU_EVENT *)malloc(sizeof(struct AFU_EVENT));
+	afu = (struct AFU_EVENT *)malloc(sizeof(struct AFU_EVENT));
+	if (!tlx || !afu) {
+		perror("malloc");
+		return -1;
+	}
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd) < 0) {
+		perror("socketpair");
+		return -1;
+	}
+	tlx_event_reset(tlx);
+	tlx_event_reset(afu);
+	tlx->sockfd = fd[0];
+	afu->sockfd = fd[1];
+
+	memset(ns, 0, sizeof(ns));
+	wrong = NULL;
+	for (cycle = 0; cycle < WARMUP + cycles; cycle++) {
+		load(mix, cycle, tlx, afu);
+		t0 = now_ns();
+		if (tlx_signal_afu_model(tlx) != TLX_SUCCESS) {
+			wrong = "tlx_signal_afu_model";
+			break;
+		}
+		t1 = now_ns();
+		if (tlx_get_tlx_events(afu) != 1) {
+			wrong = "tlx_get_tlx_events";
+			break;
+		}
+		t2 = now_ns();
+		if (tlx_get_afu_events(tlx) != 1) {
+			wrong = "tlx_get_afu_events";
+			break;
+		}
+		t3 = now_ns();
+		if ((wrong = check(mix, cycle, tlx, afu)) != NULL)
+			break;
+		if (cycle < WARMUP)
+			continue;
+		ns[0] += t1 - t0;
+		ns[1] += t2 - t1;
+		ns[2] += t3 - t2;
+	}
+
+	// Frame sizes of the last cycle, every cycle of a mix is the same
+	tlx_bytes = frame_bytes(tlx->tbuf, 1);
+	afu_bytes = frame_bytes(afu->tbuf, 0);
+	close(fd[0]);
+	close(fd[1]);
+	free(tlx);
+	free(afu);
+	if (wrong) {
+		fprintf(stderr, "%s: cycle %u: %s failed\n", mix_name[mix],
+			cycle, wrong);
+		return -1;
+	}
+
+	total = ns[0] + ns[1] + ns[2];
+	printf("%-7s %6d %6d %9.1f %9.1f %9.1f %9.1f %12.0f\n",
+	       mix_name[mix], tlx_bytes, afu_bytes,
+	       (double)ns[0] / cycles, (double)ns[1] / cycles,
+	       (double)ns[2] / cycles, (double)total / (2.0 * cycles),
+	       (2.0 * cycles) / (total / 1e9));
+	return 0;
+}
+
+static void usage(char *name)
+{
+	fprintf(stderr, "Usage: %s [-n cycles] [-m clock|cmd|resp|credit] "
+		"[-d data_bytes]\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t cycles;
+	int opt, mix, only, rc;
+
+	cycles = 1000000;
+	only = -1;
+	while ((opt = getopt(argc, argv, "n:m:d:")) != -1) {
+		switch (opt) {
+		case 'n':
+			cycles = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			for (only = 0; only < MIXES; only++)
+				if (!strcmp(optarg, mix_name[only]))
+					break;
+			if (only == MIXES)
+				usage(argv[0]);
+			break;
+		case 'd':
+			data_bytes = atoi(optarg);
+			if ((data_bytes != 64) && (data_bytes != 128) &&
+			    (data_bytes != 256)) {
+				fprintf(stderr, "data_bytes is 64, 128 or 256\n");
+				exit(1);
+			}
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (cycles == 0)
+		usage(argv[0]);
+
+	// signal is tlx_signal_afu_model, get_tlx is tlx_get_tlx_events
+	// including the AFU's reply, get_afu is tlx_get_afu_events, all ns
+	// per cycle
+	printf("%u cycles, %d data bytes from TLX\n", cycles, data_bytes);
+	printf("%-7s %6s %6s %9s %9s %9s %9s %12s\n", "mix", "tlx_B",
+	       "afu_B", "signal", "get_tlx", "get_afu", "ns/frame",
+	       "frames/s");
+	rc = 0;
+	for (mix = 0; mix < MIXES; mix++) {
+		if ((only >= 0) && (mix != only))
+			continue;
+		if (bench(mix, cycles) < 0)
+			rc = 1;
+		fflush(stdout);
+	}
+	return rc;
+}
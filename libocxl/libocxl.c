@@ -19,24 +19,31 @@
 // then mmio helpers
 // then lpc helpers
 
+#define _GNU_SOURCE  // for process_vm_readv
+
 #include <arpa/inet.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 #include <limits.h>
 
 #include "libocxl_internal.h"
 #include "libocxl.h"
+#include "../common/probe.h"
 #include "../common/utils.h"
 
 #define API_VERSION            1
@@ -66,8 +73,18 @@
 
 #define DSISR 0x4000000040000000L
 #define ERR_BUFF_MAX_COPY_SIZE 4096
+#define OCXL_REACTOR_EVENTS 64
 
 static ocxl_wait_event *ocxl_wait_list = NULL;
+static struct ocxl_mem_region *ocxl_mem_regions = NULL;
+static pthread_mutex_t ocxl_mem_lock = PTHREAD_MUTEX_INITIALIZER;
+static int ocxl_mem_probe = 1;
+static pthread_t ocxl_reactor_thread;
+static pthread_mutex_t ocxl_reactor_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ocxl_reactor_cond = PTHREAD_COND_INITIALIZER;
+static struct ocxl_afu *ocxl_reactor_afus = NULL;
+static int ocxl_reactor_epfd = -1;
+static int ocxl_reactor_pipe[2] = { -1, -1 };
 
 static int _delay_1ms()
 {
@@ -77,10 +94,50 @@ static int _delay_1ms()
 	return nanosleep(&ts, &ts);
 }
 
-static int _testmemaddr(uint8_t * memaddr)
+// Is the host memory range at memaddr safe for the afu to access?
+// Registered regions are trusted without any system call.  Otherwise the first
+// and last byte of the range are probed with a single process_vm_readv, which
+// fails cleanly on unmapped memory instead of faulting.  If process_vm_readv is
+// not permitted (e.g. by a seccomp policy) fall back to writing the first byte
+// into a pipe.
+static int _testmemaddr(uint8_t * memaddr, uint64_t size)
 {
+	struct ocxl_mem_region *region;
+	struct iovec local, remote[2];
+	uint8_t probe[2];
+	uint64_t start, end;
 	int fd[2];
 	int ret = 0;
+
+	if (size == 0)
+		size = 1;
+	start = (uint64_t)memaddr;
+	end = start + size;
+
+	pthread_mutex_lock(&ocxl_mem_lock);
+	for (region = ocxl_mem_regions; region != NULL; region = region->_next) {
+		if ((start >= region->start) && (end <= region->end)) {
+			pthread_mutex_unlock(&ocxl_mem_lock);
+			return 1;
+		}
+	}
+	pthread_mutex_unlock(&ocxl_mem_lock);
+
+	if (ocxl_mem_probe) {
+		local.iov_base = probe;
+		local.iov_len = 2;
+		remote[0].iov_base = memaddr;
+		remote[0].iov_len = 1;
+		remote[1].iov_base = memaddr + size - 1;
+		remote[1].iov_len = 1;
+		if (process_vm_readv(getpid(), &local, 1, remote, 2, 0) == 2)
+			return 1;
+		if ((errno != ENOSYS) && (errno != EPERM))
+			return 0;
+		debug_msg("_testmemaddr: process_vm_readv not permitted, using pipe probe");
+		ocxl_mem_probe = 0;
+	}
+
 	if (pipe(fd) >= 0) {
 		if (write(fd[1], memaddr, 1) > 0)
 			ret = 1;
@@ -186,35 +243,105 @@ static void _all_idle(struct ocxl_afu *afu_h)
 	afu_h->opened = 0;
 }
 
+// non zero if an event of this type is already queued on the afu
+// called with event_lock held
+static int _event_queued(struct ocxl_afu *afu, ocxl_event_type type)
+{
+	struct ocxl_event_entry *entry;
+
+	for (entry = afu->events; entry != NULL; entry = entry->_next)
+		if (entry->event.type == type)
+			return 1;
+	return 0;
+}
+
+// add an event of this type to the end of the afu event queue and return it
+// for the caller to fill in, NULL if out of memory
+// called with event_lock held
+static ocxl_event *_queue_event(struct ocxl_afu *afu, ocxl_event_type type)
+{
+	struct ocxl_event_entry *entry;
+
+	entry = (struct ocxl_event_entry *)calloc(1, sizeof(struct ocxl_event_entry));
+	if (entry == NULL) {
+		perror("calloc");
+		return NULL;
+	}
+	entry->event.type = type;
+	if (afu->events_last != NULL)
+		afu->events_last->_next = entry;
+	else
+		afu->events = entry;
+	afu->events_last = entry;
+	return &(entry->event);
+}
+
+// tell the application an event is queued through the afu event fd
+// called with event_lock held
+static int _signal_event(struct ocxl_afu *afu, ocxl_event *event)
+{
+	int i;
+
+	do {
+		i = write(afu->pipe[1], &(event->type), 1);
+	}
+	while ((i == 0) || ((i < 0) && (errno == EINTR)));
+	return i;
+}
+
 static int _handle_dsi(struct ocxl_afu *afu, uint64_t addr)
 {
+	ocxl_event *event;
 	int i;
 
 	if (!afu)
 		fatal_msg("NULL afu passed to libocxl.c:_handle_dsi");
 	// Only track a single DSI at a time
 	pthread_mutex_lock(&(afu->event_lock));
-	i = 0;
-	while (afu->events[i] != NULL) {
-		if (afu->events[i]->type == OCXL_EVENT_TRANSLATION_FAULT) {
-			pthread_mutex_unlock(&(afu->event_lock));
-			return 0;
-		}
-		++i;
+	if (_event_queued(afu, OCXL_EVENT_TRANSLATION_FAULT)) {
+		pthread_mutex_unlock(&(afu->event_lock));
+		return 0;
+	}
+
+	event = _queue_event(afu, OCXL_EVENT_TRANSLATION_FAULT);
+	if (event == NULL) {
+		pthread_mutex_unlock(&(afu->event_lock));
+		// the failure is still reported to the afu
+		warn_msg("_handle_dsi: no memory, translation fault event dropped");
+		return 0;
 	}
-	assert(i < EVENT_QUEUE_MAX);
+	// event->header.size = size;
+	// event->header.process_element = afu->context;
+	event->translation_fault.addr = (void *)(addr & FOURK_MASK);
+	event->translation_fault.dsisr = DSISR;
 
-	afu->events[i] = (struct ocxl_event *)calloc(1, sizeof( ocxl_event ) );
-	afu->events[i]->type = OCXL_EVENT_TRANSLATION_FAULT;
-	// afu->events[i]->header.size = size;
-	// afu->events[i]->header.process_element = afu->context;
-	afu->events[i]->translation_fault.addr = (void *)(addr & FOURK_MASK);
-	afu->events[i]->translation_fault.dsisr = DSISR;
+	i = _signal_event(afu, event);
+	pthread_mutex_unlock(&(afu->event_lock));
+	return i;
+}
 
-	do {
-		i = write(afu->pipe[1], &(afu->events[i]->type), 1);
+// post the completion of an asynchronous lpc copy on the afu event queue
+static int _handle_lpc_copy_event(struct ocxl_afu *afu, struct lpc_copy *copy)
+{
+	ocxl_event *event;
+	int i;
+
+	if (!afu)
+		fatal_msg("NULL afu passed to libocxl.c:_handle_lpc_copy_event");
+	pthread_mutex_lock(&(afu->event_lock));
+	event = _queue_event(afu, OCXL_EVENT_LPC_COPY);
+	if (event == NULL) {
+		pthread_mutex_unlock(&(afu->event_lock));
+		warn_msg("_handle_lpc_copy_event: no memory for the lpc copy completion");
+		return -1;
 	}
-	while ((i == 0) || (errno == EINTR));
+	event->lpc_copy.data = copy->data;
+	event->lpc_copy.offset = copy->offset;
+	event->lpc_copy.size = copy->size;
+	event->lpc_copy.arg = copy->arg;
+	event->lpc_copy.status = copy->status;
+
+	i = _signal_event(afu, event);
 	pthread_mutex_unlock(&(afu->event_lock));
 	return i;
 }
@@ -259,6 +386,7 @@ static int _handle_wake_host_thread(struct ocxl_afu *afu)
 
 	debug_msg("_handle_wake_host_thread: waking @ 0x%016llx -> 0x%04x", (uint64_t)this_wait_event, addr);
 	this_wait_event->received = 1;
+	OCSE_PROBE1(libocxl, wake_host_thread, afu->context);
 	
 	return 0;
 }
@@ -268,6 +396,7 @@ static int _handle_interrupt(struct ocxl_afu *afu, uint8_t data_is_valid)
 
 	uint16_t data_size;
 	struct ocxl_irq *irq;
+	ocxl_event *event;
 	uint64_t addr;
 	uint8_t cmd_flag;
 	uint8_t adata[8];
@@ -343,33 +472,31 @@ static int _handle_interrupt(struct ocxl_afu *afu, uint8_t data_is_valid)
 	// should that be saved or coalecsed?
 	// this code would coalesce them
 	pthread_mutex_lock(&(afu->event_lock));
-	i = 0;
-	while (afu->events[i] != NULL) {
-		if (afu->events[i]->type == OCXL_EVENT_IRQ) {
-			// we could search deeper here to see if this event is for the
-			// incoming irq.  if it is, increment count and return, if not, check the next event
-			pthread_mutex_unlock(&(afu->event_lock));
-			return 0;
-		}
-		++i;
+	// we could search deeper here to see if the queued irq event is for the
+	// incoming irq.  if it is, increment count and return
+	if (_event_queued(afu, OCXL_EVENT_IRQ)) {
+		pthread_mutex_unlock(&(afu->event_lock));
+		return 0;
 	}
-	assert(i < EVENT_QUEUE_MAX);
 
-	afu->events[i] = (ocxl_event *)calloc(1, sizeof( ocxl_event ) );
-	afu->events[i]->type = OCXL_EVENT_IRQ;
-	//afu->events[i]->header.size = size;
-	//afu->events[i]->header.process_element = afu->context; // might not need this
-	afu->events[i]->irq.irq = irq->irq;  // which came in and matched irq
-	afu->events[i]->irq.handle = addr;  // which came in and matched irq
-	afu->events[i]->irq.count = 1;  
+	event = _queue_event(afu, OCXL_EVENT_IRQ);
+	if (event == NULL) {
+		pthread_mutex_unlock(&(afu->event_lock));
+		// the message is consumed, so the afu stays usable
+		warn_msg("_handle_interrupt: no memory, irq event dropped");
+		return 0;
+	}
+	//event->header.size = size;
+	//event->header.process_element = afu->context; // might not need this
+	event->irq.irq = irq->irq;  // which came in and matched irq
+	event->irq.handle = addr;  // which came in and matched irq
+	event->irq.count = 1;  
+	OCSE_PROBE2(libocxl, interrupt, afu->context, irq->irq);
 	// should we store data from an interrupt d at the info pointer?
-	// afu->events[i]->irq.flags = cmd_flag;
+	// event->irq.flags = cmd_flag;
 	// notice we don't put ddata anywhere - that is because we don't have a place for it in Power ISA's interrupt scheme
 
-	do {
-		i = write(afu->pipe[1], &(afu->events[i]->type), 1);
-	}
-	while ((i == 0) || (errno == EINTR));
+	i = _signal_event(afu, event);
 	pthread_mutex_unlock(&(afu->event_lock));
 	return i;
 }
@@ -382,7 +509,7 @@ static void _handle_read(struct ocxl_afu *afu, uint64_t addr, uint16_t size)
 	DPRINTF("_handle_read: addr @ 0x%016" PRIx64 ", size = %d\n", addr, size);
 	if (!afu)
 		fatal_msg("NULL afu passed to libocxl.c:_handle_read");
-	if (!_testmemaddr((uint8_t *) addr)) {
+	if (!_testmemaddr((uint8_t *) addr, size)) {
 		if (_handle_dsi(afu, addr) < 0) {
 			perror("DSI Failure");
 			return;
@@ -414,7 +541,7 @@ static void _handle_write_be(struct ocxl_afu *afu, uint64_t addr, uint16_t size,
 
 	if (!afu)
 		fatal_msg("NULL afu passed to libocxl.c:_handle_write_be");
-	if (!_testmemaddr((uint8_t *) addr)) {
+	if (!_testmemaddr((uint8_t *) addr, 64)) {
 		if (_handle_dsi(afu, addr) < 0) {
 			perror("DSI Failure");
 			return;
@@ -457,7 +584,7 @@ static void _handle_write(struct ocxl_afu *afu, uint64_t addr, uint16_t size,
 
 	if (!afu)
 		fatal_msg("NULL afu passed to libocxl.c:_handle_write");
-	if (!_testmemaddr((uint8_t *) addr)) {
+	if (!_testmemaddr((uint8_t *) addr, size)) {
 		if (_handle_dsi(afu, addr) < 0) {
 			perror("DSI Failure");
 			return;
@@ -485,7 +612,7 @@ static void _handle_touch(struct ocxl_afu *afu, uint64_t addr, uint8_t function_
 // TODO check pg size; decide if to fail cmd for various other reasons and send back a fail resp code
 	if (!afu)
 		fatal_msg("NULL afu passed to libocxl.c:_handle_touch");
-	if (!_testmemaddr((uint8_t *) addr)) {
+	if (!_testmemaddr((uint8_t *) addr, 1)) {
 		if (_handle_dsi(afu, addr) < 0) {
 			perror("DSI Failure");
 			return;
@@ -519,7 +646,6 @@ static void _handle_ack(struct ocxl_afu *afu)
 		warn_msg("Socket failure getting resp_code");
 		_all_idle(afu);
 	} 
-
 	if (resp_code !=0) // TODO update this to handle resp code retry requests
 		warn_msg ("handle_ack: AFU sent RD or WR FAILED response code = 0x%d ", resp_code);
 
@@ -559,6 +685,7 @@ static void _handle_ack(struct ocxl_afu *afu)
 			debug_msg("KEM:0x%08x", afu->mmio.data);
 		}
 	}
+	OCSE_PROBE2(libocxl, request_complete, afu->context, afu->mmio.type);
 	afu->mmio.state = LIBOCXL_REQ_IDLE;
 }
 
@@ -578,7 +705,7 @@ static void _handle_DMO_OPs(struct ocxl_afu *afu, uint8_t amo_op, uint8_t op_siz
 
 	if (!afu)
 		fatal_msg("NULL afu passed to libocxl.c:_handle_DMO_OPs");
-	if (!_testmemaddr((uint8_t *) addr)) {
+	if (!_testmemaddr((uint8_t *) addr, op_size)) {
 		if (_handle_dsi(afu, addr) < 0) {
 			perror("DSI Failure");
 			return;
@@ -1266,7 +1393,7 @@ static void _mem_map(struct ocxl_afu *afu)
 	return;
 }
 
-static void _mem_read(struct ocxl_afu *afu)
+static void _mem_read(struct ocxl_afu *afu, struct mem_req *mem)
 {
 	uint8_t *buffer;
 	int buffer_length;
@@ -1286,16 +1413,16 @@ static void _mem_read(struct ocxl_afu *afu)
 	buffer = (uint8_t *)malloc( buffer_length );
 
 	debug_msg("_mem_read: buffer[0]");
-	buffer[0] = afu->mem.type;
+	buffer[0] = mem->type;
 
 	buffer_offset = 1;
 	debug_msg( "_mem_read: buffer[%d]", buffer_offset );
-	offset = htonl(afu->mem.addr);
+	offset = htonl(mem->addr);
 	memcpy( (char *)&(buffer[buffer_offset]), (char *)&offset, sizeof(offset));
 	buffer_offset += sizeof(offset);
 
 	debug_msg( "_mem_read: buffer[%d]", buffer_offset );
-	size = htonl(afu->mem.size);
+	size = htonl(mem->size);
 	memcpy((char *)&(buffer[buffer_offset]), (char *)&size, sizeof(size));
 
 	if (put_bytes_silent(afu->fd, buffer_length, buffer) != buffer_length) {
@@ -1303,15 +1430,15 @@ static void _mem_read(struct ocxl_afu *afu)
 		close_socket(&(afu->fd));
 		afu->opened = 0;
 		afu->attached = 0;
-		afu->mem.state = LIBOCXL_REQ_IDLE;
+		mem->state = LIBOCXL_REQ_IDLE;
 		return;
 	}
 
 	free(buffer);
-	afu->mem.state = LIBOCXL_REQ_PENDING;
+	mem->state = LIBOCXL_REQ_PENDING;
 }
 
-static void _mem_write(struct ocxl_afu *afu)
+static void _mem_write(struct ocxl_afu *afu, struct mem_req *mem)
 {
 	uint8_t *buffer;
 	int buffer_length;
@@ -1326,38 +1453,38 @@ static void _mem_write(struct ocxl_afu *afu)
 		fatal_msg("NULL afu passed to libocxl.c:_mem_write");
 
 	// buffer length = 1 byte for type, buffer remainder?, 4 bytes for offset, n bytes for size, m bytes for data
-	buffer_length = 1 + sizeof(offset) + sizeof(size) + afu->mem.size;
+	buffer_length = 1 + sizeof(offset) + sizeof(size) + mem->size;
 	debug_msg("_mem_write: buffer length %d", buffer_length);
 	buffer = (uint8_t *)malloc( buffer_length );
 
 	debug_msg("_mem_write: buffer[0]");
-	buffer[0] = afu->mem.type;
+	buffer[0] = mem->type;
 
 	buffer_offset = 1;
 	debug_msg( "_mem_write: buffer[%d]", buffer_offset );
-	offset = htonl(afu->mem.addr); 
+	offset = htonl(mem->addr); 
 	memcpy( (char *)&(buffer[buffer_offset]), (char *)&offset, sizeof(offset));
 	buffer_offset += sizeof(offset);
 
 	debug_msg( "_mem_write: buffer[%d]", buffer_offset );
-	size = htonl(afu->mem.size);
+	size = htonl(mem->size);
 	memcpy((char *)&(buffer[buffer_offset]), (char *)&size, sizeof(size));
 	buffer_offset += sizeof(size);
 
 	// data = htonll(afu->mmio.data);
 	debug_msg( "_mem_write: buffer[%d]", buffer_offset );
-	memcpy( (char *)&(buffer[buffer_offset]), afu->mem.data, afu->mem.size );
+	memcpy( (char *)&(buffer[buffer_offset]), mem->data, mem->size );
 	if (put_bytes_silent(afu->fd, buffer_length, buffer) != buffer_length) {
 		free(buffer);
 		close_socket(&(afu->fd));
 		afu->opened = 0;
 		afu->attached = 0;
-		afu->mem.state = LIBOCXL_REQ_IDLE;
+		mem->state = LIBOCXL_REQ_IDLE;
 		return;
 	}
 
 	free(buffer);
-	afu->mem.state = LIBOCXL_REQ_PENDING;
+	mem->state = LIBOCXL_REQ_PENDING;
 }
 
 static void _mem_write_be(struct ocxl_afu *afu)
@@ -1409,6 +1536,126 @@ static void _mem_write_be(struct ocxl_afu *afu)
 	afu->mem.state = LIBOCXL_REQ_PENDING;
 }
 
+// the largest naturally aligned stride of at most 256 bytes at addr
+static int _lpc_stride(uint64_t addr, uint64_t remainder)
+{
+	int stride;
+
+	stride = 1;
+	while ((stride < 256) && ((addr & stride) == 0))
+		stride = stride * 2;
+	while (stride > remainder)
+		stride = stride / 2;
+
+	return stride;
+}
+
+// complete the copies at the head of the list once all of their bytes are
+// acknowledged.  a waiting caller frees its own copy, otherwise run the
+// callback or post an event
+static void _lpc_copy_done(struct ocxl_afu *afu)
+{
+	struct lpc_copy *copy;
+
+	while (1) {
+		pthread_mutex_lock(&(afu->lpc_lock));
+		copy = afu->lpc_copies;
+		if ((copy == NULL) || (copy->queued != copy->size) ||
+		    (copy->acked != copy->size)) {
+			pthread_mutex_unlock(&(afu->lpc_lock));
+			return;
+		}
+		afu->lpc_copies = copy->_next;
+		if (afu->lpc_copies == NULL)
+			afu->lpc_last = NULL;
+		if (afu->lpc_queue == copy)
+			afu->lpc_queue = copy->_next;
+		pthread_mutex_unlock(&(afu->lpc_lock));
+
+		debug_msg("_lpc_copy_done: %d bytes at lpc offset 0x%016lx", copy->size, copy->offset);
+		if (copy->wait) {
+			copy->state = LIBOCXL_REQ_IDLE;
+			continue;
+		}
+		if (copy->callback != NULL) {
+			ocxl_event_lpc_copy done;
+
+			done.data = copy->data;
+			done.offset = copy->offset;
+			done.size = copy->size;
+			done.arg = copy->arg;
+			done.status = copy->status;
+			copy->callback((ocxl_afu_h)afu, &done);
+		} else {
+			_handle_lpc_copy_event(afu, copy);
+		}
+		free(copy);
+	}
+}
+
+// split queued copies into legally aligned and sized strides while there
+// is room in the stride ring
+static void _lpc_copy_strides(struct ocxl_afu *afu)
+{
+	struct lpc_copy *copy;
+	struct mem_req *mem;
+	uint64_t addr;
+	int stride;
+
+	pthread_mutex_lock(&(afu->lpc_lock));
+	while ((copy = afu->lpc_queue) != NULL) {
+		if (copy->queued == copy->size) {
+			afu->lpc_queue = copy->_next;
+			continue;
+		}
+		if (afu->lpc_tail - afu->lpc_head >= LPC_STRIDES_MAX)
+			break;
+		addr = copy->offset + copy->queued;
+		stride = _lpc_stride(addr, copy->size - copy->queued);
+		mem = &(afu->lpc[afu->lpc_tail % LPC_STRIDES_MAX]);
+		mem->type = copy->type;
+		mem->addr = addr;
+		mem->size = stride;
+		mem->be = 0;
+		mem->data = copy->data + copy->queued;
+		mem->copy = copy;
+		mem->state = LIBOCXL_REQ_REQUEST;
+		copy->queued += stride;
+		afu->lpc_tail++;
+	}
+	pthread_mutex_unlock(&(afu->lpc_lock));
+
+	// a zero length copy has nothing to wait for
+	_lpc_copy_done(afu);
+}
+
+// complete the oldest lpc stride in flight, read data goes straight to the
+// caller's buffer
+static void _handle_lpc_ack(struct ocxl_afu *afu, uint8_t resp_code)
+{
+	struct mem_req *mem;
+
+	mem = &(afu->lpc[afu->lpc_head % LPC_STRIDES_MAX]);
+	// a failed stride fails its copy, ocse sends no data with it
+	if (resp_code != 0)
+		warn_msg("_handle_lpc_ack: AFU sent RD or WR FAILED response code = 0x%x at lpc offset 0x%016lx",
+			 resp_code, mem->addr);
+	else if (mem->type == OCSE_LPC_READ) {
+		debug_msg("_handle_lpc_ack: getting %d bytes from socket", mem->size);
+		if (get_bytes_silent(afu->fd, mem->size, mem->data, 1000, 0) < 0) {
+			warn_msg("Socket failure getting LPC Ack data");
+			_all_idle(afu);
+		}
+	}
+	if (resp_code != 0)
+		mem->copy->status = OCXL_INTERNAL_ERROR;
+	mem->copy->acked += mem->size;
+	OCSE_PROBE2(libocxl, request_complete, afu->context, mem->type);
+	mem->state = LIBOCXL_REQ_IDLE;
+	afu->lpc_head++;
+	_lpc_copy_done(afu);
+}
+
 static void _handle_mem_ack(struct ocxl_afu *afu)
 {
 	uint8_t resp_code;
@@ -1422,6 +1669,10 @@ static void _handle_mem_ack(struct ocxl_afu *afu)
 		warn_msg("Socket failure getting resp_code");
 		_all_idle(afu);
 	} 
+	if (afu->lpc_head != afu->lpc_send) {
+		_handle_lpc_ack(afu, resp_code);
+		return;
+	}
 	if (resp_code !=0) // TODO update this to handle resp code retry requests
 		error_msg ("handle_mem_ack: AFU sent RD or WR FAILED response code = 0x%d ", resp_code);
 	if ( afu->mem.type == OCSE_LPC_READ ) {
@@ -1435,13 +1686,88 @@ static void _handle_mem_ack(struct ocxl_afu *afu)
 		}
 	}
 
+	OCSE_PROBE2(libocxl, request_complete, afu->context, afu->mem.type);
 	afu->mem.state = LIBOCXL_REQ_IDLE;
 }
 
 
-static void *_psl_loop(void *ptr)
+// post any requests the api functions have left for ocse on this afu's socket
+static void _psl_requests(struct ocxl_afu *afu)
+{
+	struct mem_req *mem;
+
+	if (!afu)
+		fatal_msg("NULL afu passed to libocxl.c:_psl_requests");
+
+	if (afu->int_req.state == LIBOCXL_REQ_REQUEST)
+		_req_max_int(afu);
+	if (afu->attach.state == LIBOCXL_REQ_REQUEST)
+		_ocse_attach(afu);
+	if (afu->mmio.state == LIBOCXL_REQ_REQUEST) {
+		OCSE_PROBE3(libocxl, request_submit, afu->context,
+			    afu->mmio.type, afu->mmio.addr);
+		switch (afu->mmio.type) {
+		case OCSE_MMIO_MAP:
+		case OCSE_GLOBAL_MMIO_MAP:
+			_mmio_map(afu);
+			break;
+		case OCSE_MMIO_WRITE64:
+		case OCSE_GLOBAL_MMIO_WRITE64:
+			_mmio_write64(afu);
+			break;
+		case OCSE_MMIO_WRITE32:
+		case OCSE_GLOBAL_MMIO_WRITE32:
+			_mmio_write32(afu);
+			break;
+		case OCSE_MMIO_READ64:
+		case OCSE_MMIO_READ32:	
+		case OCSE_GLOBAL_MMIO_READ64:
+		case OCSE_GLOBAL_MMIO_READ32: /*fall through */
+			_mmio_read(afu);
+			break;
+		default:
+			break;
+		}
+	}
+	if (afu->mem.state == LIBOCXL_REQ_REQUEST) {
+		OCSE_PROBE3(libocxl, request_submit, afu->context,
+			    afu->mem.type, afu->mem.addr);
+		switch (afu->mem.type) {
+		case OCSE_LPC_MAP:
+			_mem_map(afu);
+			break;
+		case OCSE_LPC_WRITE:
+			_mem_write(afu, &(afu->mem));
+			break;
+		case OCSE_LPC_WRITE_BE:
+			_mem_write_be(afu);
+			break;
+		case OCSE_LPC_READ:
+			_mem_read(afu, &(afu->mem));
+			break;
+		default:
+			break;
+		}
+	}
+	// send every lpc stride queued since the last pass, the acks come
+	// back in the order the strides were sent
+	_lpc_copy_strides(afu);
+	while (afu->opened && (afu->lpc_send != afu->lpc_tail)) {
+		mem = &(afu->lpc[afu->lpc_send % LPC_STRIDES_MAX]);
+		OCSE_PROBE3(libocxl, request_submit, afu->context, mem->type,
+			    mem->addr);
+		if (mem->type == OCSE_LPC_READ)
+			_mem_read(afu, mem);
+		else
+			_mem_write(afu, mem);
+		afu->lpc_send++;
+	}
+}
+
+// process one message from ocse on this afu's socket
+// returns -1 if the socket has failed and the afu should no longer be serviced
+static int _psl_message(struct ocxl_afu *afu)
 {
-	struct ocxl_afu *afu = (struct ocxl_afu *)ptr;
 	uint8_t buffer[MAX_LINE_CHARS];
 	uint8_t op_size, function_code, amo_op, cmd_endian, cmd_pg_size;
 	uint64_t addr, wr_be;
@@ -1455,454 +1781,609 @@ static void *_psl_loop(void *ptr)
 	int offset;
 
 	if (!afu)
-		fatal_msg("NULL afu passed to libocxl.c:_psl_loop");
-	afu->opened = 1;
-
-	while (afu->opened) {
-		_delay_1ms();
-		// Send any requests to OCSE over socket
-		if (afu->int_req.state == LIBOCXL_REQ_REQUEST)
-			_req_max_int(afu);
-		if (afu->attach.state == LIBOCXL_REQ_REQUEST)
-			_ocse_attach(afu);
-		if (afu->mmio.state == LIBOCXL_REQ_REQUEST) {
-			switch (afu->mmio.type) {
-			case OCSE_MMIO_MAP:
-			case OCSE_GLOBAL_MMIO_MAP:
-				_mmio_map(afu);
-				break;
-			case OCSE_MMIO_WRITE64:
-			case OCSE_GLOBAL_MMIO_WRITE64:
-				_mmio_write64(afu);
-				break;
-			case OCSE_MMIO_WRITE32:
-			case OCSE_GLOBAL_MMIO_WRITE32:
-				_mmio_write32(afu);
-				break;
-			case OCSE_MMIO_READ64:
-			case OCSE_MMIO_READ32:	
-			case OCSE_GLOBAL_MMIO_READ64:
-			case OCSE_GLOBAL_MMIO_READ32: /*fall through */
-				_mmio_read(afu);
-				break;
-			default:
-				break;
-			}
-		}
-		if (afu->mem.state == LIBOCXL_REQ_REQUEST) {
-			switch (afu->mem.type) {
-			case OCSE_LPC_MAP:
-				_mem_map(afu);
-				break;
-			case OCSE_LPC_WRITE:
-				_mem_write(afu);
-				break;
-			case OCSE_LPC_WRITE_BE:
-				_mem_write_be(afu);
-				break;
-			case OCSE_LPC_READ:
-				_mem_read(afu);
-				break;
-			default:
-				break;
-			}
-		}
+		fatal_msg("NULL afu passed to libocxl.c:_psl_message");
+
+	// Process socket input from OCSE
+	rc = bytes_ready(afu->fd, 1000, 0);
+	if (rc == 0)
+		return 0;
+	if (rc < 0) {
+		warn_msg("Socket failure testing bytes_ready");
+		_all_idle(afu);
+		return -1;
+	}
+	if (get_bytes_silent(afu->fd, 1, buffer, 1000, 0) < 0) {
+		warn_msg("Socket failure getting OCL event");
+		_all_idle(afu);
+		return -1;
+	}
 
-		// Process socket input from OCSE
-		rc = bytes_ready(afu->fd, 1000, 0);
-		if (rc == 0)
-			continue;
-		if (rc < 0) {
-			warn_msg("Socket failure testing bytes_ready");
+	debug_msg("OCL EVENT = 0x%02x", buffer[0]);
+	OCSE_PROBE2(libocxl, message, afu->context, buffer[0]);
+	switch (buffer[0]) {
+	case OCSE_OPEN:
+		if (get_bytes_silent(afu->fd, 1, buffer, 1000, 0) < 0) {
+			warn_msg("Socket failure getting OPEN context");
 			_all_idle(afu);
 			break;
 		}
-		if (get_bytes_silent(afu->fd, 1, buffer, 1000, 0) < 0) {
-			warn_msg("Socket failure getting OCL event");
+		afu->context = (uint16_t) buffer[0];
+		afu->open.state = LIBOCXL_REQ_IDLE;
+		break;
+	case OCSE_ATTACH:
+		afu->attach.state = LIBOCXL_REQ_IDLE;
+		break;
+	case OCSE_DETACH:
+	        info_msg("detach response from ocse");
+		afu->mapped = 0;
+		afu->global_mapped = 0;
+		afu->attached = 0;
+		afu->opened = 0;
+		afu->open.state = LIBOCXL_REQ_IDLE;
+		afu->attach.state = LIBOCXL_REQ_IDLE;
+		afu->mmio.state = LIBOCXL_REQ_IDLE;
+		afu->mem.state = LIBOCXL_REQ_IDLE;
+		afu->int_req.state = LIBOCXL_REQ_IDLE;
+		break;
+	case OCSE_MAX_INT:
+		size = sizeof(uint16_t);
+		if (get_bytes_silent(afu->fd, size, buffer, 1000, 0) <
+		    0) {
+			warn_msg
+			    ("Socket failure getting max interrupt acknowledge");
 			_all_idle(afu);
 			break;
 		}
-
-		debug_msg("OCL EVENT = 0x%02x", buffer[0]);
-		switch (buffer[0]) {
-		case OCSE_OPEN:
-			if (get_bytes_silent(afu->fd, 1, buffer, 1000, 0) < 0) {
-				warn_msg("Socket failure getting OPEN context");
-				_all_idle(afu);
-				break;
-			}
-			afu->context = (uint16_t) buffer[0];
-			afu->open.state = LIBOCXL_REQ_IDLE;
-			break;
-		case OCSE_ATTACH:
-			afu->attach.state = LIBOCXL_REQ_IDLE;
-			break;
-		case OCSE_DETACH:
-		        info_msg("detach response from ocse");
-			afu->mapped = 0;
-			afu->global_mapped = 0;
-			afu->attached = 0;
-			afu->opened = 0;
-			afu->open.state = LIBOCXL_REQ_IDLE;
-			afu->attach.state = LIBOCXL_REQ_IDLE;
-			afu->mmio.state = LIBOCXL_REQ_IDLE;
-			afu->mem.state = LIBOCXL_REQ_IDLE;
-			afu->int_req.state = LIBOCXL_REQ_IDLE;
-			break;
-		case OCSE_MAX_INT:
-			size = sizeof(uint16_t);
-			if (get_bytes_silent(afu->fd, size, buffer, 1000, 0) <
-			    0) {
-				warn_msg
-				    ("Socket failure getting max interrupt acknowledge");
-				_all_idle(afu);
-				break;
-			}
-			memcpy((char *)&value, (char *)buffer,
-			       sizeof(uint16_t));
-			// afu->irqs_max = ntohs(value);
-			afu->int_req.state = LIBOCXL_REQ_IDLE;
+		memcpy((char *)&value, (char *)buffer,
+		       sizeof(uint16_t));
+		// afu->irqs_max = ntohs(value);
+		afu->int_req.state = LIBOCXL_REQ_IDLE;
+		break;
+	case OCSE_QUERY: {
+	        size = 
+		  sizeof(uint16_t) + // device_id
+		  sizeof(uint16_t) + // vendor_id
+		  sizeof(uint8_t)  + // afu_version_major
+		  sizeof(uint8_t)  + // afu_version_minor
+		  sizeof(uint64_t) + // global_mmio_offset
+		  sizeof(uint32_t) + // global_mmio_size
+		  sizeof(uint64_t) + // pp_mmio_offset
+		  sizeof(uint32_t) + // pp_mmio_stride
+		  sizeof(uint64_t) + // mem_base_address
+		  sizeof(uint8_t)  ; // mem_size
+
+		if (get_bytes_silent(afu->fd, size, buffer, 1000, 0) <
+		    0) {
+			warn_msg("Socket failure getting OCSE query");
+			_all_idle(afu);
 			break;
-		case OCSE_QUERY: {
-		        size = 
-			  sizeof(uint16_t) + // device_id
-			  sizeof(uint16_t) + // vendor_id
-			  sizeof(uint8_t)  + // afu_version_major
-			  sizeof(uint8_t)  + // afu_version_minor
-			  sizeof(uint64_t) + // global_mmio_offset
-			  sizeof(uint32_t) + // global_mmio_size
-			  sizeof(uint64_t) + // pp_mmio_offset
-			  sizeof(uint32_t) + // pp_mmio_stride
-			  sizeof(uint64_t) + // mem_base_address
-			  sizeof(uint8_t)  ; // mem_size
-
-			if (get_bytes_silent(afu->fd, size, buffer, 1000, 0) <
-			    0) {
-				warn_msg("Socket failure getting OCSE query");
-				_all_idle(afu);
-				break;
-			}
+		}
 
-			offset = 0;
+		offset = 0;
 
                 	memcpy((char *)&value, (char *)&(buffer[offset]), 2); // device_id
-			afu->device_id = value;
-			offset += sizeof(uint16_t);
+		afu->device_id = value;
+		offset += sizeof(uint16_t);
 
                         memcpy((char *)&value, (char *)&(buffer[offset]), 2); // vendor_id
-			afu->vendor_id = value;
-			offset += sizeof(uint16_t);
+		afu->vendor_id = value;
+		offset += sizeof(uint16_t);
 
                         memcpy((char *)&bvalue, (char *)&(buffer[offset]), 1); // afu_version_major
-			afu->afu_version_major = bvalue;
-			offset += sizeof(uint8_t);
+		afu->afu_version_major = bvalue;
+		offset += sizeof(uint8_t);
 
                         memcpy((char *)&bvalue, (char *)&(buffer[offset]), 1); // afu_version_minor
-			afu->afu_version_minor = bvalue;
-			offset += sizeof(uint8_t);
+		afu->afu_version_minor = bvalue;
+		offset += sizeof(uint8_t);
 
-			afu->global_mmio.type = OCXL_GLOBAL_MMIO;
+		afu->global_mmio.type = OCXL_GLOBAL_MMIO;
 
                         memcpy((char *)&llvalue, (char *)&(buffer[offset]), 8); // global_mmio_offset
-			// afu->global_mmio_offset = llvalue;
-			afu->global_mmio.start = (char *)llvalue;
-			offset += sizeof(uint64_t);
+		// afu->global_mmio_offset = llvalue;
+		afu->global_mmio.start = (char *)llvalue;
+		offset += sizeof(uint64_t);
 
                         memcpy((char *)&lvalue, (char *)&(buffer[offset]), 4); // global_mmio_size
-			// afu->global_mmio_size = lvalue;
-			afu->global_mmio.length = lvalue;
-			offset += sizeof(uint32_t);
+		// afu->global_mmio_size = lvalue;
+		afu->global_mmio.length = lvalue;
+		offset += sizeof(uint32_t);
 
-			afu->per_pasid_mmio.type = OCXL_PER_PASID_MMIO;
+		afu->per_pasid_mmio.type = OCXL_PER_PASID_MMIO;
 
                         memcpy((char *)&llvalue, (char *)&(buffer[offset]), 8); // pp_mmio_offset
-			// afu->pp_mmio_offset = llvalue;
-			afu->per_pasid_mmio.start = (char *)llvalue;
-			offset += sizeof(uint64_t);
+		// afu->pp_mmio_offset = llvalue;
+		afu->per_pasid_mmio.start = (char *)llvalue;
+		offset += sizeof(uint64_t);
 
                         memcpy((char *)&lvalue, (char *)&(buffer[offset]), 4); // pp_mmio_stride
-			// afu->pp_mmio_stride = lvalue;
-			afu->per_pasid_mmio.length = lvalue;
-			offset += sizeof(uint32_t);
+		// afu->pp_mmio_stride = lvalue;
+		afu->per_pasid_mmio.length = lvalue;
+		offset += sizeof(uint32_t);
 
-			// we will only allow 2 mmio areas per attach.  one for global and the second for per pasid.
-			// we will only allow 1 per pasid area per attach and it must be the full area for this pasid,
-			// that is, the full stride.  and the offset is 0 from this pasid's (context) area
+		// we will only allow 2 mmio areas per attach.  one for global and the second for per pasid.
+		// we will only allow 1 per pasid area per attach and it must be the full area for this pasid,
+		// that is, the full stride.  and the offset is 0 from this pasid's (context) area
 
-			afu->mmio_count = 0;
-			afu->mmio_max = 2;
-			
+		afu->mmio_count = 0;
+		afu->mmio_max = 2;
+		
                         memcpy((char *)&llvalue, (char *)&(buffer[offset]), 8); // mem_base_address
-			afu->mem_base_address = llvalue;
-			offset += sizeof(uint64_t);
+		afu->mem_base_address = llvalue;
+		offset += sizeof(uint64_t);
 
                         memcpy((char *)&bvalue, (char *)&(buffer[offset]), 1); // mem_size
-			afu->mem_size = bvalue;
-			offset += sizeof(uint8_t);
+		afu->mem_size = bvalue;
+		offset += sizeof(uint8_t);
 
+		break;
+	}
+	case OCSE_MEMORY_READ:
+		DPRINTF("AFU MEMORY READ\n");
+		if (get_bytes_silent(afu->fd, sizeof( size ), buffer, 1000, 0) < 0) {
+			warn_msg
+			    ("Socket failure getting memory read size");
+			_all_idle(afu);
 			break;
 		}
-		case OCSE_MEMORY_READ:
-			DPRINTF("AFU MEMORY READ\n");
-			if (get_bytes_silent(afu->fd, sizeof( size ), buffer, 1000, 0) < 0) {
-				warn_msg
-				    ("Socket failure getting memory read size");
-				_all_idle(afu);
-				break;
-			}
-			// size = (uint16_t *)buffer;
-			memcpy( (char *)&size, buffer, sizeof( size ) );
-			size = ntohs(size);
-			DPRINTF( "of size=%d \n", size );
-			if (get_bytes_silent(afu->fd, sizeof(uint64_t), buffer,
-					     -1, 0) < 0) {
-				warn_msg
-				    ("Socket failure getting memory read addr");
-				_all_idle(afu);
-				break;
-			}
-			memcpy((char *)&addr, (char *)buffer, sizeof(uint64_t));
-			addr = ntohll(addr);
-			DPRINTF("from addr 0x%016" PRIx64 "\n", addr);
-			_handle_read(afu, addr, size);
+		// size = (uint16_t *)buffer;
+		memcpy( (char *)&size, buffer, sizeof( size ) );
+		size = ntohs(size);
+		DPRINTF( "of size=%d \n", size );
+		if (get_bytes_silent(afu->fd, sizeof(uint64_t), buffer,
+				     -1, 0) < 0) {
+			warn_msg
+			    ("Socket failure getting memory read addr");
+			_all_idle(afu);
 			break;
-		case OCSE_MEMORY_WRITE:
-			DPRINTF("AFU MEMORY WRITE\n");
-			if (get_bytes_silent(afu->fd, sizeof( size ), buffer, 1000, 0) < 0) {
-				warn_msg
-				    ("Socket failure getting memory write size");
-				_all_idle(afu);
-				break;
-			}
-			//size = (uint16_t) buffer[0];
-			memcpy( (char *)&size, buffer, sizeof( size ) );
-			size = ntohs(size);
-			DPRINTF( "of size=%d \n", size );
-			if (get_bytes_silent(afu->fd, sizeof(uint64_t), buffer,
-						 -1, 0) < 0) {
-				warn_msg
-				    ("Socket failure getting memory write addr");
-				_all_idle(afu);
-				break;
-			}
-			memcpy((char *)&addr, (char *)buffer, sizeof(uint64_t));
-			addr = ntohll(addr);
-			DPRINTF("to addr 0x%016" PRIx64 "\n", addr);
-			if (get_bytes_silent(afu->fd, size, buffer, 1000, 0) <
-			    0) {
-				warn_msg
-				    ("Socket failure getting memory write data");
-				_all_idle(afu);
-				break;
-			}
-			_handle_write(afu, addr, size, buffer);
+		}
+		memcpy((char *)&addr, (char *)buffer, sizeof(uint64_t));
+		addr = ntohll(addr);
+		DPRINTF("from addr 0x%016" PRIx64 "\n", addr);
+		_handle_read(afu, addr, size);
+		break;
+	case OCSE_MEMORY_WRITE:
+		DPRINTF("AFU MEMORY WRITE\n");
+		if (get_bytes_silent(afu->fd, sizeof( size ), buffer, 1000, 0) < 0) {
+			warn_msg
+			    ("Socket failure getting memory write size");
+			_all_idle(afu);
 			break;
-		// add the case for ocse_memory_be_write
-		// need to size, addr and data as above in ocse_memory_write
-	        // and then need to get byte enable in manner similar to addr (maybe)
-		case OCSE_WR_BE:
-			DPRINTF("AFU MEMORY WRITE BE\n");
-			if (get_bytes_silent(afu->fd, sizeof(size), buffer, 1000, 0) < 0) {
-				warn_msg
-				    ("Socket failure getting memory write be size");
-				_all_idle(afu);
-				break;
-			}
-			memcpy( (char *)&size, buffer, sizeof( size ) );
-			size = ntohs(size);
-			DPRINTF( "of size=%d \n", size );
-			if (get_bytes_silent(afu->fd, sizeof(uint64_t), buffer,
-					     -1, 0) < 0) {
-				warn_msg
-				    ("Socket failure getting memory write be addr");
-				_all_idle(afu);
-				break;
-			}
-			memcpy((char *)&addr, (char *)buffer, sizeof(uint64_t));
-			addr = ntohll(addr);
-			DPRINTF("to addr 0x%016" PRIx64 "\n", addr);
-			if (get_bytes_silent(afu->fd, sizeof(uint64_t), buffer,
-					     -1, 0) < 0) {
-				warn_msg
-				    ("Socket failure getting memory write be byte enable");
-				_all_idle(afu);
-				break;
-			}
-			memcpy((char *)&wr_be, (char *)buffer, sizeof(uint64_t));
-			wr_be = ntohll(wr_be);
-			DPRINTF("byte enable mask= 0x%016" PRIx64 "\n", wr_be);
-
-			if (get_bytes_silent(afu->fd, size, buffer, 1000, 0) <
-			    0) {
-				warn_msg
-				    ("Socket failure getting memory write data");
-				_all_idle(afu);
-				break;
-			}
-			_handle_write_be(afu, addr, size, buffer, wr_be);
+		}
+		//size = (uint16_t) buffer[0];
+		memcpy( (char *)&size, buffer, sizeof( size ) );
+		size = ntohs(size);
+		DPRINTF( "of size=%d \n", size );
+		if (get_bytes_silent(afu->fd, sizeof(uint64_t), buffer,
+					 -1, 0) < 0) {
+			warn_msg
+			    ("Socket failure getting memory write addr");
+			_all_idle(afu);
 			break;
-
-		case OCSE_AMO_WR:
-		case OCSE_AMO_RW:
-			amo_op = buffer[0];
-			if (amo_op == OCSE_AMO_WR)
-				DPRINTF("AFU AMO_WRITE \n");
-			else
-				DPRINTF("AFU AMO__READ/WRITE\n");
-			if (get_bytes_silent(afu->fd, sizeof(uint8_t), buffer, -1, 0) < 0) {
-				warn_msg
-				    ("Socket failure getting amo_wr or amo_rw size");
-				_all_idle(afu);
-				break;
-			}
-			memcpy( (char *)&op_size, buffer, sizeof( uint8_t ) );
-			//memcpy( (char *)&size, buffer, sizeof( size ) );
-			//size = ntohs(size);
-			DPRINTF( "op_size=%d \n", op_size );
-			if (get_bytes_silent(afu->fd, sizeof(uint64_t), buffer,
-					     -1, 0) < 0) {
-				warn_msg
-				    ("Socket failure getting amo_wr or amo_rw addr");
-				_all_idle(afu);
-				break;
-			}
-			memcpy((char *)&addr, (char *)buffer, sizeof(uint64_t));
-			addr = ntohll(addr);
-			DPRINTF("to addr 0x%016" PRIx64 "\n", addr);
-			if (get_bytes_silent(afu->fd, 18, buffer,
+		}
+		memcpy((char *)&addr, (char *)buffer, sizeof(uint64_t));
+		addr = ntohll(addr);
+		DPRINTF("to addr 0x%016" PRIx64 "\n", addr);
+		if (get_bytes_silent(afu->fd, size, buffer, 1000, 0) <
+		    0) {
+			warn_msg
+			    ("Socket failure getting memory write data");
+			_all_idle(afu);
+			break;
+		}
+		_handle_write(afu, addr, size, buffer);
+		break;
+	// add the case for ocse_memory_be_write
+	// need to size, addr and data as above in ocse_memory_write
+        // and then need to get byte enable in manner similar to addr (maybe)
+	case OCSE_WR_BE:
+		DPRINTF("AFU MEMORY WRITE BE\n");
+		if (get_bytes_silent(afu->fd, sizeof(size), buffer, 1000, 0) < 0) {
+			warn_msg
+			    ("Socket failure getting memory write be size");
+			_all_idle(afu);
+			break;
+		}
+		memcpy( (char *)&size, buffer, sizeof( size ) );
+		size = ntohs(size);
+		DPRINTF( "of size=%d \n", size );
+		if (get_bytes_silent(afu->fd, sizeof(uint64_t), buffer,
 				     -1, 0) < 0) {
-				warn_msg
-			   	 ("Socket failure getting amo_wr or amo_rw cmd_flag, cmd_endian and op1/op2 data");
-				_all_idle(afu);
-				break;
-			}
-			memcpy( (char *)&function_code, &buffer[0], sizeof( function_code ) );
-			DPRINTF("amo_wr or amo_rw cmd_flag= 0x%x\n", function_code);
-			memcpy( (char *)&cmd_endian, &buffer[1], sizeof( cmd_endian ) );
-			DPRINTF("amo_wr or amo_rw cmd_endian= 0x%x\n", cmd_endian);
-
-			// TODO FIX THIS TO CORRECTLY EXTRACT OP_1 and OP_2 if needed !!!
-			memcpy((char *)&op1, (char *)&buffer[2], sizeof(uint64_t));
-			debug_msg("op1 bytes 1-8 are 0x%016" PRIx64, op1);
-			//op1 = ntohll (op1);
-			//printf("op1 bytes 1-8 are 0x%016" PRIx64 " \n", op1);
-			memcpy((char *)&op2, (char *)&buffer[10], sizeof(uint64_t));
-			debug_msg("op2 bytes 1-8 are 0x%016" PRIx64, op2);
-			//op_size = (uint8_t) size;
-			
-			_handle_DMO_OPs(afu, amo_op, op_size, addr, function_code, op1, op2, cmd_endian);
+			warn_msg
+			    ("Socket failure getting memory write be addr");
+			_all_idle(afu);
 			break;
-
-		case OCSE_AMO_RD:
-			DPRINTF("AFU AMO READ \n");
-			amo_op = buffer[0];
-			if (get_bytes_silent(afu->fd, sizeof(op_size), buffer, -1, 0) < 0) {
-				warn_msg
-				    ("Socket failure getting amo_rd size");
-				_all_idle(afu);
-				break;
-			}
-			memcpy( (char *)&op_size, buffer, sizeof( op_size ) );
-			//memcpy( (char *)&size, buffer, sizeof( size ) );
-			//size = ntohs(size);
-		//	op_size = (uint8_t) size;
-			DPRINTF( "op_size=%d \n", op_size );
-			if (get_bytes_silent(afu->fd, sizeof(uint64_t), buffer,
-					     -1, 0) < 0) {
-				warn_msg
-				    ("Socket failure getting amo_rd addr");
-				_all_idle(afu);
-				break;
-			}
-			memcpy((char *)&addr, (char *)buffer, sizeof(uint64_t));
-			addr = ntohll(addr);
-			DPRINTF("to addr 0x%016" PRIx64 "\n", addr);
-			if (get_bytes_silent(afu->fd, 2, buffer,
-					     -1, 0) < 0) {
-				warn_msg
-				    ("Socket failure getting amo_rd cmd_flag and cmd_endian");
-				_all_idle(afu);
-				break;
-			}
-			memcpy( (char *)&function_code, &buffer[0], sizeof( function_code ) );
-			memcpy( (char *)&cmd_endian, &buffer[1], sizeof( cmd_endian ) );
-			DPRINTF("amo_rd cmd_flag= 0x%x\n", function_code);
-			DPRINTF("amo_rd cmd_endian= 0x%x\n", cmd_endian);
-
-			_handle_DMO_OPs(afu, amo_op, op_size, addr, function_code, 0, 0, cmd_endian);
+		}
+		memcpy((char *)&addr, (char *)buffer, sizeof(uint64_t));
+		addr = ntohll(addr);
+		DPRINTF("to addr 0x%016" PRIx64 "\n", addr);
+		if (get_bytes_silent(afu->fd, sizeof(uint64_t), buffer,
+				     -1, 0) < 0) {
+			warn_msg
+			    ("Socket failure getting memory write be byte enable");
+			_all_idle(afu);
+			break;
+		}
+		memcpy((char *)&wr_be, (char *)buffer, sizeof(uint64_t));
+		wr_be = ntohll(wr_be);
+		DPRINTF("byte enable mask= 0x%016" PRIx64 "\n", wr_be);
+
+		if (get_bytes_silent(afu->fd, size, buffer, 1000, 0) <
+		    0) {
+			warn_msg
+			    ("Socket failure getting memory write data");
+			_all_idle(afu);
 			break;
+		}
+		_handle_write_be(afu, addr, size, buffer, wr_be);
+		break;
+
+	case OCSE_AMO_WR:
+	case OCSE_AMO_RW:
+		amo_op = buffer[0];
+		if (amo_op == OCSE_AMO_WR)
+			DPRINTF("AFU AMO_WRITE \n");
+		else
+			DPRINTF("AFU AMO__READ/WRITE\n");
+		if (get_bytes_silent(afu->fd, sizeof(uint8_t), buffer, -1, 0) < 0) {
+			warn_msg
+			    ("Socket failure getting amo_wr or amo_rw size");
+			_all_idle(afu);
+			break;
+		}
+		memcpy( (char *)&op_size, buffer, sizeof( uint8_t ) );
+		//memcpy( (char *)&size, buffer, sizeof( size ) );
+		//size = ntohs(size);
+		DPRINTF( "op_size=%d \n", op_size );
+		if (get_bytes_silent(afu->fd, sizeof(uint64_t), buffer,
+				     -1, 0) < 0) {
+			warn_msg
+			    ("Socket failure getting amo_wr or amo_rw addr");
+			_all_idle(afu);
+			break;
+		}
+		memcpy((char *)&addr, (char *)buffer, sizeof(uint64_t));
+		addr = ntohll(addr);
+		DPRINTF("to addr 0x%016" PRIx64 "\n", addr);
+		if (get_bytes_silent(afu->fd, 18, buffer,
+			     -1, 0) < 0) {
+			warn_msg
+		   	 ("Socket failure getting amo_wr or amo_rw cmd_flag, cmd_endian and op1/op2 data");
+			_all_idle(afu);
+			break;
+		}
+		memcpy( (char *)&function_code, &buffer[0], sizeof( function_code ) );
+		DPRINTF("amo_wr or amo_rw cmd_flag= 0x%x\n", function_code);
+		memcpy( (char *)&cmd_endian, &buffer[1], sizeof( cmd_endian ) );
+		DPRINTF("amo_wr or amo_rw cmd_endian= 0x%x\n", cmd_endian);
+
+		// TODO FIX THIS TO CORRECTLY EXTRACT OP_1 and OP_2 if needed !!!
+		memcpy((char *)&op1, (char *)&buffer[2], sizeof(uint64_t));
+		debug_msg("op1 bytes 1-8 are 0x%016" PRIx64, op1);
+		//op1 = ntohll (op1);
+		//printf("op1 bytes 1-8 are 0x%016" PRIx64 " \n", op1);
+		memcpy((char *)&op2, (char *)&buffer[10], sizeof(uint64_t));
+		debug_msg("op2 bytes 1-8 are 0x%016" PRIx64, op2);
+		//op_size = (uint8_t) size;
+		
+		_handle_DMO_OPs(afu, amo_op, op_size, addr, function_code, op1, op2, cmd_endian);
+		break;
+
+	case OCSE_AMO_RD:
+		DPRINTF("AFU AMO READ \n");
+		amo_op = buffer[0];
+		if (get_bytes_silent(afu->fd, sizeof(op_size), buffer, -1, 0) < 0) {
+			warn_msg
+			    ("Socket failure getting amo_rd size");
+			_all_idle(afu);
+			break;
+		}
+		memcpy( (char *)&op_size, buffer, sizeof( op_size ) );
+		//memcpy( (char *)&size, buffer, sizeof( size ) );
+		//size = ntohs(size);
+	//	op_size = (uint8_t) size;
+		DPRINTF( "op_size=%d \n", op_size );
+		if (get_bytes_silent(afu->fd, sizeof(uint64_t), buffer,
+				     -1, 0) < 0) {
+			warn_msg
+			    ("Socket failure getting amo_rd addr");
+			_all_idle(afu);
+			break;
+		}
+		memcpy((char *)&addr, (char *)buffer, sizeof(uint64_t));
+		addr = ntohll(addr);
+		DPRINTF("to addr 0x%016" PRIx64 "\n", addr);
+		if (get_bytes_silent(afu->fd, 2, buffer,
+				     -1, 0) < 0) {
+			warn_msg
+			    ("Socket failure getting amo_rd cmd_flag and cmd_endian");
+			_all_idle(afu);
+			break;
+		}
+		memcpy( (char *)&function_code, &buffer[0], sizeof( function_code ) );
+		memcpy( (char *)&cmd_endian, &buffer[1], sizeof( cmd_endian ) );
+		DPRINTF("amo_rd cmd_flag= 0x%x\n", function_code);
+		DPRINTF("amo_rd cmd_endian= 0x%x\n", cmd_endian);
 
+		_handle_DMO_OPs(afu, amo_op, op_size, addr, function_code, 0, 0, cmd_endian);
+		break;
 
-		case OCSE_MEMORY_TOUCH:
-			DPRINTF("AFU XLATE TOUCH\n");
-			if (get_bytes_silent(afu->fd, sizeof(uint64_t), buffer,
-					     -1, 0) < 0) {
-				warn_msg
-				    ("Socket failure getting memory touch addr");
-				_all_idle(afu);
-				break;
-			}
-			memcpy((char *)&addr, (char *)buffer, sizeof(uint64_t));
-			addr = ntohll(addr);
-			DPRINTF("to addr 0x%016" PRIx64 "\n", addr);
-			if (get_bytes_silent(afu->fd, 2, buffer,
-					     -1, 0) < 0) {
-				warn_msg
-				    ("Socket failure getting cmd_flag and cmd_pg_size");
-				_all_idle(afu);
-				break;
-			}
-			memcpy( (char *)&function_code, &buffer[0], sizeof( function_code ) );
-			memcpy( (char *)&cmd_pg_size, &buffer[1], sizeof( cmd_pg_size ) );
-			DPRINTF("xlate_touch cmd_flag= 0x%x\n", function_code);
-			DPRINTF("xlate_touch cmd_pg_size= 0x%x\n", cmd_pg_size);
 
-			_handle_touch(afu, addr, function_code, cmd_pg_size);
+	case OCSE_MEMORY_TOUCH:
+		DPRINTF("AFU XLATE TOUCH\n");
+		if (get_bytes_silent(afu->fd, sizeof(uint64_t), buffer,
+				     -1, 0) < 0) {
+			warn_msg
+			    ("Socket failure getting memory touch addr");
+			_all_idle(afu);
 			break;
-		case OCSE_MMIO_ACK:
-			_handle_ack(afu);
+		}
+		memcpy((char *)&addr, (char *)buffer, sizeof(uint64_t));
+		addr = ntohll(addr);
+		DPRINTF("to addr 0x%016" PRIx64 "\n", addr);
+		if (get_bytes_silent(afu->fd, 2, buffer,
+				     -1, 0) < 0) {
+			warn_msg
+			    ("Socket failure getting cmd_flag and cmd_pg_size");
+			_all_idle(afu);
 			break;
-		case OCSE_LPC_ACK:
-			_handle_mem_ack(afu);
+		}
+		memcpy( (char *)&function_code, &buffer[0], sizeof( function_code ) );
+		memcpy( (char *)&cmd_pg_size, &buffer[1], sizeof( cmd_pg_size ) );
+		DPRINTF("xlate_touch cmd_flag= 0x%x\n", function_code);
+		DPRINTF("xlate_touch cmd_pg_size= 0x%x\n", cmd_pg_size);
+
+		_handle_touch(afu, addr, function_code, cmd_pg_size);
+		break;
+	case OCSE_MMIO_ACK:
+		_handle_ack(afu);
+		break;
+	case OCSE_LPC_ACK:
+		_handle_mem_ack(afu);
+		break;
+	case OCSE_INTERRUPT_D:
+		debug_msg("AFU INTERRUPT D");
+		if (_handle_interrupt(afu, 1) < 0) {
+			perror("Interrupt d Failure");
+			return -1;
+		}
+		break;
+	case OCSE_INTERRUPT:
+		debug_msg("AFU INTERRUPT");
+		if (_handle_interrupt(afu, 0) < 0) {
+			perror("Interrupt Failure");
+			return -1;
+		}
+		break;
+	case OCSE_WAKE_HOST_THREAD:
+		debug_msg("AFU WAKE HOST THREAD");
+		if (_handle_wake_host_thread(afu) < 0) {
+			perror("Wake Host Thread Failure");
+			return -1;
+		}
+		break;
+	/* case OCSE_AFU_ERROR: */
+	/* 	if (_handle_afu_error(afu) < 0) { */
+	/* 		perror("AFU ERROR Failure"); */
+	/* 		return -1; */
+	/* 	} */
+	/* 	break; */
+	default:
+		DPRINTF("UNKNOWN CMD IS 0x%2x \n", buffer[0]);
+		break;
+	}
+	return 0;
+}
+
+// stop servicing an afu whose socket has failed or that ocse has detached
+// called by the reactor with ocxl_reactor_lock held
+static void _reactor_stop(struct ocxl_afu *afu)
+{
+	if (afu->stopped)
+		return;
+	if (afu->fd >= 0)
+		epoll_ctl(ocxl_reactor_epfd, EPOLL_CTL_DEL, afu->fd, NULL);
+	afu->stopped = 1;
+}
+
+// wake the api functions waiting in _reactor_wait on an afu the reactor
+// just serviced
+static void _reactor_signal(struct ocxl_afu *afu)
+{
+	pthread_mutex_lock(&(afu->req_lock));
+	pthread_cond_broadcast(&(afu->req_cond));
+	pthread_mutex_unlock(&(afu->req_lock));
+}
+
+// process every message ocse has sent on this afu's socket
+// called by the reactor with ocxl_reactor_lock held
+static void _reactor_messages(struct ocxl_afu *afu)
+{
+	int rc;
+
+	do {
+		rc = _psl_message(afu);
+		if (rc < 0)
+			afu->attached = 0;
+		if ((rc < 0) || !afu->opened || (afu->fd < 0)) {
+			_reactor_stop(afu);
+			return;
+		}
+	} while (bytes_buffered(afu->fd) > 0);
+}
+
+// a single reactor thread services every open afu in the process.
+// it waits in epoll on each afu's ocse socket and on a wake pipe that the api
+// functions write to when they post a request, so there is no per afu thread
+// and no polling delay.
+static void *_ocxl_reactor(void *ptr)
+{
+	struct epoll_event events[OCXL_REACTOR_EVENTS];
+	struct ocxl_afu *afu;
+	struct ocxl_afu **list;
+	uint8_t drain[64];
+	int count, i;
+
+	while (1) {
+		count = epoll_wait(ocxl_reactor_epfd, events, OCXL_REACTOR_EVENTS, -1);
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("epoll_wait");
 			break;
-		case OCSE_INTERRUPT_D:
-			debug_msg("AFU INTERRUPT D");
-			if (_handle_interrupt(afu, 1) < 0) {
-				perror("Interrupt d Failure");
-				goto ocl_fail;
+		}
+
+		// Process socket input from OCSE.  an afu is only freed after
+		// the release step below, so the sockets are serviced without
+		// ocxl_reactor_lock and opening or closing an afu does not wait
+		// behind a message that is still arriving
+		for (i = 0; i < count; i++) {
+			afu = (struct ocxl_afu *)events[i].data.ptr;
+			if (afu == NULL) {
+				while (read(ocxl_reactor_pipe[0], drain, sizeof(drain)) > 0) ;
+				continue;
 			}
-			break;
-		case OCSE_INTERRUPT:
-			debug_msg("AFU INTERRUPT");
-			if (_handle_interrupt(afu, 0) < 0) {
-				perror("Interrupt Failure");
-				goto ocl_fail;
+			if (afu->stopped)
+				continue;
+			_reactor_messages(afu);
+		}
+
+		// Send any requests to OCSE over socket.  new afus go to the
+		// head of the list, so the walk does not need the lock either
+		pthread_mutex_lock(&ocxl_reactor_lock);
+		afu = ocxl_reactor_afus;
+		pthread_mutex_unlock(&ocxl_reactor_lock);
+		for (; afu != NULL; afu = afu->_next_reactor) {
+			if (!afu->stopped) {
+				// epoll does not see messages already in the
+				// read ahead buffer
+				if (bytes_buffered(afu->fd) > 0)
+					_reactor_messages(afu);
+				if (!afu->stopped)
+					_psl_requests(afu);
+				if (!afu->opened || (afu->fd < 0))
+					_reactor_stop(afu);
 			}
-			break;
-		case OCSE_WAKE_HOST_THREAD:
-			debug_msg("AFU WAKE HOST THREAD");
-			if (_handle_wake_host_thread(afu) < 0) {
-				perror("Wake Host Thread Failure");
-				goto ocl_fail;
+			_reactor_signal(afu);
+		}
+
+		// Release any afus that are being closed
+		pthread_mutex_lock(&ocxl_reactor_lock);
+		list = &ocxl_reactor_afus;
+		while (*list != NULL) {
+			afu = *list;
+			if (!afu->closing) {
+				list = &(afu->_next_reactor);
+				continue;
 			}
-			break;
-		/* case OCSE_AFU_ERROR: */
-		/* 	if (_handle_afu_error(afu) < 0) { */
-		/* 		perror("AFU ERROR Failure"); */
-		/* 		goto ocl_fail; */
-		/* 	} */
-		/* 	break; */
-		default:
-			DPRINTF("UNKNOWN CMD IS 0x%2x \n", buffer[0]);
-			break;
+			_reactor_stop(afu);
+			*list = afu->_next_reactor;
+			afu->closing = 0;
+			pthread_cond_broadcast(&ocxl_reactor_cond);
 		}
+
+		pthread_mutex_unlock(&ocxl_reactor_lock);
 	}
 
- ocl_fail:
-	afu->attached = 0;
 	pthread_exit(NULL);
 }
 
+// wake the reactor so it picks up a request posted on an afu
+void _reactor_wake(struct ocxl_afu *afu)
+{
+	uint8_t wake = 1;
+
+	// a full pipe means a wake up is already pending
+	if (write(afu->wake_fd, &wake, 1) < 0)
+		return;
+}
+
+// wait for the reactor to complete a request posted on an afu, that is for
+// *state to go back to idle, or for the afu to fail
+void _reactor_wait(struct ocxl_afu *afu, volatile enum libocxl_req_state *state)
+{
+	pthread_mutex_lock(&(afu->req_lock));
+	while (afu->opened && (*state != LIBOCXL_REQ_IDLE))
+		pthread_cond_wait(&(afu->req_cond), &(afu->req_lock));
+	pthread_mutex_unlock(&(afu->req_lock));
+}
+
+// start servicing an afu from the reactor, starting the reactor if needed
+static int _reactor_add(struct ocxl_afu *afu)
+{
+	struct epoll_event event;
+
+	pthread_mutex_lock(&ocxl_reactor_lock);
+	if (ocxl_reactor_epfd < 0) {
+		ocxl_reactor_epfd = epoll_create1(EPOLL_CLOEXEC);
+		if (ocxl_reactor_epfd < 0) {
+			perror("epoll_create1");
+			goto add_fail;
+		}
+		if (pipe2(ocxl_reactor_pipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+			perror("pipe2");
+			goto add_fail;
+		}
+		event.events = EPOLLIN;
+		event.data.ptr = NULL;
+		if (epoll_ctl(ocxl_reactor_epfd, EPOLL_CTL_ADD, ocxl_reactor_pipe[0], &event) < 0) {
+			perror("epoll_ctl");
+			goto add_fail;
+		}
+		if (pthread_create(&ocxl_reactor_thread, NULL, _ocxl_reactor, NULL)) {
+			perror("pthread_create");
+			goto add_fail;
+		}
+		pthread_detach(ocxl_reactor_thread);
+		debug_msg("_reactor_add: started reactor thread");
+	}
+
+	afu->opened = 1;
+	afu->stopped = 0;
+	afu->closing = 0;
+	afu->wake_fd = ocxl_reactor_pipe[1];
+	event.events = EPOLLIN;
+	event.data.ptr = afu;
+	if (epoll_ctl(ocxl_reactor_epfd, EPOLL_CTL_ADD, afu->fd, &event) < 0) {
+		perror("epoll_ctl");
+		afu->opened = 0;
+		pthread_mutex_unlock(&ocxl_reactor_lock);
+		return -1;
+	}
+	afu->_next_reactor = ocxl_reactor_afus;
+	ocxl_reactor_afus = afu;
+	// the handshake may have left messages in the read ahead buffer
+	_reactor_wake(afu);
+	pthread_mutex_unlock(&ocxl_reactor_lock);
+	return 0;
+
+ add_fail:
+	if (ocxl_reactor_pipe[0] >= 0) {
+		close(ocxl_reactor_pipe[0]);
+		close(ocxl_reactor_pipe[1]);
+		ocxl_reactor_pipe[0] = -1;
+		ocxl_reactor_pipe[1] = -1;
+	}
+	if (ocxl_reactor_epfd >= 0) {
+		close(ocxl_reactor_epfd);
+		ocxl_reactor_epfd = -1;
+	}
+	pthread_mutex_unlock(&ocxl_reactor_lock);
+	return -1;
+}
+
+// stop servicing an afu from the reactor
+// returns once the reactor no longer references the afu, so it can be freed
+static void _reactor_remove(struct ocxl_afu *afu)
+{
+	pthread_mutex_lock(&ocxl_reactor_lock);
+	afu->closing = 1;
+	_reactor_wake(afu);
+	while (afu->closing)
+		pthread_cond_wait(&ocxl_reactor_cond, &ocxl_reactor_lock);
+	pthread_mutex_unlock(&ocxl_reactor_lock);
+}
+
 static int _ocse_connect(uint16_t * afu_map, int *fd)
 {
 	char *ocse_server_dat_path;
@@ -1911,7 +2392,7 @@ static int _ocse_connect(uint16_t * afu_map, int *fd)
 	struct sockaddr_in ssadr;
 	struct hostent *he;
 	char *host, *port_str;
-	int port;
+	int port, one;
 
 	// Get hostname and port of OCSE server
 	DPRINTF("AFU CONNECT\n");
@@ -1964,6 +2445,9 @@ static int _ocse_connect(uint16_t * afu_map, int *fd)
 		perror("connect");
 		goto connect_fail;
 	}
+	// Small requests wait on their replies, send them right away
+	one = 1;
+	setsockopt(*fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
 	strcpy((char *)buffer, "OCSE");
 	buffer[4] = (uint8_t) OCSE_VERSION_MAJOR;
 	buffer[5] = (uint8_t) OCSE_VERSION_MINOR;
@@ -2207,6 +2691,9 @@ ocxl_err _query_afu( struct ocxl_afu *afu_h, int fd, uint8_t bus, uint8_t dev, u
 		return OCXL_NO_DEV;
 
 	pthread_mutex_init( &(afu_h->event_lock), NULL);
+	pthread_mutex_init( &(afu_h->lpc_lock), NULL);
+	pthread_mutex_init( &(afu_h->req_lock), NULL);
+	pthread_cond_init( &(afu_h->req_cond), NULL);
 
 	afu_h->fd = fd;
 	afu_h->bus = bus;
@@ -2258,19 +2745,17 @@ ocxl_err _open_afu( struct ocxl_afu *afu_h )
 	// afu_h->_head = afu_h;
 	afu_h->open.state = LIBOCXL_REQ_PENDING;
 
-	// Start thread
-	if (pthread_create(&(afu_h->thread), NULL, _psl_loop, afu_h)) {
-		perror("pthread_create");
+	// Hand the socket to the reactor thread
+	if (_reactor_add(afu_h) < 0) {
 		close_socket(&(afu_h->fd));
 		goto open_fail;
 	}
 
 	// Wait for open acknowledgement
-	while (afu_h->open.state != LIBOCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_reactor_wait(afu_h, &(afu_h->open.state));
 
 	if (!afu_h->opened) {
-		pthread_join(afu_h->thread, NULL);
+		_reactor_remove(afu_h);
 		goto open_fail;
 	}
 
@@ -2278,6 +2763,9 @@ ocxl_err _open_afu( struct ocxl_afu *afu_h )
 
  open_fail:
 	pthread_mutex_destroy(&(afu_h->event_lock));
+	pthread_mutex_destroy(&(afu_h->lpc_lock));
+	pthread_mutex_destroy(&(afu_h->req_lock));
+	pthread_cond_destroy(&(afu_h->req_cond));
 	free( afu_h );
 	return OCXL_INTERNAL_ERROR;
 }
@@ -2781,8 +3269,10 @@ void _afu_free( ocxl_afu_h afu )
 		goto free_done_no_afu;
 	}
 
-	if (!afu->opened)
+	if (!afu->opened) {
+		_reactor_remove(afu);
 		goto free_done;
+	}
 
 	// detach
 	buffer = OCSE_DETACH;
@@ -2796,17 +3286,34 @@ void _afu_free( ocxl_afu_h afu )
                 if(loop_count == 180000)
 		   fatal_msg("_afu_free: time out of 3s reached");
 	}
+	_reactor_remove(afu);
 	debug_msg( "_afu_free: closing host side socket %d", afu->fd );
 	// free some other stuff in the afu like the irq list
 	close_socket(&(afu->fd));
 	afu->opened = 0;
-	pthread_join(afu->thread, NULL);
 
  free_done:
+	// copies still outstanding will never complete
+	while (afu->lpc_copies != NULL) {
+		struct lpc_copy *copy = afu->lpc_copies;
+
+		afu->lpc_copies = copy->_next;
+		free(copy);
+	}
 	if (afu->id != NULL)
 		free( afu->id );
  free_done_no_afu:
+	// events the application never read
+	while (afu->events != NULL) {
+		struct ocxl_event_entry *entry = afu->events;
+
+		afu->events = entry->_next;
+		free(entry);
+	}
 	pthread_mutex_destroy( &(afu->event_lock) );
+	pthread_mutex_destroy( &(afu->lpc_lock) );
+	pthread_mutex_destroy( &(afu->req_lock) );
+	pthread_cond_destroy( &(afu->req_cond) );
 	free( afu );
 }
 
@@ -2856,8 +3363,8 @@ ocxl_err ocxl_afu_attach( ocxl_afu_h afu, __attribute__((unused)) uint64_t flags
 	// lgt - dont need to send amr - in fact, the parameter is gone now
 	// we don't model the change in permissions
 	afu->attach.state = LIBOCXL_REQ_REQUEST;
-	while (afu->attach.state != LIBOCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_reactor_wake(afu);
+	_reactor_wait(afu, &(afu->attach.state));
 	afu->attached = 1;
 
 	return OCXL_OK;
@@ -2957,7 +3464,7 @@ uint64_t ocxl_irq_get_handle( ocxl_afu_h afu, ocxl_irq_h irq )
 
 uint16_t ocxl_afu_event_check_versioned( ocxl_afu_h afu, int timeout, ocxl_event *events, uint16_t event_count, uint16_t event_api_version )
 {
-	int i;
+	struct ocxl_event_entry *entry;
  	uint8_t type; 
 
 	// check for null afu
@@ -2979,21 +3486,26 @@ uint16_t ocxl_afu_event_check_versioned( ocxl_afu_h afu, int timeout, ocxl_event
 	// read an event - if not one, just wait here
 	//     we ignore timeout for now
 	debug_msg("ocxl_read_event: waiting for event");
+	// the reactor signals req_cond after each pass over the afu, which
+	// is where events are queued
+	pthread_mutex_lock(&(afu->req_lock));
+	while (afu->opened && !afu->events)
+		pthread_cond_wait(&(afu->req_cond), &(afu->req_lock));
+	pthread_mutex_unlock(&(afu->req_lock));
 	pthread_mutex_lock(&(afu->event_lock));
-	while (afu->opened && !afu->events[0]) {	/*infinite loop */
+	entry = afu->events;
+	if (!entry) {
 		pthread_mutex_unlock(&(afu->event_lock));
-		if (_delay_1ms() < 0)
-			return -1;
-		pthread_mutex_lock(&(afu->event_lock));
+		return -1;
 	}
 
 	debug_msg("ocxl_read_event: received event");
-	// Copy event data, free and move remaining events in queue
-	memcpy( events, afu->events[0], sizeof( ocxl_event ) );
-	free(afu->events[0]);
-	for (i = 1; i < EVENT_QUEUE_MAX; i++)
-		afu->events[i - 1] = afu->events[i];
-	afu->events[EVENT_QUEUE_MAX - 1] = NULL;
+	// Copy event data and take it off the queue
+	memcpy( events, &(entry->event), sizeof( ocxl_event ) );
+	afu->events = entry->_next;
+	if (afu->events == NULL)
+		afu->events_last = NULL;
+	free(entry);
 	pthread_mutex_unlock(&(afu->event_lock));
 	if (read(afu->pipe[0], &type, 1) > 0)
 		return 1;
@@ -3053,12 +3565,14 @@ ocxl_err ocxl_mmio_map( ocxl_afu_h afu, ocxl_mmio_type type, ocxl_mmio_h *mmio )
 	  afu->mmio.type = OCSE_GLOBAL_MMIO_MAP;
 	  // my_afu->mmio.data = (uint64_t) endian;
 	  afu->mmio.state = LIBOCXL_REQ_REQUEST;
+	  _reactor_wake(afu);
 	  break;
 	case OCXL_PER_PASID_MMIO:
 	  // Send MMIO map to OCSE
 	  afu->mmio.type = OCSE_MMIO_MAP;
 	  // my_afu->mmio.data = (uint64_t) endian;
 	  afu->mmio.state = LIBOCXL_REQ_REQUEST;
+	  _reactor_wake(afu);
 	  break;
 	default:
 	  err = OCXL_INVALID_ARGS;
@@ -3066,8 +3580,7 @@ ocxl_err ocxl_mmio_map( ocxl_afu_h afu, ocxl_mmio_type type, ocxl_mmio_h *mmio )
 	  break;
 	}
 
-	while (afu->mmio.state != LIBOCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_reactor_wait(afu, &(afu->mmio.state));
 
 	if (type == OCXL_GLOBAL_MMIO)
 	  afu->global_mapped = 1;
@@ -3145,11 +3658,11 @@ ocxl_err ocxl_mmio_write64( ocxl_mmio_h mmio, off_t offset, ocxl_endian endian,
 	// should I use endian here???  maybe
 	mmio->afu->mmio.data = value;
 	mmio->afu->mmio.state = LIBOCXL_REQ_REQUEST;
+	_reactor_wake(mmio->afu);
 
 	//debug_msg("ocxl_mmio_write64: waiting for idle");
 
-	while (mmio->afu->mmio.state != LIBOCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_reactor_wait(mmio->afu, &(mmio->afu->mmio.state));
 
 	//debug_msg("ocxl_mmio_write64: mmio acked");
 
@@ -3209,8 +3722,8 @@ ocxl_err ocxl_mmio_read64( ocxl_mmio_h mmio, off_t offset, ocxl_endian endian, u
 	}
 	mmio->afu->mmio.addr = (uint32_t) offset;
 	mmio->afu->mmio.state = LIBOCXL_REQ_REQUEST;
-	while (mmio->afu->mmio.state != LIBOCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_reactor_wake(mmio->afu);
+	_reactor_wait(mmio->afu, &(mmio->afu->mmio.state));
 
 	// should use endian here...  maybe
 	*out = mmio->afu->mmio.data;
@@ -3269,8 +3782,8 @@ ocxl_err ocxl_mmio_write32( ocxl_mmio_h mmio, off_t offset, ocxl_endian endian,
 	mmio->afu->mmio.addr = (uint32_t) offset;
 	mmio->afu->mmio.data = (uint64_t) value;
 	mmio->afu->mmio.state = LIBOCXL_REQ_REQUEST;
-	while (mmio->afu->mmio.state != LIBOCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_reactor_wake(mmio->afu);
+	_reactor_wait(mmio->afu, &(mmio->afu->mmio.state));
 
 	if (!mmio->afu->opened){
 	  err = OCXL_NO_DEV;
@@ -3325,8 +3838,8 @@ ocxl_err ocxl_mmio_read32( ocxl_mmio_h mmio, off_t offset, ocxl_endian endian, u
 	}
 	mmio->afu->mmio.addr = (uint32_t) offset;
 	mmio->afu->mmio.state = LIBOCXL_REQ_REQUEST;
-	while (mmio->afu->mmio.state != LIBOCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_reactor_wake(mmio->afu);
+	_reactor_wait(mmio->afu, &(mmio->afu->mmio.state));
 	*out = (uint32_t) mmio->afu->mmio.data;
 
 	if (!mmio->afu->opened) {
@@ -3419,8 +3932,8 @@ ocxl_err ocxl_global_mmio_write64( ocxl_afu_h afu, uint64_t offset, uint64_t val
 	afu->mmio.addr = (uint32_t) offset;
 	afu->mmio.data = val;
 	afu->mmio.state = LIBOCXL_REQ_REQUEST;
-	while (afu->mmio.state != LIBOCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_reactor_wake(afu);
+	_reactor_wait(afu, &(afu->mmio.state));
 
 	if (!afu->opened)
 		goto write64_fail;
@@ -3453,8 +3966,8 @@ ocxl_err ocxl_global_mmio_read64( ocxl_afu_h afu, uint64_t offset, uint64_t *out
 	afu->mmio.type = OCSE_GLOBAL_MMIO_READ64;
 	afu->mmio.addr = (uint32_t)offset;
 	afu->mmio.state = LIBOCXL_REQ_REQUEST;
-	while (afu->mmio.state != LIBOCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_reactor_wake(afu);
+	_reactor_wait(afu, &(afu->mmio.state));
 	*out = afu->mmio.data;
 
 	if (!afu->opened)
@@ -3489,8 +4002,8 @@ ocxl_err ocxl_global_mmio_write32( ocxl_afu_h afu, uint64_t offset, uint32_t val
 	afu->mmio.addr = (uint32_t)offset;
 	afu->mmio.data = (uint64_t)val;
 	afu->mmio.state = LIBOCXL_REQ_REQUEST;
-	while (afu->mmio.state != LIBOCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_reactor_wake(afu);
+	_reactor_wait(afu, &(afu->mmio.state));
 
 	if (!afu->opened)
 		goto write32_fail;
@@ -3523,8 +4036,8 @@ ocxl_err ocxl_global_mmio_read32( ocxl_afu_h afu, uint64_t offset, uint32_t *out
 	afu->mmio.type = OCSE_GLOBAL_MMIO_READ32;
 	afu->mmio.addr = (uint32_t)offset;
 	afu->mmio.state = LIBOCXL_REQ_REQUEST;
-	while (afu->mmio.state != LIBOCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_reactor_wake(afu);
+	_reactor_wait(afu, &(afu->mmio.state));
 	*out = (uint32_t) afu->mmio.data;
 
 	if (!afu->opened)
@@ -3633,3 +4146,53 @@ int ocxl_wait()
 
 	return OCXL_OK;
 }
+
+// register a range of host memory that the afu will access.
+// afu reads, writes, touches and amos that fall entirely inside a registered
+// range are trusted without the per access address validation.
+// the caller must keep the range mapped until it is unregistered.
+ocxl_err ocxl_mem_register(void *addr, size_t size)
+{
+	struct ocxl_mem_region *region;
+
+	if ((addr == NULL) || (size == 0)) {
+		warn_msg("ocxl_mem_register: invalid region");
+		return OCXL_INVALID_ARGS;
+	}
+
+	region = (struct ocxl_mem_region *)malloc(sizeof(struct ocxl_mem_region));
+	if (region == NULL)
+		return OCXL_NO_MEM;
+	region->start = (uint64_t)addr;
+	region->end = (uint64_t)addr + size;
+
+	pthread_mutex_lock(&ocxl_mem_lock);
+	region->_next = ocxl_mem_regions;
+	ocxl_mem_regions = region;
+	pthread_mutex_unlock(&ocxl_mem_lock);
+
+	debug_msg("ocxl_mem_register: 0x%016" PRIx64 " - 0x%016" PRIx64, region->start, region->end);
+	return OCXL_OK;
+}
+
+// unregister a range of host memory previously passed to ocxl_mem_register
+ocxl_err ocxl_mem_unregister(void *addr)
+{
+	struct ocxl_mem_region **list;
+	struct ocxl_mem_region *region;
+
+	pthread_mutex_lock(&ocxl_mem_lock);
+	for (list = &ocxl_mem_regions; *list != NULL; list = &((*list)->_next)) {
+		if ((*list)->start == (uint64_t)addr) {
+			region = *list;
+			*list = region->_next;
+			pthread_mutex_unlock(&ocxl_mem_lock);
+			free(region);
+			return OCXL_OK;
+		}
+	}
+	pthread_mutex_unlock(&ocxl_mem_lock);
+
+	warn_msg("ocxl_mem_unregister: no region registered @ 0x%016" PRIx64, (uint64_t)addr);
+	return OCXL_INVALID_ARGS;
+}
@@ -97,6 +97,7 @@ typedef enum {
 typedef enum {
   OCXL_EVENT_IRQ = 0,
   OCXL_EVENT_TRANSLATION_FAULT = 1,
+  OCXL_EVENT_LPC_COPY = 2,
 } ocxl_event_type;
 
 /*
@@ -119,20 +120,40 @@ typedef struct {
   //#endif
 } ocxl_event_translation_fault;
 
+/*
+ * the data for a completed asynchronous lpc copy
+ */
+typedef struct {
+  void *data;       // host buffer given to ocxl_lpc_copy_to/from
+  uint64_t offset;  // lpc offset of the copy
+  uint64_t size;
+  void *arg;        // caller's argument given with the copy
+  ocxl_err status;
+} ocxl_event_lpc_copy;
+
 /*
  * an ocxl event
  * 
- * may be an afu interrupt or a translation fault
+ * may be an afu interrupt, a translation fault or a completed lpc copy
  */
 typedef struct ocxl_event {
   ocxl_event_type type;
   union {
     ocxl_event_irq irq;
     ocxl_event_translation_fault translation_fault;
+    ocxl_event_lpc_copy lpc_copy;
     uint64_t padding[16];
   };
 } ocxl_event;
 
+/*
+ * completion callback for an asynchronous lpc copy
+ *
+ * runs on the libocxl service thread, so it must not block or call other
+ * ocxl functions that wait on the afu
+ */
+typedef void (*ocxl_lpc_copy_cb)( ocxl_afu_h afu, ocxl_event_lpc_copy *copy );
+
 /*
  * an ocxl wait event
  * 
@@ -274,6 +295,15 @@ const char *ocxl_err_to_string( ocxl_err err );
 // the routine will block until someone issues a "wake_host_thead" or asb_notify
 ocxl_err ocxl_wait();
 
+/*
+ * host memory registration
+ */
+// afu accesses to host memory are normally validated one at a time before ocse touches the memory.
+// accesses that fall entirely inside a registered region skip that check.
+// the caller must keep a registered region mapped until it is unregistered.
+ocxl_err ocxl_mem_register( void *addr, size_t size );
+ocxl_err ocxl_mem_unregister( void *addr );
+
 // the following notions can be found in libocxl_lpc.  they are not part of the normal reference user api
 // think about an lpc or "host agent memory" set of helper functions
 // maybe a map function
@@ -23,8 +23,6 @@
 #include <poll.h>
 #include <pthread.h>
 
-#define EVENT_QUEUE_MAX 3
-
 enum libocxl_req_state {
 	LIBOCXL_REQ_IDLE,
 	LIBOCXL_REQ_REQUEST,
@@ -74,6 +72,57 @@ struct mem_req {
 	volatile uint64_t size;
 	volatile uint64_t be;
 	uint8_t *data;
+	struct lpc_copy *copy;  // bulk copy an lpc stride belongs to
+};
+
+// a bulk lpc read or write.  the reactor splits it into strides as room
+// frees up in the afu's stride ring and completes copies in order
+struct lpc_copy {
+	volatile enum libocxl_req_state state;
+	uint8_t type;       // OCSE_LPC_READ or OCSE_LPC_WRITE
+	uint64_t offset;
+	uint8_t *data;
+	uint64_t size;
+	uint64_t queued;    // bytes handed to the stride ring so far
+	uint64_t acked;     // bytes acknowledged by ocse
+	ocxl_err status;
+	int wait;           // the caller waits on state and frees the copy
+	ocxl_lpc_copy_cb callback;  // NULL posts an OCXL_EVENT_LPC_COPY instead
+	void *arg;
+	struct lpc_copy *_next;
+	struct lpc_copy *_flush;  // next copy in an ocxl_lpc_flush batch
+};
+
+// lpc strides a bulk transfer may have outstanding at ocse at once
+#define LPC_STRIDES_MAX 64
+
+// a range of host memory registered with ocxl_mem_register
+// afu accesses inside it skip the address validation in _testmemaddr
+struct ocxl_mem_region {
+	uint64_t start;
+	uint64_t end;
+	struct ocxl_mem_region *_next;
+};
+
+// a local mapping of lpc memory set up by ocxl_lpc_map_window.  pages are
+// fetched from the afu on first touch through userfaultfd and compared to
+// their shadow copy to find the dirty ones on flush
+struct lpc_window {
+	uint8_t *addr;      // mapping handed to the application
+	uint8_t *shadow;    // page contents as last fetched from or written to the afu
+	uint8_t *present;   // per page, set once the page has been fetched
+	uint64_t offset;    // lpc offset of the window
+	uint64_t size;
+	long page_size;
+	int uffd;
+	int stop[2];
+	pthread_t thread;
+};
+
+// an event waiting for ocxl_afu_event_check, queued in arrival order
+struct ocxl_event_entry {
+	ocxl_event event;
+	struct ocxl_event_entry *_next;
 };
 
 typedef struct ocxl_afu ocxl_afu;
@@ -87,9 +136,9 @@ typedef struct ocxl_mmio_area {
 
 // struct ocxl_afu_h {
 struct ocxl_afu {
-	pthread_t thread;
 	pthread_mutex_t event_lock;
-	ocxl_event *events[EVENT_QUEUE_MAX];
+	struct ocxl_event_entry *events;       // unbounded, so no event is dropped
+	struct ocxl_event_entry *events_last;
         uint64_t ppc64_amr;
 	char *id;
         ocxl_identifier ocxl_id;
@@ -116,6 +165,9 @@ struct ocxl_afu {
 	uint16_t map;  
 	uint8_t dbg_id;
 	int fd;
+	int wake_fd;   // written to wake the reactor thread after posting a request
+	int stopped;   // the reactor no longer services this afu's socket
+	int closing;   // set while the afu is being removed from the reactor
 	int opened;
 	int attached;
 	int mapped;
@@ -128,10 +180,26 @@ struct ocxl_afu {
 	struct attach_req attach;
 	struct mmio_req mmio;
 	struct mem_req mem;
+	struct mem_req lpc[LPC_STRIDES_MAX];  // ring of bulk lpc strides
+	volatile uint32_t lpc_head;  // oldest stride not yet acknowledged
+	volatile uint32_t lpc_send;  // next stride to send to ocse
+	volatile uint32_t lpc_tail;  // next free slot in the ring
+	pthread_mutex_t lpc_lock;    // guards the copy list between api and reactor
+	pthread_mutex_t req_lock;    // with req_cond, wakes _reactor_wait
+	pthread_cond_t req_cond;
+	struct lpc_copy *lpc_copies; // outstanding copies, oldest first
+	struct lpc_copy *lpc_last;   // newest outstanding copy
+	struct lpc_copy *lpc_queue;  // oldest copy with bytes left to stride
+	struct lpc_window *lpc_window;
 	struct ocxl_irq *irq;
+	struct ocxl_afu *_next_reactor;
   //struct ocxl_afu *_head;
   //struct ocxl_afu *_next;
   //struct ocxl_afu *_next_adapter; // ???
 };
 
+// libocxl.c, the reactor thread that talks to ocse for every afu
+void _reactor_wake(struct ocxl_afu *afu);
+void _reactor_wait(struct ocxl_afu *afu, volatile enum libocxl_req_state *state);
+
 #endif
@@ -22,14 +22,20 @@
 #include <arpa/inet.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <linux/userfaultfd.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
@@ -40,6 +46,10 @@
 #include "libocxl_internal.h"
 #include "../common/utils.h"
 
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1  // linux 5.11, missing from older headers
+#endif
+
 #define API_VERSION            1
 #define API_VERSION_COMPATIBLE 1
 
@@ -68,16 +78,61 @@
 #define DSISR 0x4000000040000000L
 #define ERR_BUFF_MAX_COPY_SIZE 4096
 
-static int _delay_1ms()
+// handle routines that catch calls from the libocxl reactor
+// are found in libocxl.c
+
+// queue a bulk copy for the reactor, which splits it into legally aligned and
+// sized strides and keeps up to LPC_STRIDES_MAX of them in flight at ocse
+static struct lpc_copy *_lpc_copy(struct ocxl_afu *my_afu, uint8_t type, uint64_t offset, uint8_t *data, uint64_t size,
+				  int wait, ocxl_lpc_copy_cb callback, void *arg)
 {
-	struct timespec ts;
-	ts.tv_sec = 0;
-	ts.tv_nsec = 1000000;
-	return nanosleep(&ts, &ts);
+	struct lpc_copy *copy;
+
+	copy = (struct lpc_copy *)calloc(1, sizeof(struct lpc_copy));
+	if (copy == NULL)
+		return NULL;
+	copy->type = type;
+	copy->offset = offset;
+	copy->data = data;
+	copy->size = size;
+	copy->status = OCXL_OK;
+	copy->wait = wait;
+	copy->callback = callback;
+	copy->arg = arg;
+	copy->state = LIBOCXL_REQ_REQUEST;
+
+	pthread_mutex_lock(&(my_afu->lpc_lock));
+	if (my_afu->lpc_last != NULL)
+		my_afu->lpc_last->_next = copy;
+	else
+		my_afu->lpc_copies = copy;
+	my_afu->lpc_last = copy;
+	if (my_afu->lpc_queue == NULL)
+		my_afu->lpc_queue = copy;
+	pthread_mutex_unlock(&(my_afu->lpc_lock));
+	_reactor_wake(my_afu);
+
+	return copy;
 }
 
-// handle routines that catch calls from libocxl._psl_loop
-// are found in libocxl.c
+// queue a bulk copy and wait for the reactor to complete it
+static int _lpc_copy_wait(struct ocxl_afu *my_afu, uint8_t type, uint64_t offset, uint8_t *data, uint64_t size)
+{
+	struct lpc_copy *copy;
+	ocxl_err status;
+
+	copy = _lpc_copy(my_afu, type, offset, data, size, 1, NULL, NULL);
+	if (copy == NULL)
+		return -1;
+	_reactor_wait(my_afu, &(copy->state));
+	// a copy abandoned by a failed afu is freed with the afu
+	if (copy->state != LIBOCXL_REQ_IDLE)
+		return -1;
+
+	status = copy->status;
+	free(copy);
+	return (status == OCXL_OK) ? 0 : -1;
+}
 
 // routines that are called by user applications.
 ocxl_err ocxl_lpc_map(ocxl_afu_h afu, uint32_t flags)
@@ -104,8 +159,8 @@ ocxl_err ocxl_lpc_map(ocxl_afu_h afu, uint32_t flags)
 	my_afu->mem.type = OCSE_LPC_MAP;
 	my_afu->mem.data = (uint8_t *)&(flags);
 	my_afu->mem.state = LIBOCXL_REQ_REQUEST;
-	while (my_afu->mem.state != LIBOCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_reactor_wake(my_afu);
+	_reactor_wait(my_afu, &(my_afu->mem.state));
 	my_afu->lpc_mapped = 1;
 
 	return 0;
@@ -114,12 +169,257 @@ ocxl_err ocxl_lpc_map(ocxl_afu_h afu, uint32_t flags)
 	return -1;
 }
 
+// fetch the pages of the lpc window as the application first touches them
+static void *_lpc_window_faults(void *ptr)
+{
+	struct ocxl_afu *my_afu = (struct ocxl_afu *)ptr;
+	struct lpc_window *window = my_afu->lpc_window;
+	struct uffd_msg msg;
+	struct uffdio_copy copy;
+	struct uffdio_range range;
+	struct pollfd fds[2];
+	uint64_t page;
+
+	fds[0].fd = window->uffd;
+	fds[0].events = POLLIN;
+	fds[1].fd = window->stop[0];
+	fds[1].events = POLLIN;
+	while (1) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			warn_msg("_lpc_window_faults: poll failed");
+			break;
+		}
+		if (fds[1].revents)
+			break;
+		if (read(window->uffd, &msg, sizeof(msg)) != sizeof(msg))
+			continue;
+		if (msg.event != UFFD_EVENT_PAGEFAULT)
+			continue;
+
+		// one bulk transfer brings in the whole page
+		page = (msg.arg.pagefault.address - (uint64_t)window->addr) / window->page_size;
+		debug_msg("_lpc_window_faults: fetching page %d of the lpc window", page);
+		if (_lpc_copy_wait(my_afu, OCSE_LPC_READ,
+				   window->offset + page * window->page_size,
+				   window->shadow + page * window->page_size,
+				   window->page_size) < 0) {
+			// don't map what the afu did not return.  the page is
+			// made inaccessible and the faulting access, and any
+			// later one, fails with SIGSEGV
+			warn_msg("_lpc_window_faults: failed to fetch lpc page at offset 0x%016lx, failing the access",
+				 window->offset + page * window->page_size);
+			range.start = (uint64_t)window->addr + page * window->page_size;
+			range.len = window->page_size;
+			if ((mprotect((void *)range.start, range.len, PROT_NONE) < 0) ||
+			    (ioctl(window->uffd, UFFDIO_WAKE, &range) < 0))
+				warn_msg("_lpc_window_faults: unable to fail the access to page %d", page);
+			continue;
+		}
+		window->present[page] = 1;
+
+		copy.dst = (uint64_t)window->addr + page * window->page_size;
+		copy.src = (uint64_t)window->shadow + page * window->page_size;
+		copy.len = window->page_size;
+		copy.mode = 0;
+		copy.copy = 0;
+		if ((ioctl(window->uffd, UFFDIO_COPY, &copy) < 0) && (errno != EEXIST))
+			warn_msg("_lpc_window_faults: UFFDIO_COPY failed");
+	}
+
+	return NULL;
+}
+
+// map size bytes of lpc memory starting at offset into the application's
+// address space.  pages are fetched from the afu on first touch, one bulk
+// transfer per page, and written back by ocxl_lpc_flush or ocxl_lpc_unmap
+ocxl_err ocxl_lpc_map_window(ocxl_afu_h afu, uint32_t flags, uint64_t offset, uint64_t size, void **addr)
+{
+        struct ocxl_afu *my_afu;
+	struct lpc_window *window;
+	struct uffdio_api api;
+	struct uffdio_register reg;
+	uint64_t pages;
+
+	my_afu = (struct ocxl_afu *)afu;
+	debug_msg("ocxl_lpc_map_window: %d bytes at lpc offset 0x%016lx", size, offset);
+
+        if (!my_afu) {
+	      warn_msg("NULL afu passed to ocxl_lpc_map_window");
+	      return OCXL_NO_DEV;
+	}
+
+	if (my_afu->lpc_window != NULL) {
+	      warn_msg("ocxl_lpc_map_window: afu already has an lpc window");
+	      return OCXL_ALREADY_DONE;
+	}
+
+	if ((size == 0) || (addr == NULL)) {
+	      warn_msg("ocxl_lpc_map_window: Invalid window!");
+	      return OCXL_INVALID_ARGS;
+	}
+
+	if (!my_afu->lpc_mapped && (ocxl_lpc_map(afu, flags) != 0))
+		return OCXL_NO_DEV;
+
+	window = (struct lpc_window *)calloc(1, sizeof(struct lpc_window));
+	if (window == NULL)
+		return OCXL_NO_MEM;
+	window->offset = offset;
+	window->page_size = sysconf(_SC_PAGESIZE);
+	pages = (size + window->page_size - 1) / window->page_size;
+	window->size = pages * window->page_size;
+	window->uffd = -1;
+	window->stop[0] = -1;
+	window->stop[1] = -1;
+
+	window->addr = mmap(NULL, window->size, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (window->addr == MAP_FAILED) {
+		window->addr = NULL;
+		goto window_fail;
+	}
+	window->shadow = (uint8_t *)malloc(window->size);
+	window->present = (uint8_t *)calloc(pages, 1);
+	if ((window->shadow == NULL) || (window->present == NULL))
+		goto window_fail;
+
+	// the window only needs the application's own faults, which works
+	// without privilege.  kernels before 5.11 don't know the flag
+	window->uffd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+	if ((window->uffd < 0) && (errno == EINVAL))
+		window->uffd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+	if (window->uffd < 0) {
+		warn_msg("ocxl_lpc_map_window: userfaultfd is not available");
+		goto window_fail;
+	}
+	api.api = UFFD_API;
+	api.features = 0;
+	if (ioctl(window->uffd, UFFDIO_API, &api) < 0) {
+		warn_msg("ocxl_lpc_map_window: UFFDIO_API failed");
+		goto window_fail;
+	}
+	reg.range.start = (uint64_t)window->addr;
+	reg.range.len = window->size;
+	reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+	if (ioctl(window->uffd, UFFDIO_REGISTER, &reg) < 0) {
+		warn_msg("ocxl_lpc_map_window: UFFDIO_REGISTER failed");
+		goto window_fail;
+	}
+
+	if (pipe(window->stop) < 0)
+		goto window_fail;
+	my_afu->lpc_window = window;
+	if (pthread_create(&(window->thread), NULL, _lpc_window_faults, my_afu)) {
+		my_afu->lpc_window = NULL;
+		goto window_fail;
+	}
+
+	*addr = window->addr;
+	return OCXL_OK;
+
+ window_fail:
+	if (window->stop[0] >= 0) {
+		close(window->stop[0]);
+		close(window->stop[1]);
+	}
+	if (window->uffd >= 0)
+		close(window->uffd);
+	if (window->addr != NULL)
+		munmap(window->addr, window->size);
+	free(window->shadow);
+	free(window->present);
+	free(window);
+	return OCXL_INTERNAL_ERROR;
+}
+
+// write every page of the lpc window that changed since it was fetched or
+// last flushed back to the afu.  the pages are pipelined as one batch of
+// copies
+ocxl_err ocxl_lpc_flush(ocxl_afu_h afu)
+{
+        struct ocxl_afu *my_afu;
+	struct lpc_window *window;
+	struct lpc_copy *copy, *copies, **last;
+	uint64_t page, pages;
+	uint8_t *shadow;
+	ocxl_err rc;
+
+	my_afu = (struct ocxl_afu *)afu;
+        if (!my_afu) {
+	      warn_msg("NULL afu passed to ocxl_lpc_flush");
+	      return OCXL_NO_DEV;
+	}
+
+	window = my_afu->lpc_window;
+	if (window == NULL)
+		return OCXL_OK;
+
+	copies = NULL;
+	last = &copies;
+	pages = window->size / window->page_size;
+	for (page = 0; page < pages; page++) {
+		if (!window->present[page])
+			continue;
+		shadow = window->shadow + page * window->page_size;
+		if (memcmp(shadow, window->addr + page * window->page_size, window->page_size) == 0)
+			continue;
+		memcpy(shadow, window->addr + page * window->page_size, window->page_size);
+		debug_msg("ocxl_lpc_flush: writing back page %d of the lpc window", page);
+		copy = _lpc_copy(my_afu, OCSE_LPC_WRITE, window->offset + page * window->page_size,
+				 shadow, window->page_size, 1, NULL, NULL);
+		if (copy == NULL)
+			break;
+		*last = copy;
+		last = &(copy->_flush);
+	}
+
+	// wait for the whole batch, the copies complete in order
+	rc = (page == pages) ? OCXL_OK : OCXL_NO_MEM;
+	while (copies != NULL) {
+		copy = copies;
+		copies = copy->_flush;
+		_reactor_wait(my_afu, &(copy->state));
+		if (copy->state != LIBOCXL_REQ_IDLE) {
+			// abandoned copies are freed with the afu
+			rc = OCXL_NO_DEV;
+			continue;
+		}
+		if (copy->status != OCXL_OK)
+			rc = copy->status;
+		free(copy);
+	}
+
+	return rc;
+}
+
 ocxl_err ocxl_lpc_unmap(ocxl_afu_h afu)
 {
         struct ocxl_afu *my_afu;
+	struct lpc_window *window;
+	uint8_t stop = 1;
+	ocxl_err rc;
+
 	my_afu = (struct ocxl_afu *)afu;
+	rc = OCXL_OK;
+	window = my_afu->lpc_window;
+	if (window != NULL) {
+		rc = ocxl_lpc_flush(afu);
+		if (write(window->stop[1], &stop, 1) < 0)
+			warn_msg("ocxl_lpc_unmap: failed to stop lpc window thread");
+		pthread_join(window->thread, NULL);
+		my_afu->lpc_window = NULL;
+		close(window->stop[0]);
+		close(window->stop[1]);
+		close(window->uffd);
+		munmap(window->addr, window->size);
+		free(window->shadow);
+		free(window->present);
+		free(window);
+	}
 	my_afu->lpc_mapped = 0;
-	return 0;
+	return rc;
 }
 
 // write size bytes from *data to offset in afu
@@ -148,63 +448,8 @@ ocxl_err ocxl_lpc_write(ocxl_afu_h afu, uint64_t offset, uint8_t *val, uint64_t
 
         // check address alignment against size - not required - any alignment is legal
 
-	my_afu->mem.type = OCSE_LPC_WRITE;
-	my_afu->mem.be = 0;
-
-	int i;
-	uint64_t to_i;
-	int stride;
-	int remainder;
-
-	for (i=0; i<size; i=i+stride) {
-	  to_i = offset + i;
-	  remainder = size - i;
-	  if ( ( to_i & 0x1 ) !=0 ) {
-	    // byte aligned address, send 1 byte, add 1 to i
-	    stride = 1;
-	  } else if ( ( to_i & 0x2 ) !=0 ) {
-	    // 2-byte aligned address, send 2 byte, add 2 to i
-	    stride = 2;
-	  } else if ( ( to_i & 0x4 ) !=0 ) {
-	    // 4-byte aligned address, send 4 byte, add 4 to i
-	    stride = 4;
-	  } else if ( ( to_i & 0x8 ) !=0 ) {
-	    // 8-byte aligned address, send 8 byte, add 8 to i
-	    stride = 8;
-	  } else if ( ( to_i & 0x10 ) !=0 ) {
-	    // 16-byte aligned address, send 16 byte, add 16 to i
-	    stride = 16;
-	  } else if ( ( to_i & 0x20 ) !=0 ) {
-	    // 32-byte aligned address, send 32 byte, add 32 to i
-	    stride = 32;
-	  } else if ( ( to_i & 0x40 ) !=0 ) {
-	    // 64-byte aligned address, send 64 byte, add 64 to i
-	    stride = 64;
-	  } else if ( ( to_i & 0x80 ) !=0 ) {
-	    // 128-byte aligned address, send 128 byte, add 128 to i
-	    stride = 128;
-	  } else {
-	    // 256-byte aligned address, send 256 byte, add 256 to i
-	    stride = 256;
-	  }
-	  
-	  while ( stride > remainder ) {
-	    stride = stride / 2;
-	  }
-
-	  // Send a legally aligned and sized memory write to OCSE
-	  // and wait for the ack.
-	  my_afu->mem.addr = offset + i;
-	  my_afu->mem.size = stride;
-	  my_afu->mem.data = val + i;
-	  my_afu->mem.state = LIBOCXL_REQ_REQUEST;
-	  debug_msg("ocxl_lpc_write stride : %d bytes to lpc offset 0x%016lx", stride, offset + i);
-	  while (my_afu->mem.state != LIBOCXL_REQ_IDLE)	/*infinite loop */
-	    _delay_1ms();
-	  
-	  if (!my_afu->opened)
-	    goto write_fail;
-	}
+	if (_lpc_copy_wait(my_afu, OCSE_LPC_WRITE, offset, val, size) < 0)
+		goto write_fail;
 
 	return 0;
 
@@ -249,8 +494,8 @@ ocxl_err ocxl_lpc_write_be(ocxl_afu_h afu, uint64_t offset, uint8_t *val, uint64
 	my_afu->mem.data = val;
 	my_afu->mem.be = byte_enable;
 	my_afu->mem.state = LIBOCXL_REQ_REQUEST;
-	while (my_afu->mem.state != LIBOCXL_REQ_IDLE)	/*infinite loop */
-		_delay_1ms();
+	_reactor_wake(my_afu);
+	_reactor_wait(my_afu, &(my_afu->mem.state));
 
 	if (!my_afu->opened)
 		goto write_fail;
@@ -288,73 +533,8 @@ ocxl_err ocxl_lpc_read(ocxl_afu_h afu, uint64_t offset, uint8_t *out, uint64_t s
 
         // check address alignment against size - not required - any alignment is legal
 
-	my_afu->mem.type = OCSE_LPC_READ;
-	my_afu->mem.be = 0;
-
-	int i;
-	uint64_t to_i;
-	int stride;
-	int remainder;
-
-	for (i=0; i<size; i=i+stride) {
-	  to_i = offset + i;
-	  remainder = size - i;
-	  if ( ( to_i & 0x1 ) !=0 ) {
-	    // byte aligned address, send 1 byte, add 1 to i
-	    stride = 1;
-	  } else if ( ( to_i & 0x2 ) !=0 ) {
-	    // 2-byte aligned address, send 2 byte, add 2 to i
-	    stride = 2;
-	  } else if ( ( to_i & 0x4 ) !=0 ) {
-	    // 4-byte aligned address, send 4 byte, add 4 to i
-	    stride = 4;
-	  } else if ( ( to_i & 0x8 ) !=0 ) {
-	    // 8-byte aligned address, send 8 byte, add 8 to i
-	    stride = 8;
-	  } else if ( ( to_i & 0x10 ) !=0 ) {
-	    // 16-byte aligned address, send 16 byte, add 16 to i
-	    stride = 16;
-	  } else if ( ( to_i & 0x20 ) !=0 ) {
-	    // 32-byte aligned address, send 32 byte, add 32 to i
-	    stride = 32;
-	  } else if ( ( to_i & 0x40 ) !=0 ) {
-	    // 64-byte aligned address, send 64 byte, add 64 to i
-	    stride = 64;
-	  } else if ( ( to_i & 0x80 ) !=0 ) {
-	    // 128-byte aligned address, send 128 byte, add 128 to i
-	    stride = 128;
-	  } else {
-	    // 256-byte aligned address, send 256 byte, add 256 to i
-	    stride = 256;
-	  }
-	  
-	  while ( stride > remainder ) {
-	    stride = stride / 2;
-	  }
-
-	  // Send a legally aligned and sized memory read to OCSE
-	  // and wait for the ack.
-	  my_afu->mem.addr = offset + i;
-	  my_afu->mem.size = stride;
-	  my_afu->mem.state = LIBOCXL_REQ_REQUEST;
-	  debug_msg("ocxl_lpc_read stride : %d bytes from lpc offset 0x%016lx", stride, offset + i);
-	  while (my_afu->mem.state != LIBOCXL_REQ_IDLE)	/*infinite loop */
-	    _delay_1ms();
-	  
-	  // copy the data by copying the pointer
-	  if (my_afu->mem.data == NULL) {
-	    warn_msg("afu lpc memory not returned");
-	    goto read_fail;
-	  }
-
-	  // we expect mem.data to be a full length buffer of the data we are reading
-	  // that is, the length of mem.data should match mem.size
-	  memcpy( out + i, my_afu->mem.data, my_afu->mem.size );
-	  free( my_afu->mem.data );
-
-	  if (!my_afu->opened)
-	    goto read_fail;
-	}
+	if (_lpc_copy_wait(my_afu, OCSE_LPC_READ, offset, out, size) < 0)
+		goto read_fail;
 
 	return 0;
 
@@ -363,3 +543,58 @@ ocxl_err ocxl_lpc_read(ocxl_afu_h afu, uint64_t offset, uint8_t *out, uint64_t s
 	return -1;
 }
 
+// start copying size bytes from *val to offset in afu lpc memory and return
+// without waiting.  the strides of the copy are pipelined in the background
+// and callback runs, or with a NULL callback an OCXL_EVENT_LPC_COPY event is
+// posted to the afu event fd, once the whole copy is done.  *val must stay
+// valid until then
+ocxl_err ocxl_lpc_copy_to(ocxl_afu_h afu, uint64_t offset, uint8_t *val, uint64_t size,
+			  ocxl_lpc_copy_cb callback, void *arg)
+{
+        struct ocxl_afu *my_afu;
+	my_afu = (struct ocxl_afu *)afu;
+
+	debug_msg("ocxl_lpc_copy_to: %d bytes to lpc offset 0x%016lx", size, offset);
+
+        if (!my_afu) {
+	      warn_msg("NULL afu passed to ocxl_lpc_copy_to");
+	      return OCXL_NO_DEV;
+	}
+
+        if (!my_afu->lpc_mapped) {
+	      warn_msg("afu lpc space is not mapped");
+	      return OCXL_NO_DEV;
+	}
+
+	if (_lpc_copy(my_afu, OCSE_LPC_WRITE, offset, val, size, 0, callback, arg) == NULL)
+		return OCXL_NO_MEM;
+
+	return OCXL_OK;
+}
+
+// start copying size bytes from offset in afu lpc memory to *out and return
+// without waiting.  completes like ocxl_lpc_copy_to, *out is only valid once
+// the copy completes
+ocxl_err ocxl_lpc_copy_from(ocxl_afu_h afu, uint64_t offset, uint8_t *out, uint64_t size,
+			    ocxl_lpc_copy_cb callback, void *arg)
+{
+        struct ocxl_afu *my_afu;
+	my_afu = (struct ocxl_afu *)afu;
+
+	debug_msg("ocxl_lpc_copy_from: %d bytes from lpc offset 0x%016lx", size, offset);
+
+        if (!my_afu) {
+	      warn_msg("NULL afu passed to ocxl_lpc_copy_from");
+	      return OCXL_NO_DEV;
+	}
+
+        if (!my_afu->lpc_mapped) {
+	      warn_msg("afu lpc space is not mapped");
+	      return OCXL_NO_DEV;
+	}
+
+	if (_lpc_copy(my_afu, OCSE_LPC_READ, offset, out, size, 0, callback, arg) == NULL)
+		return OCXL_NO_MEM;
+
+	return OCXL_OK;
+}
@@ -53,6 +53,13 @@ extern "C" {
 ocxl_err ocxl_lpc_map(ocxl_afu_h afu, uint32_t flags);
 ocxl_err ocxl_lpc_unmap(ocxl_afu_h afu);
 
+// map "size" bytes of lpc memory starting at "offset" and return a pointer to them in "addr".  pages are
+// fetched from the afu when first touched and changed pages are written back by ocxl_lpc_flush or
+// ocxl_lpc_unmap, which must be called before the afu is closed.  one window per afu.  an access to a
+// page the afu fails to return raises SIGSEGV, as do later accesses to that page
+ocxl_err ocxl_lpc_map_window(ocxl_afu_h afu, uint32_t flags, uint64_t offset, uint64_t size, void **addr);
+ocxl_err ocxl_lpc_flush(ocxl_afu_h afu);
+
 // write the "size" bytes starting at "data" to the location starting at "offset" in lpc memory known to "afu"
 ocxl_err ocxl_lpc_write(ocxl_afu_h afu, uint64_t offset, uint8_t *val, uint64_t size );
 // write_be is always 64 bytes of data to the offset under control of byte_enable
@@ -61,6 +68,14 @@ ocxl_err ocxl_lpc_write_be(ocxl_afu_h afu, uint64_t offset, uint8_t *val, uint64
 // read the "size" bytes starting at "offset" in lpc memory known to "afu" and save them starting at "data"
 ocxl_err ocxl_lpc_read(ocxl_afu_h afu, uint64_t offset, uint8_t *out, uint64_t size );
 
+// asynchronous versions of ocxl_lpc_write and ocxl_lpc_read.  they return once the copy is queued
+// and report completion through "callback", or an OCXL_EVENT_LPC_COPY event on the afu event fd if
+// "callback" is NULL.  copies complete in the order they were started
+ocxl_err ocxl_lpc_copy_to(ocxl_afu_h afu, uint64_t offset, uint8_t *val, uint64_t size,
+			  ocxl_lpc_copy_cb callback, void *arg );
+ocxl_err ocxl_lpc_copy_from(ocxl_afu_h afu, uint64_t offset, uint8_t *out, uint64_t size,
+			    ocxl_lpc_copy_cb callback, void *arg );
+
 
 #ifdef __cplusplus
 }
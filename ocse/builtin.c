@@ -0,0 +1,102 @@
+/*
+ * Copyright 2014,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Description: builtin.c
+ *
+ *  AFU models linked into the ocse executable, selected with a shim_host.dat
+ *  line like "tlx0,builtin:testafu".  Unlike a plug-in a model works on an
+ *  AFU_EVENT of its own, just like an AFU simulator on a socket, and the
+ *  events are moved between the two with tlx_handoff_events().
+ *
+ *  The models are not part of the plain ocse target.  Their entry points are
+ *  weak references that stay NULL unless a target such as ocse-testafu links
+ *  the model in.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtin.h"
+#include "../common/utils.h"
+
+// Test AFU, test/afu/Builtin.cpp
+void *testafu_open(const char *name) __attribute__ ((weak));
+void testafu_signal(void *afu, struct AFU_EVENT *event) __attribute__ ((weak));
+void testafu_close(void *afu) __attribute__ ((weak));
+
+struct builtin_model {
+	const char *name;
+	const char *target;	// make target that links it in
+	void *(*open) (const char *name);
+	void (*signal) (void *afu, struct AFU_EVENT * event);
+	void (*close) (void *afu);
+};
+
+static const struct builtin_model models[] = {
+	{"testafu", "ocse-testafu", testafu_open, testafu_signal, testafu_close},
+	{NULL, NULL, NULL, NULL, NULL}
+};
+
+struct builtin {
+	const struct builtin_model *model;
+	void *afu;
+};
+
+struct builtin *builtin_open(char *model, char *name)
+{
+	const struct builtin_model *m;
+	struct builtin *builtin;
+
+	for (m = models; m->name != NULL; m++) {
+		if (!strcmp(m->name, model))
+			break;
+	}
+	if (m->name == NULL) {
+		warn_msg("builtin: no AFU model called %s", model);
+		return NULL;
+	}
+	if ((m->open == NULL) || (m->signal == NULL) || (m->close == NULL)) {
+		warn_msg("builtin: %s is not linked into this ocse, build %s",
+			 model, m->target);
+		return NULL;
+	}
+
+	if ((builtin = (struct builtin *)malloc(sizeof(struct builtin))) == NULL) {
+		perror("malloc");
+		return NULL;
+	}
+	builtin->model = m;
+	if ((builtin->afu = m->open(name)) == NULL) {
+		warn_msg("builtin: %s failed to start for %s", model, name);
+		free(builtin);
+		return NULL;
+	}
+	return builtin;
+}
+
+void builtin_signal_afu(struct builtin *builtin, struct AFU_EVENT *event)
+{
+	builtin->model->signal(builtin->afu, event);
+}
+
+void builtin_close(struct builtin *builtin)
+{
+	if (builtin == NULL)
+		return;
+	builtin->model->close(builtin->afu);
+	free(builtin);
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright 2014,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _BUILTIN_H_
+#define _BUILTIN_H_
+
+#include "../common/tlx_interface.h"
+
+struct builtin;
+
+// Start the AFU model called model for tlx entry name
+struct builtin *builtin_open(char *model, char *name);
+
+// Counterpart of tlx_signal_afu_model() and tlx_get_afu_events() in one: hand
+// the model what ocse queued in event, take what it queued for ocse and clock
+// it once
+void builtin_signal_afu(struct builtin *builtin, struct AFU_EVENT *event);
+
+void builtin_close(struct builtin *builtin);
+
+#endif				/* _BUILTIN_H_ */
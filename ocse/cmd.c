@@ -41,7 +41,9 @@
 
 #include "cmd.h"
 #include "mmio.h"
+#include "trace.h"
 #include "../common/debug.h"
+#include "../common/probe.h"
 #include "../common/utils.h"
 
 #define CACHELINE_MASK 0xFFFFFFFFFFFFFFC0L
@@ -82,6 +84,7 @@ struct cmd *cmd_init(struct AFU_EVENT *afu_event, struct parms *parms,
 	cmd->afu_name = afu_name;
 	cmd->dbg_fp = dbg_fp;
 	cmd->dbg_id = dbg_id;
+	cmd->latency = latency_init();
 	return cmd;
 }
 
@@ -125,6 +128,20 @@ static int32_t _find_client_by_actag(struct cmd *cmd, uint16_t cmd_actag)
   return -1;
 }
 
+// Is event waiting for a client to answer?
+static int _at_client(struct cmd_event *event)
+{
+	return event->stamp.valid[LAT_CLIENT] && !event->stamp.valid[LAT_RETURN];
+}
+
+// Mark event sent to or answered by a client, keeping cmd->at_client
+static void _mark(struct cmd *cmd, struct cmd_event *event,
+		  enum latency_mark mark)
+{
+	cmd->at_client -= _at_client(event);
+	latency_mark(cmd->latency, &(event->stamp), mark);
+	cmd->at_client += _at_client(event);
+}
 
 // Update all pending responses at once to new state - do we KEEP?
 /*static void _update_pending_resps(struct cmd *cmd, uint32_t resp)
@@ -243,9 +260,14 @@ static void _add_cmd(struct cmd *cmd, uint32_t context, uint32_t afutag,
 		head = &((*head)->_next);
 	event->_next = *head;
 	*head = event;
+	latency_mark(cmd->latency, &(event->stamp), LAT_ADD);
+	cmd->stats->commands[command & 0xff]++;
+	if (++cmd->outstanding > cmd->stats->max_outstanding)
+		cmd->stats->max_outstanding = cmd->outstanding;
 	debug_msg("_add_cmd:created cmd_event @ 0x%016"PRIx64":command=0x%02x, size=0x%04x, type=0x%02x, afutag=0x%04x, state=0x%03x",
 		 event, event->command, event->size, event->type, event->afutag, event->state );
 	debug_cmd_add(cmd->dbg_fp, cmd->dbg_id, afutag, context, command);
+	OCSE_PROBE4(ocse, cmd_add, cmd->dbg_id, context, afutag, command);
 	// Check to see if event->cmd_data_is_valid is, and if so, set event->buffer_data
 	// TODO check to see if data is bad...if so, what???
 	//if ((event->command >= 0x20) && (event->command <= 0x2f) && (cmd_data_is_valid == 1)) {
@@ -730,6 +752,7 @@ void handle_cmd(struct cmd *cmd, uint32_t latency)
 	// No command ready */
 	if (rc != TLX_SUCCESS)
 		return;
+	cmd->stats->work++;
 
 	debug_msg( "%s:COMMAND actag=0x%02x afutag=0x%04x cmd=0x%x cmd_data_is_valid= 0x%x ",
 		   cmd->afu_name,
@@ -794,6 +817,7 @@ void handle_buffer_write(struct cmd *cmd)
 	// Test for client disconnect
 	if ((event == NULL) || ((client = _get_client(cmd, event)) == NULL))
 		return;
+	cmd->stats->work++;
 
 
 	debug_msg( "handle_buffer_write: we've picked a non-NULL event and the client is still there" );
@@ -890,6 +914,8 @@ void handle_buffer_write(struct cmd *cmd)
 		    client_drop(client, TLX_IDLE_CYCLES, CLIENT_NONE);
 		  }
 		  event->state = MEM_REQUEST;
+		  _mark(cmd, event, LAT_CLIENT);
+		  cmd->stats->bytes_read += event->size;
 		  client->mem_access = (void *)event;
 	        debug_msg("Setting client->mem_access in handle_buffer_write ");
 	        return; //exit immediately
@@ -931,6 +957,8 @@ void handle_buffer_write(struct cmd *cmd)
 		          client_drop(client, TLX_IDLE_CYCLES, CLIENT_NONE);
 		    }
 		    event->state = MEM_REQUEST;
+		    _mark(cmd, event, LAT_CLIENT);
+		    cmd->stats->bytes_read += event->size;
 		    debug_cmd_client( cmd->dbg_fp, cmd->dbg_id, event->afutag,
 				      event->context );
 		    client->mem_access = (void *)event;
@@ -970,6 +998,7 @@ void handle_afu_tlx_cmd_data_read(struct cmd *cmd)
 	debug_msg("entering HANDLE_AFU_TLX_CMD_DATA_READ");
 	rc = afu_tlx_read_cmd_data(cmd->afu_event, &cmd_data_is_valid, dptr,  &cdata_bad);
 	if (rc == TLX_SUCCESS) {
+		cmd->stats->work++;
 		if (cmd_data_is_valid) {
 			debug_msg("Copy another 64B of write data to buffer, addr=0x%016"PRIx64", total read so far=0x%x , afutag= 0x%x .\n",
 			 event->addr, event->dpartial, event->afutag);
@@ -1031,6 +1060,7 @@ void handle_afu_tlx_write_cmd(struct cmd *cmd)
 		debug_msg("client->mem_access NOT NULL so can't send MEMORY write for afutag=0x%x yet!!!!!", event->afutag);
 		return;
 	}
+	cmd->stats->work++;
 	debug_msg("entering HANDLE_AFU_TLX_WRITE_CMD");
 	// Check to see if this cmd gets selected for a RETRY or FAILED or PENDING read_failed response
 	if ( allow_retry(cmd->parms)) {
@@ -1094,6 +1124,8 @@ void handle_afu_tlx_write_cmd(struct cmd *cmd)
 		      	cmd->dbg_id, client->context) < 0) {
 			client_drop(client, TLX_IDLE_CYCLES, CLIENT_NONE);
 		}
+		_mark(cmd, event, LAT_CLIENT);
+		cmd->stats->bytes_written += event->size;
 	}
 	event->state = DMA_MEM_RESP;  //we can't set MEM_DONE until we get ACK back from client (or else SEG FAULT)
 	cmd->buffer_read = NULL;
@@ -1141,6 +1173,7 @@ void handle_write_be_or_amo(struct cmd *cmd)
 		debug_msg("handle_write_be_or_amo: Can't send to client bc client->mem_access not NULL...retry later");
 		return;
 	}
+	cmd->stats->work++;
 	// Check to see if this cmd gets selected for a RETRY or FAILED or PENDING read_failed response
 	if ( allow_retry(cmd->parms)) {
 		event->state = MEM_DONE;
@@ -1248,6 +1281,7 @@ void handle_write_be_or_amo(struct cmd *cmd)
 		}
 
 
+	_mark(cmd, event, LAT_CLIENT);
 	client->mem_access = (void *)event;
 	debug_msg("Setting client->mem_access in handle_write_be_or_amo");
 	return;
@@ -1298,6 +1332,7 @@ void handle_xlate_intrp_pending_sent(struct cmd *cmd)
 	// Test for client disconnect
 	if ((event == NULL) || ((client = _get_client(cmd, event)) == NULL))
 		return;
+	cmd->stats->work++;
 
 	debug_msg("%s:handle xlate_intrp_pending_done cmd_flag=0x%x tag=0x%02x addr=0x%016"PRIx64, cmd->afu_name,
 		  event->cmd_flag, event->afutag, event->addr);
@@ -1324,6 +1359,8 @@ void handle_xlate_intrp_pending_sent(struct cmd *cmd)
 			debug_msg("%s:XLATE_INTRP_DONE CMD event @ 0x%016" PRIx64 ", sent tag=0x%02x code=0x%x cmd=0x%x", cmd->afu_name,
 			    event, event->afutag, event->resp, cmd_to_send);
 			*head = event->_next;
+			cmd->outstanding--;
+			cmd->at_client -= _at_client(event);
 		 	free(event->data);
 		 	//free(event->parity);
 		 	free(event);
@@ -1366,6 +1403,7 @@ void handle_touch(struct cmd *cmd)
 	// Check that memory request can be driven to client
 	if (client->mem_access != NULL)
 		return;
+	cmd->stats->work++;
 
 	debug_msg("%s:XLATE TOUCH cmd_flag=0x%x tag=0x%02x addr=0x%016"PRIx64, cmd->afu_name,
 		  event->cmd_flag, event->afutag, event->addr);
@@ -1412,6 +1450,7 @@ void handle_touch(struct cmd *cmd)
 		client_drop(client, TLX_IDLE_CYCLES, CLIENT_NONE);
 	}
 	event->state = MEM_TOUCH;
+	_mark(cmd, event, LAT_CLIENT);
 	client->mem_access = (void *)event;
 	debug_msg("Setting client->mem_access in handle_touch");
 	debug_cmd_client(cmd->dbg_fp, cmd->dbg_id, event->afutag, event->context); 
@@ -1447,6 +1486,7 @@ void handle_interrupt(struct cmd *cmd)
 	// Test for client disconnect
 	if ((event == NULL) || ((client = _get_client(cmd, event)) == NULL))
 		return;
+	cmd->stats->work++;
 
 	// Check to see if this cmd gets selected for a RETRY or FAILED or PENDING response
 	// No need to set event->resp_opcode if FAILED bc resp_opcode is TLX_RSP_INTRP_RESP  or TLX_RSP_WAKE_HOST_RESP already
@@ -1514,6 +1554,7 @@ void handle_interrupt(struct cmd *cmd)
 		      event->context) < 0) {
 		client_drop(client, TLX_IDLE_CYCLES, CLIENT_NONE);
 	}
+	_mark(cmd, event, LAT_CLIENT);
 	debug_cmd_client(cmd->dbg_fp, cmd->dbg_id, event->afutag, event->context);
 
 	// this assumes the wake host thread finds a thread
@@ -1771,6 +1812,7 @@ void handle_mem_return(struct cmd *cmd, struct cmd_event *event, int fd)
 
 	debug_msg("%s:MEMORY ACK afutag=0x%02x addr=0x%016"PRIx64, cmd->afu_name,
 		  event->afutag, event->addr);
+	_mark(cmd, event, LAT_RETURN);
 
 	// Randomly cause paged response TODO, if still needed, this needs to be updated for ocse
 	/*if (((event->type != CMD_WRITE) || (event->state != MEM_REQUEST)) &&
@@ -1815,6 +1857,7 @@ void handle_mem_return(struct cmd *cmd, struct cmd_event *event, int fd)
 void handle_aerror(struct cmd *cmd, struct cmd_event *event)
 {
   	debug_msg( "ocse:handle_aerror:" );
+	_mark(cmd, event, LAT_RETURN);
 	event->state = MEM_DONE;
 	event->type = CMD_FAILED;
 	event->resp = 0x0e;
@@ -1864,6 +1907,7 @@ void handle_response(struct cmd *cmd)
 	  // maybe we should free it too???
 	  return;
 	}
+	cmd->stats->work++;
 
 
  //`drive_resp:
@@ -1963,17 +2007,27 @@ void handle_response(struct cmd *cmd)
 			debug_msg("%s:RESPONSE event @ 0x%016" PRIx64 ", sent afutag=0x%02x code=0x%x", cmd->afu_name,
 			    event, event->afutag, event->resp);
 			debug_cmd_response(cmd->dbg_fp, cmd->dbg_id, event->afutag, event->resp_opcode, event->resp);
+			trace_cmd(cmd->dbg_id, &(event->stamp),
+				  latency_cycle(cmd->latency), event->command,
+				  event->context, event->afutag, event->resp);
+			latency_done(cmd->latency, &(event->stamp), event->command, event->context);
+			OCSE_PROBE4(ocse, cmd_resp, cmd->dbg_id, event->context,
+				    event->afutag, event->resp);
+			cmd->stats->responses[event->command & 0xff]++;
 		            debug_msg( "%s:RESPONSE event @ 0x%016" PRIx64 ", free event",
 			    cmd->afu_name, event );
 			*head = event->_next;
+			cmd->outstanding--;
+			cmd->at_client -= _at_client(event);
 		 	free(event->data);
 		 	//free(event->parity);
 		 	free(event);
 	//	}
 	} else {
-		 if (rc == AFU_TLX_NO_CREDITS)
+		 if (rc == AFU_TLX_NO_CREDITS) {
+				cmd->stats->resp_credit_stalls++;
 				debug_msg ("NO AFU_TLX_RESP_CREDITS TO SEND RESP for AFUTAG 0x%x so will try LATER ", event->afutag);
-		 else
+		 } else
 			 debug_msg( "%s:RESPONSE event @ 0x%016" PRIx64 ", _response() failed for AFUTAG 0x%x so will try LATER",
 			     cmd->afu_name, event, event->afutag );
 		if (event->resp_bytes_sent != 0)
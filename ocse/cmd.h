@@ -21,8 +21,10 @@
 #include <stdio.h>
 
 #include "client.h"
+#include "latency.h"
 #include "mmio.h"
 #include "parms.h"
+#include "stats.h"
 #include "../common/tlx_interface.h"
 
 #define TOTAL_PAGES_CACHED 64
@@ -102,6 +104,7 @@ struct cmd_event {
 	enum cmd_type type;
 	enum mem_state state;
 	enum client_state client_state;
+	struct latency_stamp stamp;
 	struct cmd_event *_next;
 };
 
@@ -113,6 +116,8 @@ struct cmd {
 	struct parms *parms;
 	struct client **client;
 	struct pages page_entries;
+	struct latency *latency;
+	struct stats *stats;		// the ocl's, see ocl_init()
 	volatile enum ocse_state *ocl_state;
 	char *afu_name;
 	FILE *dbg_fp;
@@ -120,6 +125,8 @@ struct cmd {
 	uint64_t lock_addr;
 	//uint64_t res_addr;
 	int max_clients;
+	int outstanding;		// events on list
+	int at_client;			// of them waiting for a client answer
 	uint32_t pagesize;
 	uint32_t HOST_CL_SIZE;
 	uint16_t irq;
@@ -0,0 +1,260 @@
+/*
+ * Copyright 2014,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Description: latency.c
+ *
+ *  Lifecycle latency of AFU commands.  cmd.c stamps every command with the
+ *  AFU cycle and the wall time when it is added, when its request goes to the
+ *  client and when the client answers.  Once the response has gone back to
+ *  the AFU the time between the stamps is added to log2 histograms kept per
+ *  opcode and per client context:
+ *
+ *      ocse   command added until the request went to the client, i.e. the
+ *             time to collect write data and wait for the client to be free
+ *      host   request sent until the client answered, the host round trip
+ *      resp   client answer (or the last stamp) until the response went to
+ *             the AFU, including waits for AFU response credits
+ *      total  command added until the response went to the AFU
+ *
+ *  The histograms are printed when the port shuts down and, for all ports, on
+ *  every SIGUSR1 to ocse.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "latency.h"
+#include "../common/tlx_interface.h"
+#include "../common/utils.h"
+
+volatile sig_atomic_t latency_dump_request;
+
+static const char *_stage_name[LAT_STAGES] = { "ocse", "host", "resp", "total" };
+
+static uint64_t _now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+struct latency *latency_init(void)
+{
+	struct latency *latency;
+
+	latency = (struct latency *)calloc(1, sizeof(struct latency));
+	if (!latency) {
+		perror("malloc");
+		return NULL;
+	}
+	latency->dump_request = latency_dump_request;
+	return latency;
+}
+
+void latency_mark(struct latency *latency, struct latency_stamp *stamp,
+		  enum latency_mark mark)
+{
+	if (latency == NULL)
+		return;
+	stamp->cycle[mark] = latency->cycle;
+	stamp->ns[mark] = _now_ns();
+	stamp->valid[mark] = 1;
+	// a write after a touch goes to the client again, time the last trip
+	if (mark == LAT_CLIENT)
+		stamp->valid[LAT_RETURN] = 0;
+}
+
+uint64_t latency_cycle(struct latency *latency)
+{
+	if (latency == NULL)
+		return 0;
+	return latency->cycle;
+}
+
+static void _hist_add(struct latency_hist *hist, uint64_t value)
+{
+	int i;
+
+	// bucket 0 is for 0, otherwise the position of the top bit plus one
+	i = 0;
+	if (value)
+		i = 64 - __builtin_clzll(value);
+	if (i >= LATENCY_BUCKETS)
+		i = LATENCY_BUCKETS - 1;
+	hist->bucket[i]++;
+	if ((hist->count == 0) || (value < hist->min))
+		hist->min = value;
+	if (value > hist->max)
+		hist->max = value;
+	hist->count++;
+	hist->sum += value;
+}
+
+static void _key_add(struct latency_key *key, struct latency_stamp *stamp,
+		     uint64_t cycle, uint64_t ns)
+{
+	int last;
+
+	if (stamp->valid[LAT_CLIENT]) {
+		_hist_add(&(key->cycles[LAT_STAGE_OCSE]),
+			  stamp->cycle[LAT_CLIENT] - stamp->cycle[LAT_ADD]);
+		_hist_add(&(key->ns[LAT_STAGE_OCSE]),
+			  stamp->ns[LAT_CLIENT] - stamp->ns[LAT_ADD]);
+	}
+	if (stamp->valid[LAT_CLIENT] && stamp->valid[LAT_RETURN]) {
+		_hist_add(&(key->cycles[LAT_STAGE_HOST]),
+			  stamp->cycle[LAT_RETURN] - stamp->cycle[LAT_CLIENT]);
+		_hist_add(&(key->ns[LAT_STAGE_HOST]),
+			  stamp->ns[LAT_RETURN] - stamp->ns[LAT_CLIENT]);
+	}
+	last = LAT_ADD;
+	if (stamp->valid[LAT_RETURN])
+		last = LAT_RETURN;
+	else if (stamp->valid[LAT_CLIENT])
+		last = LAT_CLIENT;
+	_hist_add(&(key->cycles[LAT_STAGE_RESP]), cycle - stamp->cycle[last]);
+	_hist_add(&(key->ns[LAT_STAGE_RESP]), ns - stamp->ns[last]);
+	_hist_add(&(key->cycles[LAT_STAGE_TOTAL]), cycle - stamp->cycle[LAT_ADD]);
+	_hist_add(&(key->ns[LAT_STAGE_TOTAL]), ns - stamp->ns[LAT_ADD]);
+}
+
+// Find or create the histograms in slot
+static struct latency_key *_key(struct latency_key **slot)
+{
+	if (*slot == NULL)
+		*slot = (struct latency_key *)calloc(1,
+						     sizeof(struct latency_key));
+	return *slot;
+}
+
+void latency_done(struct latency *latency, struct latency_stamp *stamp,
+		  uint8_t opcode, int32_t context)
+{
+	struct latency_key **grown;
+	struct latency_key *key;
+	uint64_t ns;
+
+	if ((latency == NULL) || !stamp->valid[LAT_ADD])
+		return;
+	ns = _now_ns();
+	latency->commands++;
+
+	if ((key = _key(&(latency->opcode[opcode]))) != NULL)
+		_key_add(key, stamp, latency->cycle, ns);
+
+	if (context < 0)
+		return;
+	if (context >= latency->contexts) {
+		grown = (struct latency_key **)realloc(latency->context,
+						       (context + 1) *
+						       sizeof(*grown));
+		if (grown == NULL)
+			return;
+		memset(grown + latency->contexts, 0,
+		       (context + 1 - latency->contexts) * sizeof(*grown));
+		latency->context = grown;
+		latency->contexts = context + 1;
+	}
+	if ((key = _key(&(latency->context[context]))) != NULL)
+		_key_add(key, stamp, latency->cycle, ns);
+}
+
+// One line per stage: count, min/avg/max and the non empty buckets, each
+// shown with its upper bound
+static void _hist_print(FILE * fp, const char *prefix, const char *stage,
+			const char *unit, struct latency_hist *hist)
+{
+	int i;
+
+	if (hist->count == 0)
+		return;
+	fprintf(fp, "%s %-5s %-6s n=%" PRIu64 " min=%" PRIu64 " avg=%" PRIu64
+		" max=%" PRIu64 " |", prefix, stage, unit, hist->count,
+		hist->min, hist->sum / hist->count, hist->max);
+	for (i = 0; i < LATENCY_BUCKETS; i++) {
+		if (hist->bucket[i] == 0)
+			continue;
+		if (i == LATENCY_BUCKETS - 1)
+			fprintf(fp, " inf:%" PRIu64, hist->bucket[i]);
+		else
+			fprintf(fp, " <%" PRIu64 ":%" PRIu64,
+				(uint64_t) 1 << i, hist->bucket[i]);
+	}
+	fprintf(fp, "\n");
+}
+
+static void _key_print(FILE * fp, const char *prefix, struct latency_key *key)
+{
+	int i;
+
+	for (i = 0; i < LAT_STAGES; i++) {
+		_hist_print(fp, prefix, _stage_name[i], "cycles",
+			    &(key->cycles[i]));
+		_hist_print(fp, prefix, _stage_name[i], "ns", &(key->ns[i]));
+	}
+}
+
+void latency_report(struct latency *latency, char *name, FILE * fp)
+{
+	char prefix[MAX_LINE_CHARS];
+	int i;
+
+	if ((latency == NULL) || (latency->commands == 0))
+		return;
+	fprintf(fp, "%s: latency of %" PRIu64 " commands over %" PRIu64
+		" cycles\n", name, latency->commands, latency->cycle);
+	for (i = 0; i < 256; i++) {
+		if (latency->opcode[i] == NULL)
+			continue;
+		snprintf(prefix, sizeof(prefix), "%s opcode 0x%02x", name, i);
+		_key_print(fp, prefix, latency->opcode[i]);
+	}
+	for (i = 0; i < latency->contexts; i++) {
+		if (latency->context[i] == NULL)
+			continue;
+		snprintf(prefix, sizeof(prefix), "%s context %-3d", name, i);
+		_key_print(fp, prefix, latency->context[i]);
+	}
+	fflush(fp);
+}
+
+int latency_poll(struct latency *latency, char *name)
+{
+	if ((latency == NULL) ||
+	    (latency->dump_request == latency_dump_request))
+		return 0;
+	latency->dump_request = latency_dump_request;
+	latency_report(latency, name, stdout);
+	return 1;
+}
+
+void latency_free(struct latency *latency)
+{
+	int i;
+
+	if (latency == NULL)
+		return;
+	for (i = 0; i < 256; i++)
+		free(latency->opcode[i]);
+	for (i = 0; i < latency->contexts; i++)
+		free(latency->context[i]);
+	free(latency->context);
+	free(latency);
+}
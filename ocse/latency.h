@@ -0,0 +1,98 @@
+/*
+ * Copyright 2014,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Points in the life of an AFU command, see cmd.c
+enum latency_mark {
+	LAT_ADD,		// command taken from the AFU, _add_cmd()
+	LAT_CLIENT,		// request sent to the client (to the AFU for MMIOs)
+	LAT_RETURN,		// client answered, handle_mem_return()
+	LAT_MARKS
+};
+
+// Stages reported, each from one mark to the next one the command reached
+enum latency_stage {
+	LAT_STAGE_OCSE,		// LAT_ADD to LAT_CLIENT
+	LAT_STAGE_HOST,		// LAT_CLIENT to LAT_RETURN
+	LAT_STAGE_RESP,		// last mark to the response to the AFU
+	LAT_STAGE_TOTAL,	// LAT_ADD to the response to the AFU
+	LAT_STAGES
+};
+
+// log2 buckets, bucket i counts values in [2^(i-1), 2^i)
+#define LATENCY_BUCKETS 48
+
+struct latency_hist {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t bucket[LATENCY_BUCKETS];
+};
+
+// Cycle and wall time histograms of every stage
+struct latency_key {
+	struct latency_hist cycles[LAT_STAGES];
+	struct latency_hist ns[LAT_STAGES];
+};
+
+// Time stamps a command collects on its way
+struct latency_stamp {
+	uint64_t cycle[LAT_MARKS];
+	uint64_t ns[LAT_MARKS];
+	uint8_t valid[LAT_MARKS];
+};
+
+struct latency {
+	uint64_t cycle;		// AFU clocks so far
+	uint64_t commands;	// responses accounted
+	struct latency_key *opcode[256];
+	struct latency_key **context;
+	int contexts;
+	int dump_request;	// latency_dump_request last reported
+};
+
+// Bumped by SIGUSR1, every port then prints its histograms once
+extern volatile sig_atomic_t latency_dump_request;
+
+struct latency *latency_init(void);
+
+void latency_mark(struct latency *latency, struct latency_stamp *stamp,
+		  enum latency_mark mark);
+
+// AFU clocks of the port so far, 0 without latency
+uint64_t latency_cycle(struct latency *latency);
+
+// The response went to the AFU, account for all stages the command went
+// through
+void latency_done(struct latency *latency, struct latency_stamp *stamp,
+		  uint8_t opcode, int32_t context);
+
+// Print the histograms of port name, nothing if no command completed yet
+void latency_report(struct latency *latency, char *name, FILE * fp);
+
+// Report if a dump was requested since the last call, returns 1 if it did
+int latency_poll(struct latency *latency, char *name);
+
+void latency_free(struct latency *latency);
+
+#endif				/* _LATENCY_H_ */
@@ -18,8 +18,8 @@
  * Description: mmio.c
  *
  *  This file contains the code for MMIO access to the AFU including the
- *  AFU configuration space.  Only one MMIO access is legal at a time.  So each
- *  client only tracks up to one mmio_access at a time.  However, since a
+ *  AFU configuration space.  A client waits for each MMIO access to complete,
+ *  but may keep several lpc memory accesses in flight.  Since a
  *  "directed mode" AFU may have multiple clients attached the mmio struct
  *  tracks multiple mmio accesses with the element "list."  As MMIO requests
  *  are received from clients they are added to the list and handled in FIFO
@@ -27,7 +27,9 @@
  *  as they are received from a client.  The ocl code will periodically call
  *  send_mmio() which will drive the oldest pending MMIO command event to the AFU.
  *  That event is put in PENDING state which blocks the OCL from sending any
- *  further MMIO until this MMIO event completes.  When the ocl code detects
+ *  further MMIO until this MMIO event completes.  Config and lpc memory
+ *  accesses behind it of the same kind are sent while credits allow, each
+ *  with its own capp tag so responses are matched back to their event.  When the ocl code detects
  *  the MMIO response it will call handle_mmio_ack().  This function moves
  *  the list head to the next event so that the next MMIO request can be sent.
  *  However, the event still lives and the client will still point to it.  When
@@ -40,11 +42,14 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "../common/debug.h"
+#include "../common/probe.h"
 #include "mmio.h"
 #include "ocl.h"
+#include "trace.h"
 
 // Initialize MMIO tracking structure
 struct mmio *mmio_init(struct AFU_EVENT *afu_event, int timeout, char *afu_name,
@@ -131,6 +136,7 @@ static struct mmio_event *_add_event(struct mmio *mmio, struct client *client,
 	event->cmd_data = data;
 	event->state = OCSE_IDLE;
 	event->_next = NULL;
+	event->_next_access = NULL;
 
 	// debug the mmio and print the input address and the translated address
 	// debug_msg("_add_event: %s: WRITE%d word=0x%05x (0x%05x) data=0x%s",
@@ -154,6 +160,9 @@ static struct mmio_event *_add_event(struct mmio *mmio, struct client *client,
 	else
 		context = client->context;
 	debug_mmio_add(mmio->dbg_fp, mmio->dbg_id, context, rnw, dw, addr);
+	event->context = context;
+	memset(&(event->stamp), 0, sizeof(event->stamp));
+	latency_mark(mmio->latency, &(event->stamp), LAT_ADD);
 
 	return event;
 }
@@ -215,6 +224,7 @@ static struct mmio_event *_add_mem_event(struct mmio *mmio, struct client *clien
 	}
 	event->state = OCSE_IDLE;
 	event->_next = NULL;
+	event->_next_access = NULL;
 
 	debug_msg("_add_mem_event: rnw=%d, access word=0x%016lx (0x%016lx)", event->rnw, event->cmd_PA, addr);
 #ifdef DEBUG
@@ -236,6 +246,9 @@ static struct mmio_event *_add_mem_event(struct mmio *mmio, struct client *clien
 	else
 		context = client->context;
 	debug_mmio_add(mmio->dbg_fp, mmio->dbg_id, context, rnw, size, addr);
+	event->context = context;
+	memset(&(event->stamp), 0, sizeof(event->stamp));
+	latency_mark(mmio->latency, &(event->stamp), LAT_ADD);
 
 	return event;
 }
@@ -264,6 +277,15 @@ static struct mmio_event *_add_mem(struct mmio *mmio, struct client *client,
   return _add_mem_event(mmio, client, rnw, size, region, addr, data, be_valid, be);
 }
 
+#define AFU_DESC_DATA_VALID 0x80000000
+#define AFU_DESC_WORDS 16  // afu descriptor words read per afu during discovery
+
+// the afu descriptor words we keep: name space (0x04-0x18), major/minor version (0x1c),
+// global mmio bar/offset lo/offset hi/size (0x20-0x28), per pasid mmio bar/offset lo/offset hi/stride (0x30-0x38)
+// and mem size/base address lo/hi (0x3c-0x44)
+static uint64_t afu_desc_offset[AFU_DESC_WORDS] = { 0x04, 0x08, 0x0c, 0x10, 0x14, 0x18, 0x1c,
+						    0x20, 0x24, 0x28, 0x30, 0x34, 0x38, 0x3c, 0x40, 0x44 };
+
 static void _wait_for_done(enum ocse_state *state, pthread_mutex_t * lock)
 {
 	while (*state != OCSE_DONE)	/* infinite loop */
@@ -279,7 +301,6 @@ static struct mmio_event *_read_afu_descriptor(struct mmio *mmio, uint64_t addr,
   struct mmio_event *event0c;
   struct mmio_event *event10;
 
-  #define AFU_DESC_DATA_VALID 0x80000000
   #define FUNCTION_CFG_OFFSET 0x0000000000010000; // per spec, each function has some config space 
 
 
@@ -313,6 +334,516 @@ static struct mmio_event *_read_afu_descriptor(struct mmio *mmio, uint64_t addr,
   return event10;
 }
 
+// Wait for a run of config events that were queued back to back and free them
+static void _wait_for_cfg_events(struct mmio_event **event, int count, pthread_mutex_t * lock)
+{
+  int i;
+
+  for (i = 0; i < count; i++) {
+    _wait_for_done(&(event[i]->state), lock);
+    free(event[i]);
+  }
+}
+
+// Read count words of AFU descriptor template 0 from the afu information DVSEC
+// pass in the address of the afu descriptor offset register
+//         the offsets of the descriptor words requested
+// returns the data of each word in data
+// The offset write, valid bit read and data read of every word are queued back to back,
+// so send_mmio can keep as many of them in flight as the afu has config credits.
+// A word whose valid bit was not yet set is read again with _read_afu_descriptor.
+static void _read_afu_descriptors(struct mmio *mmio, uint64_t addr, uint64_t *offset, uint64_t *data, int count, pthread_mutex_t * lock)
+{
+  struct mmio_event *event[3 * AFU_DESC_WORDS];
+  struct mmio_event *event10;
+  int i;
+
+  if (count > AFU_DESC_WORDS) {
+    _read_afu_descriptors(mmio, addr, offset, data, AFU_DESC_WORDS, lock);
+    _read_afu_descriptors(mmio, addr, offset + AFU_DESC_WORDS, data + AFU_DESC_WORDS, count - AFU_DESC_WORDS, lock);
+    return;
+  }
+
+  debug_msg("_read_afu_descriptors: %d AFU descriptor words indirect read", count);
+  for (i = 0; i < count; i++) {
+    event[3 * i] = _add_cfg(mmio, 0, 0, addr, offset[i]);
+    event[(3 * i) + 1] = _add_cfg(mmio, 1, 0, addr, 0L);
+    event[(3 * i) + 2] = _add_cfg(mmio, 1, 0, addr + 4, 0L);  // assuming the data register is adjacent to the offset register
+  }
+
+  for (i = 0; i < count; i++) {
+    _wait_for_cfg_events(&event[3 * i], 1, lock);
+    _wait_for_done(&(event[(3 * i) + 1]->state), lock);
+    _wait_for_done(&(event[(3 * i) + 2]->state), lock);
+    if ((event[(3 * i) + 1]->cmd_data & AFU_DESC_DATA_VALID) != 0) {
+      data[i] = event[(3 * i) + 2]->cmd_data;
+      debug_msg("   AFU descriptor offset 0x%016lx = 0x%08x", offset[i], data[i]);
+    } else {
+      data[i] = ~0L;  // mark this word to be read again once the batch has drained
+    }
+  }
+  for (i = 0; i < count; i++) {
+    free(event[(3 * i) + 1]);
+    free(event[(3 * i) + 2]);
+  }
+
+  for (i = 0; i < count; i++) {
+    if (data[i] != ~0L)
+      continue;
+    event10 = _read_afu_descriptor(mmio, addr, offset[i], lock);
+    data[i] = event10->cmd_data;
+    free(event10);
+  }
+}
+
+// Configuration space snapshot
+//
+// When OCSE_CFG_SNAPSHOT_DIR is set, the results of a full read_afu_config walk
+// are saved per tlx port in <dir>/<tlx name>.cfg.  On the next start, ocse loads
+// that file, checks the device/vendor id of every function, the AFU control DVSEC
+// header of every AFU and a hash of the AFU descriptor words it read, and if they
+// all still match it only replays the configuration writes (BAR, PASID, acTag and enables)
+// instead of walking the capability chain and AFU descriptors again.
+// The snapshot is keyed by the device/vendor id of the first function and an
+// FNV-1a hash of the snapshot contents.  Any mismatch falls back to the full walk.
+#define CFG_SNAPSHOT_VERSION 2
+#define CFG_SNAPSHOT_FCN_FIELDS 15
+#define CFG_SNAPSHOT_AFU_FIELDS 20
+#define FNV_OFFSET_BASIS 2166136261U
+#define FNV_PRIME 16777619U
+
+// Issue a single config space access and wait for it to finish
+// returns the data read (or 0 for a write)
+static uint64_t _cfg_access(struct mmio *mmio, uint32_t rnw, uint64_t addr,
+			    uint64_t data, pthread_mutex_t * lock)
+{
+	struct mmio_event *event;
+
+	event = _add_cfg(mmio, rnw, 0, addr, data);
+	_wait_for_done(&(event->state), lock);
+	data = rnw ? event->cmd_data : 0;
+	free(event);
+	return data;
+}
+
+static uint32_t _cfg_snapshot_hash(uint32_t hash, char *line)
+{
+	while (*line) {
+		hash ^= (uint8_t)*line++;
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+// FNV-1a of the afu descriptor words read at afu_desc_offset
+static uint32_t _afu_desc_hash(uint64_t *desc)
+{
+	uint32_t hash;
+	int i, j;
+
+	hash = FNV_OFFSET_BASIS;
+	for (i = 0; i < AFU_DESC_WORDS; i++) {
+		for (j = 0; j < 4; j++) {
+			hash ^= (uint8_t)(desc[i] >> (8 * j));
+			hash *= FNV_PRIME;
+		}
+	}
+	return hash;
+}
+
+static char *_cfg_snapshot_path(char *dir, char *name)
+{
+	char *path;
+
+	path = (char *)malloc(strlen(dir) + strlen(name) + 6);
+	if (path)
+		sprintf(path, "%s/%s.cfg", dir, name);
+	return path;
+}
+
+static void _free_fcn_cfg_array(struct fcn_cfg **fcn_cfg_array)
+{
+	int f, a;
+
+	if (fcn_cfg_array == NULL)
+		return;
+	for (f = 0; f < 8; f++) {
+		if (fcn_cfg_array[f] == NULL)
+			continue;
+		if (fcn_cfg_array[f]->afu_cfg_array) {
+			for (a = 0; a <= fcn_cfg_array[f]->max_afu_index; a++)
+				free(fcn_cfg_array[f]->afu_cfg_array[a]);
+			free(fcn_cfg_array[f]->afu_cfg_array);
+		}
+		free(fcn_cfg_array[f]);
+	}
+	free(fcn_cfg_array);
+}
+
+// Write the discovered configuration of this port to path
+static void _save_cfg_snapshot(struct ocl *ocl, char *path)
+{
+	struct fcn_cfg *fcn;
+	struct afu_cfg *afu;
+	char line[MAX_LINE_CHARS];
+	char *tmp_path;
+	uint32_t hash;
+	uint16_t key_device, key_vendor;
+	FILE *fp;
+	int f, a;
+
+	tmp_path = (char *)malloc(strlen(path) + 5);
+	if (tmp_path == NULL)
+		return;
+	sprintf(tmp_path, "%s.tmp", path);
+	fp = fopen(tmp_path, "w");
+	if (fp == NULL) {
+		warn_msg("Unable to write config snapshot %s", tmp_path);
+		free(tmp_path);
+		return;
+	}
+
+	hash = FNV_OFFSET_BASIS;
+	key_device = 0;
+	key_vendor = 0;
+	sprintf(line, "VERSION:%x,%x\n", CFG_SNAPSHOT_VERSION, ocl->max_clients);
+	hash = _cfg_snapshot_hash(hash, line);
+	fputs(line, fp);
+	for (f = 0; f < 8; f++) {
+		fcn = ocl->mmio->fcn_cfg_array[f];
+		if (fcn == NULL)
+			continue;
+		if (key_device == 0) {
+			key_device = fcn->device_id;
+			key_vendor = fcn->vendor_id;
+		}
+		sprintf(line, "FCN:%d,%x,%x,%" PRIx64 ",%x,%x,%x,%x,%x,%" PRIx64
+			",%x,%x,%x,%x,%" PRIx64 "\n",
+			f, fcn->device_id, fcn->vendor_id, fcn->bar0,
+			fcn->max_pasid_width, fcn->tl_major_version_capability,
+			fcn->tl_minor_version_capability, fcn->tl_xmit_template_cfg,
+			fcn->tl_xmit_rate_per_template_cfg, fcn->function_dvsec_pa,
+			fcn->afu_present, fcn->max_afu_index, fcn->function_actag_base,
+			fcn->function_actag_length_enabled, fcn->afu_information_dvsec_pa);
+		hash = _cfg_snapshot_hash(hash, line);
+		fputs(line, fp);
+		if ((fcn->afu_present == 0) || (fcn->afu_cfg_array == NULL))
+			continue;
+		for (a = 0; a <= fcn->max_afu_index; a++) {
+			afu = fcn->afu_cfg_array[a];
+			if (afu == NULL)
+				continue;
+			sprintf(line, "AFU:%d,%d,%" PRIx64 ",%x,%x,%x,%x,%x,%x,%x,%x,%x,%"
+				PRIx64 ",%x,%x,%" PRIx64 ",%x,%" PRIx64 ",%x,%x,%s\n",
+				f, a, afu->afu_control_dvsec_pa, afu->pasid_base,
+				afu->pasid_len_enabled, afu->pasid_len_supported,
+				afu->actag_base, afu->actag_length_enabled,
+				afu->actag_length_supported, afu->afu_version_major,
+				afu->afu_version_minor, afu->global_mmio_bar,
+				afu->global_mmio_offset, afu->global_mmio_size,
+				afu->pp_mmio_bar, afu->pp_mmio_offset,
+				afu->pp_mmio_stride, afu->mem_base_address,
+				afu->mem_size, afu->desc_hash, afu->namespace);
+			hash = _cfg_snapshot_hash(hash, line);
+			fputs(line, fp);
+		}
+	}
+	fprintf(fp, "KEY:%x,%x,%x\n", key_device, key_vendor, hash);
+	fclose(fp);
+
+	if (rename(tmp_path, path) < 0)
+		warn_msg("Unable to write config snapshot %s", path);
+	else
+		info_msg("Saved config snapshot %s", path);
+	free(tmp_path);
+}
+
+// Parse count comma separated hex fields from value, returns the remainder
+static char *_parse_cfg_snapshot_fields(char *value, uint64_t *field, int count)
+{
+	char *end;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		field[i] = strtoull(value, &end, 16);
+		if ((end == value) || ((*end != ',') && (*end != '\0')))
+			return NULL;
+		value = (*end == ',') ? end + 1 : end;
+	}
+	return value;
+}
+
+// Read a snapshot file into a new fcn_cfg array, NULL if missing or stale
+static struct fcn_cfg **_read_cfg_snapshot(char *path, int *max_clients)
+{
+	struct fcn_cfg **fcn_cfg_array;
+	struct fcn_cfg *fcn;
+	struct afu_cfg *afu;
+	char line[MAX_LINE_CHARS];
+	char *value;
+	uint64_t field[CFG_SNAPSHOT_AFU_FIELDS];
+	uint32_t hash;
+	uint16_t key_device, key_vendor;
+	int version, keyed;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return NULL;
+	fcn_cfg_array = (struct fcn_cfg **)calloc(8, sizeof(struct fcn_cfg *));
+	if (fcn_cfg_array == NULL) {
+		fclose(fp);
+		return NULL;
+	}
+
+	hash = FNV_OFFSET_BASIS;
+	key_device = 0;
+	key_vendor = 0;
+	version = 0;
+	keyed = 0;
+	while (fgets(line, MAX_LINE_CHARS, fp)) {
+		if (!strncmp(line, "KEY:", 4)) {
+			value = strchr(line, '\n');
+			if (value)
+				*value = '\0';
+			if (_parse_cfg_snapshot_fields(line + 4, field, 3) == NULL)
+				goto snapshot_stale;
+			if ((field[0] != key_device) || (field[1] != key_vendor) ||
+			    (field[2] != hash))
+				goto snapshot_stale;
+			keyed = 1;
+			break;
+		}
+		hash = _cfg_snapshot_hash(hash, line);
+		value = strchr(line, '\n');
+		if (value)
+			*value = '\0';
+		value = strchr(line, ':');
+		if (value == NULL)
+			goto snapshot_stale;
+		*value = '\0';
+		++value;
+
+		if (!strcmp(line, "VERSION")) {
+			if (_parse_cfg_snapshot_fields(value, field, 2) == NULL)
+				goto snapshot_stale;
+			version = field[0];
+			*max_clients = field[1];
+		} else if (!strcmp(line, "FCN")) {
+			if (_parse_cfg_snapshot_fields(value, field, CFG_SNAPSHOT_FCN_FIELDS) == NULL)
+				goto snapshot_stale;
+			if ((field[0] >= 8) || (fcn_cfg_array[field[0]] != NULL))
+				goto snapshot_stale;
+			fcn = (struct fcn_cfg *)calloc(1, sizeof(struct fcn_cfg));
+			if (fcn == NULL)
+				goto snapshot_stale;
+			fcn_cfg_array[field[0]] = fcn;
+			fcn->device_id = field[1];
+			fcn->vendor_id = field[2];
+			fcn->bar0 = field[3];
+			fcn->max_pasid_width = field[4];
+			fcn->tl_major_version_capability = field[5];
+			fcn->tl_minor_version_capability = field[6];
+			fcn->tl_xmit_template_cfg = field[7];
+			fcn->tl_xmit_rate_per_template_cfg = field[8];
+			fcn->function_dvsec_pa = field[9];
+			fcn->afu_present = field[10];
+			fcn->max_afu_index = field[11] & 0x3F;
+			fcn->function_actag_base = field[12];
+			fcn->function_actag_length_enabled = field[13];
+			fcn->afu_information_dvsec_pa = field[14];
+			if (fcn->afu_present) {
+				fcn->afu_cfg_array = (struct afu_cfg **)calloc(fcn->max_afu_index + 1,
+									       sizeof(struct afu_cfg *));
+				if (fcn->afu_cfg_array == NULL)
+					goto snapshot_stale;
+			}
+			if (key_device == 0) {
+				key_device = fcn->device_id;
+				key_vendor = fcn->vendor_id;
+			}
+		} else if (!strcmp(line, "AFU")) {
+			value = _parse_cfg_snapshot_fields(value, field, CFG_SNAPSHOT_AFU_FIELDS);
+			if (value == NULL)
+				goto snapshot_stale;
+			if ((field[0] >= 8) || (fcn_cfg_array[field[0]] == NULL))
+				goto snapshot_stale;
+			fcn = fcn_cfg_array[field[0]];
+			if ((fcn->afu_cfg_array == NULL) || (field[1] > fcn->max_afu_index) ||
+			    (fcn->afu_cfg_array[field[1]] != NULL))
+				goto snapshot_stale;
+			afu = (struct afu_cfg *)calloc(1, sizeof(struct afu_cfg));
+			if (afu == NULL)
+				goto snapshot_stale;
+			fcn->afu_cfg_array[field[1]] = afu;
+			afu->afu_control_dvsec_pa = field[2];
+			afu->pasid_base = field[3];
+			afu->pasid_len_enabled = field[4];
+			afu->pasid_len_supported = field[5];
+			afu->actag_base = field[6];
+			afu->actag_length_enabled = field[7];
+			afu->actag_length_supported = field[8];
+			afu->afu_version_major = field[9];
+			afu->afu_version_minor = field[10];
+			afu->global_mmio_bar = field[11];
+			afu->global_mmio_offset = field[12];
+			afu->global_mmio_size = field[13];
+			afu->pp_mmio_bar = field[14];
+			afu->pp_mmio_offset = field[15];
+			afu->pp_mmio_stride = field[16];
+			afu->mem_base_address = field[17];
+			afu->mem_size = field[18];
+			afu->desc_hash = field[19];
+			strncpy(afu->namespace, value, 24);
+		} else {
+			goto snapshot_stale;
+		}
+	}
+	fclose(fp);
+	if (!keyed || (version != CFG_SNAPSHOT_VERSION) || (key_device == 0))
+		goto snapshot_free;
+	return fcn_cfg_array;
+
+ snapshot_stale:
+	fclose(fp);
+ snapshot_free:
+	warn_msg("Ignoring stale config snapshot %s", path);
+	_free_fcn_cfg_array(fcn_cfg_array);
+	return NULL;
+}
+
+// Check a few key registers of the AFU against the snapshot
+static int _verify_cfg_snapshot(struct mmio *mmio, struct fcn_cfg **fcn_cfg_array,
+				uint64_t cmd_pa_bus, pthread_mutex_t * lock)
+{
+	struct fcn_cfg *fcn;
+	struct afu_cfg *afu;
+	struct mmio_event *header[8];
+	uint64_t data;
+	uint64_t desc[AFU_DESC_WORDS];
+	uint16_t device_id, vendor_id;
+	int f, a, valid;
+
+	for (f = 0; f < 8; f++)
+		header[f] = _add_cfg(mmio, 1, 0, cmd_pa_bus + (f * 0x10000), 0L);
+	for (f = 0; f < 8; f++)
+		_wait_for_done(&(header[f]->state), lock);
+
+	for (f = 0; f < 8; f++) {
+		data = header[f]->cmd_data;
+		device_id = (uint16_t)((data >> 16) & 0x0000FFFF);
+		vendor_id = (uint16_t)(data & 0x0000FFFF);
+		valid = (device_id != 0) && (device_id != 0xffff) &&
+			(vendor_id != 0) && (vendor_id != 0xffff);
+		fcn = fcn_cfg_array[f];
+		if (fcn == NULL) {
+			if (valid)
+				goto verify_fail;
+			continue;
+		}
+		if ((fcn->device_id != device_id) || (fcn->vendor_id != vendor_id))
+			goto verify_fail;
+		if (fcn->afu_cfg_array == NULL)
+			continue;
+		for (a = 0; a <= fcn->max_afu_index; a++) {
+			afu = fcn->afu_cfg_array[a];
+			if (afu == NULL)
+				continue;
+			// AFU control DVSEC id and afu index
+			data = _cfg_access(mmio, 1, afu->afu_control_dvsec_pa + 0x08, 0L, lock);
+			if (((data & 0x0000FFFF) != 0xF004) || (((data >> 16) & 0x003F) != a))
+				goto verify_fail;
+			// every AFU descriptor word discovery keeps, so a changed
+			// name, mmio layout or lpc size is caught too
+			_cfg_access(mmio, 0, fcn->afu_information_dvsec_pa + 0x08, a << 16, lock);
+			_read_afu_descriptors(mmio, fcn->afu_information_dvsec_pa + 0x0c,
+					      afu_desc_offset, desc, AFU_DESC_WORDS, lock);
+			if (_afu_desc_hash(desc) != afu->desc_hash)
+				goto verify_fail;
+		}
+	}
+	for (f = 0; f < 8; f++)
+		free(header[f]);
+	return 0;
+
+ verify_fail:
+	for (f = 0; f < 8; f++)
+		free(header[f]);
+	return -1;
+}
+
+// Replay the configuration writes of read_afu_config from the snapshot
+// the writes of each function are queued back to back and waited for together
+static void _replay_cfg_snapshot(struct mmio *mmio, uint64_t cmd_pa_bus,
+				 pthread_mutex_t * lock)
+{
+	struct fcn_cfg *fcn;
+	struct afu_cfg *afu;
+	struct mmio_event **event;
+	uint64_t cmd_pa_fcn;
+	int f, a, n;
+
+	for (f = 0; f < 8; f++) {
+		fcn = mmio->fcn_cfg_array[f];
+		if (fcn == NULL)
+			continue;
+		event = (struct mmio_event **)malloc((4 + (5 * (fcn->max_afu_index + 1))) *
+						     sizeof(struct mmio_event *));
+		if (event == NULL)
+			return;
+		n = 0;
+		cmd_pa_fcn = cmd_pa_bus + (f * 0x10000);
+		if (fcn->afu_present != 0) {
+			event[n++] = _add_cfg(mmio, 0, 0, cmd_pa_fcn + 0x10, fcn->bar0 & 0xFFFFFFFF);
+			event[n++] = _add_cfg(mmio, 0, 0, cmd_pa_fcn + 0x14, fcn->bar0 >> 32);
+			event[n++] = _add_cfg(mmio, 0, 0, cmd_pa_fcn + 0x04, 0x00000002);
+			info_msg("    function %d bar0 = 0x%016lx, memory space enabled", f, fcn->bar0);
+		}
+		for (a = 0; (fcn->afu_cfg_array != NULL) && (a <= fcn->max_afu_index); a++) {
+			afu = fcn->afu_cfg_array[a];
+			if (afu == NULL)
+				continue;
+			event[n++] = _add_cfg(mmio, 0, 0, afu->afu_control_dvsec_pa + 0x10, afu->pasid_len_enabled << 8);
+			event[n++] = _add_cfg(mmio, 0, 0, afu->afu_control_dvsec_pa + 0x14, afu->pasid_base);
+			event[n++] = _add_cfg(mmio, 0, 0, afu->afu_control_dvsec_pa + 0x18, afu->actag_length_enabled << 16);
+			event[n++] = _add_cfg(mmio, 0, 0, afu->afu_control_dvsec_pa + 0x1c, afu->actag_base);
+			event[n++] = _add_cfg(mmio, 0, 0, afu->afu_control_dvsec_pa + 0x0c, 0x01000000);
+			info_msg("    afu %d.%d %s: pasid base = 0x%05x, actag base = 0x%03x, enabled",
+				 f, a, afu->namespace, afu->pasid_base, afu->actag_base);
+		}
+		event[n++] = _add_cfg(mmio, 0, 0, fcn->function_dvsec_pa + 0x0c,
+				      ((uint32_t)fcn->function_actag_base << 16) |
+				      (uint32_t)fcn->function_actag_length_enabled);
+		_wait_for_cfg_events(event, n, lock);
+		free(event);
+	}
+}
+
+// Configure the AFU from a snapshot file, returns 0 on success
+static int _load_cfg_snapshot(struct ocl *ocl, char *path, uint64_t cmd_pa_bus,
+			      pthread_mutex_t * lock)
+{
+	struct fcn_cfg **fcn_cfg_array;
+	int max_clients;
+
+	max_clients = 0;
+	fcn_cfg_array = _read_cfg_snapshot(path, &max_clients);
+	if (fcn_cfg_array == NULL)
+		return -1;
+	if (_verify_cfg_snapshot(ocl->mmio, fcn_cfg_array, cmd_pa_bus, lock) < 0) {
+		info_msg("Config snapshot %s does not match %s, reading full config space",
+			 path, ocl->name);
+		_free_fcn_cfg_array(fcn_cfg_array);
+		return -1;
+	}
+
+	info_msg("Config snapshot %s matches %s, skipping config space walk", path, ocl->name);
+	ocl->mmio->fcn_cfg_array = fcn_cfg_array;
+	ocl->max_clients = max_clients;
+	_replay_cfg_snapshot(ocl->mmio, cmd_pa_bus, lock);
+	return 0;
+}
+
 // Read the AFU config_record, extended capabilities (if any), PASID extended capabilities,
 // OpenCAPI TL extended capabilities, AFU info extended capabilites (AFU descriptor)
 // and AFU control information extended capabilities and keep a copy
@@ -352,14 +883,31 @@ int read_afu_config(struct ocl *ocl, uint8_t bus, pthread_mutex_t * lock)
 	uint16_t ec_id;
 	int f;
 	int afu_index;
-	struct mmio_event *eventa, *eventb, *eventc;
+	struct mmio_event *eventa, *eventb;
+	struct mmio_event *eventh[8];  // configuration space headers of each function
+	struct mmio_event *eventp;     // extended capability offset + 0x04
+	struct mmio_event *eventw[5];  // config accesses queued back to back
+	char *snapshot_dir;
+	char *snapshot_path;
 
 	ocl->max_clients = 0;
 
 	cmd_pa_bus = (uint64_t)bus << 24; // shift the bus number to the proper location in the pa
 
+	// use the config snapshot from a previous run if we have a matching one
+	snapshot_path = NULL;
+	snapshot_dir = getenv("OCSE_CFG_SNAPSHOT_DIR");
+	if (snapshot_dir != NULL) {
+		snapshot_path = _cfg_snapshot_path(snapshot_dir, ocl->name);
+		if ((snapshot_path != NULL) &&
+		    (_load_cfg_snapshot(ocl, snapshot_path, cmd_pa_bus, lock) == 0)) {
+			free(snapshot_path);
+			return 0;
+		}
+	}
+
 	// allocate space for function configuration information
-	mmio->fcn_cfg_array = (struct fcn_cfg **)malloc( 8 * sizeof( struct fun_cfg * ) );
+	mmio->fcn_cfg_array = (struct fcn_cfg **)calloc( 8, sizeof( struct fcn_cfg * ) );
 
 	// loop through all the potential functions by incrementing the fcn portion of the physical address.
 	// eventually, we might want to set up "bus" in a parm file.  For now, we assume bus = 0
@@ -370,6 +918,11 @@ int read_afu_config(struct ocl *ocl, uint8_t bus, pthread_mutex_t * lock)
 	bar = 0x0000040000000000; // 4 TB
 	actag = 0;
 
+	// queue the open capi configuration space header reads of all the functions back to back
+	for (f = 0; f < 8; f++ ) {
+		eventh[f] = _add_cfg(mmio, 1, 0, cmd_pa_bus + ( f * 0x10000 ), 0L); // opencapi configuration header
+	}
+
 	for (f = 0; f < 8; f++ ) {
   	        // reset the high water mark for pasid
  	        pasid = 0;
@@ -377,7 +930,7 @@ int read_afu_config(struct ocl *ocl, uint8_t bus, pthread_mutex_t * lock)
 
 		// read open capi configuration space header
 		debug_msg("_read_config_space_header:  pa 0x%016lx ", cmd_pa_fcn);
-		eventa  = _add_cfg(mmio, 1, 0, cmd_pa_fcn, 0L); // opencapi configuration header
+		eventa  = eventh[f];
   		_wait_for_done( &(eventa->state), lock );
 		device_id = (uint16_t)( ( eventa->cmd_data >> 16 ) & 0x0000FFFF);
 		vendor_id = (uint16_t)( eventa->cmd_data & 0x0000FFFF );
@@ -392,7 +945,7 @@ int read_afu_config(struct ocl *ocl, uint8_t bus, pthread_mutex_t * lock)
 		if ( ( ( device_id != 0 ) && ( device_id != 0xffff ) ) && 
 		     ( ( vendor_id != 0 ) && ( vendor_id != 0xffff ) ) ) {
          	      // allocate the fcn_cfg structure and store the pointer at mmio->fcn_cfg_array_p[f]
-		      mmio->fcn_cfg_array[f] = (struct fcn_cfg *)malloc( sizeof( struct fcn_cfg ) );
+		      mmio->fcn_cfg_array[f] = (struct fcn_cfg *)calloc( 1, sizeof( struct fcn_cfg ) );
 		      mmio->fcn_cfg_array[f]->device_id = device_id;
 		      mmio->fcn_cfg_array[f]->vendor_id = vendor_id;
 					
@@ -401,9 +954,15 @@ int read_afu_config(struct ocl *ocl, uint8_t bus, pthread_mutex_t * lock)
 		      next_capability_offset = 0x100;
 		      while ( next_capability_offset != 0 ) {
 			  // Read extended capabilities - offset + 0x100  [31:20] next ec offset, [7:0] this ec ID
+			  // also read the words at + 0x04 (PASID capabilities) and + 0x08 (DVSEC id) of this capability
+			  // back to back with it, so we don't wait another round trip once we know its ec_id
 			  cmd_pa_ec = cmd_pa_fcn + next_capability_offset;
 			  eventa  = _add_cfg( mmio, 1, 0, cmd_pa_ec, 0L ); // extended capabilities
+			  eventp  = _add_cfg( mmio, 1, 0, cmd_pa_ec + 0x04, 0L ); 
+			  eventb  = _add_cfg( mmio, 1, 0, cmd_pa_ec + 0x08, 0L ); 
 			  _wait_for_done( &(eventa->state), lock );
+			  _wait_for_done( &(eventp->state), lock );
+			  _wait_for_done( &(eventb->state), lock );
 			
 			  ec_id = (uint16_t)( eventa->cmd_data & 0x0000FFFF );
 			  
@@ -415,38 +974,29 @@ int read_afu_config(struct ocl *ocl, uint8_t bus, pthread_mutex_t * lock)
 				     break;
 				case 0x001b: 
 				     info_msg("    Found a PASID extended capability 0x%04x at offset 0x%04x", ec_id, next_capability_offset );
-				     eventb = _add_cfg( mmio, 1, 0, cmd_pa_ec + 0x04, 0L ); 
-				     _wait_for_done(&(eventb->state), lock);
-				     mmio->fcn_cfg_array[f]->max_pasid_width = eventb->cmd_data >> 8;
+				     mmio->fcn_cfg_array[f]->max_pasid_width = eventp->cmd_data >> 8;
 				     ocl->max_clients = ocl->max_clients + ( 1 << mmio->fcn_cfg_array[f]->max_pasid_width );
 				     // this functions max clients is 1 << max_pasid_width
 				     info_msg("    Max PASID width is 0x%08x ", mmio->fcn_cfg_array[f]->max_pasid_width );
-				     free( eventb );
 				     break;
 				case 0x0023: 
 				     info_msg("    Found a OpenCAPI DVSEC 0x%04x at offset 0x%04x", ec_id, next_capability_offset );
-				     // we need to read the dvsec id to learn what to do next
-				     eventb = _add_cfg( mmio, 1, 0, cmd_pa_ec + 0x08, 0L ); 
-				     _wait_for_done( &(eventb->state), lock );
+				     // we need the dvsec id to learn what to do next
 				     switch ( eventb->cmd_data & 0x0000FFFF ) {
 				          case 0xF000: 
 					       info_msg("    Found OpenCAPI TL DVSEC ");
 					       // make these subroutines ???
-					       eventc = _add_cfg( mmio, 1, 0, cmd_pa_ec + 0x0c, 0L ); 
-					       _wait_for_done( &(eventc->state), lock );
-					       mmio->fcn_cfg_array[f]->tl_major_version_capability = ( eventc->cmd_data & 0xff000000 ) >> 24;
-					       mmio->fcn_cfg_array[f]->tl_minor_version_capability = ( eventc->cmd_data & 0x00ff0000 ) >> 16;
-					       free( eventc );
-
-					       eventc = _add_cfg( mmio, 1, 0, cmd_pa_ec + 0x24, 0L ); 
-					       _wait_for_done( &(eventc->state), lock );
-					       mmio->fcn_cfg_array[f]->tl_xmit_template_cfg = eventc->cmd_data;
-					       free( eventc );
-
-					       eventc = _add_cfg( mmio, 1, 0, cmd_pa_ec + 0x6c, 0L ); 
-					       _wait_for_done( &(eventc->state), lock );
-					       mmio->fcn_cfg_array[f]->tl_xmit_rate_per_template_cfg = eventc->cmd_data;
-					       free( eventc );
+					       eventw[0] = _add_cfg( mmio, 1, 0, cmd_pa_ec + 0x0c, 0L ); 
+					       eventw[1] = _add_cfg( mmio, 1, 0, cmd_pa_ec + 0x24, 0L ); 
+					       eventw[2] = _add_cfg( mmio, 1, 0, cmd_pa_ec + 0x6c, 0L ); 
+					       _wait_for_done( &(eventw[0]->state), lock );
+					       _wait_for_done( &(eventw[1]->state), lock );
+					       _wait_for_done( &(eventw[2]->state), lock );
+					       mmio->fcn_cfg_array[f]->tl_major_version_capability = ( eventw[0]->cmd_data & 0xff000000 ) >> 24;
+					       mmio->fcn_cfg_array[f]->tl_minor_version_capability = ( eventw[0]->cmd_data & 0x00ff0000 ) >> 16;
+					       mmio->fcn_cfg_array[f]->tl_xmit_template_cfg = eventw[1]->cmd_data;
+					       mmio->fcn_cfg_array[f]->tl_xmit_rate_per_template_cfg = eventw[2]->cmd_data;
+					       _wait_for_cfg_events( eventw, 3, lock );
 					       info_msg( "    major = 0x%02x, minor = 0x%02x, xmit_template_cfg = 0x%08x, xmit_rate_per_template_cfg = 0x%08x", 
 							 mmio->fcn_cfg_array[f]->tl_major_version_capability, 
 							 mmio->fcn_cfg_array[f]->tl_minor_version_capability, 
@@ -464,27 +1014,22 @@ int read_afu_config(struct ocl *ocl, uint8_t bus, pthread_mutex_t * lock)
 					       // do this only if there afu_present is not 0
 					       if ( mmio->fcn_cfg_array[f]->afu_present != 0 ) {
 						     mmio->fcn_cfg_array[f]->afu_cfg_array = 
-						       (struct afu_cfg **)malloc( sizeof( struct afu_cfg * ) * ( mmio->fcn_cfg_array[f]->max_afu_index + 1 ) );
+						       (struct afu_cfg **)calloc( mmio->fcn_cfg_array[f]->max_afu_index + 1, sizeof( struct afu_cfg * ) );
 
 						     // one or more afu's are present, discover and set the BAR's
 						     // write all 1's to the bar lo/hi
-						     eventc  = _add_cfg(mmio, 0, 0, cmd_pa_fcn + 0x10, 0xFFFFFFFF );
-						     _wait_for_done( &(eventc->state), lock );
-						     free( eventc );
-						     eventc  = _add_cfg(mmio, 0, 0, cmd_pa_fcn + 0x14, 0xFFFFFFFF );
-						     _wait_for_done( &(eventc->state), lock );
-						     free( eventc );
+						     eventw[0]  = _add_cfg(mmio, 0, 0, cmd_pa_fcn + 0x10, 0xFFFFFFFF );
+						     eventw[1]  = _add_cfg(mmio, 0, 0, cmd_pa_fcn + 0x14, 0xFFFFFFFF );
 						     
-						     // read bar lo/hi
-						     eventc  = _add_cfg(mmio, 1, 0, cmd_pa_fcn + 0x10, 0x00 );
-						     _wait_for_done( &(eventc->state), lock );
+						     // read bar lo/hi - queued right behind the writes, the afu applies config accesses in order
+						     eventw[2]  = _add_cfg(mmio, 1, 0, cmd_pa_fcn + 0x10, 0x00 );
+						     eventw[3]  = _add_cfg(mmio, 1, 0, cmd_pa_fcn + 0x14, 0x00 );
+						     _wait_for_done( &(eventw[2]->state), lock );
+						     _wait_for_done( &(eventw[3]->state), lock );
 						     // the low order 4 bits of cmd_data have some reserved data not related to the window, mask them off
-						     bar0 = eventc->cmd_data & 0xFFFFFFF0;
-						     free( eventc );
-						     eventc  = _add_cfg(mmio, 1, 0, cmd_pa_fcn + 0x14, 0x00 );
-						     _wait_for_done( &(eventc->state), lock );
-						     bar0 = bar0 | ( eventc->cmd_data << 32 );
-						     free( eventc );
+						     bar0 = eventw[2]->cmd_data & 0xFFFFFFF0;
+						     bar0 = bar0 | ( eventw[3]->cmd_data << 32 );
+						     _wait_for_cfg_events( eventw, 4, lock );
 		      
 						     // bar0 represents the "window" of address bits that are available
 						     // bar represents the current high water mark (ie, the next available base address)
@@ -492,12 +1037,8 @@ int read_afu_config(struct ocl *ocl, uint8_t bus, pthread_mutex_t * lock)
 						     //    OpenCAPI Configuration Header 0x10 = bar0 low
 						     //    OpenCAPI Configuration Header 0x14 = bar0 high
 						     mmio->fcn_cfg_array[f]->bar0 = bar;
-						     eventc  = _add_cfg(mmio, 0, 0, cmd_pa_fcn + 0x10, mmio->fcn_cfg_array[f]->bar0 & 0xFFFFFFFF );
-						     _wait_for_done( &(eventc->state), lock );
-						     free( eventc );
-						     eventc  = _add_cfg(mmio, 0, 0, cmd_pa_fcn + 0x14, mmio->fcn_cfg_array[f]->bar0 >> 32 );
-						     _wait_for_done( &(eventc->state), lock );
-						     free( eventc );
+						     eventw[0]  = _add_cfg(mmio, 0, 0, cmd_pa_fcn + 0x10, mmio->fcn_cfg_array[f]->bar0 & 0xFFFFFFFF );
+						     eventw[1]  = _add_cfg(mmio, 0, 0, cmd_pa_fcn + 0x14, mmio->fcn_cfg_array[f]->bar0 >> 32 );
 						     
 						     // add the size of the current window to bar
 						     bar = bar + ( ~( bar0 ) + 1 );
@@ -507,9 +1048,8 @@ int read_afu_config(struct ocl *ocl, uint8_t bus, pthread_mutex_t * lock)
 						     mmio->fcn_cfg_array[f]->function_actag_base = actag;
 								
 						     // one or more afu's are present, so set the memory space bit in the configuration space header
-						     eventc  = _add_cfg(mmio, 0, 0, cmd_pa_fcn + 0x04, 0x00000002 );
-						     _wait_for_done( &(eventc->state), lock );
-						     free( eventc );
+						     eventw[2]  = _add_cfg(mmio, 0, 0, cmd_pa_fcn + 0x04, 0x00000002 );
+						     _wait_for_cfg_events( eventw, 3, lock );
 						     info_msg( "    Enabled memory space for function %d", f );	
 					       }
 					       info_msg( "    function %d afu present = 0x%02x, max afu index = 0x%02x", 
@@ -533,107 +1073,72 @@ int read_afu_config(struct ocl *ocl, uint8_t bus, pthread_mutex_t * lock)
 					      // and index intor the afu cfg array.
 					      afu_index = ( eventb->cmd_data >> 16 ) & 0x003F;
 					      // alloc an afu_cfg and store the pointer in afu_cfg_p_array[afu_index]
-					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index] = (struct afu_cfg *)malloc( sizeof( struct afu_cfg ) );
-
-					      // read 0x10
-					      eventc = _add_cfg( mmio, 1, 0, cmd_pa_ec + 0x10, 0L ); 
-					      _wait_for_done( &(eventc->state), lock );
-					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pasid_len_supported = ( eventc->cmd_data ) & 0x1F;
-					      free( eventc );
-					      // read 0x18
-					      eventc = _add_cfg( mmio, 1, 0, cmd_pa_ec + 0x18, 0L ); 
-					      _wait_for_done( &(eventc->state), lock );
-					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->actag_length_supported = ( eventc->cmd_data ) & 0xFFF;
-					      free( eventc );
-					      // read afu descriptor data for this afu
-					      //     write afu_index to afu_information_ec_pa.afu_info_index
-					      eventc = _add_cfg( mmio, 0, 0, mmio->fcn_cfg_array[f]->afu_information_dvsec_pa + 0x08, afu_index << 16 ); 
-					      _wait_for_done( &(eventc->state), lock );
-					      free( eventc );
-
-					      //     read name space
+					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index] = (struct afu_cfg *)calloc( 1, sizeof( struct afu_cfg ) );
+					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->afu_control_dvsec_pa = cmd_pa_ec;
+
+					      // read 0x10 and 0x18, then (to read afu descriptor data for this afu)
+					      // write afu_index to afu_information_ec_pa.afu_info_index - all queued back to back
+					      eventw[0] = _add_cfg( mmio, 1, 0, cmd_pa_ec + 0x10, 0L ); 
+					      eventw[1] = _add_cfg( mmio, 1, 0, cmd_pa_ec + 0x18, 0L ); 
+					      eventw[2] = _add_cfg( mmio, 0, 0, mmio->fcn_cfg_array[f]->afu_information_dvsec_pa + 0x08, afu_index << 16 ); 
+					      _wait_for_done( &(eventw[0]->state), lock );
+					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pasid_len_supported = ( eventw[0]->cmd_data ) & 0x1F;
+					      _wait_for_done( &(eventw[1]->state), lock );
+					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->actag_length_supported = ( eventw[1]->cmd_data ) & 0xFFF;
+					      _wait_for_cfg_events(eventw, 3, lock);
+
+					      //     read the afu descriptor words we keep, their hash keys the config snapshot
+					      uint64_t desc[AFU_DESC_WORDS];
 					      int i, j;
-					      uint64_t name_offset = 0x04;
 					      uint64_t name_stride = 0x04;
+					      _read_afu_descriptors( mmio, mmio->fcn_cfg_array[f]->afu_information_dvsec_pa + 0x0c, afu_desc_offset, desc, AFU_DESC_WORDS, lock );
+					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->desc_hash = _afu_desc_hash( desc );
 					      for (i = 0; i < 6; i++ ) {
-						eventc = _read_afu_descriptor( mmio, mmio->fcn_cfg_array[f]->afu_information_dvsec_pa + 0x0c, name_offset, lock );
 						for ( j = 0; j < name_stride; j++ ) {
 						  // suppress '.' in namespace - replace with '\0'
-						  if ( ( (uint8_t *)&eventc->cmd_data )[j] =='.' ) mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->namespace[( i*name_stride ) + j] = '\0';
-						  else mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->namespace[( i*name_stride ) + j] = ( (uint8_t *)&eventc->cmd_data )[j];
+						  if ( ( (uint8_t *)&desc[i] )[j] =='.' ) mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->namespace[( i*name_stride ) + j] = '\0';
+						  else mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->namespace[( i*name_stride ) + j] = ( (uint8_t *)&desc[i] )[j];
 						}
-						name_offset = name_offset + name_stride;
-						free( eventc );
 					      }
 					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->namespace[24] = '\0'; // make sure name space is null terminated
 					      info_msg("name space is %s ", mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->namespace);
 
-					      //     read major/minor version
-					      eventc = _read_afu_descriptor( mmio, mmio->fcn_cfg_array[f]->afu_information_dvsec_pa + 0x0c, 0x1c, lock );
-					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->afu_version_major = ( eventc->cmd_data >> 24 ) & 0xFF;
-					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->afu_version_minor = ( eventc->cmd_data >> 16 ) & 0xFF;
-					      free( eventc );
-
-					      //     read global mmio bar/offset lo/offset hi
-					      eventc = _read_afu_descriptor( mmio, mmio->fcn_cfg_array[f]->afu_information_dvsec_pa + 0x0c, 0x20, lock );
-					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->global_mmio_bar = ( eventc->cmd_data ) & 0x07;
-					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->global_mmio_offset = ( eventc->cmd_data ) & 0xFFFF0000;
-					      free( eventc );
-					      eventc = _read_afu_descriptor( mmio, mmio->fcn_cfg_array[f]->afu_information_dvsec_pa + 0x0c, 0x24, lock );
-					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->global_mmio_offset = 
-						mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->global_mmio_offset | ( eventc->cmd_data << 32 );
-					      free( eventc );
-					      eventc = _read_afu_descriptor( mmio, mmio->fcn_cfg_array[f]->afu_information_dvsec_pa + 0x0c, 0x28, lock );
-					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->global_mmio_size = eventc->cmd_data ;
-					      free( eventc );
+					      //     major/minor version
+					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->afu_version_major = ( desc[6] >> 24 ) & 0xFF;
+					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->afu_version_minor = ( desc[6] >> 16 ) & 0xFF;
+
+					      //     global mmio bar/offset lo/offset hi
+					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->global_mmio_bar = ( desc[7] ) & 0x07;
+					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->global_mmio_offset = ( ( desc[7] ) & 0xFFFF0000 ) | ( desc[8] << 32 );
+					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->global_mmio_size = desc[9] ;
 					      info_msg( "    afu %d global mmio bar = %d, global mmio offset = 0x%016x, global mmio size = 0x%016x", 
 							afu_index,
 							mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->global_mmio_bar, 
 							mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->global_mmio_offset, 
 							mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->global_mmio_size );
 
-					      //     read per pasid mmio bar/offset hi/offset lo
-					      eventc = _read_afu_descriptor( mmio, mmio->fcn_cfg_array[f]->afu_information_dvsec_pa + 0x0c, 0x30, lock );
-					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pp_mmio_bar = ( eventc->cmd_data ) & 0x07;
-					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pp_mmio_offset = ( eventc->cmd_data ) & 0xFFFF0000;
-					      free( eventc );
-					      eventc = _read_afu_descriptor( mmio, mmio->fcn_cfg_array[f]->afu_information_dvsec_pa + 0x0c, 0x34, lock );
-					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pp_mmio_offset = 
-						mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pp_mmio_offset | ( eventc->cmd_data << 32 );
-					      free( eventc );
-					      eventc = _read_afu_descriptor( mmio, mmio->fcn_cfg_array[f]->afu_information_dvsec_pa + 0x0c, 0x38, lock );
-					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pp_mmio_stride = eventc->cmd_data & 0xFFFF0000 ;
-					      free( eventc );
+					      //     per pasid mmio bar/offset hi/offset lo
+					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pp_mmio_bar = ( desc[10] ) & 0x07;
+					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pp_mmio_offset = ( ( desc[10] ) & 0xFFFF0000 ) | ( desc[11] << 32 );
+					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pp_mmio_stride = desc[12] & 0xFFFF0000 ;
 					      info_msg( "    afu %d per pasid mmio bar = %d, per pasid mmio offset = 0x%016x, per pasid mmio stride = 0x%016x", 
 							afu_index,
 							mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pp_mmio_bar, 
 							mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pp_mmio_offset, 
 							mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pp_mmio_stride );
 
-					      //     read mem base address/size
-					      eventc = _read_afu_descriptor( mmio, mmio->fcn_cfg_array[f]->afu_information_dvsec_pa + 0x0c, 0x3c, lock );
-					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->mem_size = eventc->cmd_data & 0xFF ;
-					      free( eventc );
-					      eventc = _read_afu_descriptor( mmio, mmio->fcn_cfg_array[f]->afu_information_dvsec_pa + 0x0c, 0x40, lock );
-					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->mem_base_address = eventc->cmd_data;
-					      free( eventc );
-					      eventc = _read_afu_descriptor( mmio, mmio->fcn_cfg_array[f]->afu_information_dvsec_pa + 0x0c, 0x44, lock );
-					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->mem_base_address = 
-						mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->mem_base_address | ( eventc->cmd_data << 32 );
-					      free( eventc );
+					      //     mem base address/size
+					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->mem_size = desc[13] & 0xFF ;
+					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->mem_base_address = desc[14] | ( desc[15] << 32 );
 
 					      //     write pasid_length_enabled (same as _supported)
 					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pasid_len_enabled = 
 						mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pasid_len_supported;
-					      eventc = _add_cfg( mmio, 0, 0, cmd_pa_ec + 0x10, mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pasid_len_enabled << 8 ); 
-					      _wait_for_done( &(eventc->state), lock );
-					      free( eventc );
+					      eventw[0] = _add_cfg( mmio, 0, 0, cmd_pa_ec + 0x10, mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pasid_len_enabled << 8 ); 
 
 					      //   write pasid base...  
 					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pasid_base = pasid;
-					      eventc = _add_cfg( mmio, 0, 0, cmd_pa_ec + 0x14, mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pasid_base ); 
-					      _wait_for_done( &(eventc->state), lock );
-					      free( eventc );
+					      eventw[1] = _add_cfg( mmio, 0, 0, cmd_pa_ec + 0x14, mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->pasid_base ); 
 
 					      info_msg( "    afu %d pasid base = 0x%05x, pasid length supported = 0x%02x, pasid length enabled = 0x%02x", 
 							afu_index,
@@ -649,15 +1154,11 @@ int read_afu_config(struct ocl *ocl, uint8_t bus, pthread_mutex_t * lock)
 						mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->actag_length_supported;
 					      mmio->fcn_cfg_array[f]->function_actag_length_enabled = 
 						mmio->fcn_cfg_array[f]->function_actag_length_enabled + mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->actag_length_enabled;
-					      eventc = _add_cfg( mmio, 0, 0, cmd_pa_ec + 0x18, mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->actag_length_enabled << 16 ); 
-					      _wait_for_done( &(eventc->state), lock );
-					      free( eventc );
+					      eventw[2] = _add_cfg( mmio, 0, 0, cmd_pa_ec + 0x18, mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->actag_length_enabled << 16 ); 
 					      
 					      // actag base...  
 					      mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->actag_base = actag;
-					      eventc = _add_cfg( mmio, 0, 0, cmd_pa_ec + 0x1c, mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->actag_base ); 
-					      _wait_for_done( &(eventc->state), lock );
-					      free( eventc );
+					      eventw[3] = _add_cfg( mmio, 0, 0, cmd_pa_ec + 0x1c, mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->actag_base ); 
 
 					      info_msg( "    afu %d actag base = 0x%03x, actag length supported = 0x%03x, actag length enabled = 0x%03x", 
 							afu_index,
@@ -669,8 +1170,10 @@ int read_afu_config(struct ocl *ocl, uint8_t bus, pthread_mutex_t * lock)
 					      actag = actag + mmio->fcn_cfg_array[f]->afu_cfg_array[afu_index]->actag_length_enabled;
 
 					      //   rwrite afu_control_dvsec(0x0c) enable afu - can I really do this here?
-					      eventc = _add_cfg(mmio, 0, 0, cmd_pa_ec + 0x0c, 0x01000000);
-					      _wait_for_done(&(eventc->state), lock);
+					      eventw[4] = _add_cfg(mmio, 0, 0, cmd_pa_ec + 0x0c, 0x01000000);
+
+					      // the writes above were queued back to back, wait for all of them
+					      _wait_for_cfg_events(eventw, 5, lock);
 					      info_msg("    afu %d enabled", afu_index );
 
 					      break;
@@ -682,7 +1185,6 @@ int read_afu_config(struct ocl *ocl, uint8_t bus, pthread_mutex_t * lock)
 					      break;
 				     } // end of switch dvsec_id	
 
-				     free(eventb);
 				     break;
 				default:   
 				     warn_msg ("FOUND something UNEXPECTED in EC 0x%016lx - skipping ", ec_id);
@@ -693,6 +1195,8 @@ int read_afu_config(struct ocl *ocl, uint8_t bus, pthread_mutex_t * lock)
 			  // advance to the next capability
 			  next_capability_offset = (uint16_t)((eventa->cmd_data & 0xFFF00000) >> 20);
 			  free(eventa);
+			  free(eventp);
+			  free(eventb);
 
 		      } // end of read extended capability loop
 
@@ -715,12 +1219,64 @@ int read_afu_config(struct ocl *ocl, uint8_t bus, pthread_mutex_t * lock)
   	
 	} // end of read function csh loop
 
+	if (snapshot_path != NULL) {
+		_save_cfg_snapshot(ocl, snapshot_path);
+		free(snapshot_path);
+	}
+
 	return 0;
 }
 
 // modify to check command and use size, dl dp and stuff...
 // Send pending MMIO event to AFU; use config_read or config_write for descriptor
 // for MMIO use cmd_pr_rd_mem or cmd_pr_wr_mem
+// Can this event be sent while earlier events of the same kind are in flight?
+// Config accesses and lpc memory accesses can; mmio accesses are sent one at a time.
+static int _mmio_pipelined(struct mmio_event *event)
+{
+	return ( event->cfg || ( event->size != 0 ) );
+}
+
+// Account for an access sent to the AFU
+static void _sent(struct mmio *mmio, struct mmio_event *event)
+{
+	latency_mark(mmio->latency, &(event->stamp), LAT_CLIENT);
+	OCSE_PROBE4(ocse, mmio_send, mmio->dbg_id, event->context,
+		    event->cmd_PA, event->rnw);
+}
+
+// Account for an access the AFU answered, before it is marked OCSE_DONE and
+// may be freed by whoever waits for it
+static void _answered(struct mmio *mmio, struct mmio_event *event)
+{
+	const char *name;
+
+	if (event->cfg)
+		name = event->rnw ? "config read" : "config write";
+	else if (event->size)
+		name = event->rnw ? "mem read" : "mem write";
+	else
+		name = event->rnw ? "mmio read" : "mmio write";
+	mmio->stats->mmios++;
+	OCSE_PROBE4(ocse, mmio_ack, mmio->dbg_id, event->context,
+		    event->cmd_PA, event->rnw);
+	trace_mmio(mmio->dbg_id, &(event->stamp), latency_cycle(mmio->latency),
+		   event->cfg ? -1 : event->context, name, event->cmd_PA);
+}
+
+// Remove a completed mmio or lpc memory event from the list.
+// With pipelined accesses it need not be at the head of the list.
+static void _retire_mmio(struct mmio *mmio, struct mmio_event *event)
+{
+	struct mmio_event **list;
+
+	list = &(mmio->list);
+	while ( ( *list != NULL ) && ( *list != event ) )
+		list = &((*list)->_next);
+	if ( *list != NULL )
+		*list = event->_next;
+}
+
 void send_mmio(struct mmio *mmio)
 {
 	struct mmio_event *event;
@@ -743,6 +1299,14 @@ void send_mmio(struct mmio *mmio)
 
 	event = mmio->list;
 
+	// Config accesses and lpc memory accesses may be pipelined: skip over
+	// events of the same kind as the list head that are already in flight
+	// and send the next queued event behind them, as long as the afu has
+	// credits left.  Responses are matched to their access by capp tag.
+	while ( ( event != NULL ) && _mmio_pipelined( event ) && ( event->cfg == mmio->list->cfg ) &&
+		( event->state != OCSE_IDLE ) ) 
+		event = event->_next;
+
 	// Check for valid event
 	if ( event == NULL ) 
 		return;
@@ -750,21 +1314,35 @@ void send_mmio(struct mmio *mmio)
 
 	if ( event->state != OCSE_IDLE ) // the mmio has already been sent
 		return;
+
+	if ( event != mmio->list ) {
+		// only events of the same kind can be sent behind in flight events
+		if ( !_mmio_pipelined( event ) || ( event->cfg != mmio->list->cfg ) )
+			return;
+		if ( ( event->cfg && ( mmio->afu_event->cfg_tlx_credits_available == 0 ) ) ||
+		     ( !event->cfg && ( mmio->afu_event->afu_tlx_cmd_credits_available <= 0 ) ) ) {
+			mmio->stats->mmio_credit_stalls++;
+			return;
+		}
+	}
 	debug_msg( "send_mmio: valid command is ready to send" );
 
 	event->ack = OCSE_MMIO_ACK;
 	if (event->cfg) {
 	        //debug_msg( "ocse:send_mmio:mmio to config space" );
 		sprintf(type, "CFG");
+		// every config access in flight has its own capp tag
+		event->cmd_CAPPtag = mmio->capptag++;
 		// Attempt to send config_rd or config_wr to AFU
 		if (event->rnw) { //for config reads, no data to send
 			if ( tlx_afu_send_cfg_cmd_and_data(mmio->afu_event,
-			TLX_CMD_CONFIG_READ, 0xdead, 2, 0, event->cmd_PA,
+			TLX_CMD_CONFIG_READ, event->cmd_CAPPtag, 2, 0, event->cmd_PA,
 			0,0) == TLX_SUCCESS) {
 				debug_msg("%s:%s READ%d word=0x%05x", mmio->afu_name, type,
 			  	 	event->dw ? 64 : 32, event->cmd_PA);
 				debug_mmio_send(mmio->dbg_fp, mmio->dbg_id, event->cfg,
 					event->rnw, event->dw, event->cmd_PA);
+				_sent(mmio, event);
 				event->state = OCSE_PENDING;
 			}
 		} else { //for config writes and we ALWAYS send 32 bits of data
@@ -775,7 +1353,7 @@ void send_mmio(struct mmio *mmio)
 			 offset = event->cmd_PA & 0x0000000000000003 ;
 			memcpy(dptr +offset, &(event->cmd_data), 4);
 			if ( tlx_afu_send_cfg_cmd_and_data(mmio->afu_event,
-				TLX_CMD_CONFIG_WRITE, 0xbeef, 2, 0, event->cmd_PA,
+				TLX_CMD_CONFIG_WRITE, event->cmd_CAPPtag, 2, 0, event->cmd_PA,
 				0,dptr) == TLX_SUCCESS) {
 						sprintf(data, "%08" PRIx32, (uint32_t) event->cmd_data);
 					debug_msg("%s:%s WRITE%d word=0x%05x data=0x%s offset=0x%x",
@@ -783,6 +1361,7 @@ void send_mmio(struct mmio *mmio)
 			  			event->cmd_PA, data, offset);
 					debug_mmio_send(mmio->dbg_fp, mmio->dbg_id, event->cfg,
 						event->rnw, event->dw, event->cmd_PA);
+					_sent(mmio, event);
 					event->state = OCSE_PENDING;
 				}
 			}
@@ -811,12 +1390,14 @@ void send_mmio(struct mmio *mmio)
 		      // fix the data pointer for the write command later
 		      // ???
 		      event->data = (uint8_t *)&(event->cmd_data);
+		      event->cmd_CAPPtag = mmio->capptag++;
 
 		} else {
 		      // we have the new general memory style
 		      // debug_msg( "ocse:send_mmio:mmio to LPC space" );
 		      sprintf(type, "MEM");
 		      event->ack = OCSE_LPC_ACK;
+		      event->cmd_CAPPtag = mmio->capptag++;
 
 		      // calculate event->pL, dL, and dP from event->dw
 		      // calculate cmd_byte_cnt from event->size
@@ -860,16 +1441,18 @@ void send_mmio(struct mmio *mmio)
 		if (event->rnw) { // read
 		  if (cmd_byte_cnt < 64) { // partial
 		    if (tlx_afu_send_cmd(mmio->afu_event,
-					 TLX_CMD_PR_RD_MEM, 0xcafe, event->cmd_dL, event->cmd_pL, 0, 0, event->cmd_PA) == TLX_SUCCESS) {
+					 TLX_CMD_PR_RD_MEM, event->cmd_CAPPtag, event->cmd_dL, event->cmd_pL, 0, 0, event->cmd_PA) == TLX_SUCCESS) {
 		      debug_msg("%s:%s READ%d word=0x%05x", mmio->afu_name, type, event->dw ? 64 : 32, event->cmd_PA);
 		      debug_mmio_send(mmio->dbg_fp, mmio->dbg_id, event->cfg, event->rnw, event->dw, event->cmd_PA);
+		      _sent(mmio, event);
 		      event->state = OCSE_PENDING;
 		    }
 		  } else { // full
 		    if (tlx_afu_send_cmd(mmio->afu_event,
-					 TLX_CMD_RD_MEM, 0xefac, event->cmd_dL, event->cmd_pL, 0, 0, event->cmd_PA) == TLX_SUCCESS) {
+					 TLX_CMD_RD_MEM, event->cmd_CAPPtag, event->cmd_dL, event->cmd_pL, 0, 0, event->cmd_PA) == TLX_SUCCESS) {
 		      debug_msg("%s:%s READ size=%d offset=0x%05x", mmio->afu_name, type, cmd_byte_cnt, event->cmd_PA);
 		      debug_mmio_send(mmio->dbg_fp, mmio->dbg_id, event->cfg, event->rnw, event->dw, event->cmd_PA);
+		      _sent(mmio, event);
 		      event->state = OCSE_PENDING;
 		    }
 		  }
@@ -924,7 +1507,7 @@ void send_mmio(struct mmio *mmio)
 #endif
 		      if (tlx_afu_send_cmd_and_data( mmio->afu_event,
 						     TLX_CMD_PR_WR_MEM, 
-						     0xbead, 
+						     event->cmd_CAPPtag, 
 						     event->cmd_dL, 
 						     event->cmd_pL, 
 						     0, 
@@ -932,6 +1515,7 @@ void send_mmio(struct mmio *mmio)
 						     event->cmd_PA,
 						     0, // always good data for now
 						     tdata_bus ) == TLX_SUCCESS) {
+			_sent(mmio, event);
 			event->state = OCSE_PENDING; //OCSE_RD_RQ_PENDING;
 		      }
 		    } else { // full
@@ -946,7 +1530,7 @@ void send_mmio(struct mmio *mmio)
 		      if (event->be_valid == 0) {
 			if (tlx_afu_send_cmd_and_data( mmio->afu_event,
 						       TLX_CMD_WRITE_MEM, // opcode
-						       0xdaeb,            // capp tag
+						       event->cmd_CAPPtag, // capp tag
 						       event->cmd_dL,     // dL
 						       event->cmd_pL,     // pL
 						       0,                 // be
@@ -954,12 +1538,13 @@ void send_mmio(struct mmio *mmio)
 						       event->cmd_PA,
 						       0, // always good data for now
 						       tdata_bus ) == TLX_SUCCESS) {
+			  _sent(mmio, event);
 			  event->state = OCSE_PENDING; //OCSE_RD_RQ_PENDING;
 			}
 		      } else {
 			if (tlx_afu_send_cmd_and_data( mmio->afu_event,
 						       TLX_CMD_WRITE_MEM_BE, 
-						       0xbebe, 
+						       event->cmd_CAPPtag, 
 						       event->cmd_dL, 
 						       event->cmd_pL, 
 						       event->be, 
@@ -967,6 +1552,7 @@ void send_mmio(struct mmio *mmio)
 						       event->cmd_PA,
 						       0, // always good data for now
 						       tdata_bus ) == TLX_SUCCESS) {
+			  _sent(mmio, event);
 			  event->state = OCSE_PENDING; //OCSE_RD_RQ_PENDING;
 			}
 		      }
@@ -984,6 +1570,7 @@ void send_mmio(struct mmio *mmio)
 // this will include responses to mmio requests, and lpc memory requests
 void handle_ap_resp_data(struct mmio *mmio)
 {
+	struct mmio_event *event;
 	int rc;
 	uint8_t resp_data_is_valid;
 	uint8_t rdata_bad;
@@ -996,6 +1583,10 @@ void handle_ap_resp_data(struct mmio *mmio)
 
 	rc = 1;
 
+	// handle_ap_resp may have already retired the last write on the list
+	if ( mmio->list == NULL )
+		return;
+
 	// handle mmio, and lpc response data 
 	// we are expecting 1 to 4 beats of data depending on the value of dL or dw
 	// we can use size to define how many bytes we expect
@@ -1012,25 +1603,36 @@ void handle_ap_resp_data(struct mmio *mmio)
 	  if ( mmio->list->state == OCSE_DONE ) {
 	    // we have read the response and the data (if any) already so just return
 	    mmio->list = mmio->list->_next;
+	    mmio->stats->work++;
 	    // debug_msg( "handle_ap_resp_data: removed cfg from list" );
 	  }
 	  // debug_msg( "handle_ap_resp_data: have a cfg, but state is not done: rc = %d", rc );
 	  return;
 	} else {
-	  if (mmio->list->rnw) {
+	  // lpc memory reads may be pipelined, so the data belongs to the oldest
+	  // read still collecting data.  Otherwise look at the list head.
+	  event = mmio->list;
+	  while ( ( event != NULL ) && !event->cfg && ( event->state != OCSE_BUFFER ) )
+		event = event->_next;
+	  if ( ( event == NULL ) || event->cfg )
+		event = mmio->list;
+
+	  if (event->rnw) {
 	    rc = afu_tlx_read_resp_data( mmio->afu_event,
 					 &resp_data_is_valid, rdata_bus, &rdata_bad);
 	    // debug_msg( "handle_ap_resp_data: not cfg, but a mmio read: attempted a read of resp data: rc = %d", rc );
 	  } else {
 	    // no resp data to read
-	    if ( mmio->list->state == OCSE_DONE ) {
-	      mmio->list = mmio->list->_next;
+	    if ( event->state == OCSE_DONE ) {
+	      _retire_mmio(mmio, event);
+	      mmio->stats->work++;
 	      // debug_msg( "handle_ap_resp_data: removed mmio/lpc write from list" );
 	    }
 	    return;
 	  }
 	
 	  if (rc == TLX_SUCCESS) {
+	      mmio->stats->work++;
 	      // we have some data for a read command
 	      // check to make sure there is a BUFFERing mmio - if not, it is an error...
       	      // if there is a BUFFERing mmio and we didn't get data, it is an error...
@@ -1047,8 +1649,8 @@ void handle_ap_resp_data(struct mmio *mmio)
 
 	      debug_mmio_ack(mmio->dbg_fp, mmio->dbg_id);
 
-	      // is mmio->list there or is it in the expected state
-	      if (!mmio->list || (mmio->list->state != OCSE_BUFFER)) {
+	      // is the event there or is it in the expected state
+	      if (!event || (event->state != OCSE_BUFFER)) {
 	      		warn_msg("handle_ap_resp_data: Unexpected resp data from AFU");
 			return;
 	      }
@@ -1063,71 +1665,74 @@ void handle_ap_resp_data(struct mmio *mmio)
 #endif	  
 
 		    // calculate length.  
-		    //    for lpc, we can just use mmio->list->size
-		    //    for mmio, we use pL - maybe we could set up mmio->list->size even for the old mmio path - then this is always use the size...
-		    if ( mmio->list->size == 0 ) {
+		    //    for lpc, we can just use event->size
+		    //    for mmio, we use pL - maybe we could set up event->size even for the old mmio path - then this is always use the size...
+		    if ( event->size == 0 ) {
 		          // we have a mmio of either 32 or 64 bits
-		          if (mmio->list->cmd_pL == 0x02) {
+		          if (event->cmd_pL == 0x02) {
 			        length = 4;
 			  } else {
   			        length = 8;
 			  }
 		          // for a partial read, the data comes back at an offset in rdata_bus
-		          offset = mmio->list->cmd_PA & 0x000000000000003F ;
-			  memcpy( &mmio->list->cmd_data, &rdata_bus[offset], length );
-			  mmio->list->state = OCSE_DONE;
-			  debug_msg("%s: CMD RESP offset=%d length=%d data=0x%016x", mmio->afu_name, offset, length, mmio->list->cmd_data );
-			  mmio->list = mmio->list->_next;  // the mmio we just processed is pointed to by ...
+		          offset = event->cmd_PA & 0x000000000000003F ;
+			  memcpy( &event->cmd_data, &rdata_bus[offset], length );
+			  _answered(mmio, event);
+			  event->state = OCSE_DONE;
+			  debug_msg("%s: CMD RESP offset=%d length=%d data=0x%016x", mmio->afu_name, offset, length, event->cmd_data );
+			  _retire_mmio(mmio, event);  // the mmio we just processed is pointed to by ...
 			  // debug_msg( "handle_ap_resp_data: removed mmio read from list" );
 		    } else {
-		          if ( mmio->list->size < 64 ) {
+		          if ( event->size < 64 ) {
 			        // for a partial read, the data comes back at an offset in rdata_bus
-			        offset = mmio->list->cmd_PA & 0x000000000000003F ;
-			        memcpy( mmio->list->data, &rdata_bus[offset], mmio->list->size );
-				mmio->list->state = OCSE_DONE;
+			        offset = event->cmd_PA & 0x000000000000003F ;
+			        memcpy( event->data, &rdata_bus[offset], event->size );
+				_answered(mmio, event);
+				event->state = OCSE_DONE;
 			  } else {
 			        // size will be 64, 128 or 256
 			        length = 64;
 				offset = 0;
-				switch (mmio->list->resp_dL) {
+				switch (event->resp_dL) {
 				case 1:
 				  // the size of the response is 64 bytes in 1 beat
 				  // offset is a simple function of dP * length
 				  // only one beat of data comes in, so we can forget partial_index
-				  offset = mmio->list->resp_dP * length;
+				  offset = event->resp_dP * length;
 				  break;
 				case 2:
 				  // the size of the response is 128 bytes in 2 beats
 				  // offset is a simple function of dP * 2 * length  plus the partial index
-				  offset = ( mmio->list->resp_dP * ( 2 * length ) ) + mmio->list->partial_index;
+				  offset = ( event->resp_dP * ( 2 * length ) ) + event->partial_index;
 				  break;
 				case 3:
 				  // the size of the response is 256 bytes in 4 beats
 				  // offset is a simple function of partial_index
-				  offset = mmio->list->partial_index;
+				  offset = event->partial_index;
 				  break;
 				default:
-				  error_msg("UNEXPECTED resp_dL: %d received", mmio->list->resp_dL);
+				  error_msg("UNEXPECTED resp_dL: %d received", event->resp_dL);
 				}
-				memcpy( &mmio->list->data[offset], rdata_bus, length );
-				mmio->list->partial_index = mmio->list->partial_index + length;
-				mmio->list->size_received = mmio->list->size_received + length;
-				if ( mmio->list->size_received == mmio->list->size ) {
+				memcpy( &event->data[offset], rdata_bus, length );
+				event->partial_index = event->partial_index + length;
+				event->size_received = event->size_received + length;
+				if ( event->size_received == event->size ) {
 				      // we have all the data we expect
-				      mmio->list->state = OCSE_DONE;
+				      _answered(mmio, event);
+				      event->state = OCSE_DONE;
 				}
 			  }
 
-			  if ( mmio->list->state == OCSE_DONE ) {
+			  if ( event->state == OCSE_DONE ) {
 #ifdef DEBUG
 			    debug_msg("%s: CMD RESP length=%d", mmio->afu_name, length );
-			    printf( "mmio->list->data = 0x" );
-			    for (i = 0; i < mmio->list->size; i++) {
-			      printf( "%02x", mmio->list->data[i] );
+			    printf( "event->data = 0x" );
+			    for (i = 0; i < event->size; i++) {
+			      printf( "%02x", event->data[i] );
 			    }
 			    printf( "\n" );
 #endif	  
-			    mmio->list = mmio->list->_next;
+			    _retire_mmio(mmio, event);
 			    // debug_msg( "handle_ap_resp_data: removed lpc read from list" );
 			  }
 		    }
@@ -1193,6 +1798,7 @@ int _resp_dldp_is_legal(uint8_t cmd_dl, uint8_t resp_dl, uint8_t resp_dp)
 // this will include responses to config commmands, mmio requests, and lpc memory requests
 void handle_ap_resp(struct mmio *mmio)
 {
+	struct mmio_event *event, *match;
 	int rc;
 	char type[7];
 	uint8_t afu_resp_opcode, resp_dl, resp_dp, resp_data_is_valid, resp_code, rdata_bad;
@@ -1218,17 +1824,13 @@ void handle_ap_resp(struct mmio *mmio)
 	// capture the response and data and we're done
 	// otherwise, just capture the repsone and prepare to recieve the data
 	if (mmio->list->cfg) {
-		if (mmio->list->rnw) {
-			rc = afu_tlx_read_cfg_resp_and_data (mmio->afu_event,
-							     &afu_resp_opcode, &resp_capptag, 0xdead,
-							     &resp_data_is_valid, &resp_code, rdata_bus, &rdata_bad);
-			// debug_msg( "handle_ap_resp: rc from afu_tlx_read_cfg_resp_and_data = %d", rc );
-		} else {
-			rc = afu_tlx_read_cfg_resp_and_data (mmio->afu_event,
-							     &afu_resp_opcode, &resp_capptag, 0xbeef,
-							     &resp_data_is_valid, &resp_code, 0, 0);
-			// debug_msg( "handle_ap_resp: rc from afu_tlx_read_cfg_resp_and_data (no data expected) = %d", rc );
-		}
+		// take whichever config response is there, it is matched to its
+		// access by capp tag below.  only read responses carry data
+		rc = afu_tlx_read_cfg_resp_and_data (mmio->afu_event,
+						     &afu_resp_opcode, &resp_capptag,
+						     mmio->afu_event->cfg_tlx_resp_capptag,
+						     &resp_data_is_valid, &resp_code, rdata_bus, &rdata_bad);
+		// debug_msg( "handle_ap_resp: rc from afu_tlx_read_cfg_resp_and_data = %d", rc );
 	} else {
 	        // we read the response, and prepare to read the data in a subsequent routine.
 	        rc = afu_tlx_read_resp(mmio->afu_event,
@@ -1237,6 +1839,7 @@ void handle_ap_resp(struct mmio *mmio)
 	}
 
 	if (rc == TLX_SUCCESS) {
+	      mmio->stats->work++;
 	      //
               // at this point, either have 64 bytes of data in rdata_bus (for config), or we have set the mmio resp state to OCSE_BUFFER (a new state)
 	      //
@@ -1244,29 +1847,48 @@ void handle_ap_resp(struct mmio *mmio)
               // but we can check it...
 	      debug_mmio_ack(mmio->dbg_fp, mmio->dbg_id);
 
-	      // debug_msg( "handle_ap_resp: current event state = %d", mmio->list->state );
+	      // debug_msg( "handle_ap_resp: current event state = %d", event->state );
+
+	      // config and lpc memory accesses may be pipelined, so find the access
+	      // of the list head's kind that the capp tag belongs to, or failing
+	      // that the oldest one still waiting for a response.
+	      event = mmio->list;
+	      if ( event != NULL ) {
+		    match = NULL;
+		    for ( event = mmio->list; event != NULL; event = event->_next ) {
+			  if ( ( event->cfg != mmio->list->cfg ) || ( event->state != OCSE_PENDING ) )
+				continue;
+			  if ( match == NULL )
+				match = event;
+			  if ( event->cmd_CAPPtag == resp_capptag ) {
+				match = event;
+				break;
+			  }
+		    }
+		    event = match;
+	      }
 
 	      // make sure we have an mmio expecting a response
-	      if (!mmio->list || (mmio->list->state != OCSE_PENDING)) {
+	      if (!event || (event->state != OCSE_PENDING)) {
 	      		warn_msg("handle_ap_resp: Unexpected resp from AFU");
 			return;
 	      }
 
 	      // check the CAPPtag - later
 
-	      if (mmio->list->cfg) {
+	      if (event->cfg) {
 		    sprintf(type, "CONFIG");
-	      } else if ( mmio->list->size == 0 ) {
+	      } else if ( event->size == 0 ) {
 		    sprintf(type, "MMIO");
 	      } else {
 	            sprintf(type, "MEM");
 	      }
 	      debug_msg("handle_ap_resp: resp_capptag = %x and resp_code = %x! ", resp_capptag, resp_code);
 
-	      mmio->list->resp_code = resp_code;  //save this to send back to libocxl/client
-	      mmio->list->resp_opcode = afu_resp_opcode;  //save this to send back to libocxl/client
+	      event->resp_code = resp_code;  //save this to send back to libocxl/client
+	      event->resp_opcode = afu_resp_opcode;  //save this to send back to libocxl/client
 
-	      if (mmio->list->cfg) {
+	      if (event->cfg) {
 		if (resp_data_is_valid) {
 		  // that is, we are processing a config...
 #ifdef DEBUG
@@ -1285,31 +1907,43 @@ void handle_ap_resp(struct mmio *mmio)
 	      }
 
 	      // Keep data for MMIO reads
-	      if (mmio->list->rnw) {
+	      if (event->rnw) {
 		// debug_msg( "READ - stashing data" );
-		if (mmio->list->cfg) {
+		if (event->cfg) {
 		      // debug_msg( "CONFIG" );
-		      mmio->list->cmd_data = (uint64_t) (cfg_read_data);
-		      mmio->list->state = OCSE_DONE;
-		      // mmio->list = mmio->list->_next;
+		      event->cmd_data = (uint64_t) (cfg_read_data);
+		      _answered(mmio, event);
+		      event->state = OCSE_DONE;
+		} else if ( ( afu_resp_opcode == AFU_RSP_MEM_RD_FAIL ) && ( event->size != 0 ) ) {
+		  // no data follows a failed lpc read, _mmio_done passes the
+		  // resp_code on to the client
+		  warn_msg("%s:%s READ FAILED pa=0x%016lx code=0x%x", mmio->afu_name, type,
+			   event->cmd_PA, resp_code);
+		  _answered(mmio, event);
+		  event->state = OCSE_DONE;
+		  _retire_mmio(mmio, event);
 		} else {
 		  // debug_msg( "MMIO size > 0" );
-		  if ( _resp_dldp_is_legal( mmio->list->cmd_dL, resp_dl, resp_dp ) == 1 ) {
+		  if ( _resp_dldp_is_legal( event->cmd_dL, resp_dl, resp_dp ) == 1 ) {
 		    error_msg("%s:%s PARTIAL MEMORY READ RESP: cmd dL %d received illegal resp dL/dP received %d/%d", 
 			      mmio->afu_name, 
 			      type, 
-			      mmio->list->cmd_dL, 
+			      event->cmd_dL, 
 			      resp_dl, 
 			      resp_dp );
 		  }
 		  // save resp_dl and resp_dp to handle the split response insertion into the data buffer
-		  mmio->list->resp_dL = resp_dl;
-		  mmio->list->resp_dP = resp_dp;
-		  mmio->list->partial_index = 0;
-		  mmio->list->state = OCSE_BUFFER;
+		  event->resp_dL = resp_dl;
+		  event->resp_dP = resp_dp;
+		  event->partial_index = 0;
+		  event->state = OCSE_BUFFER;
 		}
 	      } else {
-		mmio->list->state = OCSE_DONE;
+		_answered(mmio, event);
+		event->state = OCSE_DONE;
+		// config events are removed from the list in order by handle_ap_resp_data
+		if (!event->cfg)
+		      _retire_mmio(mmio, event);
 	      }
 	}
 
@@ -1481,6 +2115,7 @@ void handle_mmio_ack(struct mmio *mmio)
 #endif	  
 		}
 	      }
+	      _answered(mmio, mmio->list);
 	      mmio->list->state = OCSE_DONE;
 	      mmio->list = mmio->list->_next;
 	}
@@ -1627,27 +2262,20 @@ struct mmio_event *handle_mmio(struct mmio *mmio, struct client *client,
 }
 
 // Handle MMIO done
-struct mmio_event *handle_mmio_done(struct mmio *mmio, struct client *client)
+// Send the acknowledge for a completed access back to the client and free it
+static void _mmio_done(struct mmio *mmio, struct client *client, struct mmio_event *event)
 {
-	struct mmio_event *event;
 	uint64_t data64;
 	uint32_t data32;
 	uint8_t *buffer;
 	int fd = client->fd;
 
-	// Is there an MMIO event pending?
-	event = (struct mmio_event *)client->mmio_access;
-	if (event == NULL)
-		return NULL;
-
-	// MMIO event not done yet
-	if (event->state != OCSE_DONE)
-		return event;
-
 	// if AFU sent a mem_rd_fail or mem_wr_fail response, send them on to libocxl so it can interpret the resp_code
 	// and retry if needed, or fail simulation 
 	if (((event->resp_opcode == 0x02) || (event->resp_opcode == 0x04)) && (event->resp_code != 0))  {
 	      debug_msg("handle mmio_done: sending OCSE_ACK for failed READ or WRITE to client");
+	      if (event->rnw && (event->size != 0))
+		    free(event->data);
 	      buffer = (uint8_t *) malloc(2);
 	      buffer[0] = event->ack;
 	      buffer[1] = event->resp_code;
@@ -1658,7 +2286,7 @@ struct mmio_event *handle_mmio_done(struct mmio *mmio, struct client *client)
 	debug_mmio_return(mmio->dbg_fp, mmio->dbg_id, client->context);
 	free(event);
 	free(buffer);
-	return NULL;
+	return;
 	}
 
 	if (event->rnw) {
@@ -1710,8 +2338,23 @@ struct mmio_event *handle_mmio_done(struct mmio *mmio, struct client *client)
 	debug_mmio_return(mmio->dbg_fp, mmio->dbg_id, client->context);
 	free(event);
 	free(buffer);
+}
 
-	return NULL;
+// Acknowledge the client's completed accesses in the order they were made.
+// Returns the oldest access that is still outstanding, if any.
+struct mmio_event *handle_mmio_done(struct mmio *mmio, struct client *client)
+{
+	struct mmio_event *event, *next;
+
+	// Is there an MMIO event pending?
+	event = (struct mmio_event *)client->mmio_access;
+	while ((event != NULL) && (event->state == OCSE_DONE)) {
+		next = event->_next_access;
+		_mmio_done(mmio, client, event);
+		event = next;
+	}
+
+	return event;
 }
 
 // Add mem write event to offset in memory space
@@ -24,6 +24,8 @@
 
 #include "ocl.h"
 #include "client.h"
+#include "latency.h"
+#include "stats.h"
 #include "parms.h"
 #include "../common/tlx_interface.h"
 #include "../common/utils.h"
@@ -67,7 +69,10 @@ struct mmio_event {
         uint8_t cmd_dL;     // dL, dP, and pL are encoded from either size or dw in send_mmio
         uint8_t cmd_dP;
 	enum ocse_state state;
+	uint16_t context;	// client context, 0xffff for config
+	struct latency_stamp stamp;	// LAT_ADD and LAT_CLIENT (sent to AFU)
 	struct mmio_event *_next;
+	struct mmio_event *_next_access;  // next access queued by the same client
 };
 
 // per afu structure
@@ -75,6 +80,7 @@ struct mmio_event {
 // query/open will look for this based on the afu index parsed from the given device name
 struct afu_cfg {
       // from AFU Control DVSEC
+      uint64_t afu_control_dvsec_pa;
       uint8_t pasid_base;
       uint8_t pasid_len_enabled;
       uint8_t pasid_len_supported;
@@ -94,6 +100,7 @@ struct afu_cfg {
       uint32_t pp_mmio_stride;
       uint64_t mem_base_address;
       uint8_t  mem_size;
+      uint32_t desc_hash;  // FNV-1a of the descriptor words read, keys the config snapshot
 };
 
 // per function structure
@@ -217,11 +224,14 @@ struct mmio {
         //struct afu_cfg_sp cfg;
 	//struct fun_cfg_sp *fun_array;
 	struct mmio_event *list;
+	uint16_t capptag;  // next capp tag for an mmio or lpc memory access
 	char *afu_name;
 	FILE *dbg_fp;
 	uint8_t dbg_id;
 	uint32_t flags;
 	int timeout;
+	struct latency *latency;	// cmd's, for the port's cycle count
+	struct stats *stats;		// the ocl's
 };
 
 struct mmio *mmio_init(struct AFU_EVENT *afu_event, int timeout, char *afu_name,
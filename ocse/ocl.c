@@ -26,16 +26,22 @@
  *  for handling commands and mmios are each in separate files.
  */
 
+#define _GNU_SOURCE  // for ppoll
+
 #include <arpa/inet.h>
 #include <assert.h>
 #include <inttypes.h>
 #include <poll.h>
+#include <sched.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 
 #include "mmio.h"
 #include "ocl.h"
+#include "trace.h"
 #include "../common/debug.h"
+#include "../common/probe.h"
 #include "../common/tlx_interface.h"
 
 // are there any pending commands with this context?
@@ -129,34 +135,49 @@ static void _detach(struct ocl *ocl, struct client *client)
 // Handle events from AFU
 static void _handle_afu(struct ocl *ocl)
 {
+	struct stats *stats = &(ocl->stats);
+
 	if (ocl->mmio->list != NULL) {
-	  handle_ap_resp(ocl->mmio);
-	  handle_ap_resp_data(ocl->mmio);
+	  STATS_HANDLER(stats, STATS_AP_RESP, handle_ap_resp(ocl->mmio));
+	  STATS_HANDLER(stats, STATS_AP_RESP_DATA,
+			handle_ap_resp_data(ocl->mmio));
 	}
 
 	if (ocl->cmd != NULL) {
 	  // handle_response should follow a similar flow to handle_cmd
 	  // that is, the response may need subsequent resp data valid beats to complete the data for a give response, just like a command...
-	  handle_response(ocl->cmd);  // sends response and data (if required)
-	  handle_buffer_write(ocl->cmd);  // just finishes up the read command structures
-	  handle_xlate_intrp_pending_sent(ocl->cmd);  // just finishes up an xlate_pending resp
-	  handle_cmd(ocl->cmd, ocl->latency);
-	  handle_afu_tlx_cmd_data_read(ocl->cmd);  // just fills up the write command structures
-	  handle_afu_tlx_write_cmd(ocl->cmd);  // completes the write command
-	  handle_touch(ocl->cmd);
-	  handle_interrupt(ocl->cmd);
-	  handle_write_be_or_amo(ocl->cmd);
+	  // sends response and data (if required)
+	  STATS_HANDLER(stats, STATS_RESPONSE, handle_response(ocl->cmd));
+	  // just finishes up the read command structures
+	  STATS_HANDLER(stats, STATS_BUFFER_WRITE,
+			handle_buffer_write(ocl->cmd));
+	  // just finishes up an xlate_pending resp
+	  STATS_HANDLER(stats, STATS_XLATE_INTRP_PENDING_SENT,
+			handle_xlate_intrp_pending_sent(ocl->cmd));
+	  STATS_HANDLER(stats, STATS_CMD, handle_cmd(ocl->cmd, ocl->latency));
+	  // just fills up the write command structures
+	  STATS_HANDLER(stats, STATS_AFU_TLX_CMD_DATA_READ,
+			handle_afu_tlx_cmd_data_read(ocl->cmd));
+	  // completes the write command
+	  STATS_HANDLER(stats, STATS_AFU_TLX_WRITE_CMD,
+			handle_afu_tlx_write_cmd(ocl->cmd));
+	  STATS_HANDLER(stats, STATS_TOUCH, handle_touch(ocl->cmd));
+	  STATS_HANDLER(stats, STATS_INTERRUPT, handle_interrupt(ocl->cmd));
+	  STATS_HANDLER(stats, STATS_WRITE_BE_OR_AMO,
+			handle_write_be_or_amo(ocl->cmd));
 	}
 }
 
 static void _handle_client(struct ocl *ocl, struct client *client)
 {
 	struct mmio_event *mmio;
+	struct mmio_event **access;
 	struct cmd_event *cmd;
 	uint8_t buffer[MAX_LINE_CHARS];
 	int dw = 0;  // 1 means mmio that is 64 bits
 	int global = 0;  // 1 means mmio to the global space
 	int region = 0;  // 0 = lpc memory, 1 = global mmio, 2 = per process mmio
+	int ready, timeout;
 
 	// Handle MMIO done
 	 if (client->mmio_access != NULL) {
@@ -173,7 +194,11 @@ static void _handle_client(struct ocl *ocl, struct client *client)
 	dw = 0;
 	global = 0;
 	region = 0;
-	if (bytes_ready(client->fd, 1, &(client->abort))) {
+	// an AFU in ocse's process is clocked by this thread, which waits
+	// for clients in _ocl_delay() without the lock instead
+	timeout = (ocl->builtin || ocl->plugin) ? 0 : 1;
+	ready = bytes_ready(client->fd, timeout, &(client->abort));
+	if (ready) {
 		if (get_bytes(client->fd, 1, buffer, ocl->timeout,
 			      &(client->abort), ocl->dbg_fp, ocl->dbg_id,
 			      client->context) < 0) {
@@ -247,26 +272,126 @@ static void _handle_client(struct ocl *ocl, struct client *client)
 		  error_msg("Unexpected 0x%02x from client on socket 0x%02x", buffer[0], client->fd);
 		}
 
-		if (mmio)
-			client->mmio_access = (void *)mmio;
+		// lpc accesses may be pipelined, so queue behind any accesses
+		// the client already has outstanding
+		if (mmio) {
+			access = (struct mmio_event **)&(client->mmio_access);
+			while (*access != NULL)
+				access = &((*access)->_next_access);
+			*access = mmio;
+		}
 
 		if (client->state == CLIENT_VALID)
 			client->idle_cycles = TLX_IDLE_CYCLES;
 	}
 }
 
+// Clock the AFU, over the socket, by calling into the plug-in or by handing
+// the events to the built in model
+static void _signal_afu(struct ocl *ocl)
+{
+	if (ocl->builtin)
+		builtin_signal_afu(ocl->builtin, ocl->afu_event);
+	else if (ocl->plugin)
+		plugin_signal_afu(ocl->plugin, ocl->afu_event);
+	else
+		tlx_signal_afu_model(ocl->afu_event);
+}
+
+static int _get_afu_events(struct ocl *ocl)
+{
+	// a built in model's events arrived with _signal_afu()
+	if (ocl->builtin)
+		return 1;
+	if (ocl->plugin)
+		return plugin_get_afu_events(ocl->plugin, ocl->afu_event);
+	return tlx_get_afu_events(ocl->afu_event);
+}
+
+static void _close_afu(struct ocl *ocl)
+{
+	if (ocl->builtin) {
+		builtin_close(ocl->builtin);
+		ocl->builtin = NULL;
+	} else if (ocl->plugin) {
+		plugin_close(ocl->plugin);
+		ocl->plugin = NULL;
+	} else {
+		tlx_close_afu_event(ocl->afu_event);
+	}
+}
+
+// Did the AFU drive anything on the events just received?
+static int _afu_driving(struct ocl *ocl)
+{
+	struct AFU_EVENT *e = ocl->afu_event;
+
+	return e->afu_tlx_cmd_valid || e->afu_tlx_cdata_valid ||
+	    e->afu_tlx_resp_valid || e->afu_tlx_rdata_valid ||
+	    e->cfg_tlx_resp_valid || e->cfg_tlx_rdata_valid;
+}
+
+// Give up the lock between two passes of the TLX thread loop.  A simulator
+// on a socket sets its own pace, so that thread sleeps 100us as it always
+// has.  A built in or plug-in AFU runs only as fast as this loop clocks it:
+// while it or ocse has work in flight just yield, and once idle wait for the
+// next message from an application.  Requests arrive on client sockets,
+// which is why this is a poll() and not a condition variable, and the wait
+// is still bounded by the old sleep so newly attached clients are picked up.
+static void _ocl_delay(struct ocl *ocl, int busy)
+{
+	struct timespec ts;
+	int i, n;
+
+	if (!ocl->builtin && !ocl->plugin) {
+		lock_delay(ocl->lock);
+		return;
+	}
+	if ((ocl->mmio->list != NULL) || (ocl->cmd->list != NULL))
+		busy = 1;
+	// a plug-in hands over one beat per pass, drain what it queued
+	if (ocl->plugin && plugin_pending(ocl->plugin))
+		busy = 1;
+	n = 0;
+	for (i = 0; !busy && (ocl->client != NULL) && (i < ocl->max_clients);
+	     i++) {
+		if ((ocl->client[i] == NULL) || (ocl->client[i]->fd < 0))
+			continue;
+		// already read ahead, poll() would not see it
+		if (bytes_buffered(ocl->client[i]->fd) > 0) {
+			busy = 1;
+			break;
+		}
+		ocl->poll_fds[n].fd = ocl->client[i]->fd;
+		ocl->poll_fds[n].events = POLLIN;
+		ocl->poll_fds[n].revents = 0;
+		n++;
+	}
+	pthread_mutex_unlock(ocl->lock);
+	if (busy) {
+		sched_yield();
+	} else {
+		ts.tv_sec = 0;
+		ts.tv_nsec = 100000;
+		ppoll(ocl->poll_fds, n, &ts, NULL);
+	}
+	pthread_mutex_lock(ocl->lock);
+}
+
 // TLX thread loop
 static void *_ocl_loop(void *ptr)
 {
 	struct ocl *ocl = (struct ocl *)ptr;
 	struct cmd_event *event, *temp;
-	int events, i, stopped, reset;
+	int events, i, stopped, reset, busy;
 	uint8_t ack = OCSE_DETACH;
 
 
 	stopped = 1;
 	pthread_mutex_lock(ocl->lock);
 	while (ocl->state != OCSE_DONE) {
+		busy = 0;
+		stats_loop(ocl);
 		// idle_cycles continues to generate clock cycles for some
 		// time after the AFU has gone idle.  Eventually clocks will
 		// not be presented to an idle AFU to keep simulation
@@ -285,17 +410,26 @@ static void *_ocl_loop(void *ptr)
 		}
 		if (ocl->idle_cycles) {
 			// Clock AFU
-			tlx_signal_afu_model(ocl->afu_event);
+			_signal_afu(ocl);
+			if (ocl->cmd->latency)
+				ocl->cmd->latency->cycle++;
+			OCSE_PROBE2(ocse, clock, ocl->dbg_id,
+				    latency_cycle(ocl->cmd->latency));
 			// Check for events from AFU
-			events = tlx_get_afu_events(ocl->afu_event);
+			events = _get_afu_events(ocl);
+			stats_time(&(ocl->stats), STATS_SIM);
 			// Error on socket
 			if (events < 0) {
 				warn_msg("Lost connection with AFU");
 				break;
 			}
 			// Handle events from AFU
-			if (events > 0)
+			if (events > 0) {
+				busy = _afu_driving(ocl);
 				_handle_afu(ocl);
+			}
+			else
+				ocl->stats.idle++;
 
 			// Drive events to AFU
 			send_mmio(ocl->mmio);
@@ -306,12 +440,19 @@ static void *_ocl_loop(void *ptr)
 			if (!stopped)
 				info_msg("Stopping clocks to %s", ocl->name);
 			stopped = 1;
-			lock_delay(ocl->lock);
+			stats_time(&(ocl->stats), STATS_OCSE);
+			_ocl_delay(ocl, 0);
+			stats_time(&(ocl->stats), STATS_DELAY);
 		}
 
+		if (latency_poll(ocl->cmd->latency, ocl->name))
+			stats_report(ocl, stdout);
+
 		// Skip client section if AFU descriptor hasn't been read yet
 		if (ocl->client == NULL) {
-			lock_delay(ocl->lock);
+			stats_time(&(ocl->stats), STATS_OCSE);
+			_ocl_delay(ocl, busy);
+			stats_time(&(ocl->stats), STATS_DELAY);
 			continue;
 		}
 		// Check for event from application
@@ -366,10 +507,14 @@ static void *_ocl_loop(void *ptr)
 				free(temp);
 			}
 			ocl->cmd->list = NULL;
+			ocl->cmd->outstanding = 0;
+			ocl->cmd->at_client = 0;
 			info_msg("No longer sending reset to AFU");
 		}
 
-		lock_delay(ocl->lock);
+		stats_time(&(ocl->stats), STATS_OCSE);
+		_ocl_delay(ocl, busy);
+		stats_time(&(ocl->stats), STATS_DELAY);
 	}
 
 	// Disconnect clients
@@ -389,11 +534,16 @@ static void *_ocl_loop(void *ptr)
 	info_msg("Disconnecting %s @ %s:%d", ocl->name, ocl->host, ocl->port);
 	if (ocl->client)
 		free(ocl->client);
+	if (ocl->poll_fds)
+		free(ocl->poll_fds);
 	if (ocl->_prev)
 		ocl->_prev->_next = ocl->_next;
 	if (ocl->_next)
 		ocl->_next->_prev = ocl->_prev;
 	if (ocl->cmd) {
+		latency_report(ocl->cmd->latency, ocl->name, stdout);
+		stats_report(ocl, stdout);
+		latency_free(ocl->cmd->latency);
 		free(ocl->cmd);
 	}
 	if (ocl->mmio) {
@@ -402,7 +552,7 @@ static void *_ocl_loop(void *ptr)
 	if (ocl->host)
 		free(ocl->host);
 	if (ocl->afu_event) {
-		tlx_close_afu_event(ocl->afu_event);
+		_close_afu(ocl);
 		free(ocl->afu_event);
 	}
 	printf("ocl->name is %s \n", ocl->name);
@@ -425,7 +575,7 @@ static void *_ocl_loop(void *ptr)
 // The return value is encode int a 16-bit value where each bit represents a
 // possible tlx interface.  For example: tlx0 is 0x8000 and tlx5 is 0x0400.
 uint16_t ocl_init(struct ocl **head, struct parms *parms, char *id, char *host,
-		  int port, pthread_mutex_t * lock, FILE * dbg_fp)
+		  int port, char *model, pthread_mutex_t * lock, FILE * dbg_fp)
 {
 	struct ocl *ocl;
 	uint16_t location;
@@ -480,13 +630,33 @@ uint16_t ocl_init(struct ocl **head, struct parms *parms, char *id, char *host,
 		perror("malloc");
 		goto init_fail;
 	}
-	info_msg("Attempting to connect AFU: %s @ %s:%d", ocl->name,
-		 ocl->host, ocl->port);
-	if (tlx_init_afu_event(ocl->afu_event, ocl->host, ocl->port) !=
-	    TLX_SUCCESS) {
-		warn_msg("Unable to connect AFU: %s @ %s:%d", ocl->name,
+	if (model && !strcmp(host, "builtin")) {
+		info_msg("Starting AFU: %s @ builtin:%s", ocl->name, model);
+		tlx_event_reset(ocl->afu_event);
+		ocl->afu_event->sockfd = -1;
+		if ((ocl->builtin = builtin_open(model, ocl->name)) == NULL) {
+			warn_msg("Unable to start AFU: %s @ builtin:%s",
+				 ocl->name, model);
+			goto init_fail;
+		}
+	} else if (model) {
+		info_msg("Loading AFU: %s @ %s", ocl->name, model);
+		tlx_event_reset(ocl->afu_event);
+		ocl->afu_event->sockfd = -1;
+		if ((ocl->plugin = plugin_open(model, ocl->name)) == NULL) {
+			warn_msg("Unable to load AFU: %s @ %s", ocl->name,
+				 model);
+			goto init_fail;
+		}
+	} else {
+		info_msg("Attempting to connect AFU: %s @ %s:%d", ocl->name,
 			 ocl->host, ocl->port);
-		goto init_fail;
+		if (tlx_init_afu_event(ocl->afu_event, ocl->host, ocl->port) !=
+		    TLX_SUCCESS) {
+			warn_msg("Unable to connect AFU: %s @ %s:%d", ocl->name,
+				 ocl->host, ocl->port);
+			goto init_fail;
+		}
 	}
 	// DEBUG
 	debug_afu_connect(ocl->dbg_fp, ocl->dbg_id);
@@ -507,6 +677,10 @@ uint16_t ocl_init(struct ocl **head, struct parms *parms, char *id, char *host,
 		perror("cmd_init");
 		goto init_fail;
 	}
+	ocl->mmio->latency = ocl->cmd->latency;
+	ocl->cmd->stats = &(ocl->stats);
+	ocl->mmio->stats = &(ocl->stats);
+	trace_port(ocl->dbg_id, ocl->name);
 
 	// Set credits for TLX interface
 	ocl->state = OCSE_DESC;
@@ -527,7 +701,7 @@ uint16_t ocl_init(struct ocl **head, struct parms *parms, char *id, char *host,
 	}
 
 	debug_msg("ocl_init: transmit initial TLX_AFU credits to afu");
-	tlx_signal_afu_model(ocl->afu_event);
+	_signal_afu(ocl);
 
 	// Start ocl loop thread
 	if (pthread_create(&(ocl->thread), NULL, _ocl_loop, ocl)) {
@@ -549,7 +723,7 @@ uint16_t ocl_init(struct ocl **head, struct parms *parms, char *id, char *host,
 	debug_msg( "ocl_init: receive initial AFU_TXL credits from afu");
 
 	int event;
-	event = tlx_get_afu_events(ocl->afu_event);
+	event = _get_afu_events(ocl);
 	//printf("after tlx_get_afu_events, event is 0x%3x \n", event);
 	// Error on socket
 	if (event < 0) {
@@ -578,8 +752,15 @@ uint16_t ocl_init(struct ocl **head, struct parms *parms, char *id, char *host,
 		error_msg("AFU programming model is invalid");
 		goto init_fail;
 	}
+	ocl->poll_fds = (struct pollfd *)calloc(ocl->max_clients,
+						sizeof(struct pollfd));
 	ocl->client = (struct client **)calloc(ocl->max_clients,
 					       sizeof(struct client *));
+	if ((ocl->client == NULL) || (ocl->poll_fds == NULL)) {
+		perror("calloc");
+		error_msg("Unable to allocate memory for %s clients", ocl->name);
+		goto init_fail;
+	}
 	ocl->cmd->client = ocl->client;
 	ocl->cmd->max_clients = ocl->max_clients;
 
@@ -588,7 +769,7 @@ uint16_t ocl_init(struct ocl **head, struct parms *parms, char *id, char *host,
  init_fail:
 	if (ocl) {
 		if (ocl->afu_event) {
-			tlx_close_afu_event(ocl->afu_event);
+			_close_afu(ocl);
 			free(ocl->afu_event);
 		}
 		if (ocl->host)
@@ -17,25 +17,33 @@
 #ifndef _OCL_H_
 #define _OCL_H_
 
+#include <poll.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 
+#include "builtin.h"
 #include "client.h"
 #include "cmd.h"
 #include "mmio.h"
 #include "parms.h"
+#include "plugin.h"
+#include "stats.h"
 #include "../common/utils.h"
 
 
 struct ocl {
 	struct AFU_EVENT *afu_event;
+	struct plugin *plugin;		// NULL unless the AFU is a plug-in
+	struct builtin *builtin;	// NULL unless the AFU is linked in
 	pthread_t thread;
 	pthread_mutex_t *lock;
 	FILE *dbg_fp;
 	struct client **client;
+	struct pollfd *poll_fds;	// for waiting on clients, see _ocl_delay
 	struct cmd *cmd;
 	struct mmio *mmio;
+	struct stats stats;
 	struct ocl **head;
 	struct ocl *_prev;
 	struct ocl *_next;
@@ -54,6 +62,6 @@ struct ocl {
 };
 
 uint16_t ocl_init(struct ocl **head, struct parms *parms, char *id, char *host,
-		  int port, pthread_mutex_t * lock, FILE * dbg_fp);
+		  int port, char *model, pthread_mutex_t * lock, FILE * dbg_fp);
 
 #endif				/* _OCL_H_ */
@@ -35,6 +35,7 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
 #include <pthread.h>
 #include <signal.h>
@@ -48,10 +49,13 @@
 #include <time.h>
 
 #include "client.h"
+#include "latency.h"
 #include "mmio.h"
 #include "parms.h"
 #include "ocl.h"
 #include "shim_host.h"
+#include "stats.h"
+#include "trace.h"
 #include "../common/debug.h"
 #include "../common/utils.h"
 
@@ -88,6 +92,12 @@ static void _INThandler(int sig)
 	}
 }
 
+// Have every ocl thread print its command latency histograms
+static void _USR1handler(int sig)
+{
+	latency_dump_request++;
+}
+
 // Find OCL for specific AFU id
 static struct ocl *_find_ocl(uint8_t id, uint8_t * major)
 {
@@ -453,6 +463,29 @@ static void _query(struct client *client)
 	free(buffer);
 }
 
+// Send the live counters of all ports: OCSE_STATS, the text length in 32
+// bits network order, then the text (see stats.c)
+static void _stats(struct client *client)
+{
+	uint8_t *buffer;
+	uint32_t length;
+	int size;
+
+	size = STATS_MAX_CHARS;
+	buffer = (uint8_t *) malloc(size + 5);
+	if (buffer == NULL) {
+		client_drop(client, TLX_IDLE_CYCLES, CLIENT_NONE);
+		return;
+	}
+	size = stats_text(ocl_list, (char *)&(buffer[5]), size);
+	buffer[0] = OCSE_STATS;
+	length = htonl(size);
+	memcpy(&(buffer[1]), &length, sizeof(length));
+	if (put_bytes(client->fd, size + 5, buffer, fp, -1, -1) < 0)
+		client_drop(client, TLX_IDLE_CYCLES, CLIENT_NONE);
+	free(buffer);
+}
+
 static void _free_client(struct client *client)
 {
 	if (client == NULL)
@@ -614,7 +647,9 @@ static void *_client_loop(void *ptr)
 
 	pthread_mutex_lock(&lock);
 	while (client->pending) {
-		rc = bytes_ready(client->fd, client->timeout, &(client->abort));
+		// don't wait with the lock held, a client like debug/ocse_stats
+		// may stay connected between requests
+		rc = bytes_ready(client->fd, 0, &(client->abort));
 		if (rc == 0) {
 			lock_delay(&lock);
 			continue;
@@ -639,6 +674,11 @@ static void *_client_loop(void *ptr)
 			lock_delay(&lock);
 			continue;
 		}
+		if (data[0] == OCSE_STATS) {
+			_stats(client);
+			lock_delay(&lock);
+			continue;
+		}
 		if (data[0] == OCSE_OPEN) {
 			_client_associate(client);
 			debug_msg("_client_loop: client associated");
@@ -709,13 +749,14 @@ int main(int argc, char **argv)
 	struct sockaddr_in client_addr;
 	struct client *client;
 	struct client **client_ptr;
-	int listen_fd, connect_fd;
+	int listen_fd, connect_fd, opt;
 	socklen_t client_len;
 	sigset_t set;
 	struct sigaction action;
 	char *shim_host_path;
 	char *parms_path;
 	char *debug_log_path;
+	char *trace_path;
 	struct parms *parms;
 	char *ip;
 
@@ -728,6 +769,11 @@ int main(int argc, char **argv)
 		return -1;
 	}
 
+	// Chrome trace of the AFU transactions if asked for
+	trace_path = getenv("OCSE_TRACE");
+	if (trace_path && (trace_open(trace_path) < 0))
+		warn_msg("Could not open trace file %s", trace_path);
+
 	// Mask SIGPIPE signal for all threads
 	sigemptyset(&set);
 	sigaddset(&set, SIGPIPE);
@@ -740,6 +786,10 @@ int main(int argc, char **argv)
 	sigemptyset(&(action.sa_mask));
 	action.sa_flags = 0;
 	sigaction(SIGINT, &action, NULL);
+	// SIGUSR1 prints the command latency histograms of every port
+	action.sa_handler = _USR1handler;
+	action.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &action, NULL);
 
 	// Report version
 	info_msg("OCSE version %d.%03d compiled @ %s %s", OCSE_VERSION_MAJOR,
@@ -769,6 +819,8 @@ int main(int argc, char **argv)
 	if (ocl_list == NULL) {
 		pthread_mutex_unlock(&lock);
 		free(parms);
+		trace_close();
+		debug_flush();
 		fclose(fp);
 		pthread_mutex_destroy(&lock);
 		warn_msg("Unable to connect to any simulators");
@@ -778,6 +830,8 @@ int main(int argc, char **argv)
 	if ((listen_fd = _start_server()) < 0) {
 		pthread_mutex_unlock(&lock);
 		free(parms);
+		trace_close();
+		debug_flush();
 		fclose(fp);
 		pthread_mutex_destroy(&lock);
 		return -1;
@@ -794,6 +848,10 @@ int main(int argc, char **argv)
 			lock_delay(&lock);
 			continue;
 		}
+		// Replies are small and answered right away, don't let Nagle
+		// hold them back behind the peer's delayed ack
+		opt = 1;
+		setsockopt(connect_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
 		ip = (char *)malloc(INET_ADDRSTRLEN + 1);
 		inet_ntop(AF_INET, &(client_addr.sin_addr.s_addr), ip,
 			  INET_ADDRSTRLEN);
@@ -847,6 +905,8 @@ int main(int argc, char **argv)
 	pthread_mutex_unlock(&lock);
 
 	free(parms);
+	trace_close();
+	debug_flush();
 	fclose(fp);
 	pthread_mutex_destroy(&lock);
 
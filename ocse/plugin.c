@@ -0,0 +1,439 @@
+/*
+ * Copyright 2014,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Description: plugin.c
+ *
+ *  Transport for AFUs loaded as shared objects, see common/ocse_plugin.h.
+ *  It stands in for the socket half of tlx_interface.c: plugin_signal_afu()
+ *  turns what ocse queued in the AFU_EVENT into calls to the plug-in and
+ *  plugin_get_afu_events() fills the AFU_EVENT from what the plug-in handed
+ *  back, one 64 byte beat per call, just like a message from an AFU
+ *  simulator.  The rest of ocse can not tell the difference.
+ */
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "plugin.h"
+#include "../common/ocse_plugin.h"
+#include "../common/utils.h"
+
+// config credits the plug-in starts with; credits are returned as soon as
+// an op returns, so any number keeps ocse going
+#define PLUGIN_CFG_CREDITS 8
+
+// One beat from the plug-in to ocse.  The first beat of a command or
+// response carries its fields, the rest only data.
+struct plugin_beat {
+	int header;
+	int data_valid;
+	struct ocse_plugin_afu_cmd cmd;
+	struct ocse_plugin_afu_resp resp;
+	struct ocse_plugin_cfg_resp cfg;
+	uint8_t data[64];
+	struct plugin_beat *_next;
+};
+
+struct plugin_queue {
+	struct plugin_beat *head;
+	struct plugin_beat **tail;
+};
+
+struct plugin {
+	void *dl;
+	const struct ocse_plugin_ops *ops;
+	void *afu;
+	struct ocse_plugin_host host;
+	pthread_mutex_t lock;	// protects the queues
+	struct plugin_queue cmd;
+	struct plugin_queue resp;
+	struct plugin_queue cfg;
+	int credits_sent;
+	char *path;
+};
+
+// Split size bytes of data into beats behind first, returns the last beat
+// or NULL if out of memory
+static struct plugin_beat *_add_data(struct plugin_beat *first, uint8_t *data,
+				     uint16_t size)
+{
+	struct plugin_beat *beat = first;
+	uint16_t offset, bytes;
+
+	for (offset = 0; offset < size; offset += 64) {
+		if (offset) {
+			beat->_next = (struct plugin_beat *)
+			    calloc(1, sizeof(struct plugin_beat));
+			if (beat->_next == NULL)
+				return NULL;
+			beat = beat->_next;
+		}
+		bytes = size - offset;
+		if (bytes > 64)
+			bytes = 64;
+		memcpy(beat->data, data + offset, bytes);
+		beat->data_valid = 1;
+	}
+	return beat;
+}
+
+static void _free_beats(struct plugin_beat *beat)
+{
+	struct plugin_beat *next;
+
+	while (beat != NULL) {
+		next = beat->_next;
+		free(beat);
+		beat = next;
+	}
+}
+
+// Append the chain starting at first and ending at last to queue
+static void _enqueue(struct plugin *plugin, struct plugin_queue *queue,
+		     struct plugin_beat *first, struct plugin_beat *last)
+{
+	pthread_mutex_lock(&(plugin->lock));
+	*(queue->tail) = first;
+	queue->tail = &(last->_next);
+	pthread_mutex_unlock(&(plugin->lock));
+}
+
+// Caller holds plugin->lock
+static struct plugin_beat *_dequeue(struct plugin_queue *queue)
+{
+	struct plugin_beat *beat = queue->head;
+
+	if (beat == NULL)
+		return NULL;
+	queue->head = beat->_next;
+	if (queue->head == NULL)
+		queue->tail = &(queue->head);
+	beat->_next = NULL;
+	return beat;
+}
+
+static void _queue_init(struct plugin_queue *queue)
+{
+	queue->head = NULL;
+	queue->tail = &(queue->head);
+}
+
+// ocse_plugin_host functions, ptr is the struct plugin
+
+static int _afu_cmd(void *ptr, const struct ocse_plugin_afu_cmd *cmd)
+{
+	struct plugin *plugin = (struct plugin *)ptr;
+	struct plugin_beat *first, *last;
+
+	if ((cmd->data_size > 256) || (cmd->data_size && (cmd->data == NULL))) {
+		warn_msg("plugin: %s: bad afu command data size %d",
+			 plugin->path, cmd->data_size);
+		return -1;
+	}
+	if ((first = (struct plugin_beat *)calloc(1, sizeof(struct plugin_beat))) == NULL)
+		return -1;
+	first->header = 1;
+	first->cmd = *cmd;
+	first->cmd.data = NULL;
+	if ((last = _add_data(first, cmd->data, cmd->data_size)) == NULL) {
+		_free_beats(first);
+		return -1;
+	}
+	_enqueue(plugin, &(plugin->cmd), first, last);
+	return 0;
+}
+
+static int _afu_resp(void *ptr, const struct ocse_plugin_afu_resp *resp)
+{
+	struct plugin *plugin = (struct plugin *)ptr;
+	struct plugin_beat *first, *last;
+
+	if ((resp->data_size > 256) || (resp->data_size && (resp->data == NULL))) {
+		warn_msg("plugin: %s: bad afu response data size %d",
+			 plugin->path, resp->data_size);
+		return -1;
+	}
+	if ((first = (struct plugin_beat *)calloc(1, sizeof(struct plugin_beat))) == NULL)
+		return -1;
+	first->header = 1;
+	first->resp = *resp;
+	first->resp.data = NULL;
+	if ((last = _add_data(first, resp->data, resp->data_size)) == NULL) {
+		_free_beats(first);
+		return -1;
+	}
+	_enqueue(plugin, &(plugin->resp), first, last);
+	return 0;
+}
+
+static int _cfg_resp(void *ptr, const struct ocse_plugin_cfg_resp *resp)
+{
+	struct plugin *plugin = (struct plugin *)ptr;
+	struct plugin_beat *beat;
+
+	if ((beat = (struct plugin_beat *)calloc(1, sizeof(struct plugin_beat))) == NULL)
+		return -1;
+	beat->header = 1;
+	beat->cfg = *resp;
+	_enqueue(plugin, &(plugin->cfg), beat, beat);
+	return 0;
+}
+
+struct plugin *plugin_open(char *path, char *name)
+{
+	struct plugin *plugin;
+	ocse_plugin_init_t init;
+
+	if ((plugin = (struct plugin *)calloc(1, sizeof(struct plugin))) == NULL) {
+		perror("calloc");
+		return NULL;
+	}
+	if ((plugin->path = strdup(path)) == NULL) {
+		perror("strdup");
+		goto open_fail;
+	}
+	pthread_mutex_init(&(plugin->lock), NULL);
+	_queue_init(&(plugin->cmd));
+	_queue_init(&(plugin->resp));
+	_queue_init(&(plugin->cfg));
+
+	if ((plugin->dl = dlopen(path, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+		warn_msg("plugin: %s", dlerror());
+		goto open_fail;
+	}
+	*(void **)(&init) = dlsym(plugin->dl, OCSE_PLUGIN_INIT);
+	if (init == NULL) {
+		warn_msg("plugin: %s has no %s", path, OCSE_PLUGIN_INIT);
+		goto open_fail;
+	}
+	plugin->ops = init();
+	if ((plugin->ops == NULL) || (plugin->ops->version != OCSE_PLUGIN_VERSION)) {
+		warn_msg("plugin: %s: want interface version %d, got %d", path,
+			 OCSE_PLUGIN_VERSION,
+			 plugin->ops ? (int)plugin->ops->version : -1);
+		goto open_fail;
+	}
+	if (!plugin->ops->open || !plugin->ops->close || !plugin->ops->cfg_cmd ||
+	    !plugin->ops->cmd || !plugin->ops->resp) {
+		warn_msg("plugin: %s: missing ops", path);
+		goto open_fail;
+	}
+
+	plugin->host.ocl = plugin;
+	plugin->host.afu_cmd = _afu_cmd;
+	plugin->host.afu_resp = _afu_resp;
+	plugin->host.cfg_resp = _cfg_resp;
+	if ((plugin->afu = plugin->ops->open(&(plugin->host), name)) == NULL) {
+		warn_msg("plugin: %s failed to open %s", path, name);
+		goto open_fail;
+	}
+	info_msg("plugin: %s opened for %s", path, name);
+	return plugin;
+
+ open_fail:
+	if (plugin->dl)
+		dlclose(plugin->dl);
+	if (plugin->path)
+		free(plugin->path);
+	free(plugin);
+	return NULL;
+}
+
+void plugin_signal_afu(struct plugin *plugin, struct AFU_EVENT *event)
+{
+	struct ocse_plugin_cfg_cmd cfg;
+	struct ocse_plugin_host_cmd cmd;
+	struct ocse_plugin_host_resp resp;
+
+	if (event->tlx_cfg_valid) {
+		memset(&cfg, 0, sizeof(cfg));
+		cfg.opcode = event->tlx_cfg_opcode;
+		cfg.capptag = event->tlx_cfg_capptag;
+		cfg.pl = event->tlx_cfg_pl;
+		cfg.t = event->tlx_cfg_t;
+		cfg.pa = event->tlx_cfg_pa;
+		memcpy(cfg.data, event->tlx_cfg_data_bus, 4);
+		event->tlx_cfg_valid = 0;
+		plugin->ops->cfg_cmd(plugin->afu, &cfg);
+		event->cfg_tlx_credits_available++;
+	}
+
+	if (event->tlx_afu_cmd_valid) {
+		memset(&cmd, 0, sizeof(cmd));
+		cmd.opcode = event->tlx_afu_cmd_opcode;
+		cmd.capptag = event->tlx_afu_cmd_capptag;
+		cmd.dl = event->tlx_afu_cmd_dl;
+		cmd.pl = event->tlx_afu_cmd_pl;
+		cmd.be = event->tlx_afu_cmd_be;
+		cmd.end = event->tlx_afu_cmd_end;
+#ifdef TLX4
+		cmd.os = event->tlx_afu_cmd_os;
+		cmd.flag = event->tlx_afu_cmd_flag;
+#endif
+		cmd.pa = event->tlx_afu_cmd_pa;
+		if (event->tlx_afu_cmd_data_valid) {
+			cmd.data = event->tlx_afu_cmd_data_bus;
+			cmd.data_size = event->tlx_afu_cmd_data_byte_cnt;
+		}
+		event->tlx_afu_cmd_valid = 0;
+		event->tlx_afu_cmd_data_valid = 0;
+		plugin->ops->cmd(plugin->afu, &cmd);
+		event->afu_tlx_cmd_credits_available++;
+	} else if (event->tlx_afu_cmd_data_valid) {
+		warn_msg("plugin: %s: dropping command data without a command",
+			 plugin->path);
+		event->tlx_afu_cmd_data_valid = 0;
+	}
+
+	if (event->tlx_afu_resp_valid) {
+		memset(&resp, 0, sizeof(resp));
+		resp.opcode = event->tlx_afu_resp_opcode;
+		resp.afutag = event->tlx_afu_resp_afutag;
+		resp.code = event->tlx_afu_resp_code;
+		resp.pg_size = event->tlx_afu_resp_pg_size;
+		resp.dl = event->tlx_afu_resp_dl;
+		resp.dp = event->tlx_afu_resp_dp;
+		resp.addr_tag = event->tlx_afu_resp_addr_tag;
+#ifdef TLX4
+		resp.host_tag = event->tlx_afu_resp_host_tag;
+		resp.cache_state = event->tlx_afu_resp_cache_state;
+#endif
+		if (event->tlx_afu_resp_data_valid) {
+			resp.data = event->tlx_afu_resp_data;
+			resp.data_size = event->tlx_afu_resp_data_byte_cnt;
+		}
+		event->tlx_afu_resp_valid = 0;
+		event->tlx_afu_resp_data_valid = 0;
+		plugin->ops->resp(plugin->afu, &resp);
+		event->afu_tlx_resp_credits_available++;
+	}
+
+	// credits ocse hands the AFU are meaningless to a plug-in
+	event->tlx_afu_credit_valid = 0;
+	event->tlx_cfg_resp_ack = 0;
+
+	if (plugin->ops->poll)
+		plugin->ops->poll(plugin->afu);
+}
+
+int plugin_get_afu_events(struct plugin *plugin, struct AFU_EVENT *event)
+{
+	struct plugin_beat *cmd, *resp, *cfg;
+
+	if (!plugin->credits_sent) {
+		event->afu_tlx_cmd_initial_credit = MAX_AFU_TLX_CMD_CREDITS;
+		event->cfg_tlx_initial_credit = PLUGIN_CFG_CREDITS;
+		event->afu_tlx_resp_initial_credit = MAX_AFU_TLX_RESP_CREDITS;
+		event->afu_tlx_credit_req_valid = 1;
+		plugin->credits_sent = 1;
+	}
+
+	pthread_mutex_lock(&(plugin->lock));
+	cmd = _dequeue(&(plugin->cmd));
+	resp = _dequeue(&(plugin->resp));
+	cfg = _dequeue(&(plugin->cfg));
+	pthread_mutex_unlock(&(plugin->lock));
+
+	event->afu_tlx_cmd_valid = 0;
+	event->afu_tlx_cdata_valid = 0;
+	if (cmd != NULL) {
+		if (cmd->header) {
+			event->afu_tlx_cmd_valid = 1;
+			event->afu_tlx_cmd_opcode = cmd->cmd.opcode;
+			event->afu_tlx_cmd_actag = cmd->cmd.actag;
+			event->afu_tlx_cmd_stream_id = cmd->cmd.stream_id;
+			memcpy(event->afu_tlx_cmd_ea_or_obj, cmd->cmd.ea_or_obj, 9);
+			event->afu_tlx_cmd_afutag = cmd->cmd.afutag;
+			event->afu_tlx_cmd_dl = cmd->cmd.dl;
+			event->afu_tlx_cmd_pl = cmd->cmd.pl;
+#ifdef TLX4
+			event->afu_tlx_cmd_os = cmd->cmd.os;
+#endif
+			event->afu_tlx_cmd_be = cmd->cmd.be;
+			event->afu_tlx_cmd_flag = cmd->cmd.flag;
+			event->afu_tlx_cmd_endian = cmd->cmd.endian;
+			event->afu_tlx_cmd_bdf = cmd->cmd.bdf;
+			event->afu_tlx_cmd_pasid = cmd->cmd.pasid;
+			event->afu_tlx_cmd_pg_size = cmd->cmd.pg_size;
+		}
+		if (cmd->data_valid) {
+			event->afu_tlx_cdata_valid = 1;
+			event->afu_tlx_cdata_bdi = 0;
+			memcpy(event->afu_tlx_cdata_bus, cmd->data, 64);
+		}
+		free(cmd);
+	}
+
+	event->afu_tlx_resp_valid = 0;
+	event->afu_tlx_rdata_valid = 0;
+	if (resp != NULL) {
+		if (resp->header) {
+			event->afu_tlx_resp_valid = 1;
+			event->afu_tlx_resp_opcode = resp->resp.opcode;
+			event->afu_tlx_resp_dl = resp->resp.dl;
+			event->afu_tlx_resp_capptag = resp->resp.capptag;
+			event->afu_tlx_resp_dp = resp->resp.dp;
+			event->afu_tlx_resp_code = resp->resp.code;
+		}
+		if (resp->data_valid) {
+			event->afu_tlx_rdata_valid = 1;
+			event->afu_tlx_rdata_bdi = 0;
+			memcpy(event->afu_tlx_rdata_bus, resp->data, 64);
+		}
+		free(resp);
+	}
+
+	event->cfg_tlx_resp_valid = 0;
+	if (cfg != NULL) {
+		event->cfg_tlx_resp_valid = 1;
+		event->cfg_tlx_resp_opcode = cfg->cfg.opcode;
+		event->cfg_tlx_resp_capptag = cfg->cfg.capptag;
+		event->cfg_tlx_resp_code = cfg->cfg.code;
+		event->cfg_tlx_rdata_bdi = 0;
+		memcpy(event->cfg_tlx_rdata_bus, cfg->cfg.data, 4);
+		free(cfg);
+	}
+
+	return 1;
+}
+
+int plugin_pending(struct plugin *plugin)
+{
+	int pending;
+
+	pthread_mutex_lock(&(plugin->lock));
+	pending = (plugin->cmd.head != NULL) || (plugin->resp.head != NULL) ||
+	    (plugin->cfg.head != NULL);
+	pthread_mutex_unlock(&(plugin->lock));
+	return pending;
+}
+
+void plugin_close(struct plugin *plugin)
+{
+	if (plugin == NULL)
+		return;
+	plugin->ops->close(plugin->afu);
+	dlclose(plugin->dl);
+	_free_beats(plugin->cmd.head);
+	_free_beats(plugin->resp.head);
+	_free_beats(plugin->cfg.head);
+	pthread_mutex_destroy(&(plugin->lock));
+	free(plugin->path);
+	free(plugin);
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2014,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _PLUGIN_H_
+#define _PLUGIN_H_
+
+#include "../common/tlx_interface.h"
+
+struct plugin;
+
+// Load the shared object at path and open it for tlx entry name
+struct plugin *plugin_open(char *path, char *name);
+
+// Counterpart of tlx_signal_afu_model(): hand what ocse queued in event to
+// the plug-in and return the credits it used
+void plugin_signal_afu(struct plugin *plugin, struct AFU_EVENT *event);
+
+// Counterpart of tlx_get_afu_events(): move the next beat the plug-in queued
+// into event, always returns 1
+int plugin_get_afu_events(struct plugin *plugin, struct AFU_EVENT *event);
+
+// Non-zero while the plug-in has beats queued that ocse has not taken yet
+int plugin_pending(struct plugin *plugin);
+
+void plugin_close(struct plugin *plugin);
+
+#endif				/* _PLUGIN_H_ */
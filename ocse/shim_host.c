@@ -32,7 +32,7 @@ uint16_t parse_host_data(struct ocl ** head, struct parms * parms,
 {
 	FILE *fp;
 	struct ocl *ocl;
-	char *hostdata, *comment, *tlx_id, *host, *port_str;
+	char *hostdata, *comment, *tlx_id, *host, *port_str, *model;
 	uint16_t location, tlx_map;
 	int port;
 
@@ -85,9 +85,18 @@ uint16_t parse_host_data(struct ocl ** head, struct parms * parms,
 		}
 		port = atoi(port_str);
 
+		// "plugin:<path>" loads the AFU from a shared object and
+		// "builtin:<model>" uses one linked into ocse instead
+		model = NULL;
+		if (!strcmp(host, "plugin") || !strcmp(host, "builtin")) {
+			model = port_str;
+			model[strcspn(model, " \t\r\n")] = '\0';
+			port = 0;
+		}
+
 		// Initialize OCL
 		if ((location = ocl_init(head, parms, tlx_id, host, port,
-					 lock, dbg_fp)) == 0) {
+					 model, lock, dbg_fp)) == 0) {
 			continue;
 		}
 		tlx_map |= location;
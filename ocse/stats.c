@@ -0,0 +1,306 @@
+/*
+ * Copyright 2014,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Description: stats.c
+ *
+ *  Live counters of every port for the OCSE_STATS client request, see
+ *  debug/ocse_stats.  The answer is text, one "<port> <counter> <value>" line
+ *  per counter, so new counters don't need a new protocol version:
+ *
+ *      cycles                  AFU clocks so far
+ *      idle                    clocks without an event from a socket AFU
+ *      clients                 client contexts attached
+ *      commands, command.<op>  AFU commands taken, in total and by opcode
+ *      responses, response.<op> responses sent back to the AFU
+ *      outstanding             commands in flight now
+ *      max_outstanding         most commands in flight at once
+ *      mmios, mmio_pending     accesses the AFU answered, accesses queued
+ *      bytes_read              data read from clients for the AFU
+ *      bytes_written           data the AFU wrote to clients
+ *      resp_credit_stalls      times a response waited for AFU credits
+ *      mmio_credit_stalls      times an MMIO waited for TLX credits
+ *      context.<n>.round_trips client round trips of AFU commands
+ *      context.<n>.round_trip_ns  their average wall time
+ *      wall_ns                 wall time of the port thread
+ *      simulator_ns            of it clocking the AFU, i.e. in the simulator
+ *      ocse_ns                 handling AFU events, MMIOs and clients,
+ *                              polling client sockets included
+ *      delay_ns                in lock_delay(), where client threads relay
+ *                              messages from the applications
+ *      application_ns          with a command waiting for a client answer,
+ *                              overlaps the three above
+ *
+ *  stats_report() prints the same split, the cycles per second over time and
+ *  the calls, the calls that found work and the time spent in each handler
+ *  _handle_afu() calls every cycle when the port shuts down and on SIGUSR1.
+ *  Handlers are timed with the time stamp counter, converted to ns with the
+ *  ticks counted over the life of the port.
+ */
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "stats.h"
+#include "cmd.h"
+#include "latency.h"
+#include "mmio.h"
+#include "ocl.h"
+
+static const char *_time_name[STATS_TIMES] = {
+	"simulator", "ocse", "delay"
+};
+
+static const char *_handler_name[STATS_HANDLERS] = {
+	"handle_ap_resp", "handle_ap_resp_data", "handle_response",
+	"handle_buffer_write", "handle_xlate_intrp_pending_sent", "handle_cmd",
+	"handle_afu_tlx_cmd_data_read", "handle_afu_tlx_write_cmd",
+	"handle_touch", "handle_interrupt", "handle_write_be_or_amo"
+};
+
+static uint64_t _now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void stats_loop(struct ocl *ocl)
+{
+	struct stats *stats = &(ocl->stats);
+	uint64_t now, cycle;
+	int i;
+
+	now = _now_ns();
+	cycle = latency_cycle(ocl->cmd->latency);
+	if (stats->start_ns == 0) {
+		stats->start_ns = now;
+		stats->start_ticks = stats_ticks();
+		stats->last_ns = now;
+		stats->rate_ns = STATS_RATE_NS;
+		stats->rate_cycle = cycle;
+	}
+	stats->ns[STATS_OCSE] += now - stats->last_ns;
+	if (stats->client_wait)
+		stats->client_wait_ns += now - stats->loop_ns;
+	while (now >= stats->start_ns + (stats->rates + 1) * stats->rate_ns) {
+		if (stats->rates == STATS_RATES) {
+			for (i = 0; i < STATS_RATES / 2; i++)
+				stats->rate[i] = stats->rate[2 * i] +
+				    stats->rate[2 * i + 1];
+			stats->rates = STATS_RATES / 2;
+			stats->rate_ns *= 2;
+			continue;
+		}
+		stats->rate[stats->rates++] = cycle - stats->rate_cycle;
+		stats->rate_cycle = cycle;
+	}
+	stats->client_wait = (ocl->cmd->at_client != 0);
+	stats->loop_ns = now;
+	stats->last_ns = now;
+}
+
+void stats_time(struct stats *stats, enum stats_time time)
+{
+	uint64_t now;
+
+	now = _now_ns();
+	stats->ns[time] += now - stats->last_ns;
+	stats->last_ns = now;
+}
+
+// Calls of each _handle_afu() handler, the ticks of calls that found no
+// work are what polling every cycle costs
+static void _handler_report(struct ocl *ocl, FILE * fp, uint64_t wall)
+{
+	struct stats *stats = &(ocl->stats);
+	struct stats_calls *calls;
+	uint64_t ticks, idle;
+	double ns;
+	int i;
+
+	ticks = stats_ticks() - stats->start_ticks;
+	if ((ticks == 0) || (stats->handler[STATS_CMD].calls == 0))
+		return;
+	// ns per tick, from the ticks and wall time since the port started
+	ns = (double)wall / ticks;
+	fprintf(fp, "%s handler %-32s %10s %10s %12s %12s %9s\n", ocl->name,
+		"", "calls", "busy", "busy_ns", "idle_ns", "idle/call");
+	for (i = 0; i < STATS_HANDLERS; i++) {
+		calls = &(stats->handler[i]);
+		idle = calls->ticks - calls->busy_ticks;
+		fprintf(fp, "%s handler %-32s %10" PRIu64 " %10" PRIu64
+			" %12.0f %12.0f %9.1f\n", ocl->name,
+			_handler_name[i], calls->calls, calls->busy,
+			calls->busy_ticks * ns, idle * ns,
+			(calls->calls > calls->busy) ? idle * ns /
+			(calls->calls - calls->busy) : 0);
+	}
+}
+
+void stats_report(struct ocl *ocl, FILE * fp)
+{
+	struct stats *stats = &(ocl->stats);
+	uint64_t wall, cycles;
+	double seconds;
+	int i;
+
+	if (stats->start_ns == 0)
+		return;
+	wall = _now_ns() - stats->start_ns;
+	seconds = wall / 1e9;
+	cycles = latency_cycle(ocl->cmd->latency);
+	fprintf(fp, "%s: %" PRIu64 " cycles in %.3f s, %.1f cycles/s\n",
+		ocl->name, cycles, seconds, seconds ? cycles / seconds : 0);
+	for (i = 0; i < STATS_TIMES; i++)
+		fprintf(fp, "%s time %-11s %10.3f s %5.1f%%\n", ocl->name,
+			_time_name[i], stats->ns[i] / 1e9,
+			wall ? 100.0 * stats->ns[i] / wall : 0);
+	fprintf(fp, "%s time %-11s %10.3f s %5.1f%% (overlaps the above)\n",
+		ocl->name, "application", stats->client_wait_ns / 1e9,
+		wall ? 100.0 * stats->client_wait_ns / wall : 0);
+	if (stats->rates) {
+		fprintf(fp, "%s cycles/s every %g s:", ocl->name,
+			stats->rate_ns / 1e9);
+		for (i = 0; i < stats->rates; i++)
+			fprintf(fp, " %.0f", stats->rate[i] /
+				(stats->rate_ns / 1e9));
+		fprintf(fp, "\n");
+	}
+	_handler_report(ocl, fp, wall);
+	fflush(fp);
+}
+
+static int _line(char *buffer, int size, int used, const char *format, ...)
+    __attribute__ ((format(printf, 4, 5)));
+
+// Append a line if it fits, returns the new length of the text
+static int _line(char *buffer, int size, int used, const char *format, ...)
+{
+	va_list args;
+	int len;
+
+	va_start(args, format);
+	len = vsnprintf(buffer + used, size - used, format, args);
+	va_end(args);
+	if ((len < 0) || (used + len >= size)) {
+		buffer[used] = '\0';
+		return used;
+	}
+	return used + len;
+}
+
+static int _port_text(struct ocl *ocl, char *buffer, int size, int used)
+{
+	struct stats *stats = &(ocl->stats);
+	struct latency *latency = ocl->cmd->latency;
+	struct latency_hist *hist;
+	struct mmio_event *access;
+	uint64_t commands, responses;
+	int i, clients, outstanding, pending;
+
+	clients = 0;
+	for (i = 0; (ocl->client != NULL) && (i < ocl->max_clients); i++) {
+		if (ocl->client[i] != NULL)
+			clients++;
+	}
+	outstanding = ocl->cmd->outstanding;
+	pending = 0;
+	for (access = ocl->mmio->list; access != NULL; access = access->_next)
+		pending++;
+	commands = 0;
+	responses = 0;
+	for (i = 0; i < 256; i++) {
+		commands += stats->commands[i];
+		responses += stats->responses[i];
+	}
+
+	used = _line(buffer, size, used, "%s cycles %" PRIu64 "\n", ocl->name,
+		     latency_cycle(latency));
+	used = _line(buffer, size, used, "%s idle %" PRIu64 "\n", ocl->name,
+		     stats->idle);
+	used = _line(buffer, size, used, "%s clients %d\n", ocl->name, clients);
+	used = _line(buffer, size, used, "%s commands %" PRIu64 "\n",
+		     ocl->name, commands);
+	used = _line(buffer, size, used, "%s responses %" PRIu64 "\n",
+		     ocl->name, responses);
+	used = _line(buffer, size, used, "%s outstanding %d\n", ocl->name,
+		     outstanding);
+	used = _line(buffer, size, used, "%s max_outstanding %d\n", ocl->name,
+		     stats->max_outstanding);
+	used = _line(buffer, size, used, "%s mmios %" PRIu64 "\n", ocl->name,
+		     stats->mmios);
+	used = _line(buffer, size, used, "%s mmio_pending %d\n", ocl->name,
+		     pending);
+	used = _line(buffer, size, used, "%s bytes_read %" PRIu64 "\n",
+		     ocl->name, stats->bytes_read);
+	used = _line(buffer, size, used, "%s bytes_written %" PRIu64 "\n",
+		     ocl->name, stats->bytes_written);
+	used = _line(buffer, size, used, "%s resp_credit_stalls %" PRIu64 "\n",
+		     ocl->name, stats->resp_credit_stalls);
+	used = _line(buffer, size, used, "%s mmio_credit_stalls %" PRIu64 "\n",
+		     ocl->name, stats->mmio_credit_stalls);
+	for (i = 0; i < 256; i++) {
+		if (stats->commands[i])
+			used = _line(buffer, size, used, "%s command.0x%02x %"
+				     PRIu64 "\n", ocl->name, i,
+				     stats->commands[i]);
+		if (stats->responses[i])
+			used = _line(buffer, size, used, "%s response.0x%02x %"
+				     PRIu64 "\n", ocl->name, i,
+				     stats->responses[i]);
+	}
+	for (i = 0; (latency != NULL) && (i < latency->contexts); i++) {
+		if (latency->context[i] == NULL)
+			continue;
+		hist = &(latency->context[i]->ns[LAT_STAGE_HOST]);
+		used = _line(buffer, size, used, "%s context.%d.round_trips %"
+			     PRIu64 "\n", ocl->name, i, hist->count);
+		if (hist->count)
+			used = _line(buffer, size, used, "%s context.%d."
+				     "round_trip_ns %" PRIu64 "\n", ocl->name,
+				     i, hist->sum / hist->count);
+	}
+	if (stats->start_ns) {
+		used = _line(buffer, size, used, "%s wall_ns %" PRIu64 "\n",
+			     ocl->name, stats->last_ns - stats->start_ns);
+		for (i = 0; i < STATS_TIMES; i++)
+			used = _line(buffer, size, used, "%s %s_ns %" PRIu64
+				     "\n", ocl->name, _time_name[i],
+				     stats->ns[i]);
+		used = _line(buffer, size, used, "%s application_ns %" PRIu64
+			     "\n", ocl->name, stats->client_wait_ns);
+	}
+	return used;
+}
+
+int stats_text(struct ocl *list, char *buffer, int size)
+{
+	struct ocl *ocl;
+	int used;
+
+	used = 0;
+	buffer[0] = '\0';
+	for (ocl = list; ocl != NULL; ocl = ocl->_next) {
+		if ((ocl->cmd == NULL) || (ocl->mmio == NULL))
+			continue;
+		used = _port_text(ocl, buffer, size, used);
+	}
+	return used;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2014,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+struct ocl;
+
+// What the port thread spends its wall time on, see _ocl_loop()
+enum stats_time {
+	STATS_SIM,		// clocking the AFU and collecting its events
+	STATS_OCSE,		// handling AFU events, MMIOs and clients
+	STATS_DELAY,		// lock_delay(), client threads relay messages
+	STATS_TIMES
+};
+
+// The handlers _handle_afu() calls every cycle
+enum stats_handler {
+	STATS_AP_RESP,
+	STATS_AP_RESP_DATA,
+	STATS_RESPONSE,
+	STATS_BUFFER_WRITE,
+	STATS_XLATE_INTRP_PENDING_SENT,
+	STATS_CMD,
+	STATS_AFU_TLX_CMD_DATA_READ,
+	STATS_AFU_TLX_WRITE_CMD,
+	STATS_TOUCH,
+	STATS_INTERRUPT,
+	STATS_WRITE_BE_OR_AMO,
+	STATS_HANDLERS
+};
+
+// Calls of a handler, those that found work bumped stats.work
+struct stats_calls {
+	uint64_t calls;
+	uint64_t busy;		// calls that found work
+	uint64_t ticks;		// stats_ticks() spent in all calls
+	uint64_t busy_ticks;	// of them in calls that found work
+};
+
+// Cycles per second are kept for this many periods, when they are full
+// neighbours merge and the period doubles
+#define STATS_RATES 32
+#define STATS_RATE_NS 1000000000
+
+// Counters of one port, updated by its ocl thread with the ocse lock held
+struct stats {
+	uint64_t idle;			// cycles clocked without an AFU event
+	uint64_t commands[256];		// AFU commands by opcode
+	uint64_t responses[256];	// responses to the AFU by command opcode
+	uint64_t mmios;			// MMIO, lpc and config accesses answered
+	uint64_t bytes_read;		// data read from clients for the AFU
+	uint64_t bytes_written;		// data the AFU wrote to clients
+	uint64_t resp_credit_stalls;	// responses held for AFU credits
+	uint64_t mmio_credit_stalls;	// MMIOs held for TLX credits
+	int max_outstanding;		// most commands in flight at once
+	uint64_t ns[STATS_TIMES];	// wall time by activity
+	uint64_t client_wait_ns;	// wall time with a command at a client,
+					// the applications' share
+	uint64_t start_ns;		// first loop of the port thread
+	uint64_t loop_ns;		// start of the current loop
+	uint64_t last_ns;		// end of the last timed section
+	int client_wait;		// a command was at a client at loop_ns
+	uint64_t rate[STATS_RATES];	// cycles clocked in each period
+	int rates;			// periods complete
+	uint64_t rate_ns;		// length of a period
+	uint64_t rate_cycle;		// cycle the current period started at
+	uint64_t start_ticks;		// stats_ticks() at start_ns
+	uint64_t work;			// bumped by handlers that found work
+	struct stats_calls handler[STATS_HANDLERS];
+};
+
+// Time stamp counter, or ns where there is none, for timing handlers
+static inline uint64_t stats_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(__powerpc64__)
+	return __builtin_ppc_get_timebase();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// Call a handler of _handle_afu(), counting the call and its ticks
+#define STATS_HANDLER(stats, which, call)				\
+	do {								\
+		struct stats_calls *_calls = &((stats)->handler[which]);	\
+		uint64_t _work = (stats)->work;				\
+		uint64_t _ticks = stats_ticks();			\
+		call;							\
+		_ticks = stats_ticks() - _ticks;			\
+		_calls->calls++;					\
+		_calls->ticks += _ticks;				\
+		if ((stats)->work != _work) {				\
+			_calls->busy++;					\
+			_calls->busy_ticks += _ticks;			\
+		}							\
+	} while (0)
+
+// Start of a loop of the port thread
+void stats_loop(struct ocl *ocl);
+
+// Charge the wall time since the last call to time
+void stats_time(struct stats *stats, enum stats_time time);
+
+// Print where the wall time of the port went, its cycles per second and
+// the calls of every handler
+void stats_report(struct ocl *ocl, FILE * fp);
+
+// Largest answer to OCSE_STATS
+#define STATS_MAX_CHARS 0x20000
+
+// Append "<port> <counter> <value>" lines for every port in list to buffer
+// of size bytes, returns the length of the text, ocse lock held
+int stats_text(struct ocl *list, char *buffer, int size);
+
+#endif				/* _STATS_H_ */
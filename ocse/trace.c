@@ -0,0 +1,383 @@
+/*
+ * Copyright 2014,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Description: trace.c
+ *
+ *  Chrome trace event JSON of the transactions on every port, for
+ *  chrome://tracing or ui.perfetto.dev.  Set OCSE_TRACE to the file to write.
+ *
+ *  Every port is a process.  Each AFU command (interrupts included) is a
+ *  slice from the AFU sending it until ocse's response, with the client round
+ *  trip nested inside; each MMIO, lpc memory and config access is a slice from
+ *  the client (or ocse for config) asking until the AFU answered, with the
+ *  AFU round trip nested inside.  Slice times are wall time since the trace
+ *  was opened, the AFU cycle count of the port at both ends is in the args.
+ *
+ *  Commands and MMIOs go on tracks of their own per client context.  Slices
+ *  on a track can't overlap, so each track has as many lanes as it had
+ *  transactions in flight at once, each lane a thread in the trace.  Slices
+ *  are written when the transaction ends, i.e. not in time order, which the
+ *  viewers don't mind.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+#include "../common/tlx_interface.h"
+
+#define TRACE_LANES 64
+#define TRACE_EVENT_CHARS 1024
+
+enum trace_kind {
+	TRACE_MMIO,
+	TRACE_CMD
+};
+
+struct trace_track {
+	int32_t context;
+	enum trace_kind kind;
+	int lanes;
+	int tid[TRACE_LANES];
+	uint64_t end[TRACE_LANES];	// ns the last slice on the lane ends
+};
+
+struct trace_port {
+	struct trace_track *track;
+	int tracks;
+	int tids;
+};
+
+static FILE *_trace_fp;
+static pthread_mutex_t _trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t _trace_base;
+static int _trace_events;
+static struct trace_port _trace_port[256];
+
+static const char *_cmd_name[256] = {
+	[AFU_CMD_NOP] = "nop",
+	[AFU_CMD_RD_WNITC] = "rd_wnitc",
+	[AFU_CMD_RD_WNITC_S] = "rd_wnitc.s",
+	[AFU_CMD_RD_WNITC_N] = "rd_wnitc.n",
+	[AFU_CMD_RD_WNITC_N_S] = "rd_wnitc.n.s",
+	[AFU_CMD_PR_RD_WNITC] = "pr_rd_wnitc",
+	[AFU_CMD_PR_RD_WNITC_S] = "pr_rd_wnitc.s",
+	[AFU_CMD_PR_RD_WNITC_N] = "pr_rd_wnitc.n",
+	[AFU_CMD_PR_RD_WNITC_N_S] = "pr_rd_wnitc.n.s",
+	[AFU_CMD_DMA_W] = "dma_w",
+	[AFU_CMD_DMA_W_S] = "dma_w.s",
+	[AFU_CMD_DMA_W_P] = "dma_w.p",
+	[AFU_CMD_DMA_W_P_S] = "dma_w.p.s",
+	[AFU_CMD_DMA_W_N] = "dma_w.n",
+	[AFU_CMD_DMA_W_N_S] = "dma_w.n.s",
+	[AFU_CMD_DMA_W_N_P] = "dma_w.n.p",
+	[AFU_CMD_DMA_W_N_P_S] = "dma_w.n.p.s",
+	[AFU_CMD_DMA_W_BE] = "dma_w.be",
+	[AFU_CMD_DMA_W_BE_S] = "dma_w.be.s",
+	[AFU_CMD_DMA_W_BE_P] = "dma_w.be.p",
+	[AFU_CMD_DMA_W_BE_P_S] = "dma_w.be.p.s",
+	[AFU_CMD_DMA_W_BE_N] = "dma_w.be.n",
+	[AFU_CMD_DMA_W_BE_N_S] = "dma_w.be.n.s",
+	[AFU_CMD_DMA_W_BE_N_P] = "dma_w.be.n.p",
+	[AFU_CMD_DMA_W_BE_N_P_S] = "dma_w.be.n.p.s",
+	[AFU_CMD_DMA_PR_W] = "dma_pr_w",
+	[AFU_CMD_DMA_PR_W_S] = "dma_pr_w.s",
+	[AFU_CMD_DMA_PR_W_P] = "dma_pr_w.p",
+	[AFU_CMD_DMA_PR_W_P_S] = "dma_pr_w.p.s",
+	[AFU_CMD_DMA_PR_W_N] = "dma_pr_w.n",
+	[AFU_CMD_DMA_PR_W_N_S] = "dma_pr_w.n.s",
+	[AFU_CMD_DMA_PR_W_N_P] = "dma_pr_w.n.p",
+	[AFU_CMD_DMA_PR_W_N_P_S] = "dma_pr_w.n.p.s",
+	[AFU_CMD_AMO_RD] = "amo_rd",
+	[AFU_CMD_AMO_RD_S] = "amo_rd.s",
+	[AFU_CMD_AMO_RD_N] = "amo_rd.n",
+	[AFU_CMD_AMO_RD_N_S] = "amo_rd.n.s",
+	[AFU_CMD_AMO_RW] = "amo_rw",
+	[AFU_CMD_AMO_RW_S] = "amo_rw.s",
+	[AFU_CMD_AMO_RW_N] = "amo_rw.n",
+	[AFU_CMD_AMO_RW_N_S] = "amo_rw.n.s",
+	[AFU_CMD_AMO_W] = "amo_w",
+	[AFU_CMD_AMO_W_S] = "amo_w.s",
+	[AFU_CMD_AMO_W_P] = "amo_w.p",
+	[AFU_CMD_AMO_W_P_S] = "amo_w.p.s",
+	[AFU_CMD_AMO_W_N] = "amo_w.n",
+	[AFU_CMD_AMO_W_N_S] = "amo_w.n.s",
+	[AFU_CMD_AMO_W_N_P] = "amo_w.n.p",
+	[AFU_CMD_AMO_W_N_P_S] = "amo_w.n.p.s",
+	[AFU_CMD_ASSIGN_ACTAG] = "assign_actag",
+	[AFU_CMD_ADR_TAG_RELEASE] = "adr_tag_release",
+	[AFU_CMD_MEM_PA_FLUSH] = "mem_pa_flush",
+	[AFU_CMD_CASTOUT] = "castout",
+	[AFU_CMD_CASTOUT_PUSH] = "castout.push",
+	[AFU_CMD_INTRP_REQ] = "intrp_req",
+	[AFU_CMD_INTRP_REQ_S] = "intrp_req.s",
+	[AFU_CMD_INTRP_REQ_D] = "intrp_req.d",
+	[AFU_CMD_INTRP_REQ_D_S] = "intrp_req.d.s",
+	[AFU_CMD_WAKE_HOST_THRD] = "wake_host_thread",
+	[AFU_CMD_WAKE_HOST_THRD_S] = "wake_host_thread.s",
+	[AFU_CMD_UPGRADE_STATE] = "upgrade_state",
+};
+
+static uint64_t _now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Trace time stamps are us with ns precision
+static double _us(uint64_t ns)
+{
+	if (ns < _trace_base)
+		return 0.0;
+	return (ns - _trace_base) / 1000.0;
+}
+
+// Append one event to buffer, separated from the ones before it
+static void _append(char *buffer, const char *format, ...)
+    __attribute__ ((format(printf, 2, 3)));
+
+static void _append(char *buffer, const char *format, ...)
+{
+	va_list args;
+	size_t used;
+
+	used = strlen(buffer);
+	if (used >= TRACE_EVENT_CHARS - 2)
+		return;
+	if (used) {
+		strcpy(buffer + used, ",\n");
+		used += 2;
+	}
+	va_start(args, format);
+	vsnprintf(buffer + used, TRACE_EVENT_CHARS - used, format, args);
+	va_end(args);
+}
+
+// Write events in buffer, _trace_lock held
+static void _write(char *buffer)
+{
+	if (buffer[0] == '\0')
+		return;
+	fprintf(_trace_fp, "%s%s", _trace_events ? ",\n" : "", buffer);
+	_trace_events++;
+}
+
+// Find a lane of the track of context and kind that is free at begin, adds
+// a thread for a new lane to buffer.  _trace_lock held.
+static int _lane(uint8_t port, int32_t context, enum trace_kind kind,
+		 uint64_t begin, uint64_t end, char *buffer)
+{
+	struct trace_port *p = &(_trace_port[port]);
+	struct trace_track *track, *grown;
+	int i, lane, oldest;
+
+	track = NULL;
+	for (i = 0; i < p->tracks; i++) {
+		if ((p->track[i].context == context) &&
+		    (p->track[i].kind == kind)) {
+			track = &(p->track[i]);
+			break;
+		}
+	}
+	if (track == NULL) {
+		grown = (struct trace_track *)realloc(p->track,
+						      (p->tracks + 1) *
+						      sizeof(*grown));
+		if (grown == NULL)
+			return 0;
+		p->track = grown;
+		track = &(p->track[p->tracks++]);
+		memset(track, 0, sizeof(*track));
+		track->context = context;
+		track->kind = kind;
+	}
+
+	// first lane the slice fits on, the earliest one to end if none does
+	// and the track has all the lanes it can get
+	lane = -1;
+	oldest = 0;
+	for (i = 0; i < track->lanes; i++) {
+		if (track->end[i] <= begin) {
+			lane = i;
+			break;
+		}
+		if (track->end[i] < track->end[oldest])
+			oldest = i;
+	}
+	if ((lane < 0) && (track->lanes == TRACE_LANES))
+		lane = oldest;
+	if (lane < 0) {
+		lane = track->lanes++;
+		track->tid[lane] = ++(p->tids);
+		if (context < 0)
+			_append(buffer, "{\"ph\":\"M\",\"name\":\"thread_name\","
+				"\"pid\":%d,\"tid\":%d,\"args\":{\"name\":"
+				"\"config %d\"}}", port, track->tid[lane],
+				lane);
+		else
+			_append(buffer, "{\"ph\":\"M\",\"name\":\"thread_name\","
+				"\"pid\":%d,\"tid\":%d,\"args\":{\"name\":"
+				"\"context %d %s %d\"}}", port,
+				track->tid[lane], context,
+				kind == TRACE_CMD ? "cmd" : "mmio", lane);
+		_append(buffer, "{\"ph\":\"M\",\"name\":\"thread_sort_index\","
+			"\"pid\":%d,\"tid\":%d,\"args\":{\"sort_index\":%d}}",
+			port, track->tid[lane],
+			(context + 1) * 2 * TRACE_LANES + kind * TRACE_LANES +
+			lane);
+	}
+	if (end > track->end[lane])
+		track->end[lane] = end;
+	return track->tid[lane];
+}
+
+int trace_open(char *path)
+{
+	pthread_mutex_lock(&_trace_lock);
+	if ((_trace_fp = fopen(path, "w")) == NULL) {
+		pthread_mutex_unlock(&_trace_lock);
+		return -1;
+	}
+	_trace_base = _now_ns();
+	_trace_events = 0;
+	fprintf(_trace_fp, "[\n");
+	pthread_mutex_unlock(&_trace_lock);
+	return 0;
+}
+
+void trace_close(void)
+{
+	int i;
+
+	pthread_mutex_lock(&_trace_lock);
+	if (_trace_fp != NULL) {
+		fprintf(_trace_fp, "\n]\n");
+		fclose(_trace_fp);
+		_trace_fp = NULL;
+	}
+	for (i = 0; i < 256; i++) {
+		free(_trace_port[i].track);
+		memset(&(_trace_port[i]), 0, sizeof(struct trace_port));
+	}
+	pthread_mutex_unlock(&_trace_lock);
+}
+
+void trace_port(uint8_t port, char *name)
+{
+	char buffer[TRACE_EVENT_CHARS];
+
+	if (_trace_fp == NULL)
+		return;
+	buffer[0] = '\0';
+	_append(buffer, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,"
+		"\"args\":{\"name\":\"%s\"}}", port, name);
+	_append(buffer, "{\"ph\":\"M\",\"name\":\"process_sort_index\","
+		"\"pid\":%d,\"args\":{\"sort_index\":%d}}", port, port);
+	pthread_mutex_lock(&_trace_lock);
+	if (_trace_fp != NULL)
+		_write(buffer);
+	pthread_mutex_unlock(&_trace_lock);
+}
+
+void trace_cmd(uint8_t port, struct latency_stamp *stamp, uint64_t cycle,
+	       uint8_t opcode, int32_t context, uint16_t afutag, uint8_t resp)
+{
+	char buffer[TRACE_EVENT_CHARS];
+	char unnamed[16];
+	const char *name;
+	uint64_t ns;
+	int tid;
+
+	if ((_trace_fp == NULL) || !stamp->valid[LAT_ADD])
+		return;
+	ns = _now_ns();
+	name = _cmd_name[opcode];
+	if (name == NULL) {
+		snprintf(unnamed, sizeof(unnamed), "cmd 0x%02x", opcode);
+		name = unnamed;
+	}
+
+	buffer[0] = '\0';
+	pthread_mutex_lock(&_trace_lock);
+	if (_trace_fp == NULL) {
+		pthread_mutex_unlock(&_trace_lock);
+		return;
+	}
+	tid = _lane(port, context, TRACE_CMD, stamp->ns[LAT_ADD], ns, buffer);
+	_append(buffer, "{\"ph\":\"X\",\"cat\":\"cmd\",\"name\":\"%s\","
+		"\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":"
+		"{\"afutag\":%d,\"context\":%d,\"resp\":%d,\"cycle\":%" PRIu64
+		",\"cycles\":%" PRIu64 "}}", name, port, tid,
+		_us(stamp->ns[LAT_ADD]), (ns - stamp->ns[LAT_ADD]) / 1000.0,
+		afutag, context, resp, stamp->cycle[LAT_ADD],
+		cycle - stamp->cycle[LAT_ADD]);
+	if (stamp->valid[LAT_CLIENT] && stamp->valid[LAT_RETURN])
+		_append(buffer, "{\"ph\":\"X\",\"cat\":\"client\",\"name\":"
+			"\"client\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":"
+			"%.3f,\"args\":{\"cycle\":%" PRIu64 ",\"cycles\":%"
+			PRIu64 "}}", port, tid, _us(stamp->ns[LAT_CLIENT]),
+			(stamp->ns[LAT_RETURN] - stamp->ns[LAT_CLIENT]) / 1000.0,
+			stamp->cycle[LAT_CLIENT],
+			stamp->cycle[LAT_RETURN] - stamp->cycle[LAT_CLIENT]);
+	_write(buffer);
+	pthread_mutex_unlock(&_trace_lock);
+}
+
+void trace_mmio(uint8_t port, struct latency_stamp *stamp, uint64_t cycle,
+		int32_t context, const char *name, uint64_t addr)
+{
+	char buffer[TRACE_EVENT_CHARS];
+	uint64_t ns;
+	int tid;
+
+	if ((_trace_fp == NULL) || !stamp->valid[LAT_ADD])
+		return;
+	ns = _now_ns();
+
+	buffer[0] = '\0';
+	pthread_mutex_lock(&_trace_lock);
+	if (_trace_fp == NULL) {
+		pthread_mutex_unlock(&_trace_lock);
+		return;
+	}
+	tid = _lane(port, context, TRACE_MMIO, stamp->ns[LAT_ADD], ns, buffer);
+	_append(buffer, "{\"ph\":\"X\",\"cat\":\"%s\",\"name\":\"%s\","
+		"\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":"
+		"{\"addr\":\"0x%" PRIx64 "\",\"context\":%d,"
+		"\"cycle\":%" PRIu64 ",\"cycles\":%" PRIu64 "}}",
+		context < 0 ? "config" : "mmio", name, port, tid,
+		_us(stamp->ns[LAT_ADD]), (ns - stamp->ns[LAT_ADD]) / 1000.0,
+		addr, context, stamp->cycle[LAT_ADD],
+		cycle - stamp->cycle[LAT_ADD]);
+	if (stamp->valid[LAT_CLIENT])
+		_append(buffer, "{\"ph\":\"X\",\"cat\":\"afu\",\"name\":\"afu\","
+			"\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":"
+			"{\"cycle\":%" PRIu64 ",\"cycles\":%" PRIu64 "}}", port,
+			tid, _us(stamp->ns[LAT_CLIENT]),
+			(ns - stamp->ns[LAT_CLIENT]) / 1000.0,
+			stamp->cycle[LAT_CLIENT],
+			cycle - stamp->cycle[LAT_CLIENT]);
+	_write(buffer);
+	pthread_mutex_unlock(&_trace_lock);
+}
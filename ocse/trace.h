@@ -0,0 +1,44 @@
+/*
+ * Copyright 2014,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+
+#include "latency.h"
+
+// Start writing the trace to path, returns -1 if it can't be opened
+int trace_open(char *path);
+
+// Finish the JSON and close the trace, nothing if not open
+void trace_close(void);
+
+// Name the process of port in the trace
+void trace_port(uint8_t port, char *name);
+
+// AFU command done: a slice from LAT_ADD to now and, if the command went to
+// the client, one for the client round trip inside it
+void trace_cmd(uint8_t port, struct latency_stamp *stamp, uint64_t cycle,
+	       uint8_t opcode, int32_t context, uint16_t afutag, uint8_t resp);
+
+// MMIO, lpc memory or config access answered by the AFU: a slice from
+// LAT_ADD to now and one for the AFU round trip from LAT_CLIENT, the send
+// to the AFU.  context is -1 for config accesses.
+void trace_mmio(uint8_t port, struct latency_stamp *stamp, uint64_t cycle,
+		int32_t context, const char *name, uint64_t addr);
+
+#endif				/* _TRACE_H_ */
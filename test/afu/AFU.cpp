@@ -31,40 +31,55 @@ using std::vector;
 #define CONTEXT_SIZE 0x400
 #define CONTEXT_MASK (CONTEXT_SIZE - 1)
 
-uint8_t memory[256];
-uint8_t next_cmd = 0;
-uint8_t retry_cmd = 0;
-uint8_t interrupt_pending = 0;
-uint8_t read_resp_completed = 0;
-uint8_t write_resp_completed = 0;
-uint8_t cmd_ready = 1;
-uint8_t status_data[256];
-uint8_t status_resp_valid = 0;
-uint8_t status_updated = 0;
-uint8_t insert_cycle = 0;
-uint8_t afu_enable_reset = 0;
-uint32_t wr_config_data;
-uint32_t bar_h0, bar_l0, bar_h1, bar_l1, bar_h2, bar_l2;
-uint64_t bar = 0x00000000ll;
-uint8_t enable_bar = 0;
-uint8_t read_status_resp = 0;
-uint8_t write_status_resp = 0;
-uint32_t write_status_tag;
-uint32_t afu_function = 0;
-uint16_t gBDF = 0; 
-uint16_t gACTAG = 0;
-uint16_t gDUT = 0;
-uint16_t other_resp_completed = 0;
+// afutag width, AFU_TAG_BITS if set
+static uint32_t
+afu_tag_bits ()
+{
+    char *bits = getenv ("AFU_TAG_BITS");
+
+    if (bits == NULL)
+        return TAG_BITS_DEFAULT;
+    return strtoul (bits, NULL, 0);
+}
 
 AFU::AFU (int port, string filename, bool parity, bool jerror):
     descriptor (filename),
-    context_to_mc ()
+    tag_manager (afu_tag_bits ()),
+    traffic (&tag_manager),
+    context_to_mc (),
+    active_contexts (),
+    tag_to_mc (tag_manager.get_tag_num (), NULL)
 {
-
     // initializes AFU socket connection as server
     if (tlx_serv_afu_event (&afu_event, port) == TLX_BAD_SOCKET)
         error_msg ("AFU: unable to create socket");
 
+    init (jerror);
+}
+
+AFU::AFU (string filename, bool parity, bool jerror):
+    descriptor (filename),
+    tag_manager (afu_tag_bits ()),
+    traffic (&tag_manager),
+    context_to_mc (),
+    active_contexts (),
+    tag_to_mc (tag_manager.get_tag_num (), NULL)
+{
+    // no socket, ocse moves the events with tlx_handoff_events
+    tlx_event_reset (&afu_event);
+    afu_event.sockfd = -1;
+
+    init (jerror);
+}
+
+void
+AFU::init (bool jerror)
+{
+    highest_priority_mc = 0;
+    machine_controller = NULL;
+    cycle = 0;
+    initial_credit_flag = 0;
+
     if (jerror)
 	set_jerror_not_run = true;
     else
@@ -75,6 +90,32 @@ AFU::AFU (int port, string filename, bool parity, bool jerror):
     config_state = IDLE;
     mem_state = IDLE;
     resp_state = IDLE;
+    mem_resp.clear();
+    mem_resp_beat = 0;
+    memset(memory, 0, sizeof(memory));
+    memset(status_data, 0, sizeof(status_data));
+    next_cmd = 0;
+    retry_cmd = 0;
+    interrupt_pending = 0;
+    read_resp_completed = 0;
+    write_resp_completed = 0;
+    other_resp_completed = 0;
+    cmd_ready = 1;
+    status_resp_valid = 0;
+    status_updated = 0;
+    insert_cycle = 0;
+    afu_enable_reset = 0;
+    wr_config_data = 0;
+    bar_h0 = bar_l0 = bar_h1 = bar_l1 = bar_h2 = bar_l2 = 0;
+    bar = 0;
+    enable_bar = 0;
+    read_status_resp = 0;
+    write_status_resp = 0;
+    write_status_tag = 0;
+    afu_function = 0;
+    gBDF = 0;
+    gACTAG = 0;
+    gDUT = 0;
     debug_msg("AFU: Set AFU and CONFIG state = IDLE");
     afu_event.afu_tlx_resp_initial_credit = MAX_AFU_TLX_RESP_CREDITS; 
     afu_event.afu_tlx_cmd_initial_credit = MAX_AFU_TLX_CMD_CREDITS;
@@ -82,6 +123,13 @@ AFU::AFU (int port, string filename, bool parity, bool jerror):
 		10, MAX_AFU_TLX_RESP_CREDITS);
     debug_msg("AFU: Send initial afu cmd and resp credits to ocse");
     reset ();
+    load_traffic_config ();
+}
+
+AFU_EVENT *
+AFU::get_afu_event ()
+{
+    return &afu_event;
 }
 
 bool 
@@ -109,10 +157,6 @@ AFU::afu_is_reset()
 void
 AFU::start ()
 {
-    uint32_t cycle = 0;
-    uint8_t  initial_credit_flag = 0;
-    uint16_t index=0;
-
     while (1) {
         fd_set watchset;
 
@@ -124,23 +168,31 @@ AFU::start ()
 	printf("getting tlx events\n");
         int rc = tlx_get_tlx_events (&afu_event);
 
-        //info_msg("Cycle: %d", cycle);
-        ++cycle;
-
 	// connection dropped
         if (rc < 0) {
             info_msg ("AFU: connection lost");
             break;
         }
 
+        run_cycle (rc);
+    }
+}
+
+void
+AFU::run_cycle (int rc)
+{
+        //info_msg("Cycle: %d", cycle);
+        ++cycle;
+
 	// get TLX initial cmd and data credits run once
 	if(initial_credit_flag == 0) {
 	    debug_msg("AFU: afu read initial credit");
-	    if(tlx_afu_read_initial_credits(&afu_event, &tlx_afu_cmd_max_credit,
-		&tlx_afu_data_max_credit) != TLX_SUCCESS) {
+	    uint8_t tlx_afu_resp_max_credit_tmp, tlx_afu_resp_data_max_credit_tmp;
+	    if(tlx_afu_read_initial_credits(&afu_event, &tlx_afu_cmd_max_credit, &tlx_afu_resp_max_credit_tmp,
+		&tlx_afu_data_max_credit, &tlx_afu_resp_data_max_credit_tmp) != TLX_SUCCESS) {
 		error_msg("AFU: Failed tlx_afu_read_initial_credits");
 	    }
-	    TagManager::reset_tlx_credit(tlx_afu_cmd_max_credit, tlx_afu_data_max_credit);
+	    tag_manager.reset_tlx_credit(tlx_afu_cmd_max_credit, tlx_afu_data_max_credit);
 	    info_msg("AFU: Receive TLX cmd and data initial credits");
     	    debug_msg("AFU:  tlx_afu_cmd_max_credit = %d", tlx_afu_cmd_max_credit);
     	    debug_msg("AFU:  tlx_afu_data_max_credit = %d", tlx_afu_data_max_credit);
@@ -149,23 +201,23 @@ AFU::start ()
 
 	// no new events to be processed
         if (rc <= 0)		
-            continue;
+            return;
 	
 	// Return TLX credit
 	if(afu_event.tlx_afu_resp_credit) {
-	    TagManager::release_tlx_credit(RESP_CREDIT);
+	    tag_manager.release_tlx_credit(RESP_CREDIT);
 	    //afu_event.tlx_afu_resp_credit = 0;
 	}
 	if(afu_event.tlx_afu_resp_data_credit) {
-	    TagManager::release_tlx_credit(RESP_DATA_CREDIT);
+	    tag_manager.release_tlx_credit(RESP_DATA_CREDIT);
 	    //afu_event.tlx_afu_resp_data_credit = 0;
 	}
 	if(afu_event.tlx_afu_cmd_credit) {
-	    TagManager::release_tlx_credit(CMD_CREDIT);
+	    tag_manager.release_tlx_credit(CMD_CREDIT);
 	    //afu_event.tlx_afu_cmd_credit = 0;
 	}
 	if(afu_event.tlx_afu_cmd_data_credit) {
-	    TagManager::release_tlx_credit(CMD_DATA_CREDIT);
+	    tag_manager.release_tlx_credit(CMD_DATA_CREDIT);
 	    //afu_event.tlx_afu_cmd_data_credit = 0;
 	}
 	// process config commands
@@ -186,6 +238,7 @@ AFU::start ()
 	    debug_msg("AFU: Received TLX response 0x%x", afu_event.tlx_afu_resp_opcode);
 	    resolve_tlx_afu_resp();
 	    afu_event.afu_tlx_resp_credit = 1;	// return TLX resp credit
+	    afu_event.afu_tlx_credit_req_valid = 1;
 	    afu_event.tlx_afu_resp_valid = 0;
 	}
 	// process tlx config response
@@ -219,6 +272,7 @@ AFU::start ()
 	    info_msg("AFU: calling tlx_pr_wr_mem");
 	    tlx_pr_wr_mem();
  	}
+	send_mem_resp();
 
 	//printf("checking afu reset bit\n");
 	//  reset AFU
@@ -242,7 +296,8 @@ AFU::start ()
 	}
 	// get machine context and create new MachineController
 	else if(state == READY) {
-	    if(get_machine_context()) {
+	    bool traffic_start = get_traffic_config();
+	    if(traffic_start || get_machine_context()) {
 		if(gDUT==1) {
 		    printf("gDUT = %d\n", gDUT);
 		    gBDF = 1;
@@ -250,7 +305,10 @@ AFU::start ()
 		}
 		else if(gDUT == 2) {
 		    printf("gDUT = %d\n", gDUT);
-		    gBDF++;
+		    // the function is picked on the first run, later runs
+		    // assign their acTag to the same BDF
+		    if(gBDF == 0)
+		    	gBDF++;
 		    gACTAG++;
 	  	}
 		printf("AFU: gBDF = %d gACTAG = %d\n", gBDF, gACTAG);
@@ -258,12 +316,25 @@ AFU::start ()
 		afu_event.afu_tlx_cmd_actag = gACTAG;
 		printf("AFU: request afu assign actag\n");
 		request_assign_actag();
-	    	printf("AFU: set state = RUNNING\n");
-	    	state = RUNNING;
-		//debug1
-		read_resp_completed = 0;
-		write_resp_completed = 0;
-		other_resp_completed = 0;
+		if(traffic_start) {
+		    printf("AFU: set state = TRAFFIC\n");
+		    traffic.start(cycle);
+		    state = TRAFFIC;
+		}
+		else {
+	    	    printf("AFU: set state = RUNNING\n");
+	    	    state = RUNNING;
+		    //debug1
+		    read_resp_completed = 0;
+		    write_resp_completed = 0;
+		    other_resp_completed = 0;
+		    // a run after one the application stopped with 0x55
+		    // starts from the first command again
+		    next_cmd = 0;
+		    cmd_ready = 1;
+		    read_status_resp = 0;
+		    write_status_resp = 0;
+		}
 	    }
 	}
   	
@@ -317,29 +388,49 @@ AFU::start ()
 	    }
             else if(cmd_ready) {
 		cmd_ready = 0;
-		if(context_to_mc.size () != 0) {
-			printf("AFU: context to mc size = %d\n", context_to_mc.size());
-                	std::map < uint16_t, MachineController * >::iterator prev = highest_priority_mc;
-                    do {
-                    if(highest_priority_mc == context_to_mc.end ())
-                        highest_priority_mc = context_to_mc.begin ();
+		if(active_contexts.size () != 0) {
+			debug_msg("AFU: context to mc size = %zu", active_contexts.size());
+		    // start after the context that sent last, contexts without an
+		    // enabled machine are skipped
+		    for (uint32_t n = 0; n < active_contexts.size (); ++n) {
+			if(highest_priority_mc >= active_contexts.size ())
+			    highest_priority_mc = 0;
+			uint16_t context = active_contexts[highest_priority_mc++];
+			MachineController *mc = context_to_mc[context];
+
+			if(!mc->is_enabled ())
+			    continue;
 		// calling MachineController send command
-			printf("AFU: context = %d mc = 0x%x\n", highest_priority_mc->first, highest_priority_mc->second);
-	
-                    	if(highest_priority_mc->second->send_command(&afu_event, cycle)) {
-                        	++highest_priority_mc;
-                        	break;
-                    	    }
-                        ++highest_priority_mc;
-                	} while (++highest_priority_mc != prev);
+			debug_msg("AFU: context = %d mc = %p", context, mc);
+			// a store writes back the data of the last read
+			memcpy(afu_event.afu_tlx_cdata_bus, memory, 64);
+                    	if(mc->send_command(&afu_event, cycle)) {
+			    machine_controller = mc;
+			    tag_to_mc[afu_event.afu_tlx_cmd_afutag] = mc;
+                            break;
+                        }
+		    }
 		}
             }
 	    else if(retry_cmd) {
-		printf("AFU: attempt retry command\n");
-		highest_priority_mc->second->resend_command(&afu_event, cycle);
+		debug_msg("AFU: attempt retry command");
+		if(machine_controller) {
+		    memcpy(afu_event.afu_tlx_cdata_bus, memory, 64);
+		    machine_controller->resend_command(&afu_event, cycle);
+		}
 		retry_cmd = 0;
 	    }
         }
+	// keep the traffic generator's commands in flight until it is done
+	else if (state == TRAFFIC) {
+	    if(traffic.is_done()) {
+		set_traffic_stats();
+		printf("AFU: set state = READY\n");
+		state = READY;
+	    }
+	    else
+		traffic.send_command(&afu_event, cycle);
+	}
         else if (state == RESET) {
 	    debug_msg("AFU: resetting");
 	    debug_msg("AFU: set AFU state = READY");
@@ -355,10 +446,9 @@ AFU::start ()
 	    response = 0x00000000;
 	    offset  = 0x1008 + 0x1000 * afu_event.afu_tlx_cmd_pasid;
 	    descriptor.set_mmio_mem(offset, (char*)&response, 4);
-            for (std::map < uint16_t, MachineController * >::iterator it =
-                        context_to_mc.begin (); it != context_to_mc.end (); ++it)
+            for (uint32_t i = 0; i < active_contexts.size (); ++i)
             {
-                if (!(it->second)->all_machines_completed ())
+                if (!context_to_mc[active_contexts[i]]->all_machines_completed ())
                     all_machines_completed = false;
             }
 
@@ -371,19 +461,15 @@ AFU::start ()
 		debug_msg("AFU: state = HALT");
             }
         }
-    }
 }
 
 AFU::~AFU ()
 {
     // close socket connection
-    tlx_close_afu_event (&afu_event);
+    if (afu_event.sockfd >= 0)
+        tlx_close_afu_event (&afu_event);
 
-    for (std::map < uint16_t, MachineController * >::iterator it =
-                context_to_mc.begin (); it != context_to_mc.end (); ++it)
-        delete it->second;
-  
-    context_to_mc.clear ();
+    clear_machine_controllers ();
 }
 
 
@@ -401,14 +487,45 @@ AFU::reset ()
 void
 AFU::reset_machine_controllers ()
 {
-    TagManager::reset ();
+    tag_manager.reset ();
 
-    for (std::map < uint16_t, MachineController * >::iterator it =
-                context_to_mc.begin (); it != context_to_mc.end (); ++it)
-        delete it->second;
+    clear_machine_controllers ();
+}
 
-    context_to_mc.clear ();
+void
+AFU::clear_machine_controllers ()
+{
+    for (uint32_t i = 0; i < active_contexts.size (); ++i) {
+        delete context_to_mc[active_contexts[i]];
+        context_to_mc[active_contexts[i]] = NULL;
+    }
 
+    active_contexts.clear ();
+    tag_to_mc.assign (tag_to_mc.size (), NULL);
+    highest_priority_mc = 0;
+    machine_controller = NULL;
+}
+
+// replaces the machine controller of context with a fresh one
+MachineController *
+AFU::add_machine_controller (uint16_t context)
+{
+    if (context >= context_to_mc.size ())
+        context_to_mc.resize (context + 1, NULL);
+
+    if (context_to_mc[context]) {
+        if (machine_controller == context_to_mc[context])
+            machine_controller = NULL;
+        for (uint32_t i = 0; i < tag_to_mc.size (); ++i)
+            if (tag_to_mc[i] == context_to_mc[context])
+                tag_to_mc[i] = NULL;
+        delete context_to_mc[context];
+    }
+    else
+        active_contexts.push_back (context);
+
+    context_to_mc[context] = new MachineController (context, &tag_manager);
+    return context_to_mc[context];
 }
 
 // get machine context from mmio and create new MachineController
@@ -423,28 +540,23 @@ AFU::get_machine_context()
 
     debug_msg("AFU: get machine context");
     machine_number = 0;
-    for(context=0; context<4; context++) {
-	descriptor.get_mmio_mem(0x1000*context+machine_number, (char*)&data, size);
+    for(context=0; context<TESTAFU_CONTEXTS; context++) {
+	mmio_base = TESTAFU_CONTEXT_MMIO*context + machine_number*MACHINE_SLOT_SIZE;
+	descriptor.get_mmio_mem(mmio_base, (char*)&data, size);
 	if(data) {
-	    mmio_base = 0x1000*context + machine_number;
 	    afu_event.afu_tlx_cmd_pasid = context;
 	    context = (uint16_t)((data & 0x0000FFFF00000000LL) >> 32);
 	    debug_msg("AFU: context = %d", context);
-	    if(context == 0) {
-		afu_event.afu_tlx_cmd_pasid = context;
-		//afu_event.afu_tlx_cmd_bdf = 0x0001;
-		context_to_mc[context] = new MachineController(context);
-	    }
-	    else if(context == 1) {
+	    if(context == 1) {
 		printf("AFU: clear context to mc\n");
-		context_to_mc.clear();
+		clear_machine_controllers();
 		printf("AFU: context = %d\n", context);
-		afu_event.afu_tlx_cmd_pasid = context;
-	    	context_to_mc[context] = new MachineController(context);
 	    }
-	    highest_priority_mc = context_to_mc.end();
-	    mc = context_to_mc[context];
-	    printf("AFU: context_to_mc = %p size = %d\n", mc, context_to_mc.size());
+	    afu_event.afu_tlx_cmd_pasid = context;
+	    //afu_event.afu_tlx_cmd_bdf = 0x0001;
+	    mc = add_machine_controller(context);
+	    highest_priority_mc = 0;
+	    debug_msg("AFU: context_to_mc = %p size = %zu", mc, active_contexts.size());
 	    for(i=0; i< 4; i++) {
 		descriptor.get_mmio_mem(mmio_base+i*8, (char*)&data, size);
 		if(i==1) {
@@ -459,13 +571,77 @@ AFU::get_machine_context()
     return false;		
 }
 
+// preload the traffic generator config of every context from AFU_TRAFFIC_CFG
+void
+AFU::load_traffic_config()
+{
+    uint64_t config[TRAFFIC_CONFIG_WORDS];
+    uint16_t context, i;
+    char *filename;
+
+    filename = getenv("AFU_TRAFFIC_CFG");
+    if(filename == NULL || !TrafficGenerator::parse_config_file(filename, config))
+	return;
+    info_msg("AFU: traffic config %s", filename);
+    for(context=0; context<TESTAFU_CONTEXTS; context++) {
+	for(i=1; i<TRAFFIC_CONFIG_WORDS; i++)
+	    descriptor.set_mmio_mem(TESTAFU_CONTEXT_MMIO*context+TRAFFIC_OFFSET+i*8, (char*)&config[i], 8);
+    }
+}
+
+// look for a context whose application set the traffic start bit and load
+// its traffic generator config
+bool
+AFU::get_traffic_config()
+{
+    uint64_t  data;
+    uint32_t  mmio_base;
+    uint16_t  context, i;
+
+    for(context=0; context<TESTAFU_CONTEXTS; context++) {
+	mmio_base = TESTAFU_CONTEXT_MMIO*context + TRAFFIC_OFFSET;
+	descriptor.get_mmio_mem(mmio_base, (char*)&data, 8);
+	if(data & TRAFFIC_START) {
+	    debug_msg("AFU: traffic start context = %d", context);
+	    traffic_context = context;
+	    afu_event.afu_tlx_cmd_pasid = context;
+	    for(i=1; i<TRAFFIC_CONFIG_WORDS; i++) {
+		descriptor.get_mmio_mem(mmio_base+i*8, (char*)&data, 8);
+		traffic.change_traffic_config(i, data);
+	    }
+	    data = TRAFFIC_BUSY;
+	    descriptor.set_mmio_mem(mmio_base, (char*)&data, 8);
+	    return true;
+	}
+    }
+    return false;
+}
+
+// publish the traffic generator counters and mark the run done
+void
+AFU::set_traffic_stats()
+{
+    uint64_t  stats[TRAFFIC_STATS_WORDS];
+    uint64_t  data;
+    uint32_t  mmio_base;
+
+    traffic.get_stats(stats);
+    info_msg("AFU: traffic completed %lld bytes %lld failed %lld cycles %lld latency min %lld max %lld total %lld",
+	(long long)stats[0], (long long)stats[1], (long long)stats[2], (long long)stats[3],
+	(long long)stats[4], (long long)stats[5], (long long)stats[6]);
+    mmio_base = TESTAFU_CONTEXT_MMIO*traffic_context + TRAFFIC_OFFSET;
+    descriptor.set_mmio_mem(mmio_base+TRAFFIC_STATS_WORD*8, (char*)stats, sizeof(stats));
+    data = TRAFFIC_DONE;
+    descriptor.set_mmio_mem(mmio_base, (char*)&data, 8);
+}
+
 void
 AFU::request_assign_actag()
 {
     uint8_t ea[12];
     uint32_t afutag;
 
-    TagManager::request_tag(&afutag);
+    tag_manager.request_tag(&afutag);
     printf("afu_tlx_cmd_bdf = %d\n", afu_event.afu_tlx_cmd_bdf);
     afu_event.afu_tlx_cmd_afutag = afutag;
     printf("AFU: afu_tag = 0x%x\n", afutag);
@@ -485,6 +661,8 @@ AFU::request_assign_actag()
 	    printf("PASS: request_assign_actag\n");
 	    //afu_event.afu_tlx_cmd_valid = 0;
 	}
+    // assign_actag is not answered, its tag is free right away
+    tag_manager.release_tag(afutag);
 }
 
 // process commands from ocse to AFU
@@ -631,6 +809,17 @@ AFU::resolve_tlx_afu_resp()
 		&resp_dp, &resp_addr_tag);
  
 //	read_resp_completed = 1;	//debug1
+	// the traffic generator only counts its responses, any read data is
+	// dropped when the resp data credit is returned
+	if(traffic.has_tag(resp_afutag)) {
+	    traffic.process_response(tlx_resp_opcode, resp_afutag, resp_code);
+	    return;
+	}
+	resolve_response_event(cycle);
+	// machine and status commands are done with their tag once answered,
+	// unless they are to be retried with it
+	if((resp_code != 0x2) && tag_manager.is_in_use(resp_afutag))
+	    tag_manager.release_tag(resp_afutag);
     }
 
     switch (tlx_resp_opcode) {
@@ -923,6 +1112,8 @@ AFU::tlx_afu_config_write()
 		    case 0x14:
 			bar_h0 = wr_config_data;
 		  	printf("AFU: bar_h0 = 0x%x\n", bar_h0);
+			// mmio sits at the top of BAR0, lpc offsets stay below it
+			bar = (uint64_t)bar_h0 << 32;
 			break;
 		    case 0x18:
 			enable_bar = 1;
@@ -961,20 +1152,17 @@ AFU::tlx_afu_config_write()
 void
 AFU::tlx_pr_rd_mem()
 {
-    uint8_t afu_tlx_resp_opcode;
-    uint8_t afu_tlx_resp_dl;
-    uint8_t afu_tlx_resp_code;
-    uint8_t afu_tlx_rdata_valid;
+    MemResp resp;
     uint16_t data_size;
-    uint16_t afu_tlx_resp_capptag;
     uint32_t mem_offset;
     uint64_t mem_data;
 
-    afu_tlx_resp_opcode = 0x01;		// mem rd response
-    afu_tlx_resp_dl = 0x01;		// length 64 byte
-    afu_tlx_resp_code = 0x0;
-    afu_tlx_rdata_valid = 0x0;
-    afu_tlx_resp_capptag = afu_event.tlx_afu_cmd_capptag;
+    resp.opcode = 0x01;		// mem rd response
+    resp.dl = 0x01;		// length 64 byte
+    resp.code = 0x0;
+    resp.capptag = afu_event.tlx_afu_cmd_capptag;
+    resp.beats = 1;
+    memset(resp.data, 0, sizeof(resp.data));
 
     debug_msg("AFU: tlx_pr_rd_mem");
     // calculate data size
@@ -987,13 +1175,13 @@ AFU::tlx_pr_rd_mem()
 		data_size = 128;
 	    else if(afu_event.tlx_afu_cmd_dl == 3)
 		data_size = 256;
+	    // the whole length goes back in one response, dp 0
+	    resp.dl = afu_event.tlx_afu_cmd_dl;
+	    resp.beats = data_size / 64;
 	    break;
 	case TLX_CMD_PR_RD_MEM:	// 0x28
 	    printf("AFU: TLX_CMD_PR_RD_MEM 0x28\n");
-    	    if(afu_event.tlx_afu_cmd_pl == 3)
-		data_size = 8;
-    	    else if(afu_event.tlx_afu_cmd_pl == 2)
-		data_size = 4;
+	    data_size = 1 << afu_event.tlx_afu_cmd_pl;	// 1 to 32 bytes
 	    break;
 	default:
 	    break;
@@ -1004,37 +1192,14 @@ AFU::tlx_pr_rd_mem()
 	mem_offset = afu_event.tlx_afu_cmd_pa;
     	descriptor.get_mmio_mem(mem_offset, (char*)&mem_data, data_size);
     	debug_msg("mem_offset = 0x%x mem_data = 0x%016llx", mem_offset, mem_data);
-    	memcpy(&afu_event.afu_tlx_rdata_bus, &mem_data, data_size);
-    	byte_shift(afu_event.afu_tlx_rdata_bus, data_size, mem_offset, RIGHT);
-
-      	if(TagManager::request_tlx_credit(RESP_CREDIT)) {
-            if(afu_tlx_send_resp_and_data(&afu_event, afu_tlx_resp_opcode, afu_tlx_resp_dl, 
-		afu_tlx_resp_capptag, afu_event.afu_tlx_resp_dp, 
-		afu_tlx_resp_code, afu_tlx_rdata_valid, 
-		afu_event.afu_tlx_rdata_bus, afu_event.afu_tlx_rdata_bdi) != TLX_SUCCESS) {
-
-		error_msg("AFU: Failed afu_tlx_send_resp_and_data");
-    	    }
-    	}
-    	else {
-	    error_msg("AFU: No response credit available");
-    	}
+    	memcpy(resp.data, &mem_data, data_size);
+    	byte_shift(resp.data, data_size, mem_offset & 0x3F, RIGHT);
     }
     else {	// lpc memory space
-	printf("AFU: lpc addr = 0x%lx \n",afu_event.tlx_afu_cmd_pa );
-	lpc.read_lpc_mem(afu_event.tlx_afu_cmd_pa, data_size, afu_event.afu_tlx_rdata_bus);
-	if(TagManager::request_tlx_credit(RESP_CREDIT)) {
-	    if(afu_tlx_send_resp_and_data(&afu_event, afu_tlx_resp_opcode, afu_tlx_resp_dl,
-		afu_tlx_resp_capptag, afu_event.afu_tlx_resp_dp,
-		afu_tlx_resp_code, afu_tlx_rdata_valid,
-		afu_event.afu_tlx_rdata_bus, afu_event.afu_tlx_rdata_bdi) != TLX_SUCCESS) {
-		error_msg("AFU: Failed afu_tlx_send_resp_and_data");
-	    }
-	}
-	else {
-	    error_msg("AFU: No response credit available");
-	}
+	debug_msg("AFU: lpc addr = 0x%lx", afu_event.tlx_afu_cmd_pa);
+	lpc.read_lpc_mem(afu_event.tlx_afu_cmd_pa, data_size, resp.data);
     }
+    mem_resp.push_back(resp);
 }
 
 void
@@ -1045,18 +1210,18 @@ AFU::tlx_pr_wr_mem()
     uint8_t  cmd_data_bdi;
     uint32_t cmd_pa;
     uint64_t mem_data;
-    uint8_t  afu_resp_opcode;
-    uint8_t  resp_dl = 0;
-    uint16_t resp_capptag;
-    uint8_t  resp_dp = 0;
-    uint8_t  resp_code = 0;
+    MemResp  resp;
     uint8_t  byte_offset;
     uint16_t  data_size;		
 
     debug_msg("AFU:tlx_pr_wr_mem");
 
     cmd_pa = afu_event.tlx_afu_cmd_pa & 0x0000FFFC;
-    resp_capptag = afu_event.tlx_afu_cmd_capptag;
+    resp.opcode = 0x04;		// mem write resp
+    resp.dl = 0;
+    resp.code = 0;
+    resp.capptag = afu_event.tlx_afu_cmd_capptag;
+    resp.beats = 0;
     byte_offset = 0x0000003F & afu_event.tlx_afu_cmd_pa;
 
     if(mem_state == IDLE) {
@@ -1084,18 +1249,17 @@ AFU::tlx_pr_wr_mem()
 		    data_size = 256;
 		break;
 	    case TLX_CMD_PR_WR_MEM:
-		if(afu_event.tlx_afu_cmd_pl == 3)
-	    	    data_size = 8;
-		else if(afu_event.tlx_afu_cmd_pl == 2)
-	    	    data_size = 4;
+		data_size = 1 << afu_event.tlx_afu_cmd_pl;	// 1 to 32 bytes
 		break;
 	    default:
 		break;
 	}
+#ifdef DEBUG
 	printf("wr cmd data bus = 0x");
 	for(int i=0; i<64; i++)
 	    printf("%02x", afu_event.tlx_afu_cmd_data_bus[i]);
 	printf("\n");
+#endif
 	//byte_shift(afu_event.tlx_afu_cmd_data_bus, data_size, byte_offset, LEFT);
 	//memcpy(&mem_data, afu_event.tlx_afu_cmd_data_bus, data_size);
 	//debug_msg("mem_data offset = 0x%x mem_data = 0x%016llx", cmd_pa, mem_data);
@@ -1105,35 +1269,54 @@ AFU::tlx_pr_wr_mem()
 	    // mmio write
 	    descriptor.set_mmio_mem(cmd_pa, (char*)&mem_data, data_size);
 	    //descriptor.set_port_reg(cmd_pa, mem_data);
-	    afu_resp_opcode = 0x04;		// mem write resp
-	    resp_code = 0x0;
-	    if(TagManager::request_tlx_credit(RESP_CREDIT)) {
-                if(afu_tlx_send_resp(&afu_event, afu_resp_opcode, resp_dl, resp_capptag,
-			resp_dp, resp_code) != TLX_SUCCESS) {
-	    	    printf("AFU: Failed afu_tlx_send_resp\n");
-	    	}
-	    }
-	    else {
-		    error_msg("AFU: no resp credit available");
-	    }
+	    mem_resp.push_back(resp);
 	    debug_msg("set mem_state = IDLE");
 	    mem_state = IDLE;
 	}
 	else { 	// lpc memory address space
-	    printf("AFU: lpc addr = 0x%lx\n", afu_event.tlx_afu_cmd_pa);
-	    printf("AFU: cmd data bus addr = 0x%lx\n", afu_event.tlx_afu_cmd_data_bus);
-	    lpc.write_lpc_mem(afu_event.tlx_afu_cmd_pa, data_size, afu_event.tlx_afu_cmd_data_bus);
-	    if(TagManager::request_tlx_credit(RESP_CREDIT)) {
-		if(afu_tlx_send_resp(&afu_event, afu_resp_opcode, resp_dl, resp_capptag,
-			resp_dp, resp_code) != TLX_SUCCESS) {
-		    printf("AFU: Failed afu_tlx_send_resp\n");
-		}
+	    debug_msg("AFU: lpc addr = 0x%lx", afu_event.tlx_afu_cmd_pa);
+	    if(!lpc.write_lpc_mem(afu_event.tlx_afu_cmd_pa, data_size, afu_event.tlx_afu_cmd_data_bus)) {
+		printf("AFU: lpc write at 0x%lx failed\n", afu_event.tlx_afu_cmd_pa);
+		resp.opcode = AFU_RSP_MEM_WR_FAIL;
+		resp.code = 0xe;	// failed
 	    }
+	    mem_resp.push_back(resp);
 	    debug_msg("set mem_state = IDLE");
 	    mem_state = IDLE;
 	}
     }
 }
+// send the oldest queued memory response, or its next data beat.  ocse
+// takes the beats of a multi beat response back to back, so the next
+// response waits until the last beat is out.  without a TLX credit the
+// response stays queued for a later cycle
+void
+AFU::send_mem_resp()
+{
+    int rc;
+
+    if(mem_resp.empty())
+	return;
+    MemResp &resp = mem_resp.front();
+    if(mem_resp_beat == 0 && resp.beats == 0)
+	rc = afu_tlx_send_resp(&afu_event, resp.opcode, resp.dl, resp.capptag,
+		0, resp.code);
+    else if(mem_resp_beat == 0)
+	rc = afu_tlx_send_resp_and_data(&afu_event, resp.opcode, resp.dl,
+		resp.capptag, 0, resp.code, 1, resp.data, 0);
+    else
+	rc = afu_tlx_send_resp_data(&afu_event, 1, 0, 0, resp.dl,
+		resp.data + 64 * mem_resp_beat);
+    if(rc != TLX_SUCCESS) {
+	debug_msg("AFU: memory response capptag 0x%x waits, rc = %d", resp.capptag, rc);
+	return;
+    }
+    if(++mem_resp_beat >= resp.beats) {
+	mem_resp.pop_front();
+	mem_resp_beat = 0;
+    }
+}
+
 uint32_t
 AFU::is_mmio_addr(uint64_t addr)
 {
@@ -1181,7 +1364,7 @@ AFU::write_app_status(uint8_t *address, uint32_t data)
     uint8_t ea_addr[9];
     uint32_t cmd_afutag;
 
-    TagManager::request_tag(&cmd_afutag);
+    tag_manager.request_tag(&cmd_afutag);
 
     memcpy((void*)&ea_addr, (void*)&address, sizeof(uint64_t));
     printf("AFU: status address = 0x%p and data = 0x%x\n", address, data);
@@ -1211,7 +1394,7 @@ AFU::read_app_status(uint8_t *address)
     uint8_t ea_addr[9];
     uint32_t cmd_afutag;
 
-    TagManager::request_tag(&cmd_afutag);
+    tag_manager.request_tag(&cmd_afutag);
 
     memcpy((void*)&ea_addr, (void*)&address, sizeof(uint64_t));
     printf("AFU: status address = 0x%p\n", address);
@@ -1237,9 +1420,8 @@ AFU::resolve_control_event ()
 {
 
         
-        for (std::map < uint16_t, MachineController * >::iterator it =
-                    context_to_mc.begin (); it != context_to_mc.end (); ++it)
-            it->second->disable_all_machines ();
+        for (uint32_t i = 0; i < active_contexts.size (); ++i)
+            context_to_mc[active_contexts[i]]->disable_all_machines ();
         state = RESET;
 	debug_msg("AFU: state = RESET");
         reset_delay = 1000;
@@ -1249,17 +1431,16 @@ AFU::resolve_control_event ()
 void
 AFU::resolve_response_event (uint32_t cycle)
 {
-    //if (!TagManager::is_in_use (afu_event.response_tag))
-    //    error_msg ("AFU: received tag not in use");
+    uint32_t  tag = afu_event.tlx_afu_resp_afutag;
 
+    // only the machine controller that sent the command sees the response
+    if (tag >= tag_to_mc.size () || tag_to_mc[tag] == NULL)
+        return;
 
-    for (std::map < uint16_t, MachineController * >::iterator it =
-                context_to_mc.begin (); it != context_to_mc.end (); ++it) {
-        //if (it->second->has_tag (afu_event.response_tag)) {
-            it->second->process_response (&afu_event, cycle);
-         //   break;
-        //}
-    }
+    tag_to_mc[tag]->process_response (&afu_event, cycle);
+    // a retried command keeps its tag
+    if (afu_event.tlx_afu_resp_code != 0x2)
+        tag_to_mc[tag] = NULL;
 }
 
 void
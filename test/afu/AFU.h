@@ -22,12 +22,14 @@
 #include "MachineController.h"
 #include "Commands.h"
 #include "Lpc.h"
+#include "TrafficGenerator.h"
 
 extern "C" {
 #include "tlx_interface.h"
 #include "utils.h"
 }
 
+#include <deque>
 #include <string>
 #include <vector>
 
@@ -40,17 +42,38 @@ class AFU
 {
 private:
     enum AFU_State
-    { IDLE, RESET, READY, RUNNING, WAITING_FOR_DATA, WAITING_FOR_LAST_RESPONSES, HALT };
+    { IDLE, RESET, READY, RUNNING, TRAFFIC, WAITING_FOR_DATA, WAITING_FOR_LAST_RESPONSES, HALT };
 
     AFU_EVENT afu_event;
     Descriptor descriptor;
+    TagManager tag_manager;
+    TrafficGenerator traffic;
+    uint16_t traffic_context;
     Lpc	lpc;
-    std::map < uint16_t, MachineController * >context_to_mc;
-    std::map < uint16_t,
-        MachineController * >::iterator highest_priority_mc;
-
+    // indexed by context, NULL where no machine controller was created
+    std::vector < MachineController * >context_to_mc;
+    // contexts that have a machine controller, in round robin order
+    std::vector < uint16_t > active_contexts;
+    uint32_t highest_priority_mc;	// index into active_contexts
+    // indexed by afutag, the machine controller a response goes to
+    std::vector < MachineController * >tag_to_mc;
+
+    // the machine controller that sent the last command, for retries
     MachineController *machine_controller;
 
+    // a memory read or write response waiting for the TLX response
+    // interface, its data goes out one 64 byte beat per cycle
+    struct MemResp {
+	uint8_t  opcode;
+	uint8_t  dl;
+	uint8_t  code;
+	uint16_t capptag;
+	uint8_t  beats;		// 0 for a write response
+	uint8_t  data[256];
+    };
+    std::deque < MemResp > mem_resp;
+    uint8_t mem_resp_beat;	// beats of the oldest response already sent
+
     AFU_State state;
     AFU_State config_state;
     AFU_State mem_state, resp_state;
@@ -61,7 +84,35 @@ private:
     uint8_t  tlx_afu_data_max_credit;
 
     int reset_delay;
-
+    uint32_t cycle;
+    uint8_t initial_credit_flag;
+
+    uint8_t  memory[256];	// data of the last read, stores write it back
+    uint8_t  next_cmd;
+    uint8_t  retry_cmd;
+    uint8_t  interrupt_pending;
+    uint8_t  read_resp_completed;
+    uint8_t  write_resp_completed;
+    uint16_t other_resp_completed;
+    uint8_t  cmd_ready;
+    uint8_t  status_data[256];
+    uint8_t  status_resp_valid;
+    uint8_t  status_updated;
+    uint8_t  insert_cycle;
+    uint8_t  afu_enable_reset;
+    uint32_t wr_config_data;
+    uint32_t bar_h0, bar_l0, bar_h1, bar_l1, bar_h2, bar_l2;
+    uint64_t bar;
+    uint8_t  enable_bar;
+    uint8_t  read_status_resp;
+    uint8_t  write_status_resp;
+    uint32_t write_status_tag;
+    uint32_t afu_function;
+    uint16_t gBDF;
+    uint16_t gACTAG;
+    uint16_t gDUT;
+
+    void init (bool jerror);
     void resolve_tlx_afu_cmd();
     void resolve_tlx_afu_resp();
     void resolve_cfg_cmd();
@@ -69,6 +120,7 @@ private:
     void tlx_afu_config_write();
     void tlx_pr_rd_mem();
     void tlx_pr_wr_mem();
+    void send_mem_resp();
     void byte_shift(unsigned char* array, uint8_t size, uint8_t offset, uint8_t direction);
     void resolve_control_event ();
     void resolve_response_event (uint32_t cycle);
@@ -80,7 +132,12 @@ private:
     bool afu_is_reset();
     void reset ();
     void reset_machine_controllers ();
+    void clear_machine_controllers ();
+    MachineController *add_machine_controller (uint16_t context);
     bool get_machine_context();
+    void load_traffic_config();
+    bool get_traffic_config();
+    void set_traffic_stats();
     void request_assign_actag();
     uint32_t is_mmio_addr(uint64_t addr);
     bool get_mmio_read_parity ();
@@ -91,9 +148,20 @@ public:
        and waits for client to connect */
     AFU (int port, std::string filename, bool parity, bool jerror);
 
+    /* constructor for an AFU linked into ocse, there is no socket and ocse
+       hands the events over directly, see get_afu_event */
+    AFU (std::string filename, bool parity, bool jerror);
+
     /* starts the main loop of the afu test platform */
     void start ();
 
+    /* one pass of the main loop on the events just received, rc as
+       returned by tlx_get_tlx_events */
+    void run_cycle (int rc);
+
+    /* the AFU_EVENT the AFU works on */
+    AFU_EVENT *get_afu_event ();
+
     /* destrutor close the socket connection */
     ~AFU ();
 
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2015,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test AFU linked into ocse (the ocse-testafu target in ocse/Makefile) for
+ * "tlxN,builtin:testafu" lines in shim_host.dat.  Each device is an AFU
+ * object, all of an AFU's state is in it, so the device runs on the ocl
+ * thread that clocks it: testafu_signal() moves the events between ocse's
+ * AFU_EVENT and the AFU's directly and then runs one pass of the AFU's main
+ * loop.  What the AFU drives in that pass reaches ocse with the next call.
+ * The descriptor file is $TESTAFU_DESCRIPTOR, afu_descriptor.cfg by default.
+ */
+
+#include <stdlib.h>
+
+#include "AFU.h"
+
+// The entry points ocse/builtin.c looks for
+
+extern "C" void *
+testafu_open (const char *name)
+{
+    const char *descriptor_file = getenv ("TESTAFU_DESCRIPTOR");
+    AFU *afu = new AFU (descriptor_file ? descriptor_file :
+                        "afu_descriptor.cfg", false, false);
+
+    info_msg ("testafu: %s started", name);
+    return afu;
+}
+
+extern "C" void
+testafu_signal (void *ptr, AFU_EVENT * event)
+{
+    AFU *afu = (AFU *) ptr;
+
+    tlx_handoff_events (event, afu->get_afu_event ());
+    afu->run_cycle (1);
+}
+
+extern "C" void
+testafu_close (void *ptr)
+{
+    delete (AFU *) ptr;
+}
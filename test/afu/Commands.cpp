@@ -260,12 +260,12 @@ StoreCommand::send_command (AFU_EVENT * afu_event, uint32_t new_tag,
     cdata_bad = 0;
 
     printf("StoreCommand: sending command = 0x%x\n", Command::code);
+    // the AFU stages the data to write in afu_tlx_cdata_bus
     printf("memory = 0x");
     for(i=0; i<9; i++) {
-	printf("%02x", memory[i]);
+	printf("%02x", afu_event->afu_tlx_cdata_bus[i]);
     }
     printf("\n");
-    memcpy(afu_event->afu_tlx_cdata_bus, memory, 64);
 
 //    if (Command::state != IDLE)
 //        error_msg
@@ -22,7 +22,6 @@ extern "C" {
 #include "tlx_interface.h"
 #include "utils.h"
 }
-extern uint8_t memory[256];
 /* Command class - the base class of the three types of command: load, store, and others */
 class Command
 {
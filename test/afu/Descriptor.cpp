@@ -15,6 +15,7 @@
  */
 
 #include "Descriptor.h"
+#include "TestAFU_mmio.h"
 
 #include <limits.h>
 #include <string>
@@ -27,7 +28,7 @@ using std::string;
 using std::ifstream;
 using std::stringstream;
 
-Descriptor::Descriptor (string filename):vsec(0x650), vsec1(0x650), vsec2(0x650), port(0x1000), afu_desc(0x300), regs (DESCRIPTOR_NUM_REGS), mmio(0x4000)
+Descriptor::Descriptor (string filename):vsec(0x650), vsec1(0x650), vsec2(0x650), port(0x1000), afu_desc(0x1000), regs (DESCRIPTOR_NUM_REGS), mmio(TESTAFU_CONTEXTS * TESTAFU_CONTEXT_MMIO)
 {
     info_msg ("Descriptor: Reading descriptor %s file", filename.c_str ());
     parse_descriptor_file (filename);
@@ -309,14 +310,13 @@ Descriptor::set_afu_desc_reg(uint32_t offset, uint32_t data)
     afu_desc[offset] = data;
 }
 
-// mmio memory space 
-// 0x0000 - 0x4000
+// mmio memory space, a page for each of the TESTAFU_CONTEXTS contexts
 void
 Descriptor::set_mmio_mem(uint32_t offset, char *data, uint16_t size)
 {
     uint8_t i;
     debug_msg("Descriptor:set_mmio_mem");
-    if(offset > 0x4000) {
+    if(offset + size > mmio.size()) {
 	error_msg("Descriptor:set_mmio memory out of range");
     }
     //memcpy(&mmio[offset], &data, size);
@@ -335,7 +335,7 @@ Descriptor::get_mmio_mem(uint32_t offset, char *data, uint16_t size)
     uint8_t i;
     debug_msg("Descriptor:get_mmio_mem");
     offset = offset & 0x0007FFFF;
-    if(offset > 0x4000) {
+    if(offset + size > mmio.size()) {
 	error_msg("Descriptor:get_mmio address out of range\n");
     }
     //memcpy(&data, &mmio[offset], size);
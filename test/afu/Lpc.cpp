@@ -16,82 +16,132 @@
 
 #include "Lpc.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>	// memcpy
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// default size of a file backed lpc memory, the whole 32 bit lpc offset range
+#define LPC_MEMORY_SIZE_DEFAULT	0x100000000ull
 
 Lpc::Lpc() {
-    uint32_t i;
+    char *path, *size;
+    int fd;
 
-    std::vector<uint8_t> x32k(32);
-    std::vector<uint8_t> x256(128);
-    std::vector<uint8_t> x64(4);
-    printf("Lpc: allocating LPC memory\n");
-//    uint8_t *lpc_memory;
-//    lpc_memory = new uint8_t [0x1000];
-    lpc_memory.resize(0x1000);
-    // initialize lpc memory
-    for(i=0; i<4096; i++)
-	lpc_memory[i] = 0;
-}
+    backing = NULL;
+    backing_size = 0;
+    path = getenv("LPC_MEMORY_FILE");
+    if(path == NULL) {
+	printf("Lpc: using sparse LPC memory\n");
+	return;
+    }
 
-// address must be 64 byte aligned
-uint8_t
-Lpc::lpc_addr_exist(uint64_t addr) {
-    
-    if(addr_list.empty()) {
-	printf("Lpc: add address to lpc list entry\n");
-	addr_list.push_back(addr);
-	return 0;
+    size = getenv("LPC_MEMORY_SIZE");
+    backing_size = size ? strtoull(size, NULL, 0) : LPC_MEMORY_SIZE_DEFAULT;
+    backing_size = (backing_size + LPC_PAGE_SIZE - 1) & ~(LPC_PAGE_SIZE - 1);
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if((fd < 0) || (ftruncate(fd, backing_size) < 0)) {
+	perror("Lpc: LPC_MEMORY_FILE");
+	printf("Lpc: using sparse LPC memory\n");
+	if(fd >= 0)
+	    close(fd);
+	backing_size = 0;
+	return;
+    }
+    backing = (uint8_t*)mmap(NULL, backing_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(backing == MAP_FAILED) {
+	perror("Lpc: mmap LPC_MEMORY_FILE");
+	printf("Lpc: using sparse LPC memory\n");
+	backing = NULL;
+	backing_size = 0;
+	return;
     }
-    else {
-	for(it_list=addr_list.begin(); it_list != addr_list.end(); it_list++) {
-	    if(*it_list != addr) {
-		continue;
-	    }
-	    else {
-		printf("Lpc: address exist\n");
-		return 1;
-	    }
-	}
+    printf("Lpc: LPC memory backed by %s, 0x%lx bytes\n", path, backing_size);
+}
+
+// the page holding addr, or NULL if it was never written and allocate is
+// false or it could not be allocated
+uint8_t*
+Lpc::lpc_page(uint64_t addr, bool allocate) {
+    std::unordered_map<uint64_t, uint8_t*>::iterator it;
+    uint64_t page;
+    uint8_t *data;
+
+    if(addr < backing_size)
+	return backing + (addr & ~(LPC_PAGE_SIZE - 1));
+
+    page = addr >> LPC_PAGE_SHIFT;
+    it = page_table.find(page);
+    if(it != page_table.end())
+	return it->second;
+    if(!allocate)
+	return NULL;
+
+    data = (uint8_t*)calloc(1, LPC_PAGE_SIZE);
+    if(data == NULL) {
+	perror("Lpc: allocating LPC page");
+	return NULL;
     }
-    return 0;
+    page_table[page] = data;
+    return data;
 }
 
+// partial accesses of less than 64 bytes sit at the offset of addr in the
+// 64 byte data bus, larger accesses start at the beginning of it
 void
 Lpc::read_lpc_mem(uint64_t addr, uint16_t size, uint8_t *data) {
-    uint32_t i;
-    printf("Lpc: read memory at addr = 0x%lx\n", addr);
-    if(lpc_addr_exist(addr)) {
-	addr = addr & 0x0000000000000FC0;
-	for(i=0; i< size; i++) {
-	    data[i] = lpc_memory[addr+i];
-	}
-	//memcpy(&data, (uint8_t*)addr, size);
-    }
-    else {
-	printf("Lpc: no data at the addr requested\n");
+    uint64_t offset, length;
+    uint8_t *page;
+
+    if(size < 64)
+	data += addr & 0x3F;
+    while(size > 0) {
+	offset = addr & (LPC_PAGE_SIZE - 1);
+	length = LPC_PAGE_SIZE - offset;
+	if(length > size)
+	    length = size;
+	page = lpc_page(addr, false);
+	if(page != NULL)
+	    memcpy(data, page + offset, length);
+	else
+	    memset(data, 0, length);	// never written
+	addr += length;
+	data += length;
+	size -= length;
     }
 }
 
-void
+// false if a page could not be allocated, what came before it is written
+bool
 Lpc::write_lpc_mem(uint64_t addr, uint16_t size, uint8_t *data) {
-    uint32_t i;
-    uint32_t offset;
-    printf("Lpc: write memory at addr = 0x%lx and size = 0x%2x data addr = 0x%x \n", addr, size, data);
-    if(lpc_addr_exist(addr)) {
-	printf("Lpc: will overwrite data at this address\n");
-    }
-    offset = (uint32_t)addr & 0x00000FC0;
-    printf("Lpc: offset = 0x%x\n", offset);
-    printf("Lpc: lpc memory size = 0x%x\n", lpc_memory.size());
-    printf("Lpc: data = 0x");
-    for(i=0; i< size; i++) {
-	lpc_memory[offset+i] = data[i];
-	printf("%02x", data[i]);
+    uint64_t offset, length;
+    uint8_t *page;
+
+    if(size < 64)
+	data += addr & 0x3F;
+    while(size > 0) {
+	offset = addr & (LPC_PAGE_SIZE - 1);
+	length = LPC_PAGE_SIZE - offset;
+	if(length > size)
+	    length = size;
+	page = lpc_page(addr, true);
+	if(page == NULL)
+	    return false;
+	memcpy(page + offset, data, length);
+	addr += length;
+	data += length;
+	size -= length;
     }
-    //memcpy((uint8_t*)lpc_memory[addr], data, size);
+    return true;
 }
 
 Lpc::~Lpc() {
-//    delete[] lpc_memory;
-}
+    std::unordered_map<uint64_t, uint8_t*>::iterator it;
 
+    for(it = page_table.begin(); it != page_table.end(); it++)
+	free(it->second);
+    if(backing != NULL)
+	munmap(backing, backing_size);
+}
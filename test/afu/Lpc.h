@@ -18,32 +18,28 @@
 #define	__lpc_h__
 
 #include <stdint.h>
-#include <vector>
-#include <list>
+#include <unordered_map>
+
+// LPC memory is kept in a sparse page table of 64KB pages, allocated on
+// first write.  Setting LPC_MEMORY_FILE backs the range [0, LPC_MEMORY_SIZE)
+// with an mmap'd file instead, so the contents survive the AFU.
+#define LPC_PAGE_SHIFT	16
+#define LPC_PAGE_SIZE	(1ull << LPC_PAGE_SHIFT)
 
 class Lpc
 {
 private:
-    std::vector<uint8_t> x32k;	// 32x32k block [19:15]
-    std::vector<uint8_t>::iterator it_x32k;
-    std::vector<uint8_t> x256;	// 128x256B block [14:8]
-    std::vector<uint8_t>::iterator it_x256;
-    std::vector<uint8_t> x64;	// 4x64B block [7:6]
-    std::vector<uint8_t>::iterator it_x64;
-    std::list<uint64_t> addr_list;
-    std::list<uint64_t>::iterator it_list;
-    //uint8_t *lpc_memory;
-    std::vector<uint8_t> lpc_memory; 
+    std::unordered_map<uint64_t, uint8_t*> page_table;	// page number to page
+    uint8_t *backing;		// mmap'd LPC_MEMORY_FILE, or NULL
+    uint64_t backing_size;
+
+    uint8_t* lpc_page(uint64_t addr, bool allocate);
 
 public:
     Lpc();
-    uint8_t lpc_addr_exist(uint64_t addr);
     void read_lpc_mem(uint64_t addr, uint16_t size, uint8_t* data);
-    void write_lpc_mem(uint64_t addr, uint16_t size, uint8_t* data);
+    bool write_lpc_mem(uint64_t addr, uint16_t size, uint8_t* data);
     ~Lpc();
 };
 
 #endif
-
-
-
@@ -19,60 +19,66 @@
 
 #include <stdlib.h>
 
-MachineController::MachineController ():machines (NUM_MACHINES),
-    tag_to_machine ()
+MachineController::MachineController (TagManager * tm):machine_enable_bit (MASK_WORDS, 0),
+    machine_command_bit (MASK_WORDS, 0), machines (NUM_MACHINES, Machine (0)),
+    tag_to_machine (tm->get_tag_num (), NULL)
 {
     flushed_state = false;
-
-    for (uint32_t i = 0; i < machines.size (); ++i)
-        machines[i] = new Machine (0);
+    tag_manager = tm;
 }
 
-MachineController::MachineController (uint16_t ctx):machines (NUM_MACHINES),
-    tag_to_machine ()
+MachineController::MachineController (uint16_t ctx, TagManager * tm):machine_enable_bit (MASK_WORDS, 0),
+    machine_command_bit (MASK_WORDS, 0), machines (NUM_MACHINES, Machine (ctx)),
+    tag_to_machine (tm->get_tag_num (), NULL)
 {
     flushed_state = false;
-
-    for (uint32_t i = 0; i < machines.size (); ++i)
-        machines[i] = new Machine (ctx);
-
+    tag_manager = tm;
 }
 
 bool MachineController::send_command (AFU_EVENT * afu_event, uint32_t cycle)
 {
     bool  try_send = true;
 
+    // disabled machines neither send nor count down their delay
+    if (!is_enabled ())
+        return false;
+
     // allocate a tag
     uint32_t  tag;
 
-    if (!TagManager::request_tag (&tag)) {
+    if (!tag_manager->request_tag (&tag)) {
         debug_msg ("MachineController::send_command: no more tags available");
         try_send = false;
     }
 
-    // attempt to send a command with the allocated tag
-    for (uint32_t i = 0; i < machines.size (); ++i) {
-        if (try_send && machines[i]->is_enabled ()
-                && machines[i]->attempt_new_command (afu_event, tag,
+    // attempt to send a command with the allocated tag, lowest machine first
+    for (uint32_t w = 0; w < MASK_WORDS; ++w)
+    for (uint64_t pending = machine_enable_bit[w]; pending; pending &= pending - 1) {
+        uint32_t  i = w * 64 + __builtin_ctzll (pending);
+
+        if (try_send && machines[i].attempt_new_command (afu_event, tag,
                         flushed_state, (uint16_t) (cycle & 0x7FFF)))
         {
             debug_msg
             ("MachineController::send_command: machine id %d sent new command", i);
             try_send = false;
-            tag_to_machine[tag] = machines[i];
-	    resend_machine = machines[i];
+            tag_to_machine[tag] = &machines[i];
+            machine_command_bit[i / 64] |= 1ull << (i % 64);
+	    resend_machine = &machines[i];
   	    resend_tag = tag;
 	    memcpy(&resend_afu_event, afu_event, sizeof(resend_afu_event));
-	    debug_msg("MachineController::send_command tag = 0x%x machine = 0x%x", tag, machines[i]);
+	    debug_msg("MachineController::send_command tag = 0x%x machine = 0x%x", tag, i);
         }
 
         // regardless if a command is sent, notify machine to advanced one cycle in delaying phase
-        machines[i]->advance_cycle ();
+        machines[i].advance_cycle ();
+        // an enable_once machine drops out after its command
+        set_machine_enable_bit (i);
     }
 
     // tag was not used by any machine if try_send is still true therefore return it
     if (try_send)
-        TagManager::release_tag (tag);
+        tag_manager->release_tag (tag);
 
     return !try_send;
 }
@@ -89,12 +95,12 @@ MachineController::resend_command(AFU_EVENT *afu_event, uint32_t cycle)
 }
  
 void
-MachineController::set_machine_enable_bit(uint8_t position)
+MachineController::set_machine_enable_bit(uint32_t position)
 {
-    uint32_t i;
-    for(i=0; i<machines.size(); i++) {
-	
-    }
+    if (machines[position].is_enabled ())
+        machine_enable_bit[position / 64] |= 1ull << (position % 64);
+    else
+        machine_enable_bit[position / 64] &= ~(1ull << (position % 64));
 }
 void
 MachineController::process_response (AFU_EVENT * afu_event, uint32_t cycle)
@@ -114,13 +120,14 @@ MachineController::process_buffer_read (AFU_EVENT * afu_event)
 void
 MachineController::change_machine_config (uint16_t index, uint16_t machine_number, uint64_t data)
 {
-    machines[machine_number]->change_machine_config(index, data);
-
     if (machine_number >= NUM_MACHINES) {
         warn_msg
         ("MachineController::change_machine_config: word address exceeded machine configuration space");
         return;
     }
+
+    machines[machine_number].change_machine_config(index, data);
+    set_machine_enable_bit (machine_number);
 }
 
 void
@@ -134,27 +141,27 @@ MachineController::reset ()
 {
     flushed_state = false;
     for (uint32_t i = 0; i < machines.size (); ++i)
-        machines[i]->reset ();
+        machines[i].reset ();
+    machine_enable_bit.assign (MASK_WORDS, 0);
+    machine_command_bit.assign (MASK_WORDS, 0);
 }
 
 bool MachineController::is_enabled () const
 {
-    for (uint32_t i = 0; i < machines.size (); ++i)
-    {
-        if (machines[i]->is_enabled ()) {
+    for (uint32_t w = 0; w < MASK_WORDS; ++w)
+        if (machine_enable_bit[w] != 0)
             return true;
-        }
-    }
 
-    return
-        false;
+    return false;
 }
 
 bool MachineController::all_machines_completed () const
 {
-    for (uint32_t i = 0; i < machines.size (); ++i)
+    // a machine that never sent a command has nothing outstanding
+    for (uint32_t w = 0; w < MASK_WORDS; ++w)
+    for (uint64_t pending = machine_command_bit[w]; pending; pending &= pending - 1)
     {
-        if (!machines[i]->is_completed ()) {
+        if (!machines[w * 64 + __builtin_ctzll (pending)].is_completed ()) {
             return false;
         }
     }
@@ -166,25 +173,18 @@ bool MachineController::all_machines_completed () const
 void
 MachineController::disable_all_machines ()
 {
-    for (uint32_t i = 0; i < machines.size (); ++i)
-        machines[i]->disable ();
+    for (uint32_t w = 0; w < MASK_WORDS; ++w)
+    for (uint64_t pending = machine_enable_bit[w]; pending; pending &= pending - 1)
+        machines[w * 64 + __builtin_ctzll (pending)].disable ();
+    machine_enable_bit.assign (MASK_WORDS, 0);
 }
 
 bool MachineController::has_tag (uint32_t tag) const
 {
-    if (tag_to_machine.find (tag) != tag_to_machine.end ())
-        return true;
-
-    return false;
+    return tag < tag_to_machine.size () && tag_to_machine[tag] != NULL;
 }
 
 MachineController::~
 MachineController ()
 {
-    for (uint32_t i = 0; i < machines.size (); ++i)
-        if (machines[i])
-            delete machines[i];
-
 }
-
-
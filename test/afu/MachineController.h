@@ -17,17 +17,22 @@
 #ifndef __machine_controller_h__
 #define __machine_controller_h__
 
+#include "TagManager.h"
+#include "TestAFU_mmio.h"
+
 extern "C" {
 #include "tlx_interface.h"
 #include "utils.h"
 }
 
 #include <vector>
-#include <map>
 
 #define SIZE_CONFIG_TABLE 4	// double words
 #define SIZE_CACHE_LINE 128
-#define NUM_MACHINES 64
+#define MASK_WORDS ((NUM_MACHINES + 63) / 64)	// machine mask words
+
+static_assert (NUM_MACHINES * MACHINE_SLOT_SIZE <= TRAFFIC_OFFSET,
+               "machine config slots run into the traffic generator registers");
 
 class MachineController
 {
@@ -37,20 +42,27 @@ class MachineController
     class Machine;
 
     bool flushed_state;
-    uint64_t  machine_enable_bit;
-    std::vector < Machine * >machines;
-    std::map < uint32_t, Machine * >tag_to_machine;
+    // one bit per machine that is enabled, send_command only walks these
+    std::vector < uint64_t > machine_enable_bit;
+    // one bit per machine that has sent a command since the last reset
+    std::vector < uint64_t > machine_command_bit;
+    // machines are held by value so a walk over them stays in one block
+    std::vector < Machine > machines;
+    // indexed by afutag, NULL for tags this controller did not send
+    std::vector < Machine * >tag_to_machine;
     // resend variables
     AFU_EVENT resend_afu_event;
     uint32_t resend_tag;
     Machine *resend_machine;
+    // afutags are shared by every machine controller of an AFU
+    TagManager *tag_manager;
     
 
 public:
 
-    MachineController ();
+    MachineController (TagManager * tm);
 
-    MachineController (uint16_t ctx);
+    MachineController (uint16_t ctx, TagManager * tm);
 
     /* call this function every cylce (i.e. each iteration of while loop) in
      * AFU.cpp to send command from the first machine that has a command ready
@@ -103,8 +115,9 @@ public:
      * machine controller */
     bool has_tag (uint32_t tag) const;
     
-    // 
-    void set_machine_enable_bit(uint8_t position);
+    /* call this function after a machine may have been enabled or disabled
+     * to bring its bit in machine_enable_bit up to date */
+    void set_machine_enable_bit(uint32_t position);
     ~MachineController ();
 };
 
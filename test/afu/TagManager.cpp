@@ -17,14 +17,25 @@
 #include "TagManager.h"
 
 #include <stdlib.h>
+#include <algorithm>
 
-std::set < uint32_t > TagManager::tags_in_use;
-int TagManager::num_credits = 0;
-int TagManager::max_credits = 255;
-uint8_t TagManager::resp_credit = 0;
-uint8_t TagManager::cmd_credit  = 0;
-uint8_t TagManager::resp_data_credit = 0;
-uint8_t TagManager::cmd_data_credit  = 0;
+TagManager::TagManager (uint32_t tag_bits)
+{
+    if (tag_bits == 0 || tag_bits > TAG_BITS_MAX) {
+        warn_msg ("TagManager: tag width %d out of range, using %d", tag_bits, TAG_BITS_DEFAULT);
+        tag_bits = TAG_BITS_DEFAULT;
+    }
+    tag_num = 1 << tag_bits;
+    tags_in_use.resize ((tag_num + 63) / 64);
+    num_credits = 0;
+    max_credits = tag_num;
+    resp_credit = 0;
+    cmd_credit = 0;
+    resp_data_credit = 0;
+    cmd_data_credit = 0;
+    reset ();
+    num_credits = 0;
+}
 
 bool TagManager::request_tag (uint32_t * new_tag)
 {
@@ -36,12 +47,13 @@ bool TagManager::request_tag (uint32_t * new_tag)
     if (num_credits == 0)
         return false;
 
-    do {
-        // randomly generate number between 0 - MAX_TAG_NUM
-        *new_tag = (uint32_t) (rand () % (MAX_TAG_NUM + 1));
-    } while (tags_in_use.find (*new_tag) != tags_in_use.end ());
+    // every tag is in use
+    if (free_tags.empty ())
+        return false;
 
-    tags_in_use.insert (*new_tag);
+    *new_tag = free_tags.front ();
+    free_tags.pop_front ();
+    tags_in_use[*new_tag / 64] |= 1ull << (*new_tag % 64);
 
 //    debug_msg("TagManager::request_tag: insert new_tag = %d", *new_tag);
 
@@ -60,10 +72,13 @@ TagManager::release_tag (uint32_t tag)
 void
 TagManager::release_tag (uint32_t tag, int returned_credits)
 {
-    if (tags_in_use.find (tag) == tags_in_use.end ())
+    if (!is_in_use (tag)) {
         error_msg ("TagManager: attempt to release tag not in use");
+        return;
+    }
 
-    tags_in_use.erase (tag);
+    tags_in_use[tag / 64] &= ~(1ull << (tag % 64));
+    free_tags.push_back (tag);
     num_credits += returned_credits;
 
 //    if (num_credits > max_credits)
@@ -73,23 +88,29 @@ TagManager::release_tag (uint32_t tag, int returned_credits)
 
 bool TagManager::is_in_use (uint32_t tag)
 {
-    for (std::set<uint32_t>::iterator it=tags_in_use.begin(); it != tags_in_use.end(); it++) {
-	debug_msg ("TagManager::is_in_use: tags_in_use = %d", *it);
-    }
-    
-//    debug_msg("TagManager::is_in_use: tag = %d ", tag);
-    if (tags_in_use.find (tag) == tags_in_use.end ()) {
-	debug_msg ("TagManager::is_in_use: tag = %d return false", tag);
+    if (tag >= tag_num)
         return false;
-    }
 
-    return true;
+    return (tags_in_use[tag / 64] >> (tag % 64)) & 1;
+}
+
+uint32_t TagManager::get_tag_num () const
+{
+    return tag_num;
 }
 
 void
 TagManager::reset ()
 {
-    tags_in_use.clear ();
+    uint32_t i;
+
+    // hand the tags out in a random order, as the old random draw did
+    free_tags.clear ();
+    for (i = 0; i < tag_num; i++)
+        free_tags.push_back (i);
+    for (i = tag_num - 1; i > 0; i--)
+        std::swap (free_tags[i], free_tags[rand () % (i + 1)]);
+    std::fill (tags_in_use.begin (), tags_in_use.end (), 0);
     num_credits = max_credits;
 }
 
@@ -22,9 +22,13 @@ extern "C" {
 }
 
 #include <stdint.h>
-#include <set>
+#include <deque>
+#include <vector>
 
-#define MAX_TAG_NUM 255
+// afutags are TAG_BITS_DEFAULT wide unless AFU_TAG_BITS is set, at most
+// TAG_BITS_MAX since afu_tlx_cmd_afutag is 16 bits
+#define TAG_BITS_DEFAULT 8
+#define TAG_BITS_MAX 16
 #define CMD_CREDIT 0
 #define RESP_CREDIT 1
 #define CMD_DATA_CREDIT 2
@@ -33,44 +37,52 @@ extern "C" {
 class TagManager
 {
 private:
-    static std::set < uint32_t > tags_in_use;
-    static int num_credits;
-    static int max_credits;
-    static uint8_t resp_credit;
-    static uint8_t cmd_credit;
-    static uint8_t resp_data_credit;
-    static uint8_t cmd_data_credit;
+    uint32_t tag_num;			// number of tags, 1 << tag width
+    std::deque < uint32_t > free_tags;	// tags not in use, reused oldest first
+    std::vector < uint64_t > tags_in_use;	// bitmap of tags handed out
+    int num_credits;
+    int max_credits;
+    uint8_t resp_credit;
+    uint8_t cmd_credit;
+    uint8_t resp_data_credit;
+    uint8_t cmd_data_credit;
 
 public:
-    /* randomly generates a new tag and updates the new_tag variable,
-     * returns false if there are no more credits */
-    static bool request_tag (uint32_t * new_tag);
+    /* tag_bits sets the width of the tags handed out */
+    TagManager (uint32_t tag_bits = TAG_BITS_DEFAULT);
 
-    /* removes the tag from the set,
+    /* takes the next free tag and updates the new_tag variable,
+     * returns false if there are no more credits or free tags */
+    bool request_tag (uint32_t * new_tag);
+
+    /* marks the tag free again,
      * returned_credits is used by PSL response interface */
-    static void release_tag (uint32_t tag, int returned_credits);
+    void release_tag (uint32_t tag, int returned_credits);
 
-    /* removes the tag from the set, returned_credit default to be 1 */
-    static void release_tag (uint32_t tag);
+    /* marks the tag free again, returned_credit default to be 1 */
+    void release_tag (uint32_t tag);
 
-    /* checks to make see if the tag exists in the tags_in_use set */
-    static bool is_in_use (uint32_t tag);
+    /* checks to make see if the tag has been requested and not released */
+    bool is_in_use (uint32_t tag);
 
     /* sets max_credits and reset num_credits to max_credits,
      * should never be called while AFU is in running state */
-    static void set_max_credits (int mc);
+    void set_max_credits (int mc);
+
+    /* number of distinct tags, tags run from 0 to get_tag_num () - 1 */
+    uint32_t get_tag_num () const;
 
     /* releases all tags requested */
-    static void reset ();
+    void reset ();
 
     // reset credit
-    static void reset_tlx_credit(uint8_t cmd_max_credit, uint8_t data_max_credit);
+    void reset_tlx_credit(uint8_t cmd_max_credit, uint8_t data_max_credit);
 
     // request credit
-    static bool request_tlx_credit(uint8_t type);
+    bool request_tlx_credit(uint8_t type);
 
     // release credit
-    static void release_tlx_credit(uint8_t type);
+    void release_tlx_credit(uint8_t type);
 
 };
 
@@ -0,0 +1,332 @@
+/*
+ * Copyright 2015,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TrafficGenerator.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+
+using std::string;
+using std::ifstream;
+using std::stringstream;
+
+TrafficGenerator::TrafficGenerator (TagManager * tm):in_flight ()
+{
+    tag_manager = tm;
+    op = TRAFFIC_READ;
+    pattern = TRAFFIC_SEQUENTIAL;
+    depth = 1;
+    count = 0;
+    base = 0;
+    range = 0;
+    stride = 0;
+    start (0);
+}
+
+// Parse traffic config file, one "field : value" per line.  op takes read,
+// write, amo or intrp and pattern takes sequential, strided or random,
+// everything else is a number
+bool
+TrafficGenerator::parse_config_file (string filename, uint64_t * config)
+{
+    ifstream file (filename.c_str ());
+    string line, field, colon, s_value;
+    uint64_t value;
+
+    if (!file.is_open ()) {
+        warn_msg ("TrafficGenerator: failed to open file %s", filename.c_str ());
+        return false;
+    }
+
+    memset (config, 0, TRAFFIC_CONFIG_WORDS * sizeof (uint64_t));
+    config[1] = 1 << 16;	// depth
+    while (getline (file, line)) {
+        // skip comments and empty lines
+        if (line[0] == '#' || line == "")
+            continue;
+        stringstream ss (line);
+
+        ss >> field >> colon >> s_value;
+        value = strtoull (s_value.c_str (), NULL, 0);
+        if (field == "op") {
+            if (s_value == "write")
+                value = TRAFFIC_WRITE;
+            else if (s_value == "amo")
+                value = TRAFFIC_AMO;
+            else if (s_value == "intrp")
+                value = TRAFFIC_INTRP;
+            else
+                value = TRAFFIC_READ;
+            config[1] = (config[1] & ~0xFFull) | value;
+        }
+        else if (field == "pattern") {
+            if (s_value == "strided")
+                value = TRAFFIC_STRIDED;
+            else if (s_value == "random")
+                value = TRAFFIC_RANDOM;
+            else
+                value = TRAFFIC_SEQUENTIAL;
+            config[1] = (config[1] & ~0xFF00ull) | (value << 8);
+        }
+        else if (field == "depth")
+            config[1] = (config[1] & ~0xFFFF0000ull) | ((value & 0xFFFF) << 16);
+        else if (field == "count")
+            config[2] = value;
+        else if (field == "base")
+            config[3] = value;
+        else if (field == "range")
+            config[4] = value;
+        else if (field == "stride")
+            config[5] = value;
+        else {
+            warn_msg ("TrafficGenerator: unknown field %s", field.c_str ());
+            continue;
+        }
+        info_msg ("TrafficGenerator: %s: %s", field.c_str (), s_value.c_str ());
+    }
+    return true;
+}
+
+void
+TrafficGenerator::change_traffic_config (uint16_t index, uint64_t data)
+{
+    switch (index) {
+    case 1:
+        op = data & 0xFF;
+        pattern = (data >> 8) & 0xFF;
+        depth = (data >> 16) & 0xFFFF;
+        if (depth == 0)
+            depth = 1;
+        break;
+    case 2:
+        count = data;
+        break;
+    case 3:
+        base = data;
+        break;
+    case 4:
+        range = data;
+        break;
+    case 5:
+        stride = data;
+        break;
+    default:
+        break;
+    }
+}
+
+void
+TrafficGenerator::start (uint32_t cycle)
+{
+    in_flight.clear ();
+    offset = 0;
+    issued = 0;
+    completed = 0;
+    failed = 0;
+    bytes = 0;
+    start_cycle = cycle;
+    now = cycle;
+    latency_min = ~0ull;
+    latency_max = 0;
+    latency_sum = 0;
+    info_msg ("TrafficGenerator: op %d pattern %d depth %d count %lld base 0x%llx range 0x%llx stride 0x%llx",
+              op, pattern, depth, (long long) count, (long long) base,
+              (long long) range, (long long) stride);
+}
+
+// Bytes moved by one command
+uint16_t
+TrafficGenerator::command_size () const
+{
+    switch (op) {
+    case TRAFFIC_AMO:
+        return 8;
+    case TRAFFIC_INTRP:
+        return 0;
+    default:
+        return 64;
+    }
+}
+
+// Address of the next command, aligned to its size and kept inside
+// [base, base + range)
+uint64_t
+TrafficGenerator::next_address ()
+{
+    uint64_t size, lines, address;
+
+    if (op == TRAFFIC_INTRP)
+        return base;	// base holds the interrupt object handle
+
+    // libocxl takes the operand of an amo on an odd doubleword from the
+    // second half of the 16 bytes ocse forwards, keep them on even ones
+    size = (op == TRAFFIC_AMO) ? 16 : command_size ();
+    lines = range / size;
+    if (lines == 0)
+        lines = 1;
+    if (pattern == TRAFFIC_RANDOM)
+        offset = ((((uint64_t) rand () << 31) ^ rand ()) % lines) * size;
+    address = base + (offset % (lines * size));
+    if (pattern == TRAFFIC_STRIDED)
+        offset = (offset + (stride & ~(size - 1))) % (lines * size);
+    else if (pattern == TRAFFIC_SEQUENTIAL)
+        offset = (offset + size) % (lines * size);
+    return address;
+}
+
+bool
+TrafficGenerator::send_command (AFU_EVENT * afu_event, uint32_t cycle)
+{
+    uint8_t ea_addr[9];
+    uint8_t cdata_bus[64];
+    uint64_t address;
+    uint32_t tag;
+    int rc;
+
+    now = cycle;
+    if (issued == count || in_flight.size () >= depth)
+        return false;
+    if (afu_event->afu_tlx_cmd_valid || afu_event->tlx_afu_cmd_credits_available == 0)
+        return false;
+    if ((op == TRAFFIC_WRITE || op == TRAFFIC_AMO) &&
+            (afu_event->afu_tlx_cdata_valid ||
+             afu_event->tlx_afu_cmd_data_credits_available == 0))
+        return false;
+    if (!tag_manager->request_tag (&tag)) {
+        debug_msg ("TrafficGenerator::send_command: no more tags available");
+        return false;
+    }
+
+    address = next_address ();
+    memset (ea_addr, 0, sizeof (ea_addr));
+    memcpy (ea_addr, &address, sizeof (address));
+    switch (op) {
+    case TRAFFIC_WRITE:
+        memset (cdata_bus, issued & 0xFF, sizeof (cdata_bus));
+        rc = afu_tlx_send_cmd_and_data (afu_event, AFU_CMD_DMA_W,
+                                        afu_event->afu_tlx_cmd_actag, 0, ea_addr, tag, 1, 0,
+#ifdef	TLX4
+                                        0,
+#endif
+                                        0, 0, 0, afu_event->afu_tlx_cmd_bdf,
+                                        afu_event->afu_tlx_cmd_pasid, 0, cdata_bus, 0);
+        break;
+    case TRAFFIC_AMO:
+        // fetch and add 1, the operand sits at the address offset in the line
+        memset (cdata_bus, 0, sizeof (cdata_bus));
+        cdata_bus[address & 0x3F] = 1;
+        rc = afu_tlx_send_cmd_and_data (afu_event, AFU_CMD_AMO_RW,
+                                        afu_event->afu_tlx_cmd_actag, 0, ea_addr, tag, 0, 3,
+#ifdef	TLX4
+                                        0,
+#endif
+                                        0, AMO_WRMWF_ADD, 0, afu_event->afu_tlx_cmd_bdf,
+                                        afu_event->afu_tlx_cmd_pasid, 0, cdata_bus, 0);
+        break;
+    case TRAFFIC_INTRP:
+        rc = afu_tlx_send_cmd (afu_event, AFU_CMD_INTRP_REQ,
+                               afu_event->afu_tlx_cmd_actag, 0, ea_addr, tag, 0, 0,
+#ifdef	TLX4
+                               0,
+#endif
+                               0, 0, 0, afu_event->afu_tlx_cmd_bdf,
+                               afu_event->afu_tlx_cmd_pasid, 0);
+        break;
+    default:
+        rc = afu_tlx_send_cmd (afu_event, AFU_CMD_RD_WNITC,
+                               afu_event->afu_tlx_cmd_actag, 0, ea_addr, tag, 1, 0,
+#ifdef	TLX4
+                               0,
+#endif
+                               0, 0, 0, afu_event->afu_tlx_cmd_bdf,
+                               afu_event->afu_tlx_cmd_pasid, 0);
+        break;
+    }
+    if (rc != TLX_SUCCESS) {
+        debug_msg ("TrafficGenerator::send_command: rc = 0x%x", rc);
+        tag_manager->release_tag (tag);
+        return false;
+    }
+
+    in_flight[tag] = cycle;
+    ++issued;
+    return true;
+}
+
+bool
+TrafficGenerator::has_tag (uint32_t tag) const
+{
+    return in_flight.count (tag) != 0;
+}
+
+void
+TrafficGenerator::process_response (uint8_t resp_opcode, uint32_t tag, uint8_t resp_code)
+{
+    std::unordered_map < uint32_t, uint64_t >::iterator it = in_flight.find (tag);
+    uint64_t latency;
+
+    if (it == in_flight.end ()) {
+        error_msg ("TrafficGenerator: response for afutag 0x%x not in flight", tag);
+        return;
+    }
+
+    latency = now - it->second;
+    in_flight.erase (it);
+    tag_manager->release_tag (tag);
+
+    switch (resp_opcode) {
+    case TLX_RSP_READ_RESP:
+    case TLX_RSP_WRITE_RESP:
+        bytes += command_size ();
+        break;
+    case TLX_RSP_INTRP_RESP:
+        if (resp_code == 0)
+            break;
+        /* fall through */
+    default:
+        debug_msg ("TrafficGenerator: afutag 0x%x failed, opcode 0x%x code 0x%x",
+                   tag, resp_opcode, resp_code);
+        ++failed;
+        return;
+    }
+
+    ++completed;
+    latency_sum += latency;
+    if (latency < latency_min)
+        latency_min = latency;
+    if (latency > latency_max)
+        latency_max = latency;
+}
+
+bool
+TrafficGenerator::is_done () const
+{
+    return issued == count && in_flight.empty ();
+}
+
+void
+TrafficGenerator::get_stats (uint64_t * stats) const
+{
+    stats[0] = completed;
+    stats[1] = bytes;
+    stats[2] = failed;
+    stats[3] = now - start_cycle;
+    stats[4] = completed ? latency_min : 0;
+    stats[5] = latency_max;
+    stats[6] = latency_sum;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2015,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __traffic_generator_h__
+#define __traffic_generator_h__
+
+#include "TagManager.h"
+
+extern "C" {
+#include "tlx_interface.h"
+#include "utils.h"
+}
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+#include "TestAFU_mmio.h"
+
+// The traffic generator registers are in TestAFU_mmio.h.  AFU_TRAFFIC_CFG
+// names a file of "field : value" lines that preloads the config words of
+// every context, so the application only has to write the base address and
+// the start bit.
+
+class TrafficGenerator
+{
+private:
+    TagManager *tag_manager;
+
+    uint8_t op;
+    uint8_t pattern;
+    uint32_t depth;
+    uint64_t count;
+    uint64_t base;
+    uint64_t range;
+    uint64_t stride;
+
+    uint64_t offset;		// next offset into [base, base + range)
+    uint64_t issued;
+    uint64_t completed;
+    uint64_t failed;
+    uint64_t bytes;
+    uint64_t start_cycle;
+    uint64_t now;
+    uint64_t latency_min;
+    uint64_t latency_max;
+    uint64_t latency_sum;
+    std::unordered_map < uint32_t, uint64_t > in_flight;	// afutag to issue cycle
+
+    uint16_t command_size () const;
+    uint64_t next_address ();
+
+public:
+    TrafficGenerator (TagManager * tm);
+
+    /* fills config with the TRAFFIC_CONFIG_WORDS words described in
+     * filename, returns false if the file can not be read */
+    static bool parse_config_file (std::string filename, uint64_t * config);
+
+    /* call this function when AFU receives a normal MMIO write to modify
+     * the traffic config */
+    void change_traffic_config (uint16_t index, uint64_t data);
+
+    /* clears the counters and starts a new run at cycle */
+    void start (uint32_t cycle);
+
+    /* call this function every cycle while the generator is running, sends
+     * the next command if fewer than depth are outstanding and credits and
+     * tags allow it, returns true if a command is actually sent */
+    bool send_command (AFU_EVENT *, uint32_t cycle);
+
+    /* call this function to find out if the tag belongs to the generator */
+    bool has_tag (uint32_t tag) const;
+
+    /* call this function when AFU receives a response to one of the
+     * generator's tags */
+    void process_response (uint8_t resp_opcode, uint32_t tag, uint8_t resp_code);
+
+    /* true once count commands have been sent and answered */
+    bool is_done () const;
+
+    /* copies the TRAFFIC_STATS_WORDS counters to stats */
+    void get_stats (uint64_t * stats) const;
+};
+
+#endif
@@ -16,32 +16,80 @@
 
 #include <sstream>
 #include <stdlib.h>
+#include <pthread.h>
+#include <vector>
 
 #include "AFU.h"
 
 using std::string;
 using std::stringstream;
+using std::vector;
+
+struct afu_args {
+    int port;
+    string descriptor_file;
+    bool parity;
+    bool jerror;
+};
+
+// parses "port", "port,port,..." or "first-last" into ports
+static bool
+parse_ports (string arg, vector < int >&ports)
+{
+    stringstream ss (arg);
+    string item;
+
+    while (getline (ss, item, ',')) {
+        int first = 0, last = 0;
+        char dash = 0;
+        stringstream range (item);
+
+        range >> first;
+        if (range.fail ())
+            return false;
+        last = first;
+        if (range >> dash) {
+            if (dash != '-' || !(range >> last))
+                return false;
+        }
+        if (first <= 0 || last < first || last > 65535)
+            return false;
+        for (int port = first; port <= last; ++port)
+            ports.push_back (port);
+    }
+    return !ports.empty ();
+}
+
+static void *
+afu_thread (void *ptr)
+{
+    struct afu_args *args = (struct afu_args *) ptr;
+    AFU afu (args->port, args->descriptor_file, args->parity, args->jerror);
+
+    afu.start ();
+    debug_msg ("main: AFU on port %d quitting", args->port);
+    return NULL;
+}
 
 int
 main (int argc, char *argv[])
 {
     if (argc < 3) {
         fprintf (stderr,
-                 "Not enough arguments. Usage: ./afu port_number descriptor_file [parity] [jerror]\n");
+                 "Not enough arguments. Usage: ./afu port_number[,port_number...|first-last] descriptor_file [parity] [jerror]\n");
         exit (1);
     }
 
-    int
-    port = 0;
+    vector < int >ports;
 
     string descriptor_file (argv[2]);
     bool parity = false;
     bool jerror = false;
 
-    stringstream ss;
-
-    ss << argv[1];
-    ss >> port;
+    if (!parse_ports (argv[1], ports)) {
+        fprintf (stderr, "Bad port list %s\n", argv[1]);
+        exit (1);
+    }
 
     if (argc == 4 && string (argv[3]) == "parity") {
         printf ("MAIN: AFU parity enabled\n");
@@ -58,8 +106,31 @@ main (int argc, char *argv[])
         jerror = true;
     }
 
-    AFU afu (port, descriptor_file, parity, jerror);
+    // one independent AFU per port, each in its own thread
+    vector < struct afu_args >args (ports.size ());
+    vector < pthread_t > threads (ports.size ());
 
-    afu.start ();
+    for (uint32_t i = 0; i < ports.size (); ++i) {
+        args[i].port = ports[i];
+        args[i].descriptor_file = descriptor_file;
+        args[i].parity = parity;
+        args[i].jerror = jerror;
+        if (ports.size () == 1) {
+            afu_thread (&args[i]);
+            return 0;
+        }
+        if (pthread_create (&threads[i], NULL, afu_thread, &args[i])) {
+            // ocse expects every port in the list, so the AFUs already
+            // listening are of no use either
+            fprintf (stderr, "main: unable to start AFU thread for port %d\n",
+                     ports[i]);
+            exit (1);
+        }
+        printf ("MAIN: AFU listening on port %d\n", ports[i]);
+    }
+
+    for (uint32_t i = 0; i < threads.size (); ++i)
+        pthread_join (threads[i], NULL);
     debug_msg ("main: AFU quitting");
+    return 0;
 }
@@ -0,0 +1,773 @@
+/*
+ * Copyright 2015,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Description: ocse_bench.c
+ *
+ *  End to end benchmarks of ocse and libocxl against the Test AFU: startup
+ *  and discovery, MMIO latency and throughput, lpc memory bandwidth by
+ *  transfer size, overlapped asynchronous lpc copies, AFU DMA bandwidth by outstanding commands (the traffic
+ *  generator), AMO rate, and interrupt and wake_host_thread latency.  The
+ *  results are written as one JSON object.
+ *
+ *  With --ocse the benchmark starts that ocse-testafu itself, in a temporary
+ *  directory with a "tlx0,builtin:testafu" shim_host.dat and fixed parms
+ *  (or $OCSE_PARMS), so no simulator is needed, and stops it at the end.
+ *  Without it, it uses the ocse in $OCSE_SERVER_DAT or ocse_server.dat,
+ *  which must run the Test AFU.  "make bench" does the former.
+ *
+ *  Wall times are taken around the libocxl calls, the traffic generator
+ *  also reports its own AFU cycles and command latencies.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "TestAFU_config.h"
+#include "tlx_interface_t.h"
+#include "../../libocxl/libocxl_lpc.h"
+
+#define CACHELINE 128
+#define MDEVICE "/dev/cxl/tlx0.0000:00:00.1.0"
+#define DMA_RANGE 0x10000
+#define STARTUP_TIMEOUT 30
+#define STATUS_HINT 0x40000000
+
+#define LPC_MIN 8
+
+// Parms of a started ocse: responses right away, no reordering, no errors
+static const char *bench_parms =
+	"SEED:1\n"
+	"RESPONSE_PERCENT:100\n"
+	"PAGED_PERCENT:0\n"
+	"RETRY_PERCENT:0\n"
+	"FAILED_PERCENT:0\n"
+	"PENDING_PERCENT:0\n"
+	"REORDER_PERCENT:0\n"
+	"BUFFER_PERCENT:0\n";
+
+static char *device = MDEVICE;
+static unsigned int iterations = 32;
+static unsigned int count = 64;
+static unsigned int lpc_max = 4096;
+static unsigned int depth_max = 16;
+static uint16_t context;
+
+static FILE *json;
+static char run_dir[] = "/tmp/ocse_bench.XXXXXX";
+static pid_t ocse_pid;
+
+// Wall times of repeated operations
+struct bench_time {
+	unsigned int count;
+	double total;
+	double min;
+	double max;
+};
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void time_add(struct bench_time *t, double seconds)
+{
+	if (!t->count || (seconds < t->min))
+		t->min = seconds;
+	if (!t->count || (seconds > t->max))
+		t->max = seconds;
+	t->total += seconds;
+	t->count++;
+}
+
+// "name": {count, mean, min and max in us, operations per second}
+static void json_time(const char *name, struct bench_time *t, const char *sep)
+{
+	fprintf(json, "\t\t\"%s\": {\"count\": %u, \"mean_us\": %.1f, "
+		"\"min_us\": %.1f, \"max_us\": %.1f, \"ops_per_s\": %.1f}%s\n",
+		name, t->count, t->count ? 1e6 * t->total / t->count : 0,
+		1e6 * t->min, 1e6 * t->max,
+		(t->total > 0) ? t->count / t->total : 0, sep);
+}
+
+static void run_file(char *path, const char *name)
+{
+	snprintf(path, PATH_MAX, "%s/%s", run_dir, name);
+}
+
+// Start ocse_path with one built-in Test AFU, returns its startup time
+static double start_ocse(char *ocse_path, char *descriptor)
+{
+	char ocse[PATH_MAX], desc[PATH_MAX], path[PATH_MAX];
+	char line[256], *server;
+	double start;
+	FILE *fp;
+	int fd;
+
+	if (!realpath(ocse_path, ocse) || !realpath(descriptor, desc)) {
+		perror("realpath");
+		return -1;
+	}
+	if (!mkdtemp(run_dir)) {
+		perror("mkdtemp");
+		return -1;
+	}
+	run_file(path, "shim_host.dat");
+	if ((fp = fopen(path, "w")) == NULL) {
+		perror(path);
+		return -1;
+	}
+	fprintf(fp, "tlx0,builtin:testafu\n");
+	fclose(fp);
+	if (!getenv("OCSE_PARMS")) {
+		run_file(path, "ocse.parms");
+		if ((fp = fopen(path, "w")) == NULL) {
+			perror(path);
+			return -1;
+		}
+		fputs(bench_parms, fp);
+		fclose(fp);
+	}
+
+	start = now_seconds();
+	if ((ocse_pid = fork()) < 0) {
+		perror("fork");
+		return -1;
+	}
+	if (ocse_pid == 0) {
+		run_file(path, "ocse.log");
+		if ((chdir(run_dir) < 0) ||
+		    ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0))
+			_exit(127);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		close(fd);
+		setenv("TESTAFU_DESCRIPTOR", desc, 1);
+		unsetenv("SHIM_HOST_DAT");
+		execl(ocse, ocse, (char *)NULL);
+		_exit(127);
+	}
+
+	// ocse logs the host:port it listens on once its ports are up
+	run_file(path, "ocse.log");
+	server = NULL;
+	while (!server) {
+		if (waitpid(ocse_pid, NULL, WNOHANG) == ocse_pid) {
+			fprintf(stderr, "%s exited, see %s\n", ocse, path);
+			ocse_pid = 0;
+			return -1;
+		}
+		if (now_seconds() - start > STARTUP_TIMEOUT) {
+			fprintf(stderr, "%s did not start, see %s\n", ocse, path);
+			return -1;
+		}
+		if ((fp = fopen(path, "r")) != NULL) {
+			while (!server && fgets(line, sizeof(line), fp))
+				server = strstr(line, "listening on ");
+			fclose(fp);
+		}
+		if (!server)
+			usleep(1000);
+	}
+	start = now_seconds() - start;
+
+	server += strlen("listening on ");
+	run_file(path, "ocse_server.dat");
+	if ((fp = fopen(path, "w")) == NULL) {
+		perror(path);
+		return -1;
+	}
+	fputs(server, fp);
+	fclose(fp);
+	setenv("OCSE_SERVER_DAT", path, 1);
+	return start;
+}
+
+// Stop a started ocse, its run directory is kept if it failed
+static void stop_ocse(int failed)
+{
+	const char *files[] = { "shim_host.dat", "ocse.parms", "ocse.log",
+		"ocse_server.dat", "debug.log", NULL };
+	char path[PATH_MAX];
+	int i;
+
+	if (ocse_pid > 0) {
+		kill(ocse_pid, SIGINT);
+		waitpid(ocse_pid, NULL, 0);
+		ocse_pid = 0;
+	}
+	if (failed) {
+		fprintf(stderr, "ocse run directory kept in %s\n", run_dir);
+		return;
+	}
+	for (i = 0; files[i]; i++) {
+		run_file(path, files[i]);
+		unlink(path);
+	}
+	rmdir(run_dir);
+}
+
+static int bench_mmio(ocxl_mmio_h mmio)
+{
+	struct bench_time rd, wr;
+	uint64_t offset, value;
+	double t;
+	unsigned int i;
+
+	// The stride register of an idle traffic generator is harmless
+	offset = context * 0x1000 + TRAFFIC_OFFSET + 5 * 8;
+	memset(&rd, 0, sizeof(rd));
+	memset(&wr, 0, sizeof(wr));
+	for (i = 0; i < iterations; i++) {
+		t = now_seconds();
+		if (ocxl_mmio_write64(mmio, offset, OCXL_MMIO_LITTLE_ENDIAN, i))
+			return -1;
+		time_add(&wr, now_seconds() - t);
+		t = now_seconds();
+		if (ocxl_mmio_read64(mmio, offset, OCXL_MMIO_LITTLE_ENDIAN,
+				     &value))
+			return -1;
+		time_add(&rd, now_seconds() - t);
+		if (value != i) {
+			fprintf(stderr, "mmio read 0x%" PRIx64 " expected 0x%x\n",
+				value, i);
+			return -1;
+		}
+	}
+	fprintf(json, "\t\"mmio\": {\n");
+	json_time("read64", &rd, ",");
+	json_time("write64", &wr, "");
+	fprintf(json, "\t},\n");
+	return 0;
+}
+
+static int bench_lpc(ocxl_afu_h afu)
+{
+	struct bench_time rd, wr;
+	uint8_t *wbuf, *rbuf;
+	unsigned int size, i;
+	uint64_t offset;
+	double t;
+
+	if (ocxl_lpc_map(afu, OCXL_LPC_LITTLE_ENDIAN) != 0)
+		return -1;
+	if ((posix_memalign((void **)&wbuf, CACHELINE, lpc_max) != 0) ||
+	    (posix_memalign((void **)&rbuf, CACHELINE, lpc_max) != 0)) {
+		perror("posix_memalign");
+		return -1;
+	}
+	for (i = 0; i < lpc_max; i++)
+		wbuf[i] = rand();
+
+	fprintf(json, "\t\"lpc\": [\n");
+	for (size = LPC_MIN; size <= lpc_max; size *= 2) {
+		memset(&rd, 0, sizeof(rd));
+		memset(&wr, 0, sizeof(wr));
+		for (i = 0; i < iterations; i++) {
+			offset = (uint64_t)i * lpc_max;
+			memset(rbuf, 0, size);
+			t = now_seconds();
+			if (ocxl_lpc_write(afu, offset, wbuf, size) != OCXL_OK) {
+				fprintf(stderr, "lpc write of %u bytes failed\n",
+					size);
+				return -1;
+			}
+			time_add(&wr, now_seconds() - t);
+			t = now_seconds();
+			if (ocxl_lpc_read(afu, offset, rbuf, size) != OCXL_OK) {
+				fprintf(stderr, "lpc read of %u bytes failed\n",
+					size);
+				return -1;
+			}
+			time_add(&rd, now_seconds() - t);
+			if (memcmp(wbuf, rbuf, size)) {
+				fprintf(stderr, "lpc read back differs, %u bytes\n",
+					size);
+				return -1;
+			}
+		}
+		fprintf(json, "\t\t{\"size\": %u, \"write_us\": %.1f, "
+			"\"write_mb_per_s\": %.3f, \"read_us\": %.1f, "
+			"\"read_mb_per_s\": %.3f}%s\n", size,
+			1e6 * wr.total / wr.count,
+			size * wr.count / wr.total / 1e6,
+			1e6 * rd.total / rd.count,
+			size * rd.count / rd.total / 1e6,
+			(size * 2 <= lpc_max) ? "," : "");
+	}
+	fprintf(json, "\t],\n");
+	free(wbuf);
+	free(rbuf);
+	return 0;
+}
+
+// Asynchronous lpc copies still to complete, counted down by lpc_copy_done
+static pthread_mutex_t copy_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t copy_cond = PTHREAD_COND_INITIALIZER;
+static unsigned int copy_pending;
+static int copy_failed;
+
+static void lpc_copy_done(ocxl_afu_h afu, ocxl_event_lpc_copy *copy)
+{
+	pthread_mutex_lock(&copy_lock);
+	if (copy->status != OCXL_OK)
+		copy_failed = 1;
+	if (--copy_pending == 0)
+		pthread_cond_signal(&copy_cond);
+	pthread_mutex_unlock(&copy_lock);
+}
+
+static int lpc_copy_wait(void)
+{
+	pthread_mutex_lock(&copy_lock);
+	while (copy_pending)
+		pthread_cond_wait(&copy_cond, &copy_lock);
+	pthread_mutex_unlock(&copy_lock);
+	return copy_failed ? -1 : 0;
+}
+
+// Moves iterations blocks of lpc_max bytes one ocxl_lpc_write at a time,
+// then starts them all with ocxl_lpc_copy_to and waits once, so libocxl
+// keeps strides of several copies in flight.  Reads back asynchronously too
+static int bench_lpc_copy(ocxl_afu_h afu)
+{
+	uint8_t *wbuf, *rbuf;
+	double serial, overlapped, t;
+	unsigned int i;
+
+	if ((posix_memalign((void **)&wbuf, CACHELINE, lpc_max) != 0) ||
+	    (posix_memalign((void **)&rbuf, CACHELINE,
+			    (size_t)iterations * lpc_max) != 0)) {
+		perror("posix_memalign");
+		return -1;
+	}
+	for (i = 0; i < lpc_max; i++)
+		wbuf[i] = rand();
+	memset(rbuf, 0, (size_t)iterations * lpc_max);
+
+	t = now_seconds();
+	for (i = 0; i < iterations; i++)
+		if (ocxl_lpc_write(afu, (uint64_t)i * lpc_max, wbuf,
+				   lpc_max) != OCXL_OK)
+			return -1;
+	serial = now_seconds() - t;
+
+	copy_pending = iterations;
+	t = now_seconds();
+	for (i = 0; i < iterations; i++)
+		if (ocxl_lpc_copy_to(afu, (uint64_t)i * lpc_max, wbuf, lpc_max,
+				     lpc_copy_done, NULL) != OCXL_OK)
+			return -1;
+	if (lpc_copy_wait() < 0)
+		return -1;
+	overlapped = now_seconds() - t;
+
+	copy_pending = iterations;
+	for (i = 0; i < iterations; i++)
+		if (ocxl_lpc_copy_from(afu, (uint64_t)i * lpc_max,
+				       rbuf + (size_t)i * lpc_max, lpc_max,
+				       lpc_copy_done, NULL) != OCXL_OK)
+			return -1;
+	if (lpc_copy_wait() < 0)
+		return -1;
+	for (i = 0; i < iterations; i++) {
+		if (memcmp(wbuf, rbuf + (size_t)i * lpc_max, lpc_max)) {
+			fprintf(stderr, "lpc copy %u read back differs\n", i);
+			return -1;
+		}
+	}
+
+	fprintf(json, "\t\"lpc_copy\": {\"size\": %u, \"copies\": %u, "
+		"\"serial_us\": %.1f, \"overlapped_us\": %.1f, "
+		"\"speedup\": %.2f},\n", lpc_max, iterations, 1e6 * serial,
+		1e6 * overlapped, (overlapped > 0) ? serial / overlapped : 0);
+	free(wbuf);
+	free(rbuf);
+	return 0;
+}
+
+// Start a traffic generator run and poll it until done, returns wall time
+static double run_traffic(ocxl_mmio_h mmio, TrafficConfigParam param,
+			  TrafficStats *stats)
+{
+	uint64_t status;
+	double t;
+
+	if (config_traffic(mmio, param) < 0)
+		return -1;
+	t = now_seconds();
+	if (start_traffic_from_file(mmio, param.context, 0) < 0)
+		return -1;
+	do {
+		if (ocxl_mmio_read64(mmio, param.context * 0x1000 + TRAFFIC_OFFSET,
+				     OCXL_MMIO_LITTLE_ENDIAN, &status))
+			return -1;
+	} while (!(status & TRAFFIC_DONE));
+	t = now_seconds() - t;
+	if (wait_traffic(mmio, param.context, stats) < 0)
+		return -1;
+	if (stats->failed) {
+		fprintf(stderr, "traffic op %d: %" PRIu64 " commands failed\n",
+			param.op, stats->failed);
+		return -1;
+	}
+	return t;
+}
+
+// "seconds", "cycles" and the AFU's command latency of a traffic run
+static void json_traffic(double t, TrafficStats *s)
+{
+	fprintf(json, "\"completed\": %" PRIu64 ", \"seconds\": %.4f, "
+		"\"cycles\": %" PRIu64 ", \"latency_cycles\": %.1f, "
+		"\"latency_max_cycles\": %" PRIu64, s->completed, t, s->cycles,
+		s->completed ? (double)s->latency_total / s->completed : 0,
+		s->latency_max);
+}
+
+static int bench_dma(ocxl_mmio_h mmio, uint8_t *buffer)
+{
+	TrafficConfigParam param;
+	TrafficStats s;
+	unsigned int depth;
+	double t;
+	int op;
+
+	memset(&param, 0, sizeof(param));
+	param.context = context;
+	param.pattern = TRAFFIC_SEQUENTIAL;
+	param.count = count;
+	param.base = (uint64_t)buffer;
+	param.range = DMA_RANGE;
+
+	fprintf(json, "\t\"dma\": [\n");
+	for (op = TRAFFIC_READ; op <= TRAFFIC_WRITE; op++) {
+		for (depth = 1; depth <= depth_max; depth *= 2) {
+			param.op = op;
+			param.depth = depth;
+			if ((t = run_traffic(mmio, param, &s)) < 0)
+				return -1;
+			fprintf(json, "\t\t{\"op\": \"%s\", \"depth\": %u, "
+				"\"bytes\": %" PRIu64 ", \"mb_per_s\": %.3f, "
+				"\"bytes_per_cycle\": %.2f, ",
+				(op == TRAFFIC_READ) ? "read" : "write", depth,
+				s.bytes, s.bytes / t / 1e6,
+				s.cycles ? (double)s.bytes / s.cycles : 0);
+			json_traffic(t, &s);
+			fprintf(json, "}%s\n", ((op == TRAFFIC_WRITE) &&
+				(depth * 2 > depth_max)) ? "" : ",");
+		}
+	}
+	fprintf(json, "\t],\n");
+
+	param.op = TRAFFIC_AMO;
+	param.depth = depth_max;
+	if ((t = run_traffic(mmio, param, &s)) < 0)
+		return -1;
+	fprintf(json, "\t\"amo\": {\"depth\": %u, \"ops_per_s\": %.1f, "
+		"\"ops_per_cycle\": %.3f, ", depth_max, s.completed / t,
+		s.cycles ? (double)s.completed / s.cycles : 0);
+	json_traffic(t, &s);
+	fprintf(json, "},\n");
+	return 0;
+}
+
+// One interrupt at a time from the traffic generator, timed from the MMIO
+// that starts it to the event
+static int bench_interrupt(ocxl_afu_h afu, ocxl_mmio_h mmio)
+{
+	TrafficConfigParam param;
+	struct bench_time t;
+	ocxl_event event;
+	TrafficStats s;
+	ocxl_irq_h irq;
+	double start;
+	unsigned int i;
+
+	if (ocxl_irq_alloc(afu, NULL, &irq))
+		return -1;
+	memset(&param, 0, sizeof(param));
+	param.context = context;
+	param.op = TRAFFIC_INTRP;
+	param.depth = 1;
+	param.count = 1;
+	param.base = ocxl_irq_get_handle(afu, irq);
+	if (config_traffic(mmio, param) < 0)
+		return -1;
+
+	memset(&t, 0, sizeof(t));
+	for (i = 0; i < iterations; i++) {
+		start = now_seconds();
+		if (start_traffic_from_file(mmio, context, 0) < 0)
+			return -1;
+		if ((ocxl_afu_event_check(afu, -1, &event, 1) != 1) ||
+		    (event.type != OCXL_EVENT_IRQ)) {
+			fprintf(stderr, "no interrupt event\n");
+			return -1;
+		}
+		time_add(&t, now_seconds() - start);
+		if (wait_traffic(mmio, context, &s) < 0)
+			return -1;
+	}
+	json_time("interrupt", &t, ",");
+	return 0;
+}
+
+// Wait for the AFU to write status, the byte it and the application hand
+// back and forth between machine commands
+static void wait_status(volatile uint8_t *status, uint8_t value)
+{
+	while (*status != value)
+		usleep(10);
+}
+
+// A machine sends wake_host_thread to this thread, timed from the MMIO that
+// enables it to ocxl_wait() returning.  After each command the AFU writes 0
+// to the status byte and waits for 0x55 to stop.
+static int bench_wake(ocxl_afu_h afu, ocxl_mmio_h mmio)
+{
+	MachineConfigParam param;
+	MachineConfig machine;
+	struct bench_time t;
+	volatile uint8_t *status;
+	uint16_t tid;
+	double start;
+	unsigned int i;
+	int base, j;
+
+	// The machine takes a 32 bit status address
+	status = mmap((void *)STATUS_HINT, getpagesize(), PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if ((status == MAP_FAILED) || ((uint64_t)status >> 32)) {
+		fprintf(stderr, "no status byte below 4GB\n");
+		return -1;
+	}
+	if (ocxl_afu_get_p9_thread_id(afu, &tid))
+		return -1;
+	memset(&param, 0, sizeof(param));
+	param.context = context;
+	param.command = AFU_CMD_WAKE_HOST_THRD;
+	param.status_address = (uint32_t)(uint64_t)status;
+	param.mem_base_address = tid;
+	param.mem_size = 8;
+	init_machine(&machine);
+	config_machine(&machine, param);
+	base = context * 0x1000;
+
+	memset(&t, 0, sizeof(t));
+	for (i = 0; i < iterations; i++) {
+		*status = 0xaa;
+		for (j = 3; j > 0; j--) {
+			if (ocxl_mmio_write64(mmio, base + j * 8,
+					      OCXL_MMIO_LITTLE_ENDIAN,
+					      machine.config[j]))
+				return -1;
+		}
+		start = now_seconds();
+		if (ocxl_mmio_write64(mmio, base, OCXL_MMIO_LITTLE_ENDIAN,
+				      machine.config[0]))
+			return -1;
+		if (ocxl_wait() != OCXL_OK)
+			return -1;
+		time_add(&t, now_seconds() - start);
+
+		// Disable the machine before it is stopped, or the AFU would
+		// start it again right away
+		wait_status(status, 0);
+		if (ocxl_mmio_write64(mmio, base, OCXL_MMIO_LITTLE_ENDIAN, 0))
+			return -1;
+		*status = 0x55;
+		wait_status(status, 0);
+	}
+	munmap((void *)status, getpagesize());
+	json_time("wake_host_thread", &t, "");
+	return 0;
+}
+
+static void print_help(char *name)
+{
+	printf("\nUsage:  %s [OPTIONS]\n", name);
+	printf("\t--ocse       \tStart this ocse-testafu, else use a running ocse\n");
+	printf("\t--descriptor \tTest AFU descriptor for --ocse.  Default=afu_descriptor.cfg\n");
+	printf("\t--device     \tDefault=%s\n", device);
+	printf("\t--iterations \tMMIO, lpc, interrupt and wake repetitions.  Default=%u\n", iterations);
+	printf("\t--count      \tDMA and AMO commands per run.  Default=%u\n", count);
+	printf("\t--lpc-max    \tLargest lpc transfer in bytes.  Default=%u\n", lpc_max);
+	printf("\t--depth-max  \tMost outstanding DMA commands.  Default=%u\n", depth_max);
+	printf("\t--output     \tJSON file, - for stdout.  Default=ocse_bench.json\n");
+	printf("\t--help       \tPrint Usage\n");
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	char *ocse_path, *descriptor, *output;
+	double ocse_s, open_s, attach_s, map_s, t;
+	ocxl_afu_h afu;
+	ocxl_mmio_h mmio;
+	uint8_t *buffer;
+	int opt, option_index, rc;
+
+	static struct option long_options[] = {
+		{"ocse",       required_argument, 0, 'o'},
+		{"descriptor", required_argument, 0, 'd'},
+		{"device",     required_argument, 0, 'D'},
+		{"iterations", required_argument, 0, 'i'},
+		{"count",      required_argument, 0, 'c'},
+		{"lpc-max",    required_argument, 0, 'l'},
+		{"depth-max",  required_argument, 0, 'm'},
+		{"output",     required_argument, 0, 'O'},
+		{"help",       no_argument      , 0, 'h'},
+		{NULL, 0, 0, 0}
+	};
+
+	ocse_path = NULL;
+	descriptor = "afu_descriptor.cfg";
+	output = "ocse_bench.json";
+	while ((opt = getopt_long(argc, argv, "ho:d:D:i:c:l:m:O:",
+				  long_options, &option_index)) >= 0) {
+		switch (opt) {
+		case 'o':
+			ocse_path = optarg;
+			break;
+		case 'd':
+			descriptor = optarg;
+			break;
+		case 'D':
+			device = optarg;
+			break;
+		case 'i':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			lpc_max = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			depth_max = strtoul(optarg, NULL, 0);
+			break;
+		case 'O':
+			output = optarg;
+			break;
+		case 'h':
+			print_help(argv[0]);
+			return 0;
+		default:
+			print_help(argv[0]);
+			return 1;
+		}
+	}
+	if (!iterations || !count || (lpc_max < LPC_MIN) || !depth_max) {
+		print_help(argv[0]);
+		return 1;
+	}
+
+	if (!strcmp(output, "-"))
+		json = stdout;
+	else if ((json = fopen(output, "w")) == NULL) {
+		perror(output);
+		return 1;
+	}
+
+	ocse_s = 0;
+	if (ocse_path && ((ocse_s = start_ocse(ocse_path, descriptor)) < 0)) {
+		stop_ocse(1);
+		return 1;
+	}
+
+	rc = 1;
+	buffer = NULL;
+	t = now_seconds();
+	if (ocxl_afu_open_from_dev(device, &afu) != 0) {
+		perror(device);
+		goto done;
+	}
+	open_s = now_seconds() - t;
+	t = now_seconds();
+	if (ocxl_afu_attach(afu, 0) != 0) {
+		perror("ocxl_afu_attach");
+		goto close;
+	}
+	attach_s = now_seconds() - t;
+	t = now_seconds();
+	if (ocxl_mmio_map(afu, OCXL_GLOBAL_MMIO, &mmio) != 0) {
+		perror("ocxl_mmio_map");
+		goto close;
+	}
+	map_s = now_seconds() - t;
+	if (posix_memalign((void **)&buffer, CACHELINE, DMA_RANGE) != 0) {
+		perror("posix_memalign");
+		goto close;
+	}
+	memset(buffer, 0, DMA_RANGE);
+
+	fprintf(json, "{\n\t\"device\": \"%s\",\n", device);
+	fprintf(json, "\t\"startup\": {\"ocse_s\": %.4f, \"open_s\": %.4f, "
+		"\"attach_s\": %.4f, \"mmio_map_s\": %.4f},\n",
+		ocse_s, open_s, attach_s, map_s);
+	if (bench_mmio(mmio) < 0) {
+		fprintf(stderr, "FAILED: mmio\n");
+		goto close;
+	}
+	if (bench_lpc(afu) < 0) {
+		fprintf(stderr, "FAILED: lpc\n");
+		goto close;
+	}
+	if (bench_lpc_copy(afu) < 0) {
+		fprintf(stderr, "FAILED: lpc_copy\n");
+		goto close;
+	}
+	if (bench_dma(mmio, buffer) < 0) {
+		fprintf(stderr, "FAILED: dma\n");
+		goto close;
+	}
+	fprintf(json, "\t\"latency\": {\n");
+	if (bench_interrupt(afu, mmio) < 0) {
+		fprintf(stderr, "FAILED: interrupt\n");
+		goto close;
+	}
+	if (bench_wake(afu, mmio) < 0) {
+		fprintf(stderr, "FAILED: wake_host_thread\n");
+		goto close;
+	}
+	fprintf(json, "\t}\n}\n");
+	rc = 0;
+
+close:
+	ocxl_afu_close(afu);
+done:
+	free(buffer);
+	if (json != stdout)
+		fclose(json);
+	if (ocse_path)
+		stop_ocse(rc);
+	return rc;
+}
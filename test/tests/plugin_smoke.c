@@ -0,0 +1,308 @@
+/*
+ * Copyright 2015,2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Description: plugin_smoke.c
+ *
+ *  Smoke test of the AFU plug-in path.  Starts the given ocse in a temporary
+ *  directory with a "tlx0,plugin:<plugin>" shim_host.dat, by default the
+ *  example plug-in in common/ocse_plugin_example.c, then attaches to it and
+ *  checks that MMIO and lpc memory read back what was written.  The parms are
+ *  fixed unless $OCSE_PARMS is set.  "make plugin" builds and runs it.
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "../../libocxl/libocxl_lpc.h"
+
+#define MDEVICE "/dev/cxl/tlx0.0000:00:00.0.0"	// function 0, AFU 0
+#define STARTUP_TIMEOUT 30
+#define MMIO_WORDS 16
+#define LPC_MAX 256
+
+// Parms of the started ocse: responses right away, no reordering, no errors
+static const char *smoke_parms =
+	"SEED:1\n"
+	"RESPONSE_PERCENT:100\n"
+	"PAGED_PERCENT:0\n"
+	"RETRY_PERCENT:0\n"
+	"FAILED_PERCENT:0\n"
+	"PENDING_PERCENT:0\n"
+	"REORDER_PERCENT:0\n"
+	"BUFFER_PERCENT:0\n";
+
+static char run_dir[] = "/tmp/plugin_smoke.XXXXXX";
+static pid_t ocse_pid;
+
+static void run_file(char *path, const char *name)
+{
+	snprintf(path, PATH_MAX, "%s/%s", run_dir, name);
+}
+
+// Start ocse_path with plugin on tlx0 and point OCSE_SERVER_DAT at it
+static int start_ocse(char *ocse_path, char *plugin)
+{
+	char ocse[PATH_MAX], so[PATH_MAX], path[PATH_MAX];
+	char line[256], *server;
+	time_t start;
+	FILE *fp;
+	int fd;
+
+	if (!realpath(ocse_path, ocse) || !realpath(plugin, so)) {
+		perror("realpath");
+		return -1;
+	}
+	if (!mkdtemp(run_dir)) {
+		perror("mkdtemp");
+		return -1;
+	}
+	run_file(path, "shim_host.dat");
+	if ((fp = fopen(path, "w")) == NULL) {
+		perror(path);
+		return -1;
+	}
+	fprintf(fp, "tlx0,plugin:%s\n", so);
+	fclose(fp);
+	if (!getenv("OCSE_PARMS")) {
+		run_file(path, "ocse.parms");
+		if ((fp = fopen(path, "w")) == NULL) {
+			perror(path);
+			return -1;
+		}
+		fputs(smoke_parms, fp);
+		fclose(fp);
+	}
+
+	start = time(NULL);
+	if ((ocse_pid = fork()) < 0) {
+		perror("fork");
+		return -1;
+	}
+	if (ocse_pid == 0) {
+		run_file(path, "ocse.log");
+		if ((chdir(run_dir) < 0) ||
+		    ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0))
+			_exit(127);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		close(fd);
+		unsetenv("SHIM_HOST_DAT");
+		execl(ocse, ocse, (char *)NULL);
+		_exit(127);
+	}
+
+	// ocse logs the host:port it listens on once its ports are up
+	run_file(path, "ocse.log");
+	server = NULL;
+	while (!server) {
+		if (waitpid(ocse_pid, NULL, WNOHANG) == ocse_pid) {
+			fprintf(stderr, "%s exited, see %s\n", ocse, path);
+			ocse_pid = 0;
+			return -1;
+		}
+		if (time(NULL) - start > STARTUP_TIMEOUT) {
+			fprintf(stderr, "%s did not start, see %s\n", ocse, path);
+			return -1;
+		}
+		if ((fp = fopen(path, "r")) != NULL) {
+			while (!server && fgets(line, sizeof(line), fp))
+				server = strstr(line, "listening on ");
+			fclose(fp);
+		}
+		if (!server)
+			usleep(1000);
+	}
+
+	server += strlen("listening on ");
+	run_file(path, "ocse_server.dat");
+	if ((fp = fopen(path, "w")) == NULL) {
+		perror(path);
+		return -1;
+	}
+	fputs(server, fp);
+	fclose(fp);
+	setenv("OCSE_SERVER_DAT", path, 1);
+	return 0;
+}
+
+// Stop ocse, its run directory is kept if the test failed
+static void stop_ocse(int failed)
+{
+	const char *files[] = { "shim_host.dat", "ocse.parms", "ocse.log",
+		"ocse_server.dat", "debug.log", NULL };
+	char path[PATH_MAX];
+	int i;
+
+	if (ocse_pid > 0) {
+		kill(ocse_pid, SIGINT);
+		waitpid(ocse_pid, NULL, 0);
+		ocse_pid = 0;
+	}
+	if (failed) {
+		fprintf(stderr, "ocse run directory kept in %s\n", run_dir);
+		return;
+	}
+	for (i = 0; files[i]; i++) {
+		run_file(path, files[i]);
+		unlink(path);
+	}
+	rmdir(run_dir);
+}
+
+static int check_mmio(ocxl_afu_h afu)
+{
+	ocxl_mmio_h mmio;
+	uint64_t value;
+	uint32_t value32;
+	int i;
+
+	if (ocxl_mmio_map(afu, OCXL_GLOBAL_MMIO, &mmio) != OCXL_OK) {
+		perror("ocxl_mmio_map");
+		return -1;
+	}
+	for (i = 0; i < MMIO_WORDS; i++) {
+		if (ocxl_mmio_write64(mmio, i * 8, OCXL_MMIO_LITTLE_ENDIAN,
+				      0x0123456789abcdefull + i) != OCXL_OK)
+			return -1;
+	}
+	for (i = 0; i < MMIO_WORDS; i++) {
+		if (ocxl_mmio_read64(mmio, i * 8, OCXL_MMIO_LITTLE_ENDIAN,
+				     &value) != OCXL_OK)
+			return -1;
+		if (value != 0x0123456789abcdefull + i) {
+			fprintf(stderr, "mmio read64 0x%x: 0x%016" PRIx64 "\n",
+				i * 8, value);
+			return -1;
+		}
+	}
+	if ((ocxl_mmio_write32(mmio, 0x804, OCXL_MMIO_LITTLE_ENDIAN,
+			       0xfeedf00d) != OCXL_OK) ||
+	    (ocxl_mmio_read32(mmio, 0x804, OCXL_MMIO_LITTLE_ENDIAN,
+			      &value32) != OCXL_OK))
+		return -1;
+	if (value32 != 0xfeedf00d) {
+		fprintf(stderr, "mmio read32 0x804: 0x%08x\n", value32);
+		return -1;
+	}
+	printf("mmio: %d words read back\n", MMIO_WORDS + 1);
+	return 0;
+}
+
+static int check_lpc(ocxl_afu_h afu)
+{
+	uint8_t wbuf[LPC_MAX], rbuf[LPC_MAX];
+	unsigned int size, i;
+	uint64_t offset;
+
+	if (ocxl_lpc_map(afu, OCXL_LPC_LITTLE_ENDIAN) != OCXL_OK) {
+		perror("ocxl_lpc_map");
+		return -1;
+	}
+	for (i = 0; i < LPC_MAX; i++)
+		wbuf[i] = rand();
+	offset = 0;
+	for (size = 8; size <= LPC_MAX; size *= 2) {
+		memset(rbuf, 0, size);
+		if ((ocxl_lpc_write(afu, offset, wbuf, size) != OCXL_OK) ||
+		    (ocxl_lpc_read(afu, offset, rbuf, size) != OCXL_OK))
+			return -1;
+		if (memcmp(wbuf, rbuf, size)) {
+			fprintf(stderr, "lpc read back differs, %u bytes\n",
+				size);
+			return -1;
+		}
+		offset += LPC_MAX;
+	}
+	printf("lpc: 8 to %d bytes read back\n", LPC_MAX);
+	return 0;
+}
+
+static void print_help(char *name)
+{
+	printf("\nUsage:  %s [OPTIONS]\n", name);
+	printf("\t--ocse   \tocse to start.  Default=../../ocse/ocse\n");
+	printf("\t--plugin \tPlug-in to load.  Default=./libocse_plugin_example.so\n");
+	printf("\t--help   \tPrint Usage\n");
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	char *ocse_path, *plugin;
+	ocxl_afu_h afu;
+	int opt, option_index, rc;
+
+	static struct option long_options[] = {
+		{"ocse",   required_argument, 0, 'o'},
+		{"plugin", required_argument, 0, 'p'},
+		{"help",   no_argument      , 0, 'h'},
+		{NULL, 0, 0, 0}
+	};
+
+	ocse_path = "../../ocse/ocse";
+	plugin = "./libocse_plugin_example.so";
+	while ((opt = getopt_long(argc, argv, "ho:p:",
+				  long_options, &option_index)) >= 0) {
+		switch (opt) {
+		case 'o':
+			ocse_path = optarg;
+			break;
+		case 'p':
+			plugin = optarg;
+			break;
+		case 'h':
+			print_help(argv[0]);
+			return 0;
+		default:
+			print_help(argv[0]);
+			return 1;
+		}
+	}
+
+	if (start_ocse(ocse_path, plugin) < 0) {
+		stop_ocse(1);
+		return 1;
+	}
+
+	rc = 1;
+	if (ocxl_afu_open_from_dev(MDEVICE, &afu) != OCXL_OK) {
+		perror(MDEVICE);
+		goto done;
+	}
+	if (ocxl_afu_attach(afu, 0) != OCXL_OK) {
+		perror("ocxl_afu_attach");
+		goto close;
+	}
+	if ((check_mmio(afu) < 0) || (check_lpc(afu) < 0))
+		goto close;
+	rc = 0;
+
+close:
+	ocxl_afu_close(afu);
+done:
+	stop_ocse(rc);
+	printf("%s\n", rc ? "FAILED" : "PASSED");
+	return rc;
+}